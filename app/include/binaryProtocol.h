@@ -0,0 +1,107 @@
+// Binary Protocol module
+// Encoder/decoder for the compact binary commands served on the same UDP
+// socket as the text commands. Shared by the server and by clients.
+//
+// Every binary datagram starts with BINARY_PROTOCOL_MAGIC, which no text
+// command starts with. Requests are BINARY_REQUEST_SIZE bytes. Each reply
+// datagram starts with a BINARY_HEADER_SIZE byte header: request id, a
+// per-server datagram sequence number (to spot loss), the window id (epoch)
+// and end time, and the fragment index/count of a reply split across
+// datagrams. History replies carry raw 12-bit codes as packed uint16 (scale
+// by `voltsPerCode`); fragment i holds the samples starting at
+// i * BinaryProtocol_getSamplesPerFragment().
+// All fields are little-endian.
+
+#ifndef _BINARY_PROTOCOL_H_
+#define _BINARY_PROTOCOL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BINARY_PROTOCOL_MAGIC 0xB1
+#define BINARY_PROTOCOL_VERSION 1
+
+#define BINARY_REQUEST_SIZE 12
+#define BINARY_HEADER_SIZE 40
+#define BINARY_STATS_SIZE 24
+
+// Largest datagram a server sends; history fragments are sized to it, so
+// clients decode history with the same value
+#define BINARY_PROTOCOL_MAX_DATAGRAM_SIZE 1500
+
+enum BinaryProtocol_type {
+    // Argument: seconds before the previous complete second (0 = that second)
+    BINARY_REQUEST_HISTORY = 0x01,
+    // Argument: unused
+    BINARY_REQUEST_STATS = 0x02,
+
+    BINARY_REPLY_HISTORY = 0x81,
+    BINARY_REPLY_STATS = 0x82,
+    // Argument not valid, or no such window; no payload
+    BINARY_REPLY_ERROR = 0xFF
+};
+
+typedef struct {
+    uint8_t version;
+    uint8_t type;
+    uint32_t requestId;
+    int32_t argument;
+} BinaryProtocol_request_t;
+
+typedef struct {
+    uint8_t version;
+    uint8_t type;
+    uint32_t requestId;
+    uint32_t sequence;
+    uint64_t windowId;
+    int64_t timestampMs;
+    uint16_t fragmentIndex;
+    uint16_t fragmentCount;
+    // Samples (history) or records (stats) in this datagram
+    uint16_t numItems;
+    float voltsPerCode;
+} BinaryProtocol_header_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t dips;
+    uint32_t droppedSamples;
+    uint16_t minCode;
+    uint16_t maxCode;
+    float meanCode;
+    float varianceCode;
+} BinaryProtocol_stats_t;
+
+// True if the datagram is a binary one (rather than a text command)
+bool BinaryProtocol_isBinary(const uint8_t *pBuffer, int length);
+
+// Each encoder returns the number of bytes written, or -1 if `maxLength`
+// is too small. Each decoder returns false on a malformed datagram or an
+// unsupported version.
+int BinaryProtocol_encodeRequest(const BinaryProtocol_request_t *pRequest, uint8_t *pBuffer, int maxLength);
+bool BinaryProtocol_decodeRequest(const uint8_t *pBuffer, int length, BinaryProtocol_request_t *pRequest);
+
+// Number of samples carried per history datagram of at most `maxDatagramSize`
+int BinaryProtocol_getSamplesPerFragment(int maxDatagramSize);
+int BinaryProtocol_getFragmentCount(int numSamples, int maxDatagramSize);
+
+// Encode fragment `pHeader->fragmentIndex` of `numSamples` codes; sets
+// `numItems` in the encoded header from the samples it holds.
+int BinaryProtocol_encodeHistory(const BinaryProtocol_header_t *pHeader, const uint16_t *pSamples,
+    int numSamples, uint8_t *pBuffer, int maxLength);
+// Decode one history fragment's header and copy its samples into
+// `pDest[fragmentIndex * samplesPerFragment...]`, where `pDest` holds
+// `maxSamples` and the sender used `maxDatagramSize`.
+bool BinaryProtocol_decodeHistory(const uint8_t *pBuffer, int length, int maxDatagramSize,
+    BinaryProtocol_header_t *pHeader, uint16_t *pDest, int maxSamples);
+
+int BinaryProtocol_encodeStats(const BinaryProtocol_header_t *pHeader, const BinaryProtocol_stats_t *pStats,
+    uint8_t *pBuffer, int maxLength);
+bool BinaryProtocol_decodeStats(const uint8_t *pBuffer, int length,
+    BinaryProtocol_header_t *pHeader, BinaryProtocol_stats_t *pStats);
+
+// Header only (e.g. BINARY_REPLY_ERROR, or to check a reply's type first)
+int BinaryProtocol_encodeHeader(const BinaryProtocol_header_t *pHeader, uint8_t *pBuffer, int maxLength);
+bool BinaryProtocol_decodeHeader(const uint8_t *pBuffer, int length, BinaryProtocol_header_t *pHeader);
+
+#endif
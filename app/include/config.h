@@ -0,0 +1,75 @@
+// Config module
+// Every run-time tunable in one place, so rates, history depth, thread
+// placement, sockets and device paths can be set per deployment without
+// rebuilding. Each option starts at its default, then may be set by a file
+// of "name = value" lines (--config=<file>; # starts a comment), then by
+// "--name=value" on the command line, each overriding the last. A bare
+// "--name" (or "name" line) sets a flag.
+//
+// main() hands the values to each module before initializing it, so every
+// buffer is sized and allocated once, at startup.
+
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <stdbool.h>
+
+typedef struct {
+    // Capture
+    bool isIio;
+    bool isSimulated;
+    int samplesPerSecond;
+    char *tracePath;
+    char *recordingPath;
+    char *replayPath;
+    bool isFastReplay;
+
+    // History kept in memory, and optionally on disk
+    int rawHistorySeconds;
+    int secondSummaries;
+    int minuteSummaries;
+    int hourSummaries;
+    char *persistencePath;
+    bool isRawPersisted;
+    int persistedWindows;
+    int persistedRawWindows;
+
+    // Dip detection
+    double dipEnterVolts;
+    double dipExitVolts;
+
+    // Sampling thread (0 and -1 for normal scheduling on any CPU)
+    int samplerPriority;
+    int samplerCpu;
+
+    // Sockets (metrics off when 0)
+    int port;
+    int metricsPort;
+
+    // Board
+    int potReadsPerSecond;
+    int digitPeriodMs;
+    char *iioDirectory;
+    char *iioDevice;
+    int iioBufferLength;
+
+    // Log
+    char *logLevel;
+    char *logBinaryPath;
+} Config_t;
+
+// Fill `pConfig` from the defaults, then the file named by --config (if
+// any), then the other command line options. Returns false, having printed
+// why, if an option is unknown, its value is invalid, or the options
+// conflict (the dip must end closer to the average than it starts).
+bool Config_load(Config_t *pConfig, int argc, char *argv[]);
+void Config_cleanup(Config_t *pConfig);
+
+// Set option `name` from text, as read from a file; `value` is NULL for a
+// bare flag. Returns false, having printed why, if it cannot be set.
+bool Config_set(Config_t *pConfig, const char *name, const char *value);
+
+// Print every option with its default.
+void Config_printUsage(const char *program);
+
+#endif
@@ -0,0 +1,22 @@
+// History Text module
+// Formats raw A2D codes for the text "history" reply and pushes: each
+// sample as "%.3f" volts, ", " between samples and a newline after every
+// tenth and the last. Each 12-bit code's text is formatted once, at init,
+// so formatting a sample is a copy rather than a float conversion.
+
+#ifndef _HISTORY_TEXT_H_
+#define _HISTORY_TEXT_H_
+
+#include <stdint.h>
+
+// Room a sample needs, with its separators
+#define HISTORY_TEXT_MAX_SAMPLE_SIZE 8
+
+void HistoryText_init(void);
+
+// Append sample `i` of the `length` in `pCodes`, and its separators, at
+// `offset` in `pBuffer`; returns the new offset. Needs at least
+// HISTORY_TEXT_MAX_SAMPLE_SIZE bytes free.
+int HistoryText_appendSample(char *pBuffer, int offset, const uint16_t *pCodes, int i, int length);
+
+#endif
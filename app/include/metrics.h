@@ -0,0 +1,21 @@
+// Metrics module
+// Serves the sampler's counters, the last second's summary, the POT and
+// the period/latency statistics of every loop as Prometheus text on
+// HTTP/1.1 GET /metrics, so a monitoring stack can scrape the board.
+//
+// Every metric is registered up front in one table and each scrape is
+// rendered into a preallocated buffer. Values are read from atomics and
+// the lock-free statistics getters only, so a scrape never holds up the
+// sampling thread.
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#define METRICS_DEFAULT_PORT 9101
+
+// Begin/end serving scrapes on TCP `port` from the reactor (see
+// hal/reactor.h).
+void Metrics_init(int port);
+void Metrics_cleanup(void);
+
+#endif
@@ -6,8 +6,11 @@
 #ifndef _NETWORK_H_
 #define _NETWORK_H_
 
-// Begin/end the background thread which samples light levels.
-void Network_init(void);
+#define NETWORK_DEFAULT_PORT 12345
+
+// Begin/end answering requests on UDP `port` from the reactor thread (see
+// hal/reactor.h).
+void Network_init(int port);
 void Network_cleanup(void);
 
 #endif
\ No newline at end of file
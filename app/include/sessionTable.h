@@ -0,0 +1,91 @@
+// Session Table module
+// Per-client state for the network server, keyed by remote address and port.
+//
+// Sessions live in a fixed pool, found through an open-addressing hash of
+// pool indices (linear probing, backward-shift deletion). An LRU list over
+// the pool evicts the least recently seen client when the table is full and
+// expires clients which have been idle too long. Nothing is allocated after
+// init, so a lookup per packet costs a hash and a short probe.
+// Not thread safe: used only on the reactor thread, by the network module.
+
+#ifndef _SESSION_TABLE_H_
+#define _SESSION_TABLE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+// Long enough for any accepted command
+#define SESSION_MAX_MESSAGE_LEN 64
+
+typedef struct {
+    struct sockaddr_in address;
+    long long firstSeenMs;
+    long long lastSeenMs;
+
+    // Repeated by <enter>
+    int lastCommand;
+    char lastMessage[SESSION_MAX_MESSAGE_LEN];
+
+    // Pushed topics (bit per topic, see network.c) and the rate raw
+    // samples are decimated to (0 for all)
+    unsigned int subscriptions;
+    int samplesPerSecond;
+
+    // A subscription waiting for the client to echo `confirmNonce`, which
+    // only a client really at this address can see
+    unsigned int pendingSubscriptions;
+    int pendingSamplesPerSecond;
+    uint32_t confirmNonce;
+
+    // Token bucket limiting this client's request rate
+    int requestTokens;
+    long long tokensRefilledMs;
+    long long numDroppedRequests;
+
+    // LRU links (pool indices, -1 at the ends)
+    int newer;
+    int older;
+} Session_t;
+
+typedef struct {
+    Session_t *pSessions;
+    int maxSessions;
+    int numSessions;
+    long long idleTimeoutMs;
+
+    // Pool indices, -1 for an empty slot; a power of two in size
+    int *pSlots;
+    int slotMask;
+
+    // Unused pool entries, linked through `older`
+    int freeList;
+
+    int newest;
+    int oldest;
+} SessionTable_t;
+
+void SessionTable_init(SessionTable_t *pTable, int maxSessions, long long idleTimeoutMs);
+void SessionTable_cleanup(SessionTable_t *pTable);
+
+// Find the client's session, or start a new one (evicting the least
+// recently seen client if the table is full). Marks it most recently seen.
+// `pIsNew` may be NULL.
+Session_t *SessionTable_lookup(SessionTable_t *pTable, const struct sockaddr_in *pAddress,
+    long long nowMs, bool *pIsNew);
+
+// Remove every session idle for longer than the timeout
+void SessionTable_expireIdle(SessionTable_t *pTable, long long nowMs);
+
+// Spend one of the client's request tokens, refilled at `perSecond` up to
+// `burst`. Returns false (and counts a dropped request) when none are left.
+bool SessionTable_takeRequestToken(Session_t *pSession, long long nowMs, int perSecond, int burst);
+
+int SessionTable_getNumSessions(const SessionTable_t *pTable);
+
+// Walk every session, most recently seen first:
+// for(pSession = getFirst(); pSession != NULL; pSession = getNext(pSession))
+Session_t *SessionTable_getFirst(SessionTable_t *pTable);
+Session_t *SessionTable_getNext(SessionTable_t *pTable, const Session_t *pSession);
+
+#endif
@@ -1,7 +1,8 @@
 // Shutdown Module
 // This module is responsible for synchronizing the shutdown of the program across all
-// modules and threads. Main will be waiting in a function in this module until another
-// thread from another module unlocks it (initiates shutdown)
+// modules and threads. Main waits in Shutdown_waitForShutdown() until another thread
+// (e.g. the network "stop" command) or SIGINT/SIGTERM initiates shutdown; it then
+// stops each module, which wakes its own threads through their stop events.
 
 #ifndef _SHUTDOWN_H_
 #define _SHUTDOWN_H_
@@ -11,8 +12,9 @@
 void Shutdown_init(void);
 void Shutdown_cleanup(void);
 
+// Safe to call from any thread or a signal handler.
 void Shutdown_signalShutdown(void);
 bool Shutdown_isShutdown(void);
 void Shutdown_waitForShutdown(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -5,7 +5,13 @@
 #ifndef _STATISTICS_H
 #define _STATISTICS_H
 
+#include "hal/periodTimer.h"
+
 void Statistics_init(void);
 void Statistics_cleanup(void);
 
+// Period (or duration) statistics, with percentiles, of an event over the
+// last second. The sampler collects its own; the rest are collected here.
+void Statistics_getEventStats(enum Period_whichEvent whichEvent, Period_statistics_t *pStats);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include <string.h>
+
+#include "binaryProtocol.h"
+
+static void putU16(uint8_t *pBuffer, uint16_t value);
+static void putU32(uint8_t *pBuffer, uint32_t value);
+static void putU64(uint8_t *pBuffer, uint64_t value);
+static void putFloat(uint8_t *pBuffer, float value);
+static uint16_t getU16(const uint8_t *pBuffer);
+static uint32_t getU32(const uint8_t *pBuffer);
+static uint64_t getU64(const uint8_t *pBuffer);
+static float getFloat(const uint8_t *pBuffer);
+
+bool BinaryProtocol_isBinary(const uint8_t *pBuffer, int length) {
+    return length > 0 && pBuffer[0] == BINARY_PROTOCOL_MAGIC;
+}
+
+int BinaryProtocol_encodeRequest(const BinaryProtocol_request_t *pRequest, uint8_t *pBuffer, int maxLength) {
+    if(maxLength < BINARY_REQUEST_SIZE) {
+        return -1;
+    }
+    pBuffer[0] = BINARY_PROTOCOL_MAGIC;
+    pBuffer[1] = pRequest->version;
+    pBuffer[2] = pRequest->type;
+    pBuffer[3] = 0;
+    putU32(pBuffer + 4, pRequest->requestId);
+    putU32(pBuffer + 8, (uint32_t)pRequest->argument);
+    return BINARY_REQUEST_SIZE;
+}
+
+bool BinaryProtocol_decodeRequest(const uint8_t *pBuffer, int length, BinaryProtocol_request_t *pRequest) {
+    if(length < BINARY_REQUEST_SIZE || pBuffer[0] != BINARY_PROTOCOL_MAGIC
+        || pBuffer[1] != BINARY_PROTOCOL_VERSION) {
+        return false;
+    }
+    pRequest->version = pBuffer[1];
+    pRequest->type = pBuffer[2];
+    pRequest->requestId = getU32(pBuffer + 4);
+    pRequest->argument = (int32_t)getU32(pBuffer + 8);
+    return true;
+}
+
+int BinaryProtocol_getSamplesPerFragment(int maxDatagramSize) {
+    return (maxDatagramSize - BINARY_HEADER_SIZE) / (int)sizeof(uint16_t);
+}
+
+int BinaryProtocol_getFragmentCount(int numSamples, int maxDatagramSize) {
+    int samplesPerFragment = BinaryProtocol_getSamplesPerFragment(maxDatagramSize);
+    // An empty window is still one (empty) fragment
+    return numSamples > 0 ? (numSamples + samplesPerFragment - 1) / samplesPerFragment : 1;
+}
+
+int BinaryProtocol_encodeHistory(const BinaryProtocol_header_t *pHeader, const uint16_t *pSamples,
+    int numSamples, uint8_t *pBuffer, int maxLength)
+{
+    int samplesPerFragment = BinaryProtocol_getSamplesPerFragment(maxLength);
+    int first = pHeader->fragmentIndex * samplesPerFragment;
+    if(samplesPerFragment <= 0 || first > numSamples) {
+        return -1;
+    }
+    int count = numSamples - first < samplesPerFragment ? numSamples - first : samplesPerFragment;
+
+    BinaryProtocol_header_t header = *pHeader;
+    header.numItems = count;
+    BinaryProtocol_encodeHeader(&header, pBuffer, maxLength);
+    uint8_t *pPayload = pBuffer + BINARY_HEADER_SIZE;
+    for(int i=0; i<count; i++) {
+        putU16(pPayload + 2 * i, pSamples[first + i]);
+    }
+    return BINARY_HEADER_SIZE + count * (int)sizeof(uint16_t);
+}
+
+bool BinaryProtocol_decodeHistory(const uint8_t *pBuffer, int length, int maxDatagramSize,
+    BinaryProtocol_header_t *pHeader, uint16_t *pDest, int maxSamples)
+{
+    if(!BinaryProtocol_decodeHeader(pBuffer, length, pHeader) || pHeader->type != BINARY_REPLY_HISTORY
+        || length < BINARY_HEADER_SIZE + pHeader->numItems * (int)sizeof(uint16_t)) {
+        return false;
+    }
+    int first = pHeader->fragmentIndex * BinaryProtocol_getSamplesPerFragment(maxDatagramSize);
+    if(first + pHeader->numItems > maxSamples) {
+        return false;
+    }
+    const uint8_t *pPayload = pBuffer + BINARY_HEADER_SIZE;
+    for(int i=0; i<pHeader->numItems; i++) {
+        pDest[first + i] = getU16(pPayload + 2 * i);
+    }
+    return true;
+}
+
+int BinaryProtocol_encodeStats(const BinaryProtocol_header_t *pHeader, const BinaryProtocol_stats_t *pStats,
+    uint8_t *pBuffer, int maxLength)
+{
+    if(maxLength < BINARY_HEADER_SIZE + BINARY_STATS_SIZE) {
+        return -1;
+    }
+    BinaryProtocol_header_t header = *pHeader;
+    header.numItems = 1;
+    BinaryProtocol_encodeHeader(&header, pBuffer, maxLength);
+    uint8_t *pPayload = pBuffer + BINARY_HEADER_SIZE;
+    putU32(pPayload + 0, pStats->count);
+    putU32(pPayload + 4, pStats->dips);
+    putU32(pPayload + 8, pStats->droppedSamples);
+    putU16(pPayload + 12, pStats->minCode);
+    putU16(pPayload + 14, pStats->maxCode);
+    putFloat(pPayload + 16, pStats->meanCode);
+    putFloat(pPayload + 20, pStats->varianceCode);
+    return BINARY_HEADER_SIZE + BINARY_STATS_SIZE;
+}
+
+bool BinaryProtocol_decodeStats(const uint8_t *pBuffer, int length,
+    BinaryProtocol_header_t *pHeader, BinaryProtocol_stats_t *pStats)
+{
+    if(!BinaryProtocol_decodeHeader(pBuffer, length, pHeader) || pHeader->type != BINARY_REPLY_STATS
+        || length < BINARY_HEADER_SIZE + BINARY_STATS_SIZE) {
+        return false;
+    }
+    const uint8_t *pPayload = pBuffer + BINARY_HEADER_SIZE;
+    pStats->count = getU32(pPayload + 0);
+    pStats->dips = getU32(pPayload + 4);
+    pStats->droppedSamples = getU32(pPayload + 8);
+    pStats->minCode = getU16(pPayload + 12);
+    pStats->maxCode = getU16(pPayload + 14);
+    pStats->meanCode = getFloat(pPayload + 16);
+    pStats->varianceCode = getFloat(pPayload + 20);
+    return true;
+}
+
+int BinaryProtocol_encodeHeader(const BinaryProtocol_header_t *pHeader, uint8_t *pBuffer, int maxLength) {
+    if(maxLength < BINARY_HEADER_SIZE) {
+        return -1;
+    }
+    pBuffer[0] = BINARY_PROTOCOL_MAGIC;
+    pBuffer[1] = pHeader->version;
+    pBuffer[2] = pHeader->type;
+    pBuffer[3] = 0;
+    putU32(pBuffer + 4, pHeader->requestId);
+    putU32(pBuffer + 8, pHeader->sequence);
+    putU64(pBuffer + 12, pHeader->windowId);
+    putU64(pBuffer + 20, (uint64_t)pHeader->timestampMs);
+    putU16(pBuffer + 28, pHeader->fragmentIndex);
+    putU16(pBuffer + 30, pHeader->fragmentCount);
+    putU16(pBuffer + 32, pHeader->numItems);
+    putU16(pBuffer + 34, 0);
+    putFloat(pBuffer + 36, pHeader->voltsPerCode);
+    return BINARY_HEADER_SIZE;
+}
+
+bool BinaryProtocol_decodeHeader(const uint8_t *pBuffer, int length, BinaryProtocol_header_t *pHeader) {
+    if(length < BINARY_HEADER_SIZE || pBuffer[0] != BINARY_PROTOCOL_MAGIC
+        || pBuffer[1] != BINARY_PROTOCOL_VERSION) {
+        return false;
+    }
+    pHeader->version = pBuffer[1];
+    pHeader->type = pBuffer[2];
+    pHeader->requestId = getU32(pBuffer + 4);
+    pHeader->sequence = getU32(pBuffer + 8);
+    pHeader->windowId = getU64(pBuffer + 12);
+    pHeader->timestampMs = (int64_t)getU64(pBuffer + 20);
+    pHeader->fragmentIndex = getU16(pBuffer + 28);
+    pHeader->fragmentCount = getU16(pBuffer + 30);
+    pHeader->numItems = getU16(pBuffer + 32);
+    pHeader->voltsPerCode = getFloat(pBuffer + 36);
+    return true;
+}
+
+static void putU16(uint8_t *pBuffer, uint16_t value) {
+    pBuffer[0] = value & 0xFF;
+    pBuffer[1] = value >> 8;
+}
+
+static void putU32(uint8_t *pBuffer, uint32_t value) {
+    putU16(pBuffer, value & 0xFFFF);
+    putU16(pBuffer + 2, value >> 16);
+}
+
+static void putU64(uint8_t *pBuffer, uint64_t value) {
+    putU32(pBuffer, value & 0xFFFFFFFF);
+    putU32(pBuffer + 4, value >> 32);
+}
+
+static void putFloat(uint8_t *pBuffer, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    putU32(pBuffer, bits);
+}
+
+static uint16_t getU16(const uint8_t *pBuffer) {
+    return pBuffer[0] | (pBuffer[1] << 8);
+}
+
+static uint32_t getU32(const uint8_t *pBuffer) {
+    return getU16(pBuffer) | ((uint32_t)getU16(pBuffer + 2) << 16);
+}
+
+static uint64_t getU64(const uint8_t *pBuffer) {
+    return getU32(pBuffer) | ((uint64_t)getU32(pBuffer + 4) << 32);
+}
+
+static float getFloat(const uint8_t *pBuffer) {
+    uint32_t bits = getU32(pBuffer);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
@@ -0,0 +1,342 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "config.h"
+#include "network.h"
+#include "metrics.h"
+#include "hal/sampler.h"
+#include "hal/led.h"
+#include "hal/segDisplay.h"
+#include "hal/backend.h"
+
+#define MAX_LINE_LEN 512
+#define USAGE_COLUMN 36
+
+#define TO_STRING(value) #value
+#define VALUE_TO_STRING(value) TO_STRING(value)
+
+enum optionType {
+    OPTION_FLAG,
+    OPTION_INT,
+    OPTION_DOUBLE,
+    OPTION_STRING
+};
+
+typedef struct {
+    const char *name;
+    enum optionType type;
+    size_t offset;
+    // Accepted range of numeric values
+    double minimum;
+    double maximum;
+    // Value of a bare "--name" for options which are not flags, or NULL if
+    // they need one
+    const char *bareValue;
+    const char *argument;
+    const char *help;
+} option_t;
+
+static void setDefaults(Config_t *pConfig);
+static const option_t *findOption(const char *name);
+static bool setOption(Config_t *pConfig, const option_t *pOption, const char *value);
+static bool loadFile(Config_t *pConfig, const char *path);
+static char *trim(char *text);
+static void printDefault(const Config_t *pConfig, const option_t *pOption);
+
+#define OPTION(name, type, field, minimum, maximum, bareValue, argument, help) \
+    {name, type, offsetof(Config_t, field), minimum, maximum, bareValue, argument, help}
+
+static const option_t options[] = {
+    OPTION("iio", OPTION_FLAG, isIio, 0, 0, NULL, NULL,
+        "Read the A2D's kernel buffer in bulk instead of polling sysfs"),
+    OPTION("simulate", OPTION_FLAG, isSimulated, 0, 0, NULL, NULL,
+        "Run against the simulated board"),
+    OPTION("rate", OPTION_INT, samplesPerSecond, 1, SAMPLER_MAX_SAMPLES_PER_SECOND, NULL, "<samples per second>",
+        "Polled (or simulated) sample rate"),
+    OPTION("trace", OPTION_STRING, tracePath, 0, 0, NULL, "<packed file>",
+        "Simulate, reading the light level from a packed sample file"),
+    OPTION("record", OPTION_STRING, recordingPath, 0, 0, NULL, "<trace file>",
+        "Record every sample read"),
+    OPTION("replay", OPTION_STRING, replayPath, 0, 0, NULL, "<trace file>",
+        "Sample a recorded trace"),
+    OPTION("fast", OPTION_FLAG, isFastReplay, 0, 0, NULL, NULL,
+        "Replay as fast as possible rather than in real time"),
+    OPTION("raw-history", OPTION_INT, rawHistorySeconds, 1, 3600, NULL, "<seconds>",
+        "Raw samples kept for history requests"),
+    OPTION("second-summaries", OPTION_INT, secondSummaries, 1, 7 * 24 * 60 * 60, NULL, "<count>",
+        "Per second summaries kept"),
+    OPTION("minute-summaries", OPTION_INT, minuteSummaries, 1, 365 * 24 * 60, NULL, "<count>",
+        "Per minute summaries kept"),
+    OPTION("hour-summaries", OPTION_INT, hourSummaries, 1, 10 * 365 * 24, NULL, "<count>",
+        "Per hour summaries kept"),
+    OPTION("persist", OPTION_STRING, persistencePath, 0, 0, NULL, "<history file>",
+        "Keep the history on disk, and restore it on start"),
+    OPTION("persist-raw", OPTION_FLAG, isRawPersisted, 0, 0, NULL, NULL,
+        "Keep raw samples on disk too, in <history file>.raw"),
+    OPTION("persisted-windows", OPTION_INT, persistedWindows, 1, 7 * 24 * 60 * 60, NULL, "<seconds>",
+        "Seconds of history kept on disk"),
+    OPTION("persisted-raw-windows", OPTION_INT, persistedRawWindows, 1, 24 * 60 * 60, NULL, "<seconds>",
+        "Seconds of raw samples kept on disk with --persist-raw"),
+    OPTION("dip-enter", OPTION_DOUBLE, dipEnterVolts, 0.001, 1.8, NULL, "<volts>",
+        "Distance from the average which starts a dip"),
+    OPTION("dip-exit", OPTION_DOUBLE, dipExitVolts, 0.001, 1.8, NULL, "<volts>",
+        "Distance from the average which ends a dip"),
+    OPTION("sampler-priority", OPTION_INT, samplerPriority, 0, 99, NULL, "<0-99>",
+        "SCHED_FIFO priority of the sampling thread; 0 for normal"),
+    OPTION("sampler-cpu", OPTION_INT, samplerCpu, -1, 1023, NULL, "<cpu>",
+        "CPU the sampling thread is pinned to; -1 for any"),
+    OPTION("port", OPTION_INT, port, 1, 65535, NULL, "<UDP port>",
+        "Port answering requests"),
+    OPTION("metrics", OPTION_INT, metricsPort, 0, 65535, VALUE_TO_STRING(METRICS_DEFAULT_PORT), "<TCP port>",
+        "Serve Prometheus metrics; 0 for off"),
+    OPTION("pot-rate", OPTION_INT, potReadsPerSecond, 1, 1000, NULL, "<reads per second>",
+        "How often the POT is read and the LED updated"),
+    OPTION("digit-period", OPTION_INT, digitPeriodMs, 1, 1000, NULL, "<ms>",
+        "How long each display digit stays lit"),
+    OPTION("iio-directory", OPTION_STRING, iioDirectory, 0, 0, NULL, "<sysfs directory>",
+        "The A2D's IIO device directory"),
+    OPTION("iio-device", OPTION_STRING, iioDevice, 0, 0, NULL, "<device file>",
+        "The A2D's IIO character device"),
+    OPTION("iio-buffer", OPTION_INT, iioBufferLength, 1, 1 << 20, NULL, "<scans>",
+        "Length of the A2D's kernel buffer"),
+    OPTION("log-level", OPTION_STRING, logLevel, 0, 0, NULL, "<error|warning|info|debug>",
+        "Most detailed messages logged"),
+    OPTION("log-binary", OPTION_STRING, logBinaryPath, 0, 0, NULL, "<log file>",
+        "Log binary records to a file instead of the console"),
+};
+#define NUM_OPTIONS ((int)(sizeof(options) / sizeof(options[0])))
+
+bool Config_load(Config_t *pConfig, int argc, char *argv[]) {
+    setDefaults(pConfig);
+
+    // The file first, wherever it is given, so the command line overrides it
+    for(int i=1; i<argc; i++) {
+        if(strncmp(argv[i], "--config=", 9) == 0 && !loadFile(pConfig, argv[i] + 9)) {
+            return false;
+        }
+    }
+    for(int i=1; i<argc; i++) {
+        if(strncmp(argv[i], "--config=", 9) == 0) {
+            continue;
+        }
+        if(strcmp(argv[i], "--help") == 0) {
+            return false;
+        }
+        if(strncmp(argv[i], "--", 2) != 0) {
+            printf("Unexpected argument: %s\n", argv[i]);
+            return false;
+        }
+        char name[MAX_LINE_LEN];
+        snprintf(name, sizeof(name), "%s", argv[i] + 2);
+        char *value = strchr(name, '=');
+        if(value != NULL) {
+            *value = '\0';
+            value++;
+        }
+        if(!Config_set(pConfig, name, value)) {
+            return false;
+        }
+    }
+
+    if(pConfig->dipExitVolts >= pConfig->dipEnterVolts) {
+        printf("Option dip-exit must be below dip-enter (%g): %g\n",
+            pConfig->dipEnterVolts, pConfig->dipExitVolts);
+        return false;
+    }
+    return true;
+}
+
+void Config_cleanup(Config_t *pConfig) {
+    for(int i=0; i<NUM_OPTIONS; i++) {
+        if(options[i].type == OPTION_STRING) {
+            char **pField = (char **)((char *)pConfig + options[i].offset);
+            free(*pField);
+            *pField = NULL;
+        }
+    }
+}
+
+bool Config_set(Config_t *pConfig, const char *name, const char *value) {
+    const option_t *pOption = findOption(name);
+    if(pOption == NULL) {
+        printf("Unknown option: %s\n", name);
+        return false;
+    }
+    if(value == NULL && pOption->type != OPTION_FLAG) {
+        value = pOption->bareValue;
+        if(value == NULL) {
+            printf("Option %s needs a value: %s=%s\n", name, name, pOption->argument);
+            return false;
+        }
+    }
+    return setOption(pConfig, pOption, value);
+}
+
+void Config_printUsage(const char *program) {
+    Config_t defaults;
+    setDefaults(&defaults);
+    printf("Usage: %s [--config=<file>] [--<option>[=<value>] ...]\n"
+        "Options, also accepted in the file as \"<option> = <value>\" lines:\n", program);
+    for(int i=0; i<NUM_OPTIONS; i++) {
+        const option_t *pOption = &options[i];
+        int length = printf("  --%s", pOption->name);
+        if(pOption->argument != NULL) {
+            length += printf(pOption->bareValue != NULL ? "[=%s]" : "=%s", pOption->argument);
+        }
+        printf("%*s%s", length < USAGE_COLUMN ? USAGE_COLUMN - length : 1, "", pOption->help);
+        printDefault(&defaults, pOption);
+        printf("\n");
+    }
+    Config_cleanup(&defaults);
+}
+
+static void setDefaults(Config_t *pConfig) {
+    *pConfig = (Config_t){
+        .samplesPerSecond = SAMPLER_DEFAULT_SAMPLES_PER_SECOND,
+        .rawHistorySeconds = SAMPLER_DEFAULT_RAW_HISTORY_SECONDS,
+        .secondSummaries = SAMPLER_DEFAULT_SECOND_SUMMARIES,
+        .minuteSummaries = SAMPLER_DEFAULT_MINUTE_SUMMARIES,
+        .hourSummaries = SAMPLER_DEFAULT_HOUR_SUMMARIES,
+        .dipEnterVolts = SAMPLER_DEFAULT_DIP_ENTER_VOLTS,
+        .dipExitVolts = SAMPLER_DEFAULT_DIP_EXIT_VOLTS,
+        .persistedWindows = SAMPLER_DEFAULT_PERSISTED_WINDOWS,
+        .persistedRawWindows = SAMPLER_DEFAULT_PERSISTED_RAW_WINDOWS,
+        .samplerPriority = 0,
+        .samplerCpu = -1,
+        .port = NETWORK_DEFAULT_PORT,
+        .metricsPort = 0,
+        .potReadsPerSecond = LED_DEFAULT_POT_READS_PER_SECOND,
+        .digitPeriodMs = SEG_DEFAULT_DIGIT_PERIOD_MS,
+        .iioDirectory = strdup(BACKEND_DEFAULT_IIO_DIRECTORY),
+        .iioDevice = strdup(BACKEND_DEFAULT_IIO_DEVICE),
+        .iioBufferLength = BACKEND_DEFAULT_IIO_BUFFER_LENGTH,
+        .logLevel = strdup("info"),
+    };
+}
+
+static const option_t *findOption(const char *name) {
+    for(int i=0; i<NUM_OPTIONS; i++) {
+        if(strcmp(options[i].name, name) == 0) {
+            return &options[i];
+        }
+    }
+    return NULL;
+}
+
+static bool setOption(Config_t *pConfig, const option_t *pOption, const char *value) {
+    void *pField = (char *)pConfig + pOption->offset;
+    char *end = NULL;
+    errno = 0;
+    switch(pOption->type) {
+        case OPTION_FLAG:
+            if(value == NULL || strcmp(value, "true") == 0 || strcmp(value, "1") == 0) {
+                *(bool *)pField = true;
+            }
+            else if(strcmp(value, "false") == 0 || strcmp(value, "0") == 0) {
+                *(bool *)pField = false;
+            }
+            else {
+                printf("Option %s is a flag (true or false): %s\n", pOption->name, value);
+                return false;
+            }
+            return true;
+        case OPTION_INT: {
+            long number = strtol(value, &end, 0);
+            if(errno != 0 || end == value || *end != '\0'
+                || number < pOption->minimum || number > pOption->maximum)
+            {
+                printf("Option %s must be a whole number from %.0f to %.0f: %s\n",
+                    pOption->name, pOption->minimum, pOption->maximum, value);
+                return false;
+            }
+            *(int *)pField = (int)number;
+            return true;
+        }
+        case OPTION_DOUBLE: {
+            double number = strtod(value, &end);
+            if(errno != 0 || end == value || *end != '\0'
+                || number < pOption->minimum || number > pOption->maximum)
+            {
+                printf("Option %s must be a number from %g to %g: %s\n",
+                    pOption->name, pOption->minimum, pOption->maximum, value);
+                return false;
+            }
+            *(double *)pField = number;
+            return true;
+        }
+        case OPTION_STRING:
+            free(*(char **)pField);
+            *(char **)pField = strdup(value);
+            return true;
+    }
+    return false;
+}
+
+static bool loadFile(Config_t *pConfig, const char *path) {
+    FILE *pFile = fopen(path, "r");
+    if(pFile == NULL) {
+        printf("Unable to open config file (%s): %s\n", path, strerror(errno));
+        return false;
+    }
+    char line[MAX_LINE_LEN];
+    int lineNumber = 0;
+    bool isValid = true;
+    while(isValid && fgets(line, sizeof(line), pFile) != NULL) {
+        lineNumber++;
+        char *comment = strchr(line, '#');
+        if(comment != NULL) {
+            *comment = '\0';
+        }
+        char *value = strchr(line, '=');
+        if(value != NULL) {
+            *value = '\0';
+            value = trim(value + 1);
+        }
+        char *name = trim(line);
+        if(*name == '\0') {
+            continue;
+        }
+        if(!Config_set(pConfig, name, value)) {
+            printf("  (line %d of %s)\n", lineNumber, path);
+            isValid = false;
+        }
+    }
+    fclose(pFile);
+    return isValid;
+}
+
+static char *trim(char *text) {
+    while(isspace((unsigned char)*text)) {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while(end > text && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    *end = '\0';
+    return text;
+}
+
+static void printDefault(const Config_t *pConfig, const option_t *pOption) {
+    const void *pField = (const char *)pConfig + pOption->offset;
+    switch(pOption->type) {
+        case OPTION_FLAG:
+            break;
+        case OPTION_INT:
+            printf(" (default %d)", *(const int *)pField);
+            break;
+        case OPTION_DOUBLE:
+            printf(" (default %g)", *(const double *)pField);
+            break;
+        case OPTION_STRING:
+            if(*(char * const *)pField != NULL) {
+                printf(" (default %s)", *(char * const *)pField);
+            }
+            break;
+    }
+}
@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "historyText.h"
+#include "hal/sampler.h"
+
+#define NUM_CODES 4096
+
+static char codeText[NUM_CODES][HISTORY_TEXT_MAX_SAMPLE_SIZE];
+static uint8_t codeTextLength[NUM_CODES];
+
+void HistoryText_init(void) {
+    for(int code=0; code<NUM_CODES; code++) {
+        codeTextLength[code] = snprintf(codeText[code], HISTORY_TEXT_MAX_SAMPLE_SIZE, "%.3f",
+            Sampler_codeToVolts(code));
+    }
+}
+
+int HistoryText_appendSample(char *pBuffer, int offset, const uint16_t *pCodes, int i, int length) {
+    // Out of range codes show as full scale, so no sample's text is longer
+    // than "1.800" and it fits HISTORY_TEXT_MAX_SAMPLE_SIZE with its separators
+    uint16_t code = pCodes[i] < NUM_CODES ? pCodes[i] : NUM_CODES - 1;
+    memcpy(pBuffer + offset, codeText[code], HISTORY_TEXT_MAX_SAMPLE_SIZE);
+    offset += codeTextLength[code];
+
+    if(i != length - 1) {
+        pBuffer[offset++] = ',';
+        pBuffer[offset++] = ' ';
+    }
+
+    if((i+1) % 10 == 0 || i == length - 1) {
+        pBuffer[offset++] = '\n';
+    }
+    return offset;
+}
@@ -3,30 +3,109 @@
 #include <stdio.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
 
 #include "hal/sampler.h"
+#include "hal/periodTimer.h"
+#include "hal/backend.h"
+#include "hal/trace.h"
+#include "hal/log.h"
+#include "hal/reactor.h"
 #include "network.h"
+#include "metrics.h"
 #include "shutdown.h"
 #include "statistics.h"
+#include "config.h"
 #include "hal/led.h"
 #include "hal/segDisplay.h"
 
-int main() {
+#define TRACE_LAYOUT "le:u12/16>>0"
 
+int main(int argc, char *argv[]) {
+    Config_t config;
+    if (!Config_load(&config, argc, argv)) {
+        Config_printUsage(argv[0]);
+        Config_cleanup(&config);
+        return 1;
+    }
+
+    enum Log_level level;
+    if (!Log_parseLevel(config.logLevel, &level)) {
+        printf("Unknown log level: %s (error, warning, info or debug)\n", config.logLevel);
+        Config_cleanup(&config);
+        return 1;
+    }
+    Log_setLevel(level);
+    if (config.logBinaryPath != NULL) {
+        Log_setBinaryOutput(config.logBinaryPath);
+    }
+
+    SimulatedBackend_config_t simulation;
+    SimulatedBackend_getDefaultConfig(&simulation);
+    simulation.samplesPerSecond = config.samplesPerSecond;
+    if (config.tracePath != NULL) {
+        simulation.tracePath = config.tracePath;
+        SampleSource_parseLayout(TRACE_LAYOUT, &simulation.traceLayout);
+        config.isSimulated = true;
+    }
+    if (config.isSimulated) {
+        Backend_useSimulation(&simulation);
+    }
+    Backend_setIioDevice(config.iioDirectory, config.iioDevice, config.iioBufferLength);
+
+    Sampler_setSampleRate(config.samplesPerSecond);
+    Sampler_setHistoryDepth(config.rawHistorySeconds, config.secondSummaries, config.minuteSummaries,
+        config.hourSummaries);
+    Sampler_setDipThresholds(config.dipEnterVolts, config.dipExitVolts);
+    Sampler_setThreadScheduling(config.samplerPriority, config.samplerCpu);
+    if (config.recordingPath != NULL) {
+        Sampler_setRecording(config.recordingPath);
+    }
+    if (config.persistencePath != NULL) {
+        Sampler_setPersistence(config.persistencePath, config.persistedWindows,
+            config.isRawPersisted ? config.persistedRawWindows : 0);
+    }
+    Led_setPotReadsPerSecond(config.potReadsPerSecond);
+    Seg_setDigitPeriod(config.digitPeriodMs);
+
+    Log_init();
     Shutdown_init();
-    Sampler_init();
+    Period_init();
+    if (config.replayPath != NULL) {
+        SampleSource_t source;
+        Trace_openReplay(&source, config.replayPath, !config.isFastReplay);
+        Sampler_initWithSource(source);
+    }
+    else {
+        Sampler_init(config.isIio ? SAMPLER_CAPTURE_IIO_BUFFER : SAMPLER_CAPTURE_SYSFS);
+    }
+    Reactor_init();
     Led_init();
     Seg_init();
     Statistics_init();
-    Network_init();
+    Network_init(config.port);
+    if (config.metricsPort > 0) {
+        Metrics_init(config.metricsPort);
+    }
+    Reactor_start();
 
     Shutdown_waitForShutdown();
     
+    // Nothing runs on the reactor thread past here, so modules clean up freely
+    Reactor_stop();
+    if (config.metricsPort > 0) {
+        Metrics_cleanup();
+    }
     Network_cleanup();
     Statistics_cleanup();
     Seg_cleanup();
     Led_cleanup();
+    Reactor_cleanup();
     Sampler_cleanup();
+    Period_cleanup();
     Shutdown_cleanup();
+    Log_cleanup();
+    Config_cleanup(&config);
 
 }
\ No newline at end of file
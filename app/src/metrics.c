@@ -0,0 +1,424 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "metrics.h"
+#include "statistics.h"
+#include "hal/sampler.h"
+#include "hal/periodTimer.h"
+#include "hal/led.h"
+#include "hal/log.h"
+#include "hal/reactor.h"
+
+// Scrapes served at once, and how long one may take to send its request
+#define MAX_CONNECTIONS 4
+#define CONNECTION_TIMEOUT_MS 5000
+#define MAX_REQUEST_LEN 1024
+#define EXPIRY_PERIOD_NS 1000000000LL
+
+// Comfortably more than the whole table renders to
+#define MAX_BODY_LEN 16384
+#define MAX_HEADER_LEN 256
+
+#define MS_PER_SECOND 1000.0
+
+// Everything a scrape reports, read once before rendering so every line
+// comes from the same moment
+typedef struct {
+    long long samplesTaken;
+    int windowSamples;
+    int windowDips;
+    double averageVolts;
+    int potValue;
+    long long logDropped;
+    Period_statistics_t eventStats[NUM_PERIOD_EVENTS];
+} metricValues_t;
+
+typedef struct {
+    const char *name;
+    const char *type;
+    const char *help;
+    // Reported once per period event (with an "event" label) when set
+    bool isPerEvent;
+    // Extra "quantile" label, or NULL
+    const char *quantile;
+    double (*getValue)(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+} metric_t;
+
+typedef struct {
+    int descriptor;
+    long long openedMs;
+    int length;
+    char request[MAX_REQUEST_LEN];
+} connection_t;
+
+static double getSamplesTaken(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getWindowSamples(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getWindowDips(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getAverageVolts(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getPotValue(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getLogDropped(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getEventCount(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getEventMissedDeadlines(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getEventMin(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getEventAverage(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getEventMax(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getEventP50(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getEventP90(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getEventP99(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getEventP999(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+static double getEventSum(const metricValues_t *pValues, const Period_statistics_t *pEventStats);
+
+static const metric_t metrics[] = {
+    {"light_sampler_samples_total", "counter", "Light samples taken since start.",
+        false, NULL, getSamplesTaken},
+    {"light_sampler_window_samples", "gauge", "Light samples in the previous complete second.",
+        false, NULL, getWindowSamples},
+    {"light_sampler_window_dips", "gauge", "Dips in the previous complete second.",
+        false, NULL, getWindowDips},
+    {"light_sampler_average_volts", "gauge", "Exponential moving average of the light level.",
+        false, NULL, getAverageVolts},
+    {"light_sampler_pot_value", "gauge", "Raw POT reading (0-4095).",
+        false, NULL, getPotValue},
+    {"light_sampler_log_dropped_total", "counter", "Log messages dropped because the writer fell behind.",
+        false, NULL, getLogDropped},
+    {"light_sampler_event_count", "gauge", "Periods (or durations) timed in the last second.",
+        true, NULL, getEventCount},
+    {"light_sampler_event_missed_deadlines", "gauge", "Deadlines missed in the last second.",
+        true, NULL, getEventMissedDeadlines},
+    {"light_sampler_event_min_seconds", "gauge", "Shortest period (or duration) in the last second.",
+        true, NULL, getEventMin},
+    {"light_sampler_event_avg_seconds", "gauge", "Average period (or duration) in the last second.",
+        true, NULL, getEventAverage},
+    {"light_sampler_event_max_seconds", "gauge", "Longest period (or duration) in the last second.",
+        true, NULL, getEventMax},
+    {"light_sampler_event_seconds", "summary", "Period (or duration) percentiles over the last second.",
+        true, "0.5", getEventP50},
+    {"light_sampler_event_seconds", NULL, NULL,
+        true, "0.9", getEventP90},
+    {"light_sampler_event_seconds", NULL, NULL,
+        true, "0.99", getEventP99},
+    {"light_sampler_event_seconds", NULL, NULL,
+        true, "0.999", getEventP999},
+    {"light_sampler_event_seconds_sum", NULL, NULL,
+        true, NULL, getEventSum},
+    {"light_sampler_event_seconds_count", NULL, NULL,
+        true, NULL, getEventCount},
+};
+#define NUM_METRICS ((int)(sizeof(metrics) / sizeof(metrics[0])))
+
+static int listenPort;
+static int listenDescriptor;
+
+static connection_t connections[MAX_CONNECTIONS];
+static char responseHeader[MAX_HEADER_LEN];
+static char responseBody[MAX_BODY_LEN];
+
+static int openSocket(void);
+static void acceptConnection(int fd, void *pContext);
+static void receiveRequest(int fd, void *pContext);
+static void sendResponse(connection_t *pConnection);
+static void closeConnection(connection_t *pConnection);
+static void expireConnections(void *pContext);
+static int renderMetrics(void);
+static int append(int offset, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static long long getTimeInMs(void);
+
+void Metrics_init(int port) {
+    listenPort = port;
+    for(int i=0; i<MAX_CONNECTIONS; i++) {
+        connections[i].descriptor = -1;
+    }
+    // Scrapes are served from the reactor thread
+    listenDescriptor = openSocket();
+    Reactor_addHandler(listenDescriptor, acceptConnection, NULL);
+    Reactor_addTask(EXPIRY_PERIOD_NS, expireConnections, NULL);
+}
+
+void Metrics_cleanup(void) {
+    for(int i=0; i<MAX_CONNECTIONS; i++) {
+        closeConnection(&connections[i]);
+    }
+    close(listenDescriptor);
+}
+
+static int openSocket(void) {
+    struct sockaddr_in sin = {0};
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(listenPort);
+
+    int socketDescriptor = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(socketDescriptor == -1) {
+        perror("Failed to establish metrics socket");
+        exit(1);
+    }
+    int reuse = 1;
+    setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if(bind(socketDescriptor, (struct sockaddr*) &sin, sizeof(sin)) == -1) {
+        perror("Failed to bind metrics socket");
+        exit(1);
+    }
+    if(listen(socketDescriptor, MAX_CONNECTIONS) == -1) {
+        perror("Failed to listen on metrics socket");
+        exit(1);
+    }
+    return socketDescriptor;
+}
+
+static void acceptConnection(int fd, void *pContext) {
+    (void)pContext;
+    int descriptor = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(descriptor == -1) {
+        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            Log_write(LOG_LEVEL_ERROR, "Failed to accept metrics connection: %s\n", strerror(errno));
+        }
+        return;
+    }
+    connection_t *pConnection = NULL;
+    for(int i=0; i<MAX_CONNECTIONS && pConnection == NULL; i++) {
+        if(connections[i].descriptor == -1) {
+            pConnection = &connections[i];
+        }
+    }
+    if(pConnection == NULL) {
+        // Every slot is busy; the scraper will retry
+        close(descriptor);
+        return;
+    }
+    pConnection->descriptor = descriptor;
+    pConnection->openedMs = getTimeInMs();
+    pConnection->length = 0;
+    Reactor_addHandler(descriptor, receiveRequest, pConnection);
+}
+
+// Read what has arrived of the request; answer once its header is complete
+static void receiveRequest(int fd, void *pContext) {
+    connection_t *pConnection = pContext;
+    int bytesRx = recv(fd, pConnection->request + pConnection->length,
+        MAX_REQUEST_LEN - 1 - pConnection->length, MSG_DONTWAIT);
+    if(bytesRx == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if(bytesRx <= 0) {
+        closeConnection(pConnection);
+        return;
+    }
+    pConnection->length += bytesRx;
+    pConnection->request[pConnection->length] = 0;
+    if(strstr(pConnection->request, "\r\n\r\n") != NULL || pConnection->length == MAX_REQUEST_LEN - 1) {
+        sendResponse(pConnection);
+        closeConnection(pConnection);
+    }
+}
+
+// One response per connection; the scraper reconnects for the next. At
+// most MAX_HEADER_LEN + MAX_BODY_LEN bytes, well under a fresh connection's
+// default send buffer, so it is sent in one go without waiting; if the
+// buffer is smaller than that, the short response is logged and the
+// connection closed, and the scraper sees a truncated body.
+static void sendResponse(connection_t *pConnection) {
+    const char *status = "200 OK";
+    int bodyLength = 0;
+    if(strncmp(pConnection->request, "GET ", 4) != 0) {
+        status = "405 Method Not Allowed";
+    }
+    else if(strncmp(pConnection->request + 4, "/metrics", 8) != 0
+        || (pConnection->request[12] != ' ' && pConnection->request[12] != '?'))
+    {
+        status = "404 Not Found";
+    }
+    else {
+        bodyLength = renderMetrics();
+    }
+    int headerLength = snprintf(responseHeader, MAX_HEADER_LEN,
+        "HTTP/1.1 %s\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: %d\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        status, bodyLength);
+
+    struct iovec iovecs[2] = {
+        {.iov_base = responseHeader, .iov_len = headerLength},
+        {.iov_base = responseBody, .iov_len = bodyLength},
+    };
+    struct msghdr header = {.msg_iov = iovecs, .msg_iovlen = 2};
+    ssize_t bytesSent = sendmsg(pConnection->descriptor, &header, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if(bytesSent < 0) {
+        Log_write(LOG_LEVEL_ERROR, "Failed to send metrics: %s\n", strerror(errno));
+    }
+    else if(bytesSent != headerLength + bodyLength) {
+        Log_write(LOG_LEVEL_ERROR, "Failed to send metrics: only %zd of %d bytes fit the send buffer\n",
+            bytesSent, headerLength + bodyLength);
+    }
+}
+
+static void closeConnection(connection_t *pConnection) {
+    if(pConnection->descriptor != -1) {
+        Reactor_removeHandler(pConnection->descriptor);
+        close(pConnection->descriptor);
+        pConnection->descriptor = -1;
+    }
+}
+
+// Reactor task: drop connections which never finish their request
+static void expireConnections(void *pContext) {
+    (void)pContext;
+    long long nowMs = getTimeInMs();
+    for(int i=0; i<MAX_CONNECTIONS; i++) {
+        if(connections[i].descriptor != -1 && nowMs - connections[i].openedMs > CONNECTION_TIMEOUT_MS) {
+            closeConnection(&connections[i]);
+        }
+    }
+}
+
+// Render every metric of the table into responseBody; returns its length
+static int renderMetrics(void) {
+    metricValues_t values = {
+        .samplesTaken = Sampler_getNumSamplesTaken(),
+        .windowSamples = Sampler_getHistorySize(),
+        .windowDips = Sampler_getDips(),
+        .averageVolts = Sampler_getAverageReading(),
+        .potValue = Led_getPOTValue(),
+        .logDropped = Log_getNumDropped(),
+    };
+    for(int i=0; i<NUM_PERIOD_EVENTS; i++) {
+        Statistics_getEventStats(i, &values.eventStats[i]);
+    }
+
+    int offset = 0;
+    for(int i=0; i<NUM_METRICS; i++) {
+        const metric_t *pMetric = &metrics[i];
+        if(pMetric->help != NULL) {
+            offset = append(offset, "# HELP %s %s\n# TYPE %s %s\n",
+                pMetric->name, pMetric->help, pMetric->name, pMetric->type);
+        }
+        if(!pMetric->isPerEvent) {
+            offset = append(offset, "%s %.9g\n", pMetric->name, pMetric->getValue(&values, NULL));
+            continue;
+        }
+        for(int event=0; event<NUM_PERIOD_EVENTS; event++) {
+            double value = pMetric->getValue(&values, &values.eventStats[event]);
+            if(pMetric->quantile != NULL) {
+                offset = append(offset, "%s{event=\"%s\",quantile=\"%s\"} %.9g\n",
+                    pMetric->name, Period_getEventName(event), pMetric->quantile, value);
+            }
+            else {
+                offset = append(offset, "%s{event=\"%s\"} %.9g\n",
+                    pMetric->name, Period_getEventName(event), value);
+            }
+        }
+    }
+    return offset;
+}
+
+// Append to responseBody, never past its end; returns the new length
+static int append(int offset, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(responseBody + offset, MAX_BODY_LEN - offset, format, args);
+    va_end(args);
+    if(length < 0 || offset + length >= MAX_BODY_LEN) {
+        return offset;
+    }
+    return offset + length;
+}
+
+static double getSamplesTaken(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pEventStats;
+    return pValues->samplesTaken;
+}
+
+static double getWindowSamples(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pEventStats;
+    return pValues->windowSamples;
+}
+
+static double getWindowDips(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pEventStats;
+    return pValues->windowDips;
+}
+
+static double getAverageVolts(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pEventStats;
+    return pValues->averageVolts;
+}
+
+static double getPotValue(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pEventStats;
+    return pValues->potValue;
+}
+
+static double getLogDropped(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pEventStats;
+    return pValues->logDropped;
+}
+
+static double getEventCount(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pValues;
+    return pEventStats->numSamples;
+}
+
+static double getEventMissedDeadlines(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pValues;
+    return pEventStats->numMissedDeadlines;
+}
+
+static double getEventMin(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pValues;
+    return pEventStats->minPeriodInMs / MS_PER_SECOND;
+}
+
+static double getEventAverage(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pValues;
+    return pEventStats->avgPeriodInMs / MS_PER_SECOND;
+}
+
+static double getEventMax(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pValues;
+    return pEventStats->maxPeriodInMs / MS_PER_SECOND;
+}
+
+static double getEventP50(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pValues;
+    return pEventStats->p50PeriodInMs / MS_PER_SECOND;
+}
+
+static double getEventP90(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pValues;
+    return pEventStats->p90PeriodInMs / MS_PER_SECOND;
+}
+
+static double getEventP99(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pValues;
+    return pEventStats->p99PeriodInMs / MS_PER_SECOND;
+}
+
+static double getEventP999(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pValues;
+    return pEventStats->p999PeriodInMs / MS_PER_SECOND;
+}
+
+static double getEventSum(const metricValues_t *pValues, const Period_statistics_t *pEventStats) {
+    (void)pValues;
+    return pEventStats->avgPeriodInMs * pEventStats->numSamples / MS_PER_SECOND;
+}
+
+static long long getTimeInMs(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec * 1000LL + spec.tv_nsec / 1000000;
+}
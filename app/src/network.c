@@ -1,83 +1,235 @@
-#include <pthread.h>
+#define _GNU_SOURCE
 #include <stdbool.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/types.h>
+#include <sys/random.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
 #include "network.h"
+#include "binaryProtocol.h"
+#include "historyText.h"
+#include "sessionTable.h"
 #include "shutdown.h"
+#include "statistics.h"
 #include "hal/sampler.h"
+#include "hal/periodTimer.h"
+#include "hal/log.h"
+#include "hal/reactor.h"
 
 enum Command {
     COUNT,
     LENGTH,
     DIPS,
     HISTORY,
+    WINDOWS,
+    RANGE,
+    TIMING,
+    LATENCY,
+    SUBSCRIBE,
+    CONFIRM,
+    UNSUBSCRIBE,
     STOP,
     HELP,
     ENTER,
     UNKNOWN
 };
 
-static pthread_t networkThread;
-static _Atomic bool isRunning;
+#define MAX_LEN 1500
+
+// Datagrams drained per recvmmsg() and replies sent per sendmmsg()
+#define RECEIVE_BATCH_SIZE 32
+#define REPLY_BATCH_SIZE 64
+
+// Clients remembered at once, and how long an idle one is kept
+#define MAX_SESSIONS 4096
+#define SESSION_IDLE_TIMEOUT_MS (5 * 60 * 1000)
+
+// Requests each client may send per second, and in one burst
+#define REQUESTS_PER_SECOND 100
+#define REQUEST_BURST 50
+
+// Topics a session can subscribe to, pushed as each second completes
+#define TOPIC_WINDOWS (1 << 0)
+#define TOPIC_SAMPLES (1 << 1)
+
+static int serverSocketDescriptor;
+static SessionTable_t sessionTable;
+
+// Raw samples of an earlier second, for "history <n>"
+static uint16_t *recentHistory;
+
+// Replies queued for the next sendmmsg()
+static char replyBuffers[REPLY_BATCH_SIZE][MAX_LEN];
+static struct sockaddr_in replyAddresses[REPLY_BATCH_SIZE];
+static struct iovec replyIovecs[REPLY_BATCH_SIZE];
+static struct mmsghdr replyHeaders[REPLY_BATCH_SIZE];
+static int numReplies;
+
+// Pushed text, encoded once per window and sent to every subscriber
+static char pushSummary[MAX_LEN];
+static char (*pushDatagrams)[MAX_LEN];
+static int *pushLengths;
+static uint16_t *decimatedHistory;
 
-static void *listenLoop(void *arg);
+// Sequence number of the next binary reply datagram
+static uint32_t binarySequence;
+
+static void onRequests(int fd, void *pContext);
+static void onWindow(int fd, void *pContext);
+static int openSocket(int port);
+static void receiveBatch(int socketDescriptor);
+static void handleRequest(char *messageRx, int bytesRx, int socketDescriptor, struct sockaddr_in *sinRemote,
+    long long nowMs);
+static void sendBinaryReply(const BinaryProtocol_request_t *pRequest, int socketDescriptor,
+    struct sockaddr_in *sinRemote);
 static enum Command checkCommand(char* input);
-static void sendReply(enum Command command, int socketDescriptor, struct sockaddr_in *sinRemote);
+static void sendReply(enum Command command, char* input, Session_t *pSession, int socketDescriptor,
+    struct sockaddr_in *sinRemote);
+static void subscribe(char *input, Session_t *pSession, char *messageTx);
+static void confirm(char *input, Session_t *pSession, char *messageTx);
+static void unsubscribe(char *input, Session_t *pSession, char *messageTx);
+static unsigned int parseTopic(const char *topic);
+static void pushWindow(int socketDescriptor);
+static int encodeSamples(const uint16_t *history, int length, int step);
+static char *sendHistory(const uint16_t *history, int length, char *messageTx, int *pOffset,
+    int socketDescriptor, struct sockaddr_in *sinRemote);
+static char *getReplyBuffer(int socketDescriptor);
+static void queueReply(char *messageTx, int length, struct sockaddr_in *sinRemote);
+static void queuePush(int socketDescriptor, char *messageTx, int length, struct sockaddr_in *sinRemote);
+static void flushReplies(int socketDescriptor);
+static long long getTimeInMs(void);
+
+void Network_init(int port) {
+    int maxHistorySize = Sampler_getMaxHistorySize();
+    recentHistory = malloc(sizeof(recentHistory[0]) * maxHistorySize);
+    decimatedHistory = malloc(sizeof(decimatedHistory[0]) * maxHistorySize);
+    // Every datagram but the last holds well over MAX_LEN / HISTORY_TEXT_MAX_SAMPLE_SIZE / 2 samples
+    int maxPushDatagrams = maxHistorySize / (MAX_LEN / HISTORY_TEXT_MAX_SAMPLE_SIZE / 2) + 1;
+    pushDatagrams = malloc(sizeof(pushDatagrams[0]) * maxPushDatagrams);
+    pushLengths = malloc(sizeof(pushLengths[0]) * maxPushDatagrams);
+    SessionTable_init(&sessionTable, MAX_SESSIONS, SESSION_IDLE_TIMEOUT_MS);
+    HistoryText_init();
 
-void Network_init(void) {
-    isRunning = true;
-    pthread_create(&networkThread, NULL, listenLoop, NULL);
+    // Answer each burst of requests in batches, and push each completed
+    // window to subscribers, from the reactor thread
+    serverSocketDescriptor = openSocket(port);
+    Reactor_addHandler(serverSocketDescriptor, onRequests, NULL);
+    Reactor_addHandler(Sampler_getWindowEventDescriptor(), onWindow, NULL);
 }
 
 void Network_cleanup(void) {
-    isRunning = false;
-    pthread_join(networkThread, NULL);
+    close(serverSocketDescriptor);
+    SessionTable_cleanup(&sessionTable);
+    free(recentHistory);
+    free(decimatedHistory);
+    free(pushDatagrams);
+    free(pushLengths);
 }
 
-#define MAX_LEN 1500
-#define PORT 12345
-static void *listenLoop(void *arg) {
-    (void)arg;
-    enum Command lastCommand = UNKNOWN;
-    // Socket initialization
+static void onRequests(int fd, void *pContext) {
+    (void)pContext;
+    Period_markEvent(PERIOD_EVENT_NETWORK_LOOP);
+    receiveBatch(fd);
+}
+
+static void onWindow(int fd, void *pContext) {
+    (void)pContext;
+    Period_markEvent(PERIOD_EVENT_NETWORK_LOOP);
+    // Several windows may have completed; only the latest is kept
+    uint64_t numWindows;
+    if(read(fd, &numWindows, sizeof(numWindows)) == sizeof(numWindows)) {
+        pushWindow(serverSocketDescriptor);
+    }
+}
+
+static int openSocket(int port) {
     struct sockaddr_in sin = {0};
     sin.sin_family = AF_INET;
     sin.sin_addr.s_addr = htonl(INADDR_ANY);
-    sin.sin_port = htons(PORT);
+    sin.sin_port = htons(port);
 
-    int socketDescriptor = socket(AF_INET, SOCK_DGRAM, 0);
+    int socketDescriptor = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
     if(socketDescriptor == -1) {
         perror("Failed to establish server socket");
         exit(1);
     }
-    bind(socketDescriptor, (struct sockaddr*) &sin, sizeof(sin));
+    if(bind(socketDescriptor, (struct sockaddr*) &sin, sizeof(sin)) == -1) {
+        perror("Failed to bind server socket");
+        exit(1);
+    }
+    return socketDescriptor;
+}
+
+// Drain every waiting datagram, RECEIVE_BATCH_SIZE at a time, queueing the
+// replies and sending them together once the socket is empty.
+static void receiveBatch(int socketDescriptor) {
+    static char messagesRx[RECEIVE_BATCH_SIZE][MAX_LEN];
+    static struct sockaddr_in sinRemotes[RECEIVE_BATCH_SIZE];
+    struct iovec iovecs[RECEIVE_BATCH_SIZE];
+    struct mmsghdr headers[RECEIVE_BATCH_SIZE];
 
-    // Message receive and reply loop
-    while(!Shutdown_isShutdown()) {
-        struct sockaddr_in sinRemote;
-        unsigned int sinLen = sizeof(sinRemote);
-        char messageRx[MAX_LEN];
+    int numReceived;
+    do {
+        for(int i=0; i<RECEIVE_BATCH_SIZE; i++) {
+            iovecs[i].iov_base = messagesRx[i];
+            iovecs[i].iov_len = MAX_LEN - 1;
+            memset(&headers[i], 0, sizeof(headers[i]));
+            headers[i].msg_hdr.msg_iov = &iovecs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            headers[i].msg_hdr.msg_name = &sinRemotes[i];
+            headers[i].msg_hdr.msg_namelen = sizeof(sinRemotes[i]);
+        }
 
-        int bytesRx = recvfrom(socketDescriptor, messageRx, MAX_LEN - 1, 0, 
-            (struct sockaddr*) &sinRemote, &sinLen);
+        numReceived = recvmmsg(socketDescriptor, headers, RECEIVE_BATCH_SIZE, MSG_DONTWAIT, NULL);
+        long long nowMs = getTimeInMs();
+        for(int i=0; i<numReceived; i++) {
+            long long requestStartNs = Period_getTimeInNs();
+            handleRequest(messagesRx[i], headers[i].msg_len, socketDescriptor, &sinRemotes[i], nowMs);
+            Period_markDuration(PERIOD_EVENT_NETWORK_REQUEST, requestStartNs);
+        }
+    } while(numReceived == RECEIVE_BATCH_SIZE);
 
-        messageRx[bytesRx] = 0;
-        enum Command sentCommand = checkCommand(messageRx);
-        lastCommand = sentCommand == ENTER ? lastCommand : sentCommand;
-        sendReply(lastCommand, socketDescriptor, &sinRemote);
+    if(numReceived == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        Log_write(LOG_LEVEL_ERROR, "Failed to receive requests: %s\n", strerror(errno));
+    }
+    flushReplies(socketDescriptor);
+    SessionTable_expireIdle(&sessionTable, getTimeInMs());
+}
+
+// Answer one request using (and updating) the sender's session
+static void handleRequest(char *messageRx, int bytesRx, int socketDescriptor, struct sockaddr_in *sinRemote,
+    long long nowMs)
+{
+    Session_t *pSession = SessionTable_lookup(&sessionTable, sinRemote, nowMs, NULL);
+    if(!SessionTable_takeRequestToken(pSession, nowMs, REQUESTS_PER_SECOND, REQUEST_BURST)) {
+        return;
     }
 
-    close(socketDescriptor);
+    if(BinaryProtocol_isBinary((uint8_t*)messageRx, bytesRx)) {
+        BinaryProtocol_request_t request;
+        if(BinaryProtocol_decodeRequest((uint8_t*)messageRx, bytesRx, &request)) {
+            sendBinaryReply(&request, socketDescriptor, sinRemote);
+        }
+        return;
+    }
 
-    return NULL;
+    messageRx[bytesRx] = 0;
+    enum Command sentCommand = checkCommand(messageRx);
+    if(sentCommand != ENTER) {
+        pSession->lastCommand = sentCommand;
+        // Longer messages are never commands, so cutting them short is harmless
+        snprintf(pSession->lastMessage, SESSION_MAX_MESSAGE_LEN, "%.*s", SESSION_MAX_MESSAGE_LEN - 1, messageRx);
+    }
+    enum Command command = (pSession->lastCommand == -1) ? UNKNOWN : (enum Command)pSession->lastCommand;
+    sendReply(command, pSession->lastMessage, pSession, socketDescriptor, sinRemote);
 }
 
 static enum Command checkCommand(char* input) {
@@ -90,9 +242,30 @@ static enum Command checkCommand(char* input) {
     else if(strcmp(input, "dips\n") == 0) {
         return DIPS;
     }
-    else if(strcmp(input, "history\n") == 0) {
+    else if(strcmp(input, "history\n") == 0 || strncmp(input, "history ", 8) == 0) {
         return HISTORY;
     }
+    else if(strcmp(input, "windows\n") == 0) {
+        return WINDOWS;
+    }
+    else if(strncmp(input, "range ", 6) == 0) {
+        return RANGE;
+    }
+    else if(strcmp(input, "timing\n") == 0) {
+        return TIMING;
+    }
+    else if(strcmp(input, "latency\n") == 0) {
+        return LATENCY;
+    }
+    else if(strncmp(input, "subscribe ", 10) == 0) {
+        return SUBSCRIBE;
+    }
+    else if(strncmp(input, "confirm ", 8) == 0) {
+        return CONFIRM;
+    }
+    else if(strcmp(input, "unsubscribe\n") == 0 || strncmp(input, "unsubscribe ", 12) == 0) {
+        return UNSUBSCRIBE;
+    }
     else if(strcmp(input, "stop\n") == 0) {
         return STOP;
     }
@@ -107,10 +280,10 @@ static enum Command checkCommand(char* input) {
     }
 }
 
-#define MAX_SAMPLE_SIZE 8
-static void sendReply(enum Command command, int socketDescriptor, struct sockaddr_in *sinRemote) {
-    char messageTx[MAX_LEN];
-    unsigned int sinLen;
+static void sendReply(enum Command command, char* input, Session_t *pSession, int socketDescriptor,
+    struct sockaddr_in *sinRemote)
+{
+    char *messageTx = getReplyBuffer(socketDescriptor);
 
     switch(command) {
         case COUNT:
@@ -124,35 +297,101 @@ static void sendReply(enum Command command, int socketDescriptor, struct sockadd
             break;
         case HISTORY:
             {
-                int length = 0;
-                int offset = 0;
-                double* history = Sampler_getHistory(&length);
-                for(int i=0; i<length; i++) {
-                    int written = snprintf(messageTx + offset, MAX_LEN - offset, "%.3f", history[i]);
-                    offset += written;
-
-                    if(i != length - 1) {
-                        written = snprintf(messageTx + offset, MAX_LEN - offset, ", ");
-                        offset += written;
-                    }
-
-                    if((i+1) % 10 == 0 || i == length - 1) {
-                        written = snprintf(messageTx + offset, MAX_LEN - offset, "\n");
-                        offset += written;
-                    }
-                    
-                    if(MAX_LEN - offset < MAX_SAMPLE_SIZE) {
-                        sinLen = sizeof(*sinRemote);
-                        sendto(socketDescriptor, messageTx, strlen(messageTx), 0,
-                            (struct sockaddr*) sinRemote, sinLen);
-
-                        memset(messageTx, 0, MAX_LEN);
-                        offset = 0;
+                int secondsAgo = 0;
+                if(sscanf(input, "history %d", &secondsAgo) == 1 && secondsAgo != 0) {
+                    int length = Sampler_copyRecentHistory(secondsAgo, recentHistory, Sampler_getMaxHistorySize(), NULL);
+                    if(length < 0) {
+                        snprintf(messageTx, MAX_LEN, "# No samples kept for %d seconds ago.\n", secondsAgo);
+                        break;
                     }
+                    int offset;
+                    messageTx = sendHistory(recentHistory, length, messageTx, &offset, socketDescriptor, sinRemote);
+                    queueReply(messageTx, offset, sinRemote);
+                    return;
+                }
+                int offset;
+                const HistorySnapshot_t *pHistory = Sampler_acquireHistory();
+                messageTx = sendHistory(pHistory->pSamples, pHistory->size, messageTx, &offset, socketDescriptor, sinRemote);
+                Sampler_releaseHistory(pHistory);
+                queueReply(messageTx, offset, sinRemote);
+            }
+            return;
+        case WINDOWS:
+            {
+                int offset = 0;
+                for(int i=0; i<Sampler_getNumAnalysisWindows(); i++) {
+                    WindowAnalyzer_result_t result;
+                    Sampler_getAnalysisWindow(i, &result);
+                    offset += snprintf(messageTx + offset, MAX_LEN - offset,
+                        "# %dms window (every %dms): samples %d, dips %d, min %.3fV, max %.3fV, avg %.3fV\n",
+                        result.config.lengthMs, result.config.hopMs, result.stats.count, result.stats.dips,
+                        Sampler_codeToVolts(result.stats.minCode), Sampler_codeToVolts(result.stats.maxCode),
+                        Sampler_codeToVolts(WindowKernel_getMean(&result.stats)));
+                }
+            }
+            break;
+        case RANGE:
+            {
+                long long fromSecondsAgo = 0;
+                long long toSecondsAgo = 0;
+                // Nothing is kept past the hour tier's span, and bounding the
+                // range to it keeps it from overflowing once scaled to ms
+                long long maxSecondsAgo = Sampler_getHistorySpanSeconds();
+                HistoryStore_range_t range;
+                if(sscanf(input, "range %lld %lld", &fromSecondsAgo, &toSecondsAgo) < 1
+                    || fromSecondsAgo <= toSecondsAgo || toSecondsAgo < 0) {
+                    snprintf(messageTx, MAX_LEN, "Usage: range <from seconds ago> [<to seconds ago>]\n");
+                }
+                else if(!Sampler_queryHistoryRange(
+                    (fromSecondsAgo < maxSecondsAgo ? fromSecondsAgo : maxSecondsAgo) * 1000,
+                    (toSecondsAgo < maxSecondsAgo ? toSecondsAgo : maxSecondsAgo) * 1000, &range)) {
+                    snprintf(messageTx, MAX_LEN, "# No history between %llds and %llds ago.\n",
+                        fromSecondsAgo, toSecondsAgo);
+                }
+                else {
+                    snprintf(messageTx, MAX_LEN,
+                        "# %llds to %llds ago (%.1fs covered): samples %d, dips %d, min %.3fV, max %.3fV, avg %.3fV\n",
+                        fromSecondsAgo, toSecondsAgo, range.coveredMs / 1000.0, range.stats.count, range.stats.dips,
+                        Sampler_codeToVolts(range.stats.minCode), Sampler_codeToVolts(range.stats.maxCode),
+                        Sampler_codeToVolts(WindowKernel_getMean(&range.stats)));
+                }
+            }
+            break;
+        case TIMING:
+            {
+                int offset = 0;
+                for(int i=0; i<NUM_PERIOD_EVENTS; i++) {
+                    Period_statistics_t stats;
+                    Statistics_getEventStats(i, &stats);
+                    offset += snprintf(messageTx + offset, MAX_LEN - offset,
+                        "# %s (last second): %d times, min %.3fms, avg %.3fms, max %.3fms, %d missed deadlines\n",
+                        Period_getEventName(i), stats.numSamples, stats.minPeriodInMs, stats.avgPeriodInMs,
+                        stats.maxPeriodInMs, stats.numMissedDeadlines);
+                }
+            }
+            break;
+        case LATENCY:
+            {
+                int offset = 0;
+                for(int i=0; i<NUM_PERIOD_EVENTS; i++) {
+                    Period_statistics_t stats;
+                    Statistics_getEventStats(i, &stats);
+                    offset += snprintf(messageTx + offset, MAX_LEN - offset,
+                        "# %s (last second, ms): p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f of %d\n",
+                        Period_getEventName(i), stats.p50PeriodInMs, stats.p90PeriodInMs, stats.p99PeriodInMs,
+                        stats.p999PeriodInMs, stats.maxPeriodInMs, stats.numSamples);
                 }
-                free(history);
             }
             break;
+        case SUBSCRIBE:
+            subscribe(input, pSession, messageTx);
+            break;
+        case CONFIRM:
+            confirm(input, pSession, messageTx);
+            break;
+        case UNSUBSCRIBE:
+            unsubscribe(input, pSession, messageTx);
+            break;
         case STOP:
             Shutdown_signalShutdown();
             return;
@@ -163,6 +402,15 @@ static void sendReply(enum Command command, int socketDescriptor, struct sockadd
                 "length \t -- get the number of samples taken in the previously completed second. \n"
                 "dips \t -- get the number of dips in the previously completed second. \n"
                 "history \t -- get all the samples in the previously completed second. \n"
+                "history <n> \t -- get all the samples from n seconds before that (last few seconds only). \n"
+                "windows \t -- get the statistics of each sliding analysis window. \n"
+                "range <from> [<to>] \t -- summarize the samples taken between <from> and <to> seconds ago. \n"
+                "timing \t -- get the period statistics of the sampling, network, display and LED loops. \n"
+                "latency \t -- get the p50/p90/p99/p99.9 periods and durations of the same. \n"
+                "subscribe windows \t -- be sent the statistics of each second as it completes. \n"
+                "subscribe samples [rate] \t -- be sent each second's samples, thinned to about rate per second. \n"
+                "confirm <code> \t -- start a subscription, echoing the code the server sent back. \n"
+                "unsubscribe [<topic>] \t -- stop being sent one (or every) topic. \n"
                 "stop \t -- cause the server program to end. \n"
                 "<enter> \t -- repeat last command.\n"); 
             break;
@@ -173,9 +421,322 @@ static void sendReply(enum Command command, int socketDescriptor, struct sockadd
             perror("Invalid command");
             exit(1);
     }
-    
-    sinLen = sizeof(*sinRemote);
-    sendto(socketDescriptor, messageTx, strlen(messageTx), 0, 
-        (struct sockaddr*) sinRemote, sinLen);
+
+    queueReply(messageTx, strlen(messageTx), sinRemote);
 }
 
+// Answer a binary request with packed samples or stats, fragmenting history
+// over as many datagrams as needed
+static void sendBinaryReply(const BinaryProtocol_request_t *pRequest, int socketDescriptor,
+    struct sockaddr_in *sinRemote)
+{
+    BinaryProtocol_header_t header = {
+        .version = BINARY_PROTOCOL_VERSION,
+        .type = BINARY_REPLY_ERROR,
+        .requestId = pRequest->requestId,
+        .fragmentIndex = 0,
+        .fragmentCount = 1,
+        .voltsPerCode = Sampler_codeToVolts(1),
+    };
+    const HistorySnapshot_t *pHistory = NULL;
+    const uint16_t *pSamples = NULL;
+    int numSamples = 0;
+
+    if(pRequest->type == BINARY_REQUEST_HISTORY && pRequest->argument == 0) {
+        pHistory = Sampler_acquireHistory();
+        header.type = BINARY_REPLY_HISTORY;
+        header.windowId = pHistory->epoch;
+        header.timestampMs = pHistory->endTimeMs;
+        pSamples = pHistory->pSamples;
+        numSamples = pHistory->size;
+    }
+    else if(pRequest->type == BINARY_REQUEST_HISTORY && pRequest->argument > 0) {
+        HistoryStore_summary_t second;
+        numSamples = Sampler_copyRecentHistory(pRequest->argument, recentHistory,
+            Sampler_getMaxHistorySize(), &second);
+        if(numSamples >= 0) {
+            header.type = BINARY_REPLY_HISTORY;
+            header.windowId = second.epoch;
+            header.timestampMs = second.endTimeMs;
+            pSamples = recentHistory;
+        }
+    }
+    else if(pRequest->type == BINARY_REQUEST_STATS) {
+        pHistory = Sampler_acquireHistory();
+        BinaryProtocol_stats_t stats = {
+            .count = pHistory->stats.count,
+            .dips = pHistory->stats.dips,
+            .droppedSamples = pHistory->droppedSamples,
+            .minCode = pHistory->stats.count > 0 ? pHistory->stats.minCode : 0,
+            .maxCode = pHistory->stats.count > 0 ? pHistory->stats.maxCode : 0,
+            .meanCode = WindowKernel_getMean(&pHistory->stats),
+            .varianceCode = WindowKernel_getVariance(&pHistory->stats),
+        };
+        header.type = BINARY_REPLY_STATS;
+        header.windowId = pHistory->epoch;
+        header.timestampMs = pHistory->endTimeMs;
+        Sampler_releaseHistory(pHistory);
+
+        char *messageTx = getReplyBuffer(socketDescriptor);
+        header.sequence = binarySequence++;
+        int length = BinaryProtocol_encodeStats(&header, &stats, (uint8_t*)messageTx, MAX_LEN);
+        queueReply(messageTx, length, sinRemote);
+        return;
+    }
+
+    if(header.type == BINARY_REPLY_ERROR) {
+        char *messageTx = getReplyBuffer(socketDescriptor);
+        header.sequence = binarySequence++;
+        int length = BinaryProtocol_encodeHeader(&header, (uint8_t*)messageTx, MAX_LEN);
+        queueReply(messageTx, length, sinRemote);
+        return;
+    }
+
+    header.fragmentCount = BinaryProtocol_getFragmentCount(numSamples, BINARY_PROTOCOL_MAX_DATAGRAM_SIZE);
+    for(int i=0; i<header.fragmentCount; i++) {
+        char *messageTx = getReplyBuffer(socketDescriptor);
+        header.fragmentIndex = i;
+        header.sequence = binarySequence++;
+        int length = BinaryProtocol_encodeHistory(&header, pSamples, numSamples, (uint8_t*)messageTx,
+            BINARY_PROTOCOL_MAX_DATAGRAM_SIZE);
+        queueReply(messageTx, length, sinRemote);
+    }
+    if(pHistory != NULL) {
+        Sampler_releaseHistory(pHistory);
+    }
+}
+
+// Subscriptions last as long as the session, so clients resubscribe at
+// least every SESSION_IDLE_TIMEOUT_MS. Nothing is pushed until the client
+// echoes the nonce sent back, so a spoofed source address can't turn one
+// small request into a stream of pushes at someone else.
+static void subscribe(char *input, Session_t *pSession, char *messageTx) {
+    char topic[16] = "";
+    int samplesPerSecond = 0;
+    int numParsed = sscanf(input, "subscribe %15s %d", topic, &samplesPerSecond);
+    unsigned int topicBit = parseTopic(topic);
+    if(topicBit == 0 || (numParsed == 2 && samplesPerSecond <= 0)) {
+        snprintf(messageTx, MAX_LEN, "Usage: subscribe windows | subscribe samples [<samples per second>]\n");
+        return;
+    }
+
+    if(getrandom(&pSession->confirmNonce, sizeof(pSession->confirmNonce), GRND_NONBLOCK)
+        != sizeof(pSession->confirmNonce))
+    {
+        snprintf(messageTx, MAX_LEN, "# Unable to subscribe now; try again.\n");
+        return;
+    }
+    pSession->pendingSubscriptions = topicBit;
+    pSession->pendingSamplesPerSecond = numParsed == 2 ? samplesPerSecond : 0;
+    snprintf(messageTx, MAX_LEN, "# To subscribe to %s, send: confirm %u\n", topic, pSession->confirmNonce);
+}
+
+static void confirm(char *input, Session_t *pSession, char *messageTx) {
+    unsigned int nonce;
+    if(pSession->pendingSubscriptions == 0 || sscanf(input, "confirm %u", &nonce) != 1
+        || nonce != pSession->confirmNonce)
+    {
+        snprintf(messageTx, MAX_LEN, "# Nothing to confirm; subscribe first and echo the code sent back.\n");
+        return;
+    }
+
+    pSession->subscriptions |= pSession->pendingSubscriptions;
+    if(pSession->pendingSubscriptions == TOPIC_SAMPLES) {
+        pSession->samplesPerSecond = pSession->pendingSamplesPerSecond;
+    }
+    snprintf(messageTx, MAX_LEN, "# Subscribed to %s.\n",
+        pSession->pendingSubscriptions == TOPIC_WINDOWS ? "windows" : "samples");
+    pSession->pendingSubscriptions = 0;
+}
+
+static void unsubscribe(char *input, Session_t *pSession, char *messageTx) {
+    char topic[16] = "";
+    if(sscanf(input, "unsubscribe %15s", topic) != 1) {
+        pSession->subscriptions = 0;
+        snprintf(messageTx, MAX_LEN, "# Unsubscribed from all topics.\n");
+        return;
+    }
+
+    unsigned int topicBit = parseTopic(topic);
+    if(topicBit == 0) {
+        snprintf(messageTx, MAX_LEN, "Usage: unsubscribe [windows | samples]\n");
+        return;
+    }
+    pSession->subscriptions &= ~topicBit;
+    snprintf(messageTx, MAX_LEN, "# Unsubscribed from %s.\n", topic);
+}
+
+static unsigned int parseTopic(const char *topic) {
+    if(strcmp(topic, "windows") == 0) {
+        return TOPIC_WINDOWS;
+    }
+    else if(strcmp(topic, "samples") == 0) {
+        return TOPIC_SAMPLES;
+    }
+    return 0;
+}
+
+// Send the second which just completed to its subscribers. Each topic (and
+// each sample rate) is encoded once and the same datagrams are queued to
+// every subscriber.
+static void pushWindow(int socketDescriptor) {
+    const HistorySnapshot_t *pHistory = Sampler_acquireHistory();
+
+    int summaryLength = -1;
+    for(Session_t *pSession = SessionTable_getFirst(&sessionTable); pSession != NULL;
+        pSession = SessionTable_getNext(&sessionTable, pSession))
+    {
+        if((pSession->subscriptions & TOPIC_WINDOWS) == 0) {
+            continue;
+        }
+        if(summaryLength < 0) {
+            summaryLength = snprintf(pushSummary, MAX_LEN,
+                "# window %llu: samples %d, dips %d, min %.3fV, max %.3fV, avg %.3fV\n",
+                pHistory->epoch, pHistory->stats.count, pHistory->stats.dips,
+                Sampler_codeToVolts(pHistory->stats.minCode), Sampler_codeToVolts(pHistory->stats.maxCode),
+                Sampler_codeToVolts(WindowKernel_getMean(&pHistory->stats)));
+        }
+        queuePush(socketDescriptor, pushSummary, summaryLength, &pSession->address);
+    }
+
+    // Subscribers share an encoding per decimation step, smallest step first.
+    // The encoded datagrams are reused, so each step is sent before the next.
+    int lastStep = 0;
+    while(true) {
+        int step = 0;
+        for(Session_t *pSession = SessionTable_getFirst(&sessionTable); pSession != NULL;
+            pSession = SessionTable_getNext(&sessionTable, pSession))
+        {
+            if((pSession->subscriptions & TOPIC_SAMPLES) == 0) {
+                continue;
+            }
+            int rate = pSession->samplesPerSecond;
+            int sessionStep = (rate > 0 && pHistory->size > rate) ? (pHistory->size + rate - 1) / rate : 1;
+            if(sessionStep > lastStep && (step == 0 || sessionStep < step)) {
+                step = sessionStep;
+            }
+        }
+        if(step == 0) {
+            break;
+        }
+
+        int numDatagrams = encodeSamples(pHistory->pSamples, pHistory->size, step);
+        for(Session_t *pSession = SessionTable_getFirst(&sessionTable); pSession != NULL;
+            pSession = SessionTable_getNext(&sessionTable, pSession))
+        {
+            int rate = pSession->samplesPerSecond;
+            int sessionStep = (rate > 0 && pHistory->size > rate) ? (pHistory->size + rate - 1) / rate : 1;
+            if((pSession->subscriptions & TOPIC_SAMPLES) == 0 || sessionStep != step) {
+                continue;
+            }
+            for(int i=0; i<numDatagrams; i++) {
+                queuePush(socketDescriptor, pushDatagrams[i], pushLengths[i], &pSession->address);
+            }
+        }
+        flushReplies(socketDescriptor);
+        lastStep = step;
+    }
+
+    flushReplies(socketDescriptor);
+    Sampler_releaseHistory(pHistory);
+}
+
+// Format every `step`th sample into pushDatagrams, split and laid out
+// exactly like a history reply. Returns the number of datagrams.
+static int encodeSamples(const uint16_t *history, int length, int step) {
+    int numSamples = 0;
+    for(int i=0; i<length; i+=step) {
+        decimatedHistory[numSamples++] = history[i];
+    }
+
+    int numDatagrams = 0;
+    int offset = 0;
+    for(int i=0; i<numSamples; i++) {
+        offset = HistoryText_appendSample(pushDatagrams[numDatagrams], offset, decimatedHistory, i, numSamples);
+        if(MAX_LEN - offset < HISTORY_TEXT_MAX_SAMPLE_SIZE) {
+            pushLengths[numDatagrams++] = offset;
+            offset = 0;
+        }
+    }
+    if(offset > 0 || numDatagrams == 0) {
+        pushLengths[numDatagrams++] = offset;
+    }
+    return numDatagrams;
+}
+
+// Format samples 10 per line straight into the datagram, queueing each one
+// as it fills. The last, partly filled datagram is returned (with its length
+// in `pOffset`) for the caller to queue.
+static char *sendHistory(const uint16_t *history, int length, char *messageTx, int *pOffset,
+    int socketDescriptor, struct sockaddr_in *sinRemote)
+{
+    int offset = 0;
+    for(int i=0; i<length; i++) {
+        offset = HistoryText_appendSample(messageTx, offset, history, i, length);
+        if(MAX_LEN - offset < HISTORY_TEXT_MAX_SAMPLE_SIZE) {
+            queueReply(messageTx, offset, sinRemote);
+            messageTx = getReplyBuffer(socketDescriptor);
+            offset = 0;
+        }
+    }
+    *pOffset = offset;
+    return messageTx;
+}
+
+// Next free reply buffer; sends the queued replies first if none are left
+static char *getReplyBuffer(int socketDescriptor) {
+    if(numReplies == REPLY_BATCH_SIZE) {
+        flushReplies(socketDescriptor);
+    }
+    return replyBuffers[numReplies];
+}
+
+// Queue the buffer last returned by getReplyBuffer()
+static void queueReply(char *messageTx, int length, struct sockaddr_in *sinRemote) {
+    replyAddresses[numReplies] = *sinRemote;
+    replyIovecs[numReplies].iov_base = messageTx;
+    replyIovecs[numReplies].iov_len = length;
+
+    struct msghdr *pHeader = &replyHeaders[numReplies].msg_hdr;
+    memset(pHeader, 0, sizeof(*pHeader));
+    pHeader->msg_name = &replyAddresses[numReplies];
+    pHeader->msg_namelen = sizeof(replyAddresses[numReplies]);
+    pHeader->msg_iov = &replyIovecs[numReplies];
+    pHeader->msg_iovlen = 1;
+    numReplies++;
+}
+
+// Queue a datagram which is not in a reply buffer (e.g. a shared push)
+static void queuePush(int socketDescriptor, char *messageTx, int length, struct sockaddr_in *sinRemote) {
+    if(numReplies == REPLY_BATCH_SIZE) {
+        flushReplies(socketDescriptor);
+    }
+    queueReply(messageTx, length, sinRemote);
+}
+
+static void flushReplies(int socketDescriptor) {
+    int numSent = 0;
+    while(numSent < numReplies) {
+        int result = sendmmsg(socketDescriptor, replyHeaders + numSent, numReplies - numSent, 0);
+        if(result == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            // Only the first reply failed; drop it and send the rest
+            Log_write(LOG_LEVEL_ERROR, "Failed to send reply: %s\n", strerror(errno));
+            result = 1;
+        }
+        numSent += result;
+    }
+    numReplies = 0;
+}
+
+static long long getTimeInMs(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    long long seconds = spec.tv_sec;
+    long long nanoSeconds = spec.tv_nsec;
+    long long milliSeconds = seconds * 1000
+                            + nanoSeconds / 1000000;
+    return milliSeconds;
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "sessionTable.h"
+
+static unsigned int hashAddress(const struct sockaddr_in *pAddress, int slotMask);
+static bool isSameAddress(const struct sockaddr_in *pA, const struct sockaddr_in *pB);
+static int findSlot(const SessionTable_t *pTable, const struct sockaddr_in *pAddress);
+static void removeSession(SessionTable_t *pTable, int slot);
+static void unlinkLru(SessionTable_t *pTable, int index);
+static void linkNewest(SessionTable_t *pTable, int index);
+
+void SessionTable_init(SessionTable_t *pTable, int maxSessions, long long idleTimeoutMs) {
+    // Keep the hash at most half full so probes stay short
+    int numSlots = 1;
+    while(numSlots < maxSessions * 2) {
+        numSlots *= 2;
+    }
+
+    pTable->pSessions = malloc(sizeof(pTable->pSessions[0]) * maxSessions);
+    pTable->pSlots = malloc(sizeof(pTable->pSlots[0]) * numSlots);
+    if(pTable->pSessions == NULL || pTable->pSlots == NULL) {
+        printf("ERROR: Unable to allocate session table of %d sessions\n", maxSessions);
+        exit(-1);
+    }
+    pTable->maxSessions = maxSessions;
+    pTable->numSessions = 0;
+    pTable->idleTimeoutMs = idleTimeoutMs;
+    pTable->slotMask = numSlots - 1;
+    for(int i=0; i<numSlots; i++) {
+        pTable->pSlots[i] = -1;
+    }
+
+    for(int i=0; i<maxSessions; i++) {
+        pTable->pSessions[i].older = (i + 1 < maxSessions) ? i + 1 : -1;
+    }
+    pTable->freeList = 0;
+    pTable->newest = -1;
+    pTable->oldest = -1;
+}
+
+void SessionTable_cleanup(SessionTable_t *pTable) {
+    free(pTable->pSessions);
+    free(pTable->pSlots);
+    pTable->pSessions = NULL;
+    pTable->pSlots = NULL;
+}
+
+Session_t *SessionTable_lookup(SessionTable_t *pTable, const struct sockaddr_in *pAddress,
+    long long nowMs, bool *pIsNew)
+{
+    int slot = findSlot(pTable, pAddress);
+    int index = pTable->pSlots[slot];
+
+    // An expired session is started over
+    if(index != -1 && nowMs - pTable->pSessions[index].lastSeenMs > pTable->idleTimeoutMs) {
+        removeSession(pTable, slot);
+        slot = findSlot(pTable, pAddress);
+        index = -1;
+    }
+
+    if(index != -1) {
+        Session_t *pSession = &pTable->pSessions[index];
+        pSession->lastSeenMs = nowMs;
+        unlinkLru(pTable, index);
+        linkNewest(pTable, index);
+        if(pIsNew != NULL) {
+            *pIsNew = false;
+        }
+        return pSession;
+    }
+
+    if(pTable->numSessions == pTable->maxSessions) {
+        removeSession(pTable, findSlot(pTable, &pTable->pSessions[pTable->oldest].address));
+        slot = findSlot(pTable, pAddress);
+    }
+
+    index = pTable->freeList;
+    pTable->freeList = pTable->pSessions[index].older;
+    pTable->pSlots[slot] = index;
+    pTable->numSessions++;
+
+    Session_t *pSession = &pTable->pSessions[index];
+    memset(pSession, 0, sizeof(*pSession));
+    pSession->address = *pAddress;
+    pSession->firstSeenMs = nowMs;
+    pSession->lastSeenMs = nowMs;
+    pSession->lastCommand = -1;
+    pSession->requestTokens = -1;
+    linkNewest(pTable, index);
+    if(pIsNew != NULL) {
+        *pIsNew = true;
+    }
+    return pSession;
+}
+
+void SessionTable_expireIdle(SessionTable_t *pTable, long long nowMs) {
+    while(pTable->oldest != -1
+        && nowMs - pTable->pSessions[pTable->oldest].lastSeenMs > pTable->idleTimeoutMs)
+    {
+        removeSession(pTable, findSlot(pTable, &pTable->pSessions[pTable->oldest].address));
+    }
+}
+
+bool SessionTable_takeRequestToken(Session_t *pSession, long long nowMs, int perSecond, int burst) {
+    // A new session starts with a full bucket
+    if(pSession->requestTokens < 0) {
+        pSession->requestTokens = burst;
+        pSession->tokensRefilledMs = nowMs;
+    }
+
+    long long refill = (nowMs - pSession->tokensRefilledMs) * perSecond / 1000;
+    if(pSession->requestTokens + refill >= burst) {
+        pSession->requestTokens = burst;
+        pSession->tokensRefilledMs = nowMs;
+    }
+    else if(refill > 0) {
+        // Only advance by the whole tokens added, keeping the remainder
+        pSession->requestTokens += refill;
+        pSession->tokensRefilledMs += refill * 1000 / perSecond;
+    }
+
+    if(pSession->requestTokens == 0) {
+        pSession->numDroppedRequests++;
+        return false;
+    }
+    pSession->requestTokens--;
+    return true;
+}
+
+int SessionTable_getNumSessions(const SessionTable_t *pTable) {
+    return pTable->numSessions;
+}
+
+Session_t *SessionTable_getFirst(SessionTable_t *pTable) {
+    return pTable->newest != -1 ? &pTable->pSessions[pTable->newest] : NULL;
+}
+
+Session_t *SessionTable_getNext(SessionTable_t *pTable, const Session_t *pSession) {
+    return pSession->older != -1 ? &pTable->pSessions[pSession->older] : NULL;
+}
+
+static unsigned int hashAddress(const struct sockaddr_in *pAddress, int slotMask) {
+    uint64_t key = ((uint64_t)pAddress->sin_addr.s_addr << 16) | pAddress->sin_port;
+    return (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 32) & slotMask;
+}
+
+static bool isSameAddress(const struct sockaddr_in *pA, const struct sockaddr_in *pB) {
+    return pA->sin_addr.s_addr == pB->sin_addr.s_addr && pA->sin_port == pB->sin_port;
+}
+
+// Slot holding the address, or the empty slot where it would go
+static int findSlot(const SessionTable_t *pTable, const struct sockaddr_in *pAddress) {
+    int slot = hashAddress(pAddress, pTable->slotMask);
+    while(pTable->pSlots[slot] != -1
+        && !isSameAddress(&pTable->pSessions[pTable->pSlots[slot]].address, pAddress))
+    {
+        slot = (slot + 1) & pTable->slotMask;
+    }
+    return slot;
+}
+
+static void removeSession(SessionTable_t *pTable, int slot) {
+    int index = pTable->pSlots[slot];
+    unlinkLru(pTable, index);
+    pTable->pSessions[index].older = pTable->freeList;
+    pTable->freeList = index;
+    pTable->numSessions--;
+
+    // Shift later members of the probe run back so no lookup stops early
+    int hole = slot;
+    int next = (slot + 1) & pTable->slotMask;
+    while(pTable->pSlots[next] != -1) {
+        int home = hashAddress(&pTable->pSessions[pTable->pSlots[next]].address, pTable->slotMask);
+        if(((next - home) & pTable->slotMask) >= ((next - hole) & pTable->slotMask)) {
+            pTable->pSlots[hole] = pTable->pSlots[next];
+            hole = next;
+        }
+        next = (next + 1) & pTable->slotMask;
+    }
+    pTable->pSlots[hole] = -1;
+}
+
+static void unlinkLru(SessionTable_t *pTable, int index) {
+    Session_t *pSession = &pTable->pSessions[index];
+    if(pSession->newer != -1) {
+        pTable->pSessions[pSession->newer].older = pSession->older;
+    }
+    else {
+        pTable->newest = pSession->older;
+    }
+    if(pSession->older != -1) {
+        pTable->pSessions[pSession->older].newer = pSession->newer;
+    }
+    else {
+        pTable->oldest = pSession->newer;
+    }
+}
+
+static void linkNewest(SessionTable_t *pTable, int index) {
+    Session_t *pSession = &pTable->pSessions[index];
+    pSession->newer = -1;
+    pSession->older = pTable->newest;
+    if(pTable->newest != -1) {
+        pTable->pSessions[pTable->newest].newer = index;
+    }
+    else {
+        pTable->oldest = index;
+    }
+    pTable->newest = index;
+}
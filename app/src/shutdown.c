@@ -1,22 +1,52 @@
-#include <pthread.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "shutdown.h"
 
-static pthread_mutex_t lock;
-static bool timeToShutdown = false;
+static void onSignal(int signalNumber);
+
+static _Atomic bool timeToShutdown = false;
+static int shutdownEventDescriptor = -1;
 
 void Shutdown_init(void) {
-    pthread_mutex_init(&lock, NULL);
-    pthread_mutex_lock(&lock);
+    timeToShutdown = false;
+    shutdownEventDescriptor = eventfd(0, EFD_CLOEXEC);
+    if(shutdownEventDescriptor == -1) {
+        printf("ERROR: Unable to create shutdown event (%s)\n", strerror(errno));
+        exit(-1);
+    }
+
+    // A second signal gets the default action, so a stuck shutdown can
+    // still be interrupted
+    struct sigaction action = {0};
+    action.sa_handler = onSignal;
+    action.sa_flags = SA_RESTART | SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
 }
 
 void Shutdown_cleanup(void) {
-    pthread_mutex_destroy(&lock);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    close(shutdownEventDescriptor);
+    shutdownEventDescriptor = -1;
 }
 
+// Only async-signal-safe calls, so signal handlers may use it too
 void Shutdown_signalShutdown(void) {
-    pthread_mutex_unlock(&lock);
     timeToShutdown = true;
+    uint64_t one = 1;
+    ssize_t result = write(shutdownEventDescriptor, &one, sizeof(one));
+    (void)result;
 }
 
 bool Shutdown_isShutdown(void) {
@@ -24,6 +54,17 @@ bool Shutdown_isShutdown(void) {
 }
 
 void Shutdown_waitForShutdown(void) {
-    pthread_mutex_lock(&lock);
-    pthread_mutex_unlock(&lock);
-}
\ No newline at end of file
+    // The event is never read, so it stays readable once signalled
+    struct pollfd pollDesc = {.fd = shutdownEventDescriptor, .events = POLLIN};
+    while(!timeToShutdown) {
+        if(poll(&pollDesc, 1, -1) == -1 && errno != EINTR) {
+            printf("ERROR: Unable to wait for shutdown (%s)\n", strerror(errno));
+            exit(-1);
+        }
+    }
+}
+
+static void onSignal(int signalNumber) {
+    (void)signalNumber;
+    Shutdown_signalShutdown();
+}
@@ -6,61 +6,86 @@
 #include "statistics.h"
 #include "hal/sampler.h"
 #include "hal/led.h"
+#include "hal/log.h"
+#include "hal/reactor.h"
 
-static void *printingLoop(void *arg);
+static void report(void *pContext);
+static void collectEventStats(void);
 static void printStatistics(void);
-static void sleepForMs(long long delayInMs);
 
-static _Atomic bool isRunning;
-static pthread_t printingThread;
+#define REPORT_PERIOD_NS 1000000000LL
+
+static pthread_mutex_t eventStatsLock;
+static Period_statistics_t eventStats[NUM_PERIOD_EVENTS];
 
 void Statistics_init(void) {
-    isRunning = true;
-    pthread_create(&printingThread, NULL, printingLoop, NULL);
+    pthread_mutex_init(&eventStatsLock, NULL);
+    Reactor_addTask(REPORT_PERIOD_NS, report, NULL);
 }
 
 void Statistics_cleanup(void) {
-    isRunning = false;
-    pthread_join(printingThread, NULL);
+    pthread_mutex_destroy(&eventStatsLock);
+}
+
+void Statistics_getEventStats(enum Period_whichEvent whichEvent, Period_statistics_t *pStats) {
+    if(whichEvent == PERIOD_EVENT_SAMPLE_LIGHT) {
+        *pStats = Sampler_getHistoryStats();
+        return;
+    }
+    pthread_mutex_lock(&eventStatsLock);
+    *pStats = eventStats[whichEvent];
+    pthread_mutex_unlock(&eventStatsLock);
 }
 
-static void *printingLoop(void *arg) {
-    (void)arg;
-    while(isRunning) {
-        sleepForMs(1000);
-        printStatistics();
+// Reactor task, once a second
+static void report(void *pContext) {
+    (void)pContext;
+    collectEventStats();
+    printStatistics();
+}
+
+// Gather (and restart) every event's statistics but the sampler's
+static void collectEventStats(void) {
+    Period_statistics_t collected[NUM_PERIOD_EVENTS];
+    for(int i=0; i<NUM_PERIOD_EVENTS; i++) {
+        if(i != PERIOD_EVENT_SAMPLE_LIGHT) {
+            Period_getStatisticsAndClear(i, &collected[i]);
+        }
     }
-    return NULL;
+    pthread_mutex_lock(&eventStatsLock);
+    for(int i=0; i<NUM_PERIOD_EVENTS; i++) {
+        if(i != PERIOD_EVENT_SAMPLE_LIGHT) {
+            eventStats[i] = collected[i];
+        }
+    }
+    pthread_mutex_unlock(&eventStatsLock);
 }
 
 static void printStatistics(void) {
     int samples = Sampler_getHistorySize();
     double avgSample = Sampler_getAverageReading();
     int dips = Sampler_getDips();
-    int historySize = 0;
     int potValue = Led_getPOTValue();
-    double* history = Sampler_getHistory(&historySize);
+    const HistorySnapshot_t *pHistory = Sampler_acquireHistory();
+    int historySize = pHistory->size;
+    const uint16_t* history = pHistory->pSamples;
     Period_statistics_t stats = Sampler_getHistoryStats();
-    printf("#Smpl/s = %d \tPOT @ %d => %dHz \tavg = %1.3fV \tdips = %d\t Smpl ms[ %1.3f, %1.3f] avg %1.3f/%d\n",
+    Log_write(LOG_LEVEL_INFO, "#Smpl/s = %d \tPOT @ %d => %dHz \tavg = %1.3fV \tdips = %d\t Smpl ms[ %1.3f, %1.3f] avg %1.3f/%d"
+        " p50/90/99/99.9 %1.3f/%1.3f/%1.3f/%1.3f\n",
         samples, potValue, potValue/40, avgSample, dips, 
-        stats.minPeriodInMs, stats.maxPeriodInMs, stats.avgPeriodInMs, stats.numSamples);
+        stats.minPeriodInMs, stats.maxPeriodInMs, stats.avgPeriodInMs, stats.numSamples,
+        stats.p50PeriodInMs, stats.p90PeriodInMs, stats.p99PeriodInMs, stats.p999PeriodInMs);
 
+    // Formatted into one message, so it is written out in one piece
+    char samplesText[LOG_MAX_MESSAGE_LEN];
+    int offset = 0;
     int currentSample = 0;
     int increment = historySize / 10 == 0 ? 1 : historySize / 10;
-    while(currentSample < historySize) {
-        printf("  %d:%1.3f  ", currentSample, history[currentSample]);
+    while(currentSample < historySize && offset < LOG_MAX_MESSAGE_LEN) {
+        offset += snprintf(samplesText + offset, LOG_MAX_MESSAGE_LEN - offset, "  %d:%1.3f  ",
+            currentSample, Sampler_codeToVolts(history[currentSample]));
         currentSample += increment;
     }
-    free(history);
-    printf("\n");
+    Sampler_releaseHistory(pHistory);
+    Log_write(LOG_LEVEL_INFO, "%s\n", offset > 0 ? samplesText : "");
 }
-
-static void sleepForMs(long long delayInMs) {
-    const long long NS_PER_MS = 1000 * 1000;
-    const long long NS_PER_SECOND = 1000000000;
-    long long delayNs = delayInMs * NS_PER_MS;
-    int seconds = delayNs / NS_PER_SECOND;
-    int nanoseconds = delayNs % NS_PER_SECOND;
-    struct timespec reqDelay = {seconds, nanoseconds};
-    nanosleep(&reqDelay, (struct timespec *) NULL);
-}
\ No newline at end of file
@@ -0,0 +1,42 @@
+// Binary Client module
+// Client side of the binary protocol (see binaryProtocol.h): sends one
+// request to the server and gathers the datagrams of its reply. Used by the
+// light_client command-line tool and the protocol benchmark.
+// Not thread safe: one request at a time.
+
+#ifndef _BINARY_CLIENT_H_
+#define _BINARY_CLIENT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "binaryProtocol.h"
+
+// How long to wait for each reply datagram
+#define BINARY_CLIENT_TIMEOUT_MS 1000
+
+typedef struct {
+    // Of the first datagram received
+    BinaryProtocol_header_t header;
+    int numSamples;
+    int numLostFragments;
+
+    // On the wire, payloads only
+    int numDatagrams;
+    int numBytes;
+} BinaryClient_reply_t;
+
+// Open a UDP socket connected to the server; exits on failure
+int BinaryClient_open(const char *host, int port);
+
+// Fetch the samples of the second `secondsAgo` before the last complete
+// one into `pDest`. Returns false if the server has no such second or did
+// not answer. Samples of lost fragments are left as they were; see
+// `pReply->numLostFragments`.
+bool BinaryClient_getHistory(int socketDescriptor, int secondsAgo, uint16_t *pDest, int maxSamples,
+    BinaryClient_reply_t *pReply);
+
+// Fetch the statistics of the last complete second
+bool BinaryClient_getStats(int socketDescriptor, BinaryProtocol_stats_t *pStats, BinaryClient_reply_t *pReply);
+
+#endif
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "binaryClient.h"
+
+// Fragments of one reply seen so far
+static bool isFragmentReceived[UINT16_MAX + 1];
+static uint32_t nextRequestId = 1;
+
+static bool sendRequest(int socketDescriptor, uint8_t type, int argument, uint32_t *pRequestId);
+static int receiveReply(int socketDescriptor, uint32_t requestId, uint8_t *pBuffer, BinaryProtocol_header_t *pHeader);
+
+int BinaryClient_open(const char *host, int port) {
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if(inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+        printf("ERROR: Not an IPv4 address: %s\n", host);
+        exit(-1);
+    }
+
+    int socketDescriptor = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(socketDescriptor == -1 || connect(socketDescriptor, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        perror("ERROR: Unable to open client socket");
+        exit(-1);
+    }
+    return socketDescriptor;
+}
+
+bool BinaryClient_getHistory(int socketDescriptor, int secondsAgo, uint16_t *pDest, int maxSamples,
+    BinaryClient_reply_t *pReply)
+{
+    memset(pReply, 0, sizeof(*pReply));
+    uint32_t requestId;
+    if(!sendRequest(socketDescriptor, BINARY_REQUEST_HISTORY, secondsAgo, &requestId)) {
+        return false;
+    }
+
+    const int samplesPerFragment = BinaryProtocol_getSamplesPerFragment(BINARY_PROTOCOL_MAX_DATAGRAM_SIZE);
+    int numFragments = 0;
+    int fragmentCount = 1;
+    while(numFragments < fragmentCount) {
+        uint8_t buffer[BINARY_PROTOCOL_MAX_DATAGRAM_SIZE];
+        BinaryProtocol_header_t header;
+        int length = receiveReply(socketDescriptor, requestId, buffer, &header);
+        if(length < 0) {
+            break;
+        }
+        pReply->numDatagrams++;
+        pReply->numBytes += length;
+        if(header.type == BINARY_REPLY_ERROR) {
+            pReply->header = header;
+            return false;
+        }
+        if(!BinaryProtocol_decodeHistory(buffer, length, BINARY_PROTOCOL_MAX_DATAGRAM_SIZE, &header,
+            pDest, maxSamples))
+        {
+            continue;
+        }
+
+        if(numFragments == 0) {
+            pReply->header = header;
+            fragmentCount = header.fragmentCount;
+            memset(isFragmentReceived, 0, sizeof(isFragmentReceived[0]) * fragmentCount);
+        }
+        if(header.fragmentIndex >= fragmentCount || isFragmentReceived[header.fragmentIndex]) {
+            continue;
+        }
+        isFragmentReceived[header.fragmentIndex] = true;
+        numFragments++;
+        int end = header.fragmentIndex * samplesPerFragment + header.numItems;
+        pReply->numSamples = end > pReply->numSamples ? end : pReply->numSamples;
+    }
+
+    pReply->numLostFragments = fragmentCount - numFragments;
+    return numFragments > 0;
+}
+
+bool BinaryClient_getStats(int socketDescriptor, BinaryProtocol_stats_t *pStats, BinaryClient_reply_t *pReply) {
+    memset(pReply, 0, sizeof(*pReply));
+    uint32_t requestId;
+    if(!sendRequest(socketDescriptor, BINARY_REQUEST_STATS, 0, &requestId)) {
+        return false;
+    }
+
+    uint8_t buffer[BINARY_PROTOCOL_MAX_DATAGRAM_SIZE];
+    int length = receiveReply(socketDescriptor, requestId, buffer, &pReply->header);
+    if(length < 0) {
+        pReply->numLostFragments = 1;
+        return false;
+    }
+    pReply->numDatagrams = 1;
+    pReply->numBytes = length;
+    return BinaryProtocol_decodeStats(buffer, length, &pReply->header, pStats);
+}
+
+static bool sendRequest(int socketDescriptor, uint8_t type, int argument, uint32_t *pRequestId) {
+    BinaryProtocol_request_t request = {
+        .version = BINARY_PROTOCOL_VERSION,
+        .type = type,
+        .requestId = nextRequestId++,
+        .argument = argument,
+    };
+    uint8_t buffer[BINARY_REQUEST_SIZE];
+    int length = BinaryProtocol_encodeRequest(&request, buffer, sizeof(buffer));
+    *pRequestId = request.requestId;
+    return send(socketDescriptor, buffer, length, 0) == length;
+}
+
+// Next datagram answering `requestId` (stale replies to earlier requests
+// are skipped); returns its length, or -1 on timeout
+static int receiveReply(int socketDescriptor, uint32_t requestId, uint8_t *pBuffer, BinaryProtocol_header_t *pHeader) {
+    while(true) {
+        struct pollfd pollDesc = {.fd = socketDescriptor, .events = POLLIN};
+        if(poll(&pollDesc, 1, BINARY_CLIENT_TIMEOUT_MS) != 1) {
+            return -1;
+        }
+        int length = recv(socketDescriptor, pBuffer, BINARY_PROTOCOL_MAX_DATAGRAM_SIZE, 0);
+        if(length > 0 && BinaryProtocol_decodeHeader(pBuffer, length, pHeader) && pHeader->requestId == requestId) {
+            return length;
+        }
+    }
+}
@@ -0,0 +1,87 @@
+// Command-line client for the binary protocol
+// Fetches a second of samples, or its statistics, from a running
+// light_sampler and prints them as the text commands would.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "binaryClient.h"
+
+#define DEFAULT_HOST "127.0.0.1"
+#define DEFAULT_PORT 12345
+#define MAX_SAMPLES (1 << 20)
+
+static void printUsage(const char *program) {
+    printf("Usage: %s [--host=<ip>] [--port=<port>] history [<seconds ago>] | stats\n", program);
+}
+
+static int printHistory(int socketDescriptor, int secondsAgo) {
+    static uint16_t samples[MAX_SAMPLES];
+    BinaryClient_reply_t reply;
+    if (!BinaryClient_getHistory(socketDescriptor, secondsAgo, samples, MAX_SAMPLES, &reply)) {
+        printf(reply.numDatagrams > 0 ? "# No samples kept for %d seconds ago.\n" : "# No reply.\n", secondsAgo);
+        return 1;
+    }
+
+    printf("# window %llu ending at %lldms: %d samples", (unsigned long long)reply.header.windowId,
+        (long long)reply.header.timestampMs, reply.numSamples);
+    if (reply.numLostFragments > 0) {
+        printf(" (%d of %d datagrams lost)", reply.numLostFragments, reply.header.fragmentCount);
+    }
+    printf("\n");
+    for (int i = 0; i < reply.numSamples; i++) {
+        printf("%.3f%s", samples[i] * reply.header.voltsPerCode,
+            i == reply.numSamples - 1 ? "\n" : ((i + 1) % 10 == 0 ? ", \n" : ", "));
+    }
+    return reply.numLostFragments > 0 ? 1 : 0;
+}
+
+static int printStats(int socketDescriptor) {
+    BinaryProtocol_stats_t stats;
+    BinaryClient_reply_t reply;
+    if (!BinaryClient_getStats(socketDescriptor, &stats, &reply)) {
+        printf("# No reply.\n");
+        return 1;
+    }
+    float voltsPerCode = reply.header.voltsPerCode;
+    printf("# window %llu ending at %lldms: samples %u, dropped %u, dips %u, "
+        "min %.3fV, max %.3fV, avg %.3fV, stddev %.3fV\n",
+        (unsigned long long)reply.header.windowId, (long long)reply.header.timestampMs, stats.count,
+        stats.droppedSamples, stats.dips, stats.minCode * voltsPerCode, stats.maxCode * voltsPerCode,
+        stats.meanCode * voltsPerCode, sqrtf(stats.varianceCode) * voltsPerCode);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = DEFAULT_HOST;
+    int port = DEFAULT_PORT;
+    int first = 1;
+    for (; first < argc && strncmp(argv[first], "--", 2) == 0; first++) {
+        if (strncmp(argv[first], "--host=", 7) == 0) {
+            host = argv[first] + 7;
+        }
+        else if (strncmp(argv[first], "--port=", 7) == 0) {
+            port = atoi(argv[first] + 7);
+        }
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (first >= argc) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    int socketDescriptor = BinaryClient_open(host, port);
+    if (strcmp(argv[first], "history") == 0 && argc - first <= 2) {
+        return printHistory(socketDescriptor, argc - first == 2 ? atoi(argv[first + 1]) : 0);
+    }
+    else if (strcmp(argv[first], "stats") == 0 && argc - first == 1) {
+        return printStats(socketDescriptor);
+    }
+    printUsage(argv[0]);
+    return 1;
+}
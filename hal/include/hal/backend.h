@@ -0,0 +1,64 @@
+// Backend module
+// Part of the Hardware Abstraction Layer (HAL)
+// Every touch of the board goes through the current backend: A2D reads,
+// PWM and GPIO value writes, I2C register writes and pin configuration.
+//
+//  - hardware (the default): the BeagleBone's sysfs, /dev/bone/pwm and
+//    /dev/i2c-1, with config-pin run through the shell.
+//  - simulated: A2D samples come from a synthetic waveform or a recorded
+//    trace at any rate, and writes land in memory (see
+//    hal/simulatedBackend.h), so the whole program runs, and can be load
+//    tested and profiled, on a Linux workstation.
+//
+// Choose the backend before any other module is initialized.
+
+#ifndef _BACKEND_H_
+#define _BACKEND_H_
+
+#include <stdbool.h>
+
+#include "hal/sampleSource.h"
+#include "hal/simulatedBackend.h"
+
+enum Backend_adcMode {
+    // One conversion per read(), paced by the caller
+    BACKEND_ADC_POLLED,
+    // Conversions at the A2D's own rate, read in bulk
+    BACKEND_ADC_BUFFERED
+};
+
+void Backend_useHardware(void);
+void Backend_useSimulation(const SimulatedBackend_config_t *pConfig);
+bool Backend_isSimulated(void);
+
+#define BACKEND_DEFAULT_IIO_DIRECTORY "/sys/bus/iio/devices/iio:device0"
+#define BACKEND_DEFAULT_IIO_DEVICE "/dev/iio:device0"
+#define BACKEND_DEFAULT_IIO_BUFFER_LENGTH 1024
+
+// The hardware A2D: its sysfs directory (which holds in_voltageN_raw), its
+// character device for buffered reads, and the kernel buffer length in
+// scans. Call before opening any A2D source.
+void Backend_setIioDevice(char *directory, char *devicePath, int bufferLength);
+
+// Run a pin/board configuration command (e.g. "config-pin p9.21 pwm").
+// Exits if it fails on hardware; ignored when simulated.
+void Backend_runCommand(char *command);
+
+// Open A2D `channel` as a sample source. `maxSamplesPerSecond` bounds the
+// polled rate, or sets the buffered capture's expected rate.
+void Backend_openAdcSource(SampleSource_t *pSource, enum Backend_adcMode mode, int channel,
+    int maxSamplesPerSecond);
+
+// Small value files (PWM period/duty/enable, GPIO values) kept open and
+// rewritten in place. Opening exits on failure; writing returns false.
+int Backend_openOutput(char *path);
+bool Backend_writeOutput(int output, const char *content, int length);
+void Backend_closeOutput(int output);
+
+// An I2C device; each write sets `count` (register, value) pairs in one
+// transaction.
+int Backend_openI2c(char *bus, int address);
+bool Backend_writeI2cRegisters(int i2c, const unsigned char (*pRegisterValues)[2], int count);
+void Backend_closeI2c(int i2c);
+
+#endif
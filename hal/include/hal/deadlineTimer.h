@@ -0,0 +1,35 @@
+// Deadline Timer module
+// Part of the Hardware Abstraction Layer (HAL)
+// Drift-free periodic wakeups on CLOCK_MONOTONIC.
+//
+// Each wait sleeps until an absolute deadline (clock_nanosleep with
+// TIMER_ABSTIME) and the next deadline is the previous one plus the period,
+// so the time spent working between waits and any wakeup latency do not
+// accumulate. If the caller falls more than a period behind, the missed
+// deadlines are skipped (and counted) rather than run back to back.
+
+#ifndef _DEADLINE_TIMER_H_
+#define _DEADLINE_TIMER_H_
+
+#include <time.h>
+
+typedef struct {
+    long long periodNs;
+    long long nextDeadlineNs;
+} DeadlineTimer_t;
+
+// Start a timer whose first deadline is one period from now.
+void DeadlineTimer_start(DeadlineTimer_t *pTimer, long long periodNs);
+
+// Sleep until the next deadline. Returns the number of deadlines which
+// were already missed and skipped (0 when on time).
+int DeadlineTimer_wait(DeadlineTimer_t *pTimer);
+
+// As DeadlineTimer_wait(), but give up as soon as `eventDescriptor` is
+// readable (e.g. a stop event), returning -1 with the deadline still due.
+int DeadlineTimer_waitUnless(DeadlineTimer_t *pTimer, int eventDescriptor);
+
+// Current CLOCK_MONOTONIC time.
+long long DeadlineTimer_getTimeInNs(void);
+
+#endif
@@ -5,7 +5,36 @@
 #ifndef _FILE_H_
 #define _FILE_H_
 
+#include <stdbool.h>
+
 void File_writeToFile(char* filename, char* content);
 void File_readFromFile(char* filename, char* buff);
 
-#endif
\ No newline at end of file
+// Persistent reader for small files (such as sysfs attributes) which are
+// read over and over again. The file is opened once and each read re-reads
+// it from offset 0 with pread(), avoiding the fopen/fgets/fclose per read.
+typedef struct {
+    int fd;
+} File_reader_t;
+
+void File_openReader(File_reader_t *pReader, char* filename);
+void File_closeReader(File_reader_t *pReader);
+
+// Re-read the file from the start and parse its leading non-negative integer
+// (e.g. "4095\n"). Parsing is done by hand; no strtod/atoi.
+int File_readInt(File_reader_t *pReader);
+
+// Persistent writer for small files (such as GPIO values) which are written
+// over and over again: opened once, each write is a single pwrite() at
+// offset 0 instead of fopen/fprintf/fclose.
+typedef struct {
+    int fd;
+} File_writer_t;
+
+void File_openWriter(File_writer_t *pWriter, char* filename);
+void File_closeWriter(File_writer_t *pWriter);
+
+// Returns false (leaving the old value in place) if the write failed
+bool File_write(File_writer_t *pWriter, const char* content, int length);
+
+#endif
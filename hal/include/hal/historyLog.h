@@ -0,0 +1,76 @@
+// History Log module
+// Part of the Hardware Abstraction Layer (HAL)
+// Crash-safe on-disk ring of window summaries (and optionally their raw
+// samples), so history survives a restart.
+//
+// The file is a header followed by a fixed number of fixed-size slots and
+// is memory mapped. Appending copies the record into the next slot (a
+// memcpy into the page cache, no system call) and a background thread
+// msyncs the mapping once a second, so the sampling thread never waits on
+// the disk. Every record carries a sequence number and a CRC-32: after a
+// crash or power loss, torn and stale slots fail the check and are skipped,
+// and recovery returns the surviving records oldest first.
+//
+// Times are kept on the wall clock in the file and converted to and from
+// CLOCK_MONOTONIC of the current boot. Records are in host byte order; the
+// file is not meant to be moved between machines.
+
+#ifndef _HISTORY_LOG_H_
+#define _HISTORY_LOG_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hal/windowKernel.h"
+#include "hal/periodTimer.h"
+
+typedef struct {
+    // CLOCK_MONOTONIC
+    long long startTimeMs;
+    long long endTimeMs;
+    WindowKernel_stats_t stats;
+    Period_statistics_t periodStats;
+    int numRawSamples;
+} HistoryLog_entry_t;
+
+typedef struct {
+    int fd;
+    unsigned char *pMapping;
+    long long mappingBytes;
+    int numSlots;
+    int slotBytes;
+    int maxRawSamples;
+
+    // Producer-owned: the next sequence number (1 based) to write
+    unsigned long long nextSequence;
+
+    pthread_t flushThread;
+    pthread_mutex_t flushLock;
+    pthread_cond_t flushCondition;
+    bool isFlushing;
+    _Atomic unsigned long long writtenSequence;
+} HistoryLog_t;
+
+// Open (creating if needed) a log of `numSlots` windows, each with room for
+// `maxRawSamples` raw codes (0 for summaries only). A file of a different
+// geometry, or which is not a history log, is started afresh. Exits if the
+// file cannot be created or mapped.
+void HistoryLog_open(HistoryLog_t *pLog, char *path, int numSlots, int maxRawSamples);
+
+// Flush and unmap.
+void HistoryLog_close(HistoryLog_t *pLog);
+
+// Call `onEntry` for every intact record, oldest first. `pRaw` points at the
+// record's raw codes inside the mapping (NULL if none), and stays valid
+// until the next append. Returns the number of records recovered. Call
+// before the first append.
+int HistoryLog_recover(HistoryLog_t *pLog,
+    void (*onEntry)(const HistoryLog_entry_t *pEntry, const uint16_t *pRaw, void *pContext), void *pContext);
+
+// Producer only: append a window, with its raw codes given as up to two
+// spans (see SampleRing_getSpans()); codes beyond maxRawSamples are not kept.
+void HistoryLog_append(HistoryLog_t *pLog, const HistoryLog_entry_t *pEntry,
+    const uint16_t *pSpans[], const int spanSizes[], int numSpans);
+
+#endif
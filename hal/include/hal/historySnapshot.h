@@ -0,0 +1,60 @@
+// History Snapshot module
+// Part of the Hardware Abstraction Layer (HAL)
+// Small pool of recycled, reference-counted, read-only copies of a completed
+// sample window.
+//
+// The producer claims a free buffer, fills it and publishes it as the
+// current snapshot. Readers acquire the current snapshot (bumping its
+// reference count), read it in place and release it. A buffer is reused
+// only once it is no longer current and every reader has released it, so
+// readers never copy or allocate and never block the producer.
+
+#ifndef _HISTORY_SNAPSHOT_H_
+#define _HISTORY_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include "hal/windowKernel.h"
+
+typedef struct {
+    // Window metadata
+    unsigned long long epoch;
+    // Monotonic time the window closed
+    long long endTimeMs;
+    int size;
+    int droppedSamples;
+    // Min/max/mean/variance and dips of the window
+    WindowKernel_stats_t stats;
+
+    // Raw A2D codes; see Sampler_codeToVolts()
+    uint16_t *pSamples;
+
+    // Owned by the pool
+    _Atomic int refCount;
+    int capacity;
+} HistorySnapshot_t;
+
+typedef struct {
+    HistorySnapshot_t *pSnapshots;
+    int numSnapshots;
+    HistorySnapshot_t *_Atomic pCurrent;
+    _Atomic long long skippedPublishes;
+} HistorySnapshot_pool_t;
+
+// Allocate `numSnapshots` buffers of `capacity` samples. An empty snapshot
+// (epoch 0) is published so acquiring never fails.
+void HistorySnapshot_initPool(HistorySnapshot_pool_t *pPool, int numSnapshots, int capacity);
+void HistorySnapshot_cleanupPool(HistorySnapshot_pool_t *pPool);
+
+// Producer only: claim a free buffer to fill. Returns NULL if every buffer
+// is still held by readers.
+HistorySnapshot_t *HistorySnapshot_claim(HistorySnapshot_pool_t *pPool);
+
+// Producer only: make a claimed buffer the current snapshot.
+void HistorySnapshot_publish(HistorySnapshot_pool_t *pPool, HistorySnapshot_t *pSnapshot);
+
+// Any thread: get (and hold) the current snapshot. Must be released.
+const HistorySnapshot_t *HistorySnapshot_acquire(HistorySnapshot_pool_t *pPool);
+void HistorySnapshot_release(const HistorySnapshot_t *pSnapshot);
+
+#endif
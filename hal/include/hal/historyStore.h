@@ -0,0 +1,85 @@
+// History Store module
+// Part of the Hardware Abstraction Layer (HAL)
+// Tiered, fixed-size history of window summaries.
+//
+// Each completed one second window is added as a summary (count, min, max,
+// mean, dips). Summaries roll up into one minute and one hour tiers. Every
+// tier is a preallocated ring, so memory is bounded and the oldest entries
+// are overwritten.
+//
+// A range query merges the coarsest summaries which fit inside the range
+// and fills the edges from the finer tiers: at most a few hundred merges,
+// found by binary search, and raw samples are never scanned.
+//
+// Only the sampling thread adds summaries. Readers retry if one was added
+// while they read, so adding never waits on them.
+
+#ifndef _HISTORY_STORE_H_
+#define _HISTORY_STORE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "hal/windowKernel.h"
+
+enum HistoryStore_tier {
+    HISTORY_TIER_SECOND,
+    HISTORY_TIER_MINUTE,
+    HISTORY_TIER_HOUR,
+    NUM_HISTORY_TIERS
+};
+
+typedef struct {
+    long long startTimeMs;
+    long long endTimeMs;
+
+    // Window epoch and position of the window's raw samples in the sample
+    // ring (one second tier only); epoch 0 for a second restored from the
+    // history log without its raw samples
+    unsigned long long epoch;
+    unsigned long long firstSampleIndex;
+    int numSamples;
+
+    WindowKernel_stats_t stats;
+} HistoryStore_summary_t;
+
+typedef struct {
+    HistoryStore_summary_t *pEntries;
+    int capacity;
+    int count;
+    int next;
+} HistoryStore_ring_t;
+
+typedef struct {
+    HistoryStore_ring_t tiers[NUM_HISTORY_TIERS];
+
+    // Partial roll-ups into the coarser tiers
+    HistoryStore_summary_t pending[NUM_HISTORY_TIERS];
+    int pendingCount[NUM_HISTORY_TIERS];
+
+    // Odd while a summary is being added
+    _Atomic unsigned int sequence;
+} HistoryStore_t;
+
+typedef struct {
+    WindowKernel_stats_t stats;
+    long long firstTimeMs;  // Earliest and latest covered time
+    long long lastTimeMs;
+    long long coveredMs;    // Total time covered by the merged summaries
+    int numSummaries;
+} HistoryStore_range_t;
+
+void HistoryStore_init(HistoryStore_t *pStore, int numSeconds, int numMinutes, int numHours);
+void HistoryStore_cleanup(HistoryStore_t *pStore);
+
+// Producer only: add the summary of a completed one second window.
+void HistoryStore_addSecond(HistoryStore_t *pStore, const HistoryStore_summary_t *pSecond);
+
+// Summarize the time range [fromMs, toMs). Returns false if nothing stored
+// falls inside it.
+bool HistoryStore_query(HistoryStore_t *pStore, long long fromMs, long long toMs, HistoryStore_range_t *pRange);
+
+// Get the one second summary `secondsAgo` entries back (0 = newest).
+bool HistoryStore_getSecond(HistoryStore_t *pStore, int secondsAgo, HistoryStore_summary_t *pSecond);
+
+#endif
@@ -5,6 +5,11 @@
 #ifndef _LED_H_
 #define _LED_H_
 
+#define LED_DEFAULT_POT_READS_PER_SECOND 10
+
+// How often the POT is read and the LED updated. Call before Led_init().
+void Led_setPotReadsPerSecond(int readsPerSecond);
+
 void Led_init(void);
 void Led_cleanup(void);
 
@@ -0,0 +1,57 @@
+// Log module
+// Part of the Hardware Abstraction Layer (HAL)
+// Console and log output which never blocks the thread logging.
+//
+// Log_write() formats the message on the caller's thread straight into a
+// slot of a preallocated lock-free ring (many producers, one consumer) and
+// returns; a background thread writes the slots out. If the ring is full
+// the message is dropped and counted rather than waited for, so a slow
+// serial console limits what is shown, not how fast the sampler runs.
+//
+// Text output goes to stdout (errors to stderr) exactly as formatted; the
+// message carries its own newline, as with printf(). Binary output instead
+// appends each message to a file as, in host byte order:
+//   u64 CLOCK_MONOTONIC time (ns), u8 level, u8 0, u16 length, then
+//   `length` bytes of text
+// so a run can be logged in full at a known cost and examined later.
+//
+// Before Log_init() and after Log_cleanup() messages are written directly.
+
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <stdbool.h>
+
+enum Log_level {
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,
+    NUM_LOG_LEVELS
+};
+
+// Longer messages are truncated
+#define LOG_MAX_MESSAGE_LEN 240
+
+// Messages above `level` are discarded before formatting. Defaults to
+// LOG_LEVEL_INFO.
+void Log_setLevel(enum Log_level level);
+
+// Look up a level by name (error, warning, info or debug). Returns false if
+// there is no such level.
+bool Log_parseLevel(const char *name, enum Log_level *pLevel);
+
+// Write binary records to `path` (created or truncated) instead of text to
+// the console. Must be called before Log_init().
+void Log_setBinaryOutput(char *path);
+
+// Begin/end the writer thread. Cleanup writes out everything queued.
+void Log_init(void);
+void Log_cleanup(void);
+
+void Log_write(enum Log_level level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Messages dropped so far because the writer had fallen behind
+long long Log_getNumDropped(void);
+
+#endif
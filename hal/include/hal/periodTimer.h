@@ -12,36 +12,88 @@
 //     data collected for this event (but not others).
 //     For example, call this function once a second to get timing
 //     information to print to the screen.
-
-// Maximum number of timestamps to record for a given event.
+//
+// Marking is lock free and costs a clock read and a few integer updates:
+// each thread marking an event keeps its own streaming count/sum/min/max
+// of the periods between its marks, in two banks. Getting the statistics
+// swaps the bank marks go to and folds in the old one: marks never wait
+// for it, it only waits out a mark already in progress, and no events are
+// dropped at any rate.
+//
+// Every event also keeps a log-linear (HDR style) histogram of its periods,
+// so the statistics carry percentiles as well as the average. Events may
+// instead time an operation: Period_markDuration() records how long it
+// took, and the "period" statistics of such events are durations.
 
 #ifndef _PERIOD_TIMER_H_
 #define _PERIOD_TIMER_H_
 
-#define MAX_EVENT_TIMESTAMPS (1024*4)
+// Threads which may mark the same event; marks from any more are ignored
+#define PERIOD_MAX_THREADS_PER_EVENT 8
 
 enum Period_whichEvent {
     PERIOD_EVENT_SAMPLE_LIGHT,
+    // Duration of each read of the light sensor source (including any wait
+    // for a buffered source to fill)
+    PERIOD_EVENT_ADC_READ,
+    PERIOD_EVENT_NETWORK_LOOP,
+    // Duration of handling one UDP request (replies are sent in batches)
+    PERIOD_EVENT_NETWORK_REQUEST,
+    PERIOD_EVENT_DISPLAY_FRAME,
+    PERIOD_EVENT_LED_UPDATE,
     NUM_PERIOD_EVENTS
 };
 
+// Histogram of times in ns: exact below 32ns, then 16 buckets per power of
+// two (within about 6%), up to 2^37ns (over two minutes; longer times are
+// counted there). Recording is a count-leading-zeros, a shift and an add.
+#define PERIOD_HISTOGRAM_SUB_BUCKET_BITS 5
+#define PERIOD_HISTOGRAM_MAX_BITS 37
+#define PERIOD_HISTOGRAM_BUCKETS \
+    (((PERIOD_HISTOGRAM_MAX_BITS - PERIOD_HISTOGRAM_SUB_BUCKET_BITS + 1) + 1) << (PERIOD_HISTOGRAM_SUB_BUCKET_BITS - 1))
+
+typedef struct {
+    unsigned int counts[PERIOD_HISTOGRAM_BUCKETS];
+    long long totalCount;
+    long long maxNs;
+} Period_histogram_t;
+
 typedef struct {
     int numSamples;
     double minPeriodInMs;
     double maxPeriodInMs;
     double avgPeriodInMs;
+    int numMissedDeadlines;
+
+    // From the histogram (bucket upper bounds, so within a few percent)
+    double p50PeriodInMs;
+    double p90PeriodInMs;
+    double p99PeriodInMs;
+    double p999PeriodInMs;
 } Period_statistics_t;
 
 // Initialize/cleanup the module's data structures.
 void Period_init(void);
 void Period_cleanup(void);
 
+// Short name of the event for reports, e.g. "display frame".
+const char *Period_getEventName(enum Period_whichEvent whichEvent);
+
 // Record the current time as a timestamp for the 
 // indicated event. This allows later calls to 
 // Period_getStatisticsAndClear() to access these timestamps
 // and compute the timing statistics for this periodic event.
 void Period_markEvent(enum Period_whichEvent whichEvent);
 
+// Record the time since `startInNs` (from Period_getTimeInNs()) as one
+// duration of the indicated event.
+void Period_markDuration(enum Period_whichEvent whichEvent, long long startInNs);
+long long Period_getTimeInNs(void);
+
+// Record that `count` scheduled occurrences of the event were skipped
+// because their deadline had already passed.
+void Period_markMissedDeadlines(enum Period_whichEvent whichEvent, int count);
+
 // Fill the `pStats` struct, which must be allocated by the calling
 // code, with the statistics about the periodic event `whichEvent`.
 // This function is threadsafe, and may be called by any thread.
@@ -52,4 +104,22 @@ void Period_getStatisticsAndClear(
     Period_statistics_t *pStats
 );
 
+// As above, and also copy out the histogram behind the statistics.
+void Period_getHistogramAndClear(
+    enum Period_whichEvent whichEvent,
+    Period_statistics_t *pStats,
+    Period_histogram_t *pHistogram
+);
+
+// Histograms merge exactly, e.g. to combine seconds into a longer view.
+void Period_resetHistogram(Period_histogram_t *pHistogram);
+void Period_mergeHistogram(Period_histogram_t *pInto, const Period_histogram_t *pFrom);
+
+// Count one value (ns) in a histogram, as marking an event does.
+void Period_recordInHistogram(Period_histogram_t *pHistogram, long long valueNs);
+
+// Time (ms) at or below which `percentile` (0-100) of the recorded values
+// fall; 0 for an empty histogram.
+double Period_getPercentileInMs(const Period_histogram_t *pHistogram, double percentile);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+// Reactor module
+// Part of the Hardware Abstraction Layer (HAL)
+// One thread which runs every module's periodic work and file descriptor
+// handlers, instead of a thread per module each polling with nanosleep.
+//
+// Tasks run on absolute CLOCK_MONOTONIC deadlines from a single timerfd,
+// armed for the earliest one, and handlers run when their descriptor is
+// readable; all of it waits in one epoll_wait(). So the thread wakes only
+// when something is due, and a task due within an eighth of its period
+// runs early on another's wakeup rather than waking the thread itself. The
+// sampling thread keeps its own (optionally real-time) thread.
+//
+// Tasks and handlers run one at a time on the reactor thread and must not
+// block. Register them before Reactor_start() or from the reactor thread;
+// after Reactor_stop() none runs, so modules can then clean up freely.
+
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+#define REACTOR_MAX_TASKS 16
+#define REACTOR_MAX_HANDLERS 32
+
+typedef void (*Reactor_task_t)(void *pContext);
+typedef void (*Reactor_handler_t)(int fd, void *pContext);
+
+void Reactor_init(void);
+void Reactor_cleanup(void);
+
+// Begin/end the reactor thread.
+void Reactor_start(void);
+void Reactor_stop(void);
+
+// Run `task` every `periodNs` (each run up to an eighth of a period early),
+// first one period from now. Returns the task's id. If it falls more than a
+// period behind, it skips the missed runs rather than catching up. Exits if
+// there are too many tasks.
+int Reactor_addTask(long long periodNs, Reactor_task_t task, void *pContext);
+
+// Change a task's period, taking effect from its next run.
+void Reactor_setTaskPeriod(int task, long long periodNs);
+
+// Call `handler` whenever `fd` is readable (level triggered), until it is
+// removed. Exits if there are too many handlers.
+void Reactor_addHandler(int fd, Reactor_handler_t handler, void *pContext);
+void Reactor_removeHandler(int fd);
+
+#endif
@@ -0,0 +1,70 @@
+// Sample Ring module
+// Part of the Hardware Abstraction Layer (HAL)
+// Lock-free single-producer ring buffer of raw 12-bit A2D codes, split into
+// windows.
+//
+// The producer (the sampling thread) pushes samples and periodically closes
+// the current window. Each closed window is tagged with an epoch number, and
+// its metadata is handed out by the producer (e.g. through the history
+// store). Any number of reader threads may then copy the window out by its
+// metadata at any time; they never block the producer. If the producer
+// overwrites part of the window while a reader is copying it, the reader
+// gets only the part which survived.
+//
+// The ring holds `retainedWindows` completed windows (at least one) of
+// `maxWindowSize` samples plus the window being filled, so completed windows
+// stay intact while the next ones are filled. A window larger than
+// `maxWindowSize` keeps only its newest samples.
+
+#ifndef _SAMPLE_RING_H_
+#define _SAMPLE_RING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    unsigned long long epoch;       // 0 until the first window completes
+    unsigned long long startIndex;  // Absolute index of the first sample
+    int size;
+    int droppedSamples;             // Samples lost to a window over maxWindowSize
+} SampleRing_window_t;
+
+typedef struct {
+    _Atomic uint16_t *pSamples;
+    unsigned long long mask;
+    int maxWindowSize;
+
+    // Producer-owned positions
+    _Atomic unsigned long long claimIndex;
+    _Atomic unsigned long long writeIndex;
+    unsigned long long windowStartIndex;
+    unsigned long long windowEpoch;
+} SampleRing_t;
+
+void SampleRing_init(SampleRing_t *pRing, int maxWindowSize, int retainedWindows);
+void SampleRing_cleanup(SampleRing_t *pRing);
+
+// Producer only: append a sample to the current window.
+void SampleRing_push(SampleRing_t *pRing, uint16_t sample);
+
+// Producer only: close the current window. Returns its metadata.
+SampleRing_window_t SampleRing_completeWindow(SampleRing_t *pRing);
+
+// Producer only: read a sample by absolute index (e.g. within the window
+// just completed). No copy or synchronization needed on the producer side.
+uint16_t SampleRing_get(const SampleRing_t *pRing, unsigned long long index);
+
+// Producer only: the window's samples as (at most two, as the ring may wrap)
+// contiguous spans, for vectorized processing. Returns the number of spans.
+int SampleRing_getSpans(const SampleRing_t *pRing, SampleRing_window_t window,
+    const uint16_t *pSpans[2], int spanSizes[2]);
+
+// Any thread: copy the samples of a completed `window` into `pDest`
+// (room for `maxSamples`) and fill `pCopied` with what was copied. Returns
+// false, without copying, if the window holds more than `maxSamples`. If the
+// producer has overwritten part of the window only the intact tail is
+// copied (possibly nothing).
+bool SampleRing_copyWindow(const SampleRing_t *pRing, SampleRing_window_t window, uint16_t *pDest,
+    int maxSamples, SampleRing_window_t *pCopied);
+
+#endif
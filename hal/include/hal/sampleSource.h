@@ -0,0 +1,89 @@
+// Sample Source module
+// Part of the Hardware Abstraction Layer (HAL)
+// Pluggable capture backends which deliver raw 12-bit A2D codes to the sampler.
+//
+// A source is opened with one of the SampleSource_open*() functions and is
+// then only used through its `read` and `close` members, so the sampler does
+// not care where the codes come from:
+//  - sysfs:  one in_voltageN_raw read per sample (polled by the sampler).
+//  - IIO buffer: the kernel captures into its buffer at hardware rate and
+//    the samples are read in bulk from /dev/iio:deviceN.
+//  - packed: any file or FIFO holding the same binary layout as the IIO
+//    buffer, so the buffered path can be exercised off-target.
+
+#ifndef _SAMPLE_SOURCE_H_
+#define _SAMPLE_SOURCE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct SampleSource SampleSource_t;
+struct SampleSource {
+    // Read up to `maxCodes` raw A2D codes into `pCodes`.
+    // Returns the number of codes read, 0 if none arrived within a short
+    // timeout (so the caller can check for shutdown), or -1 at end of stream.
+    int (*read)(SampleSource_t *pSource, uint16_t *pCodes, int maxCodes);
+    void (*close)(SampleSource_t *pSource);
+
+    // True if the source delivers samples at its own rate (read() blocks
+    // until data is ready); false if the caller must pace the reads.
+    bool isPaced;
+
+    // Upper bound on the delivered sample rate; used to size buffers.
+    int maxSamplesPerSecond;
+
+    // CLOCK_MONOTONIC time (ns) at which the last read's samples were taken,
+    // for sources which replay recorded times (see hal/trace.h); NULL when
+    // samples are taken as they are read.
+    long long (*getTimeNs)(SampleSource_t *pSource);
+
+    // Descriptor which becomes readable when the owner wants a blocked read
+    // to give up at once and return 0 (e.g. to stop); -1, as opened, for
+    // none. Set by the owner after opening.
+    int stopEventDescriptor;
+
+    void *pState;
+};
+
+// Binary layout of one channel within an IIO scan, as described by
+// scan_elements/in_voltageN_type (e.g. "le:u12/16>>0").
+typedef struct {
+    int bytesPerScan;
+    int byteOffset;
+    int storageBits;
+    int realBits;
+    int shift;
+    bool isBigEndian;
+} SampleSource_layout_t;
+
+typedef struct {
+    char *iioDirectory;     // e.g. "/sys/bus/iio/devices/iio:device0"
+    char *devicePath;       // e.g. "/dev/iio:device0"
+    int channel;            // in_voltage<channel>
+    int bufferLength;       // Kernel buffer length in scans
+    char *triggerName;      // NULL for devices which run without a trigger
+    int maxSamplesPerSecond;
+} SampleSource_iioConfig_t;
+
+// Poll a single sysfs attribute, e.g. .../in_voltage1_raw.
+void SampleSource_openSysfs(SampleSource_t *pSource, char *voltageFile);
+
+// Enable the channel's scan element alone (every other one is disabled, so
+// each scan holds just this channel), size and (optionally) trigger the
+// kernel buffer, and read packed samples from the IIO character device.
+void SampleSource_openIioBuffer(SampleSource_t *pSource, const SampleSource_iioConfig_t *pConfig);
+
+// Read packed samples in `pLayout` from a regular file or FIFO.
+void SampleSource_openPacked(SampleSource_t *pSource, char *path, const SampleSource_layout_t *pLayout,
+    int maxSamplesPerSecond);
+
+// Sleep for `waitNs`, or less if the source's stop event fires first.
+// Returns false if it did; for sources' blocking reads.
+bool SampleSource_waitNs(const SampleSource_t *pSource, long long waitNs);
+
+// Parse an IIO scan element type string into `pLayout` (single channel scan).
+// Returns false if the string is not understood, or the channel is signed or
+// wider than 12 bits.
+bool SampleSource_parseLayout(const char *typeString, SampleSource_layout_t *pLayout);
+
+#endif
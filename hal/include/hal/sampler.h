@@ -5,25 +5,94 @@
 // It provides access to the samples it recorded during the _previous_
 // complete second.
 //
-// The application will do a number of actions each second which must
-// be synchronized (such as computing dips and printing to the screen).
-// To make easy to work with the data, the app must call
-// Sampler_moveCurrentDataToHistory() each second to trigger this
-// module to move the current samples into the history.
+// Each second the sampling thread closes the current window in a lock-free
+// ring buffer (see hal/sampleRing.h) and computes its dips. Readers copy out
+// the last completed window without ever blocking the sampling thread.
 
 #ifndef _SAMPLER_H_
 #define _SAMPLER_H_
 
 #include "hal/periodTimer.h"
+#include "hal/sampleSource.h"
+#include "hal/historySnapshot.h"
+#include "hal/windowAnalyzer.h"
+#include "hal/historyStore.h"
+
+enum Sampler_captureMode {
+    // Poll in_voltage1_raw once per millisecond
+    SAMPLER_CAPTURE_SYSFS,
+    // Bulk reads from the kernel's IIO buffer at the A2D's own rate
+    SAMPLER_CAPTURE_IIO_BUFFER
+};
+
+#define SAMPLER_DEFAULT_SAMPLES_PER_SECOND 1000
+#define SAMPLER_DEFAULT_RAW_HISTORY_SECONDS 10
+#define SAMPLER_DEFAULT_SECOND_SUMMARIES (60 * 60)
+#define SAMPLER_DEFAULT_MINUTE_SUMMARIES (24 * 60)
+#define SAMPLER_DEFAULT_HOUR_SUMMARIES (7 * 24)
+#define SAMPLER_DEFAULT_DIP_ENTER_VOLTS 0.1
+#define SAMPLER_DEFAULT_DIP_EXIT_VOLTS 0.07
+// A day of summaries, or ten minutes with raw samples
+#define SAMPLER_DEFAULT_PERSISTED_WINDOWS (24 * 60 * 60)
+#define SAMPLER_DEFAULT_PERSISTED_RAW_WINDOWS (10 * 60)
+
+// Highest sample rate supported: the trace recorder's buffer holds about
+// ten seconds of it, and each window's buffers are sized from the rate
+#define SAMPLER_MAX_SAMPLES_PER_SECOND 200000
+
+// Rate at which polled (sysfs) sources are read, on absolute monotonic
+// deadlines; deadlines missed are counted in the period statistics.
+// Defaults to 1000, at most SAMPLER_MAX_SAMPLES_PER_SECOND. Must be called
+// before Sampler_init().
+void Sampler_setSampleRate(int samplesPerSecond);
+
+// Keep the raw samples of the last `rawSeconds` windows, and summaries of
+// the last `secondSummaries` seconds, `minuteSummaries` minutes and
+// `hourSummaries` hours; all allocated once by Sampler_init(). Must be
+// called before Sampler_init().
+void Sampler_setHistoryDepth(int rawSeconds, int secondSummaries, int minuteSummaries, int hourSummaries);
+
+// A dip starts when a sample is more than `enterVolts` from the running
+// average and ends once one is back within `exitVolts`. Defaults to 0.1V
+// and 0.07V.
+void Sampler_setDipThresholds(double enterVolts, double exitVolts);
+
+// Record every raw code the sampler reads, with its read time, to `path`
+// for later replay (see hal/trace.h). Must be called before Sampler_init().
+void Sampler_setRecording(char *path);
+
+// Keep every completed window's summary in a memory-mapped ring file of
+// `numWindows` windows at `path` (see hal/historyLog.h) and, unless
+// `numRawWindows` is 0, the raw samples of the last `numRawWindows` in
+// another at `path`.raw. The history is restored from them on start,
+// including the raw samples of the last few seconds. Must be called before
+// Sampler_init().
+void Sampler_setPersistence(char *path, int numWindows, int numRawWindows);
+
+// Run the sampling thread under SCHED_FIFO at `priority` (1-99; 0 keeps
+// normal scheduling) and pin it to `cpu` (-1 for any). Needs the right
+// privileges; failures are reported and ignored. Call before Sampler_init().
+void Sampler_setThreadScheduling(int priority, int cpu);
 
 // Begin/end the background thread which samples light levels.
-void Sampler_init(void);
+void Sampler_init(enum Sampler_captureMode mode);
 void Sampler_cleanup(void);
 
+// Begin sampling from an already opened source (e.g. a packed sample file,
+// FIFO or replayed trace). The sampler takes ownership and closes it during
+// cleanup. Sampling stops when the source is exhausted.
+void Sampler_initWithSource(SampleSource_t source);
+
 // Gets history stats from period timer for current history
 // i.e., average time between samples, min, max, num samples
+// Lock free: never holds up the sampling thread.
 Period_statistics_t Sampler_getHistoryStats(void);
 
+// An eventfd which becomes readable each time a second completes and its
+// history is published; read it (8 bytes) to clear it. For waiting in
+// poll/epoll instead of polling the history. Valid between init and cleanup.
+int Sampler_getWindowEventDescriptor(void);
+
 // Get the number of samples collected during the previous complete second.
 int Sampler_getHistorySize(void);
 
@@ -34,7 +103,18 @@ int Sampler_getHistorySize(void);
 // Note: It provides both data and size to ensure consistency.
 double* Sampler_getHistory(int *size);
 
-// Get the average light level (not tied to the history).
+// Zero-copy access to the samples of the previous complete second.
+// Returns a read-only snapshot (samples plus window metadata) which stays
+// valid, even across later seconds, until passed to Sampler_releaseHistory().
+// Never allocates; hold it only as long as needed.
+const HistorySnapshot_t *Sampler_acquireHistory(void);
+void Sampler_releaseHistory(const HistorySnapshot_t *pHistory);
+
+// Samples are kept as raw 12-bit A2D codes; convert one (or an average of
+// codes) to volts for display.
+double Sampler_codeToVolts(double code);
+
+// Get the average light level in volts (not tied to the history).
 double Sampler_getAverageReading(void);
 
 // Get the total number of light level samples taken so far.
@@ -43,4 +123,32 @@ long long Sampler_getNumSamplesTaken(void);
 // Gets the number of dips from 1s history
 int Sampler_getDips(void);
 
+// Summarize the samples taken between `fromMsAgo` and `toMsAgo` (e.g. the
+// last hour is 3600000, 0) from the per second/minute/hour summaries.
+// Returns false if no summaries fall inside the range.
+bool Sampler_queryHistoryRange(long long fromMsAgo, long long toMsAgo, HistoryStore_range_t *pRange);
+
+// Longest time the summaries can reach back: the span of the hour tier.
+long long Sampler_getHistorySpanSeconds(void);
+
+// Raw samples are kept for the last few seconds. Copy the raw A2D codes of
+// the second `secondsAgo` seconds before the previous complete one (0 = the
+// previous complete second) into `pDest`, which should have room for
+// Sampler_getMaxHistorySize() codes, and its summary into `pSecond` (may be
+// NULL). Returns the number copied, or -1 if that second is not available
+// (including seconds restored from the history log without their raw
+// samples).
+int Sampler_getMaxHistorySize(void);
+int Sampler_copyRecentHistory(int secondsAgo, uint16_t *pDest, int maxSamples, HistoryStore_summary_t *pSecond);
+
+// Configure the sliding analysis windows (see hal/windowAnalyzer.h); must be
+// called before Sampler_init(). Defaults: 100ms every 100ms, 1s every
+// 100ms and 10s every 1s.
+void Sampler_setAnalysisWindows(const WindowAnalyzer_config_t *pConfigs, int numWindows);
+
+// Get the latest result of analysis window `index` (0..count-1).
+// Returns false if there is no such window.
+int Sampler_getNumAnalysisWindows(void);
+bool Sampler_getAnalysisWindow(int index, WindowAnalyzer_result_t *pResult);
+
 #endif
\ No newline at end of file
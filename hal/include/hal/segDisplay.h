@@ -7,6 +7,11 @@
 #ifndef _SEG_DISPLAY_H_
 #define _SEG_DISPLAY_H_
 
+#define SEG_DEFAULT_DIGIT_PERIOD_MS 5
+
+// How long each digit stays lit while multiplexing. Call before Seg_init().
+void Seg_setDigitPeriod(int periodMs);
+
 void Seg_init(void);
 void Seg_cleanup(void);
 
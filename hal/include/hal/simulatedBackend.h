@@ -0,0 +1,62 @@
+// Simulated Backend module
+// Part of the Hardware Abstraction Layer (HAL)
+// In-memory stand-in for the board, used through hal/backend.h.
+//
+// A2D channels produce codes from a synthetic waveform (or replay a packed
+// trace, as written by the IIO buffer) at a configurable rate. Output and
+// I2C writes are kept in memory and can be inspected, e.g. to check what
+// the LED and display were driven to during a load test.
+
+#ifndef _SIMULATED_BACKEND_H_
+#define _SIMULATED_BACKEND_H_
+
+#include <stdbool.h>
+
+#include "hal/sampleSource.h"
+
+enum SimulatedBackend_waveform {
+    SIMULATED_WAVE_CONSTANT,
+    SIMULATED_WAVE_SINE,
+    // `amplitudeVolts` below the base for the first tenth of every period
+    SIMULATED_WAVE_DIPS,
+    // Uniform noise of +/- `amplitudeVolts` about the base
+    SIMULATED_WAVE_NOISE
+};
+
+typedef struct {
+    // Light sensor channel
+    enum SimulatedBackend_waveform waveform;
+    double baseVolts;
+    double amplitudeVolts;
+    double frequencyHz;
+    // Packed trace to replay instead of the waveform (NULL for none)
+    char *tracePath;
+    SampleSource_layout_t traceLayout;
+    // Rate of buffered capture on every channel
+    int samplesPerSecond;
+
+    // Every other channel (e.g. the POT) reads this constant code
+    int otherChannelCode;
+} SimulatedBackend_config_t;
+
+// 1000 samples/s of a 0.9V level with 0.2V dips at 2Hz, POT at mid scale
+void SimulatedBackend_getDefaultConfig(SimulatedBackend_config_t *pConfig);
+
+void SimulatedBackend_setConfig(const SimulatedBackend_config_t *pConfig);
+
+// Backend implementation (see hal/backend.h)
+void SimulatedBackend_openAdcSource(SampleSource_t *pSource, bool isBuffered, int channel,
+    int maxSamplesPerSecond);
+int SimulatedBackend_openOutput(char *path);
+bool SimulatedBackend_writeOutput(int output, const char *content, int length);
+int SimulatedBackend_openI2c(char *bus, int address);
+bool SimulatedBackend_writeI2cRegisters(int i2c, const unsigned char (*pRegisterValues)[2], int count);
+
+// Last value written to an output (false if never opened) and I2C
+// register, and the total number of writes of each kind.
+bool SimulatedBackend_getOutput(const char *path, char *pValue, int maxLength);
+int SimulatedBackend_getI2cRegister(int i2c, int reg);
+long long SimulatedBackend_getNumOutputWrites(void);
+long long SimulatedBackend_getNumI2cWrites(void);
+
+#endif
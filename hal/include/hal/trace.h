@@ -0,0 +1,46 @@
+// Trace module
+// Part of the Hardware Abstraction Layer (HAL)
+// Records the sampler's raw input to a file and replays it as a sample
+// source, so field runs (odd dip counts, jitter spikes) can be reproduced.
+//
+// The file is append only, all fields little-endian:
+//   header:  "LSTR", u16 version (1), u16 0, u32 samples per second,
+//            u32 0, u64 CLOCK_MONOTONIC time (us) recording started
+//   records: u32 us since the previous record (or the start), u16 count,
+//            then `count` u16 A2D codes
+// with one record per read of the source, so a replay delivers the same
+// batches at the same (recorded) times.
+//
+// Recording never blocks the sampling thread: records are copied into a
+// preallocated lock-free ring which a background thread writes out. If the
+// writer falls a whole buffer behind, reads are dropped (and counted)
+// rather than waited for.
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hal/sampleSource.h"
+
+// Start recording into `path` (created or truncated); exits on failure.
+void Trace_startRecording(char *path, int samplesPerSecond);
+
+// Recording thread only: append one read's codes, taken at `timeNs`
+// (CLOCK_MONOTONIC). Does nothing unless recording.
+void Trace_record(const uint16_t *pCodes, int numCodes, long long timeNs);
+
+// Write out everything recorded, stop the writer and close the file.
+void Trace_stopRecording(void);
+
+bool Trace_isRecording(void);
+
+// Replay a recorded file as a source. In real time, each read waits until
+// its record is due (relative to when the replay was opened); otherwise
+// records are delivered as fast as they are read, which makes a benchmark
+// of the analysis path. Either way the source's clock (getTimeNs) follows
+// the recorded times, so windows split the samples exactly as recorded.
+void Trace_openReplay(SampleSource_t *pSource, char *path, bool isRealTime);
+
+#endif
@@ -0,0 +1,68 @@
+// Window Analyzer module
+// Part of the Hardware Abstraction Layer (HAL)
+// Sliding, multi-resolution window statistics computed incrementally as
+// samples arrive.
+//
+// Several windows may be configured at once (e.g. 100ms, 1s and 10s), each
+// with its own length and hop. Samples are accumulated into short "tick"
+// blocks (the greatest common divisor of all lengths and hops). When a
+// window's hop elapses its result is rebuilt by merging the last
+// length/tick blocks, so the cost is per hop rather than per sample, and
+// reading a result is O(1). Readers retry if a result was rebuilt while
+// they copied it, so the producer never waits on them.
+//
+// A window's dip count is the number of dips which began inside it.
+
+#ifndef _WINDOW_ANALYZER_H_
+#define _WINDOW_ANALYZER_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hal/windowKernel.h"
+
+#define WINDOW_ANALYZER_MAX_WINDOWS 8
+
+typedef struct {
+    int lengthMs;
+    int hopMs;      // Must divide lengthMs
+} WindowAnalyzer_config_t;
+
+typedef struct {
+    WindowAnalyzer_config_t config;
+    unsigned long long sequence;    // Results produced so far (0 = none yet)
+    long long endTimeMs;            // End of the window (monotonic clock)
+    WindowKernel_stats_t stats;
+} WindowAnalyzer_result_t;
+
+typedef struct {
+    int numWindows;
+    WindowAnalyzer_config_t configs[WINDOW_ANALYZER_MAX_WINDOWS];
+    int tickMs;
+
+    // Completed tick blocks, enough for the longest window
+    WindowKernel_stats_t *pBlocks;
+    int numBlocks;
+    unsigned long long completedBlocks;
+
+    WindowKernel_stats_t current;
+    long long currentStartMs;
+
+    // Odd while the results are being rebuilt
+    _Atomic unsigned int resultSequence;
+    WindowAnalyzer_result_t results[WINDOW_ANALYZER_MAX_WINDOWS];
+} WindowAnalyzer_t;
+
+void WindowAnalyzer_init(WindowAnalyzer_t *pAnalyzer, const WindowAnalyzer_config_t *pConfigs, int numWindows);
+void WindowAnalyzer_cleanup(WindowAnalyzer_t *pAnalyzer);
+
+// Producer only: add a batch of samples read at `timeMs` (monotonic).
+void WindowAnalyzer_addSamples(WindowAnalyzer_t *pAnalyzer, const uint16_t *pSamples, int count,
+    long long timeMs, const WindowKernel_thresholds_t *pThresholds);
+
+// Any thread: copy the latest result of window `index`.
+// Returns false if `index` is out of range.
+bool WindowAnalyzer_getResult(WindowAnalyzer_t *pAnalyzer, int index, WindowAnalyzer_result_t *pResult);
+
+#endif
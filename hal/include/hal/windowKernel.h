@@ -0,0 +1,63 @@
+// Window Kernel module
+// Part of the Hardware Abstraction Layer (HAL)
+// One-pass analysis of a window of raw A2D codes: min, max, sum and sum of
+// squares (for mean/variance) plus hysteresis dip counting.
+//
+// Uses NEON on ARM, AVX2 or SSE2 on x86 and plain C elsewhere; the scalar
+// version is always available as the reference implementation. The vector
+// paths compute threshold-crossing bit masks for blocks of samples and only
+// walk the hysteresis state machine at crossings, so the cost no longer has
+// two data-dependent branches per sample.
+//
+// Codes must fit in 12 bits (0..4095), as delivered by the A2D.
+
+#ifndef _WINDOW_KERNEL_H_
+#define _WINDOW_KERNEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A sample below `enterLow` or above `enterHigh` starts a dip; a sample in
+// [exitLow, exitHigh] ends it. Where the bands overlap, a sample in both
+// starts a dip (it is counted) and ends it at once.
+typedef struct {
+    int enterLow;
+    int enterHigh;
+    int exitLow;
+    int exitHigh;
+} WindowKernel_thresholds_t;
+
+typedef struct {
+    int count;
+    int minCode;
+    int maxCode;
+    unsigned long long sum;
+    unsigned long long sumOfSquares;
+    int dips;
+
+    // Hysteresis state, carried between calls for the same window
+    bool isDipped;
+} WindowKernel_stats_t;
+
+void WindowKernel_reset(WindowKernel_stats_t *pStats);
+
+// Add `count` samples to the running window statistics.
+void WindowKernel_accumulate(WindowKernel_stats_t *pStats, const uint16_t *pSamples, int count,
+    const WindowKernel_thresholds_t *pThresholds);
+
+// Reference implementation: one sample at a time, same results.
+void WindowKernel_accumulateScalar(WindowKernel_stats_t *pStats, const uint16_t *pSamples, int count,
+    const WindowKernel_thresholds_t *pThresholds);
+
+// Combine the statistics of a later run of samples (`pFrom`) into `pInto`.
+// Dip counts add up and the hysteresis state becomes that of `pFrom`.
+void WindowKernel_merge(WindowKernel_stats_t *pInto, const WindowKernel_stats_t *pFrom);
+
+// Mean and population variance in code units (0 for an empty window).
+double WindowKernel_getMean(const WindowKernel_stats_t *pStats);
+double WindowKernel_getVariance(const WindowKernel_stats_t *pStats);
+
+// Name of the implementation selected at compile time ("neon", "avx2", ...).
+const char *WindowKernel_getImplementation(void);
+
+#endif
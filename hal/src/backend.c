@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "hal/backend.h"
+#include "hal/file.h"
+
+#define MAX_PATH_LENGTH 256
+
+#define MAX_I2C_DEVICES 4
+
+typedef struct {
+    int fd;
+    int address;
+} i2cDevice_t;
+
+static bool isSimulated = false;
+
+static char *iioDirectory = BACKEND_DEFAULT_IIO_DIRECTORY;
+static char *iioDevicePath = BACKEND_DEFAULT_IIO_DEVICE;
+static int iioBufferLength = BACKEND_DEFAULT_IIO_BUFFER_LENGTH;
+
+static i2cDevice_t i2cDevices[MAX_I2C_DEVICES];
+static int numI2cDevices;
+
+void Backend_useHardware(void) {
+    isSimulated = false;
+}
+
+void Backend_useSimulation(const SimulatedBackend_config_t *pConfig) {
+    SimulatedBackend_setConfig(pConfig);
+    isSimulated = true;
+}
+
+void Backend_setIioDevice(char *directory, char *devicePath, int bufferLength) {
+    iioDirectory = directory;
+    iioDevicePath = devicePath;
+    iioBufferLength = bufferLength > 0 ? bufferLength : BACKEND_DEFAULT_IIO_BUFFER_LENGTH;
+}
+
+bool Backend_isSimulated(void) {
+    return isSimulated;
+}
+
+void Backend_runCommand(char *command) {
+    if (isSimulated) {
+        return;
+    }
+
+    FILE *pipe = popen(command, "r");
+    char buffer[1024];
+
+    while (!feof(pipe) && !ferror(pipe)) {
+        if (fgets(buffer, sizeof(buffer), pipe) == NULL)
+        break;
+    }
+
+    int exitCode = WEXITSTATUS(pclose(pipe));
+    if (exitCode != 0) {
+        printf("Unable to execute command: %s, exit code: %d\n", command, exitCode);
+        exit(1);
+    }
+}
+
+void Backend_openAdcSource(SampleSource_t *pSource, enum Backend_adcMode mode, int channel,
+    int maxSamplesPerSecond)
+{
+    if (isSimulated) {
+        SimulatedBackend_openAdcSource(pSource, mode == BACKEND_ADC_BUFFERED, channel, maxSamplesPerSecond);
+        return;
+    }
+
+    if (mode == BACKEND_ADC_BUFFERED) {
+        SampleSource_iioConfig_t config = {
+            .iioDirectory = iioDirectory,
+            .devicePath = iioDevicePath,
+            .channel = channel,
+            .bufferLength = iioBufferLength,
+            .triggerName = NULL,
+            .maxSamplesPerSecond = maxSamplesPerSecond,
+        };
+        SampleSource_openIioBuffer(pSource, &config);
+    }
+    else {
+        char path[MAX_PATH_LENGTH];
+        snprintf(path, sizeof(path), "%s/in_voltage%d_raw", iioDirectory, channel);
+        SampleSource_openSysfs(pSource, path);
+        pSource->maxSamplesPerSecond = maxSamplesPerSecond;
+    }
+}
+
+int Backend_openOutput(char *path) {
+    if (isSimulated) {
+        return SimulatedBackend_openOutput(path);
+    }
+    File_writer_t writer;
+    File_openWriter(&writer, path);
+    return writer.fd;
+}
+
+bool Backend_writeOutput(int output, const char *content, int length) {
+    if (isSimulated) {
+        return SimulatedBackend_writeOutput(output, content, length);
+    }
+    File_writer_t writer = {.fd = output};
+    return File_write(&writer, content, length);
+}
+
+void Backend_closeOutput(int output) {
+    if (isSimulated) {
+        return;
+    }
+    File_writer_t writer = {.fd = output};
+    File_closeWriter(&writer);
+}
+
+int Backend_openI2c(char *bus, int address) {
+    if (isSimulated) {
+        return SimulatedBackend_openI2c(bus, address);
+    }
+    if (numI2cDevices == MAX_I2C_DEVICES) {
+        printf("ERROR: Too many I2C devices (%s, 0x%02x)\n", bus, address);
+        exit(-1);
+    }
+
+    int i2cFileDesc = open(bus, O_RDWR);
+    if (i2cFileDesc < 0) {
+        printf("I2C DRV: Unable to open bus for read/write (%s)\n", bus);
+        perror("Error is:");
+        exit(-1);
+    }
+
+    int result = ioctl(i2cFileDesc, I2C_SLAVE, address);
+    if (result < 0) {
+        perror("Unable to set I2C device to slave address.");
+        exit(-1);
+    }
+
+    i2cDevices[numI2cDevices].fd = i2cFileDesc;
+    i2cDevices[numI2cDevices].address = address;
+    return numI2cDevices++;
+}
+
+// All pairs go in a single I2C_RDWR transaction (writes joined by repeated
+// starts), so this does not rely on the device's register auto-increment.
+bool Backend_writeI2cRegisters(int i2c, const unsigned char (*pRegisterValues)[2], int count) {
+    if (isSimulated) {
+        return SimulatedBackend_writeI2cRegisters(i2c, pRegisterValues, count);
+    }
+
+    struct i2c_msg messages[I2C_RDWR_IOCTL_MAX_MSGS];
+    count = count < I2C_RDWR_IOCTL_MAX_MSGS ? count : I2C_RDWR_IOCTL_MAX_MSGS;
+    for (int i = 0; i < count; i++) {
+        messages[i].addr = i2cDevices[i2c].address;
+        messages[i].flags = 0;
+        messages[i].len = 2;
+        messages[i].buf = (unsigned char *)pRegisterValues[i];
+    }
+    struct i2c_rdwr_ioctl_data transaction = {.msgs = messages, .nmsgs = count};
+    return ioctl(i2cDevices[i2c].fd, I2C_RDWR, &transaction) >= 0;
+}
+
+void Backend_closeI2c(int i2c) {
+    if (isSimulated) {
+        return;
+    }
+    close(i2cDevices[i2c].fd);
+    i2cDevices[i2c].fd = -1;
+}
@@ -0,0 +1,58 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+
+#include "hal/deadlineTimer.h"
+
+#define NS_PER_SECOND 1000000000LL
+
+void DeadlineTimer_start(DeadlineTimer_t *pTimer, long long periodNs) {
+    pTimer->periodNs = periodNs;
+    pTimer->nextDeadlineNs = DeadlineTimer_getTimeInNs() + periodNs;
+}
+
+int DeadlineTimer_wait(DeadlineTimer_t *pTimer) {
+    return DeadlineTimer_waitUnless(pTimer, -1);
+}
+
+int DeadlineTimer_waitUnless(DeadlineTimer_t *pTimer, int eventDescriptor) {
+    int missed = 0;
+    long long nowNs = DeadlineTimer_getTimeInNs();
+    if (nowNs - pTimer->nextDeadlineNs >= pTimer->periodNs) {
+        // Keep the original phase, just drop the deadlines we slept through
+        missed = (int)((nowNs - pTimer->nextDeadlineNs) / pTimer->periodNs);
+        pTimer->nextDeadlineNs += (long long)missed * pTimer->periodNs;
+    }
+
+    if (eventDescriptor < 0) {
+        struct timespec deadline = {
+            .tv_sec = pTimer->nextDeadlineNs / NS_PER_SECOND,
+            .tv_nsec = pTimer->nextDeadlineNs % NS_PER_SECOND,
+        };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+            // Interrupted by a signal: the deadline is absolute, so just retry
+        }
+    }
+    else {
+        // ppoll() only takes a relative timeout, so recompute it from the
+        // absolute deadline whenever the wait is cut short
+        struct pollfd pollDesc = {.fd = eventDescriptor, .events = POLLIN};
+        while (nowNs < pTimer->nextDeadlineNs) {
+            long long waitNs = pTimer->nextDeadlineNs - nowNs;
+            struct timespec timeout = {waitNs / NS_PER_SECOND, waitNs % NS_PER_SECOND};
+            if (ppoll(&pollDesc, 1, &timeout, NULL) > 0) {
+                return -1;
+            }
+            nowNs = DeadlineTimer_getTimeInNs();
+        }
+    }
+
+    pTimer->nextDeadlineNs += pTimer->periodNs;
+    return missed;
+}
+
+long long DeadlineTimer_getTimeInNs(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec * NS_PER_SECOND + spec.tv_nsec;
+}
@@ -2,6 +2,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 void File_writeToFile(char* filename, char* content) {
     FILE *file = fopen(filename, "w");
@@ -30,4 +32,53 @@ void File_readFromFile(char* filename, char* buff) {
     fgets(buff, MAX_LENGTH, file);
 
     fclose(file);
-}
\ No newline at end of file
+}
+
+void File_openReader(File_reader_t *pReader, char* filename) {
+    pReader->fd = open(filename, O_RDONLY);
+    if (pReader->fd < 0) {
+        printf("ERROR: Unable to open file (%s) for read\n", filename);
+        exit(-1);
+    }
+}
+
+void File_closeReader(File_reader_t *pReader) {
+    if (pReader->fd >= 0) {
+        close(pReader->fd);
+    }
+    pReader->fd = -1;
+}
+
+int File_readInt(File_reader_t *pReader) {
+    char buff[16];
+    ssize_t bytesRead = pread(pReader->fd, buff, sizeof(buff), 0);
+    if (bytesRead < 0) {
+        perror("ERROR: Unable to read file");
+        exit(-1);
+    }
+
+    int value = 0;
+    for (ssize_t i = 0; i < bytesRead && buff[i] >= '0' && buff[i] <= '9'; i++) {
+        value = value * 10 + (buff[i] - '0');
+    }
+    return value;
+}
+
+void File_openWriter(File_writer_t *pWriter, char* filename) {
+    pWriter->fd = open(filename, O_WRONLY);
+    if (pWriter->fd < 0) {
+        printf("ERROR: Unable to open file (%s) for write\n", filename);
+        exit(-1);
+    }
+}
+
+void File_closeWriter(File_writer_t *pWriter) {
+    if (pWriter->fd >= 0) {
+        close(pWriter->fd);
+    }
+    pWriter->fd = -1;
+}
+
+bool File_write(File_writer_t *pWriter, const char* content, int length) {
+    return pwrite(pWriter->fd, content, length, 0) == length;
+}
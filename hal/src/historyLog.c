@@ -0,0 +1,359 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hal/historyLog.h"
+#include "hal/log.h"
+
+#define LOG_MAGIC "LSHISTLG"
+#define LOG_VERSION 2
+#define HEADER_BYTES 64
+#define FLUSH_INTERVAL_MS 1000
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t slotBytes;
+    uint32_t numSlots;
+    uint32_t maxRawSamples;
+    // CRC-32 of the fields above
+    uint32_t checksum;
+} header_t;
+
+// One slot; followed by `numRawSamples` codes. The checksum covers the
+// whole slot (with the checksum itself as 0) up to the last code.
+typedef struct {
+    uint64_t sequence;
+    uint32_t checksum;
+    uint32_t numRawSamples;
+
+    // Wall clock
+    int64_t startTimeMs;
+    int64_t endTimeMs;
+
+    int32_t count;
+    int32_t minCode;
+    int32_t maxCode;
+    int32_t dips;
+    uint64_t sum;
+    uint64_t sumOfSquares;
+
+    int32_t numPeriodSamples;
+    int32_t numMissedDeadlines;
+    double minPeriodInMs;
+    double maxPeriodInMs;
+    double avgPeriodInMs;
+    double p50PeriodInMs;
+    double p90PeriodInMs;
+    double p99PeriodInMs;
+    double p999PeriodInMs;
+} record_t;
+
+typedef struct {
+    unsigned long long sequence;
+    int slot;
+} recoveredSlot_t;
+
+static void *flushLoop(void *arg);
+static bool isHeaderValid(const header_t *pHeader, const header_t *pExpected);
+static record_t *getSlot(HistoryLog_t *pLog, int slot);
+static bool isRecordValid(HistoryLog_t *pLog, const record_t *pRecord);
+static int compareSequences(const void *pA, const void *pB);
+static long long getWallClockOffsetMs(void);
+static long long getTimeInMs(clockid_t clock);
+static uint32_t updateCrc(uint32_t crc, const void *pData, size_t length);
+
+// Slice-by-8: crcTables[k][i] is the CRC of byte i followed by k zeros
+static uint32_t crcTables[8][256];
+
+void HistoryLog_open(HistoryLog_t *pLog, char *path, int numSlots, int maxRawSamples) {
+    memset(pLog, 0, sizeof(*pLog));
+    if (crcTables[0][1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320u : 0);
+            }
+            crcTables[0][i] = crc;
+        }
+        for (int k = 1; k < 8; k++) {
+            for (int i = 0; i < 256; i++) {
+                uint32_t crc = crcTables[k - 1][i];
+                crcTables[k][i] = (crc >> 8) ^ crcTables[0][crc & 0xFF];
+            }
+        }
+    }
+
+    header_t expected = {
+        .version = LOG_VERSION,
+        .slotBytes = (sizeof(record_t) + maxRawSamples * sizeof(uint16_t) + 7) & ~7u,
+        .numSlots = numSlots,
+        .maxRawSamples = maxRawSamples,
+    };
+    memcpy(expected.magic, LOG_MAGIC, sizeof(expected.magic));
+    expected.checksum = updateCrc(0, &expected, offsetof(header_t, checksum));
+
+    pLog->numSlots = numSlots;
+    pLog->slotBytes = expected.slotBytes;
+    pLog->maxRawSamples = maxRawSamples;
+    pLog->mappingBytes = HEADER_BYTES + (long long)numSlots * pLog->slotBytes;
+    pLog->nextSequence = 1;
+
+    pLog->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (pLog->fd < 0) {
+        printf("ERROR: Unable to open history log (%s) (%s)\n", path, strerror(errno));
+        exit(-1);
+    }
+    header_t header = {0};
+    struct stat status = {0};
+    bool isReused = fstat(pLog->fd, &status) == 0 && status.st_size == pLog->mappingBytes
+        && pread(pLog->fd, &header, sizeof(header), 0) == sizeof(header)
+        && isHeaderValid(&header, &expected);
+    if (!isReused) {
+        if (status.st_size > 0) {
+            Log_write(LOG_LEVEL_WARNING, "WARNING: %s is not a history log of this size; starting a new one\n", path);
+        }
+        // Reserve the blocks now, so a full disk fails here rather than
+        // faulting the sampling thread on a write into the mapping
+        int result = ftruncate(pLog->fd, 0);
+        result = result == 0 ? posix_fallocate(pLog->fd, 0, pLog->mappingBytes) : errno;
+        if (result != 0) {
+            printf("ERROR: Unable to size history log (%s) (%s)\n", path, strerror(result));
+            exit(-1);
+        }
+    }
+
+    pLog->pMapping = mmap(NULL, pLog->mappingBytes, PROT_READ | PROT_WRITE, MAP_SHARED, pLog->fd, 0);
+    if (pLog->pMapping == MAP_FAILED) {
+        printf("ERROR: Unable to map history log (%s) (%s)\n", path, strerror(errno));
+        exit(-1);
+    }
+    if (!isReused) {
+        memcpy(pLog->pMapping, &expected, sizeof(expected));
+        msync(pLog->pMapping, pLog->mappingBytes, MS_SYNC);
+    }
+
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&pLog->flushCondition, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_mutex_init(&pLog->flushLock, NULL);
+    pLog->isFlushing = true;
+    pthread_create(&pLog->flushThread, NULL, flushLoop, pLog);
+}
+
+void HistoryLog_close(HistoryLog_t *pLog) {
+    pthread_mutex_lock(&pLog->flushLock);
+    pLog->isFlushing = false;
+    pthread_cond_signal(&pLog->flushCondition);
+    pthread_mutex_unlock(&pLog->flushLock);
+    pthread_join(pLog->flushThread, NULL);
+    pthread_cond_destroy(&pLog->flushCondition);
+    pthread_mutex_destroy(&pLog->flushLock);
+
+    munmap(pLog->pMapping, pLog->mappingBytes);
+    close(pLog->fd);
+    pLog->pMapping = NULL;
+    pLog->fd = -1;
+}
+
+int HistoryLog_recover(HistoryLog_t *pLog,
+    void (*onEntry)(const HistoryLog_entry_t *pEntry, const uint16_t *pRaw, void *pContext), void *pContext)
+{
+    recoveredSlot_t *pRecovered = malloc(sizeof(*pRecovered) * pLog->numSlots);
+    if (pRecovered == NULL) {
+        printf("ERROR: Unable to allocate history log recovery\n");
+        exit(-1);
+    }
+    int numRecovered = 0;
+    for (int i = 0; i < pLog->numSlots; i++) {
+        const record_t *pRecord = getSlot(pLog, i);
+        if (isRecordValid(pLog, pRecord)) {
+            pRecovered[numRecovered].sequence = pRecord->sequence;
+            pRecovered[numRecovered].slot = i;
+            numRecovered++;
+        }
+    }
+    qsort(pRecovered, numRecovered, sizeof(pRecovered[0]), compareSequences);
+
+    long long wallClockOffsetMs = getWallClockOffsetMs();
+    for (int i = 0; i < numRecovered; i++) {
+        const record_t *pRecord = getSlot(pLog, pRecovered[i].slot);
+        HistoryLog_entry_t entry = {
+            .startTimeMs = pRecord->startTimeMs - wallClockOffsetMs,
+            .endTimeMs = pRecord->endTimeMs - wallClockOffsetMs,
+            .stats = {
+                .count = pRecord->count,
+                .minCode = pRecord->minCode,
+                .maxCode = pRecord->maxCode,
+                .sum = pRecord->sum,
+                .sumOfSquares = pRecord->sumOfSquares,
+                .dips = pRecord->dips,
+                .isDipped = false,
+            },
+            .periodStats = {
+                .numSamples = pRecord->numPeriodSamples,
+                .minPeriodInMs = pRecord->minPeriodInMs,
+                .maxPeriodInMs = pRecord->maxPeriodInMs,
+                .avgPeriodInMs = pRecord->avgPeriodInMs,
+                .p50PeriodInMs = pRecord->p50PeriodInMs,
+                .p90PeriodInMs = pRecord->p90PeriodInMs,
+                .p99PeriodInMs = pRecord->p99PeriodInMs,
+                .p999PeriodInMs = pRecord->p999PeriodInMs,
+                .numMissedDeadlines = pRecord->numMissedDeadlines,
+            },
+            .numRawSamples = pRecord->numRawSamples,
+        };
+        const uint16_t *pRaw = pRecord->numRawSamples > 0 ? (const uint16_t *)(pRecord + 1) : NULL;
+        onEntry(&entry, pRaw, pContext);
+        pLog->nextSequence = pRecovered[i].sequence + 1;
+    }
+    free(pRecovered);
+    return numRecovered;
+}
+
+void HistoryLog_append(HistoryLog_t *pLog, const HistoryLog_entry_t *pEntry,
+    const uint16_t *pSpans[], const int spanSizes[], int numSpans)
+{
+    long long wallClockOffsetMs = getWallClockOffsetMs();
+    record_t record = {
+        .sequence = pLog->nextSequence,
+        .checksum = 0,
+        .numRawSamples = 0,
+        .startTimeMs = pEntry->startTimeMs + wallClockOffsetMs,
+        .endTimeMs = pEntry->endTimeMs + wallClockOffsetMs,
+        .count = pEntry->stats.count,
+        .minCode = pEntry->stats.minCode,
+        .maxCode = pEntry->stats.maxCode,
+        .dips = pEntry->stats.dips,
+        .sum = pEntry->stats.sum,
+        .sumOfSquares = pEntry->stats.sumOfSquares,
+        .numPeriodSamples = pEntry->periodStats.numSamples,
+        .numMissedDeadlines = pEntry->periodStats.numMissedDeadlines,
+        .minPeriodInMs = pEntry->periodStats.minPeriodInMs,
+        .maxPeriodInMs = pEntry->periodStats.maxPeriodInMs,
+        .avgPeriodInMs = pEntry->periodStats.avgPeriodInMs,
+        .p50PeriodInMs = pEntry->periodStats.p50PeriodInMs,
+        .p90PeriodInMs = pEntry->periodStats.p90PeriodInMs,
+        .p99PeriodInMs = pEntry->periodStats.p99PeriodInMs,
+        .p999PeriodInMs = pEntry->periodStats.p999PeriodInMs,
+    };
+
+    // Raw codes go straight from the spans into the slot
+    record_t *pSlot = getSlot(pLog, (int)((pLog->nextSequence - 1) % pLog->numSlots));
+    uint16_t *pRaw = (uint16_t *)(pSlot + 1);
+    uint32_t crc = 0;
+    for (int i = 0; i < numSpans && record.numRawSamples < (uint32_t)pLog->maxRawSamples; i++) {
+        int count = spanSizes[i];
+        int room = pLog->maxRawSamples - record.numRawSamples;
+        count = count < room ? count : room;
+        memcpy(pRaw + record.numRawSamples, pSpans[i], count * sizeof(uint16_t));
+        record.numRawSamples += count;
+    }
+    crc = updateCrc(crc, &record, sizeof(record));
+    crc = updateCrc(crc, pRaw, record.numRawSamples * sizeof(uint16_t));
+    record.checksum = crc;
+    memcpy(pSlot, &record, sizeof(record));
+
+    atomic_store_explicit(&pLog->writtenSequence, pLog->nextSequence, memory_order_relaxed);
+    pLog->nextSequence++;
+}
+
+static void *flushLoop(void *arg) {
+    HistoryLog_t *pLog = arg;
+    unsigned long long flushedSequence = 0;
+    pthread_mutex_lock(&pLog->flushLock);
+    while (true) {
+        bool isStopping = !pLog->isFlushing;
+        if (!isStopping) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += FLUSH_INTERVAL_MS / 1000;
+            deadline.tv_nsec += (FLUSH_INTERVAL_MS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&pLog->flushCondition, &pLog->flushLock, &deadline);
+            isStopping = !pLog->isFlushing;
+        }
+        pthread_mutex_unlock(&pLog->flushLock);
+
+        // msync only writes the pages dirtied since the last one
+        unsigned long long writtenSequence = atomic_load_explicit(&pLog->writtenSequence, memory_order_relaxed);
+        if (writtenSequence != flushedSequence) {
+            if (msync(pLog->pMapping, pLog->mappingBytes, MS_SYNC) != 0) {
+                Log_write(LOG_LEVEL_WARNING, "WARNING: Unable to flush history log (%s)\n", strerror(errno));
+            }
+            flushedSequence = writtenSequence;
+        }
+        if (isStopping) {
+            return NULL;
+        }
+        pthread_mutex_lock(&pLog->flushLock);
+    }
+}
+
+static bool isHeaderValid(const header_t *pHeader, const header_t *pExpected) {
+    return memcmp(pHeader, pExpected, sizeof(*pHeader)) == 0;
+}
+
+static record_t *getSlot(HistoryLog_t *pLog, int slot) {
+    return (record_t *)(pLog->pMapping + HEADER_BYTES + (long long)slot * pLog->slotBytes);
+}
+
+static bool isRecordValid(HistoryLog_t *pLog, const record_t *pRecord) {
+    if (pRecord->sequence == 0 || pRecord->numRawSamples > (uint32_t)pLog->maxRawSamples) {
+        return false;
+    }
+    record_t record = *pRecord;
+    record.checksum = 0;
+    uint32_t crc = updateCrc(0, &record, sizeof(record));
+    crc = updateCrc(crc, pRecord + 1, pRecord->numRawSamples * sizeof(uint16_t));
+    return crc == pRecord->checksum;
+}
+
+static int compareSequences(const void *pA, const void *pB) {
+    unsigned long long a = ((const recoveredSlot_t *)pA)->sequence;
+    unsigned long long b = ((const recoveredSlot_t *)pB)->sequence;
+    return a < b ? -1 : a > b;
+}
+
+// Wall clock minus monotonic clock
+static long long getWallClockOffsetMs(void) {
+    return getTimeInMs(CLOCK_REALTIME) - getTimeInMs(CLOCK_MONOTONIC);
+}
+
+static long long getTimeInMs(clockid_t clock) {
+    struct timespec spec;
+    clock_gettime(clock, &spec);
+    return spec.tv_sec * 1000LL + spec.tv_nsec / 1000000;
+}
+
+// CRC-32 (IEEE 802.3), continued from `crc` (0 to start). It runs on the
+// sampling thread over every window's raw codes, so it takes eight bytes
+// per step rather than one.
+static uint32_t updateCrc(uint32_t crc, const void *pData, size_t length) {
+    const unsigned char *pBytes = pData;
+    crc = ~crc;
+    for (; length >= 8; length -= 8, pBytes += 8) {
+        crc ^= pBytes[0] | pBytes[1] << 8 | pBytes[2] << 16 | (uint32_t)pBytes[3] << 24;
+        crc = crcTables[7][crc & 0xFF] ^ crcTables[6][(crc >> 8) & 0xFF]
+            ^ crcTables[5][(crc >> 16) & 0xFF] ^ crcTables[4][crc >> 24]
+            ^ crcTables[3][pBytes[4]] ^ crcTables[2][pBytes[5]]
+            ^ crcTables[1][pBytes[6]] ^ crcTables[0][pBytes[7]];
+    }
+    for (; length > 0; length--, pBytes++) {
+        crc = crcTables[0][(crc ^ *pBytes) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
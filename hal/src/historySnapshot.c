@@ -0,0 +1,76 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hal/historySnapshot.h"
+
+void HistorySnapshot_initPool(HistorySnapshot_pool_t *pPool, int numSnapshots, int capacity) {
+    pPool->pSnapshots = calloc(numSnapshots, sizeof(pPool->pSnapshots[0]));
+    if (pPool->pSnapshots == NULL) {
+        printf("ERROR: Unable to allocate history snapshots\n");
+        exit(-1);
+    }
+    for (int i = 0; i < numSnapshots; i++) {
+        HistorySnapshot_t *pSnapshot = &pPool->pSnapshots[i];
+        pSnapshot->pSamples = calloc(capacity > 0 ? capacity : 1, sizeof(pSnapshot->pSamples[0]));
+        if (pSnapshot->pSamples == NULL) {
+            printf("ERROR: Unable to allocate history snapshots\n");
+            exit(-1);
+        }
+        pSnapshot->capacity = capacity;
+        atomic_init(&pSnapshot->refCount, 0);
+    }
+    pPool->numSnapshots = numSnapshots;
+    atomic_init(&pPool->skippedPublishes, 0);
+
+    // The current snapshot holds one reference of its own
+    atomic_store(&pPool->pSnapshots[0].refCount, 1);
+    atomic_init(&pPool->pCurrent, &pPool->pSnapshots[0]);
+}
+
+void HistorySnapshot_cleanupPool(HistorySnapshot_pool_t *pPool) {
+    for (int i = 0; i < pPool->numSnapshots; i++) {
+        free(pPool->pSnapshots[i].pSamples);
+    }
+    free(pPool->pSnapshots);
+    pPool->pSnapshots = NULL;
+    pPool->numSnapshots = 0;
+}
+
+HistorySnapshot_t *HistorySnapshot_claim(HistorySnapshot_pool_t *pPool) {
+    for (int i = 0; i < pPool->numSnapshots; i++) {
+        HistorySnapshot_t *pSnapshot = &pPool->pSnapshots[i];
+        int expected = 0;
+        // Claiming takes the reference the snapshot will hold as "current";
+        // a stale reader bumping the count first makes the claim fail
+        if (atomic_compare_exchange_strong(&pSnapshot->refCount, &expected, 1)) {
+            return pSnapshot;
+        }
+    }
+    atomic_fetch_add(&pPool->skippedPublishes, 1);
+    return NULL;
+}
+
+void HistorySnapshot_publish(HistorySnapshot_pool_t *pPool, HistorySnapshot_t *pSnapshot) {
+    HistorySnapshot_t *pOld = atomic_exchange(&pPool->pCurrent, pSnapshot);
+    HistorySnapshot_release(pOld);
+}
+
+const HistorySnapshot_t *HistorySnapshot_acquire(HistorySnapshot_pool_t *pPool) {
+    while (true) {
+        HistorySnapshot_t *pSnapshot = atomic_load(&pPool->pCurrent);
+        atomic_fetch_add(&pSnapshot->refCount, 1);
+
+        // Only valid if it was still current once our reference was taken
+        if (atomic_load(&pPool->pCurrent) == pSnapshot) {
+            return pSnapshot;
+        }
+        HistorySnapshot_release(pSnapshot);
+    }
+}
+
+void HistorySnapshot_release(const HistorySnapshot_t *pSnapshot) {
+    HistorySnapshot_t *pMutable = (HistorySnapshot_t *)pSnapshot;
+    atomic_fetch_sub(&pMutable->refCount, 1);
+}
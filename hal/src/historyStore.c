@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal/historyStore.h"
+
+// Entries of the finer tier rolled into one entry of the next tier
+#define SECONDS_PER_MINUTE 60
+#define MINUTES_PER_HOUR 60
+
+static void initRing(HistoryStore_ring_t *pRing, int capacity);
+static void append(HistoryStore_t *pStore, enum HistoryStore_tier tier, const HistoryStore_summary_t *pSummary);
+static const HistoryStore_summary_t *getEntry(const HistoryStore_ring_t *pRing, int index);
+static int findFirstStartingAtOrAfter(const HistoryStore_ring_t *pRing, long long timeMs);
+static int findFirstEndingAfter(const HistoryStore_ring_t *pRing, long long timeMs);
+static void queryTier(HistoryStore_t *pStore, int tier, long long fromMs, long long toMs, HistoryStore_range_t *pRange);
+static unsigned int beginRead(const HistoryStore_t *pStore);
+static bool isReadConsistent(const HistoryStore_t *pStore, unsigned int sequence);
+
+static const int ROLL_UP_COUNT[NUM_HISTORY_TIERS] = {SECONDS_PER_MINUTE, MINUTES_PER_HOUR, 0};
+
+void HistoryStore_init(HistoryStore_t *pStore, int numSeconds, int numMinutes, int numHours) {
+    memset(pStore, 0, sizeof(*pStore));
+    initRing(&pStore->tiers[HISTORY_TIER_SECOND], numSeconds);
+    initRing(&pStore->tiers[HISTORY_TIER_MINUTE], numMinutes);
+    initRing(&pStore->tiers[HISTORY_TIER_HOUR], numHours);
+}
+
+void HistoryStore_cleanup(HistoryStore_t *pStore) {
+    for (int i = 0; i < NUM_HISTORY_TIERS; i++) {
+        free(pStore->tiers[i].pEntries);
+        pStore->tiers[i].pEntries = NULL;
+    }
+}
+
+void HistoryStore_addSecond(HistoryStore_t *pStore, const HistoryStore_summary_t *pSecond) {
+    unsigned int sequence = atomic_load_explicit(&pStore->sequence, memory_order_relaxed);
+    atomic_store_explicit(&pStore->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    append(pStore, HISTORY_TIER_SECOND, pSecond);
+    atomic_store_explicit(&pStore->sequence, sequence + 2, memory_order_release);
+}
+
+bool HistoryStore_query(HistoryStore_t *pStore, long long fromMs, long long toMs, HistoryStore_range_t *pRange) {
+    unsigned int sequence;
+    do {
+        sequence = beginRead(pStore);
+        memset(pRange, 0, sizeof(*pRange));
+        WindowKernel_reset(&pRange->stats);
+        queryTier(pStore, HISTORY_TIER_HOUR, fromMs, toMs, pRange);
+    } while (!isReadConsistent(pStore, sequence));
+    return pRange->numSummaries > 0;
+}
+
+bool HistoryStore_getSecond(HistoryStore_t *pStore, int secondsAgo, HistoryStore_summary_t *pSecond) {
+    const HistoryStore_ring_t *pRing = &pStore->tiers[HISTORY_TIER_SECOND];
+    bool found;
+    unsigned int sequence;
+    do {
+        sequence = beginRead(pStore);
+        int count = pRing->count;
+        found = secondsAgo >= 0 && secondsAgo < count;
+        if (found) {
+            *pSecond = *getEntry(pRing, count - 1 - secondsAgo);
+        }
+    } while (!isReadConsistent(pStore, sequence));
+    return found;
+}
+
+static void initRing(HistoryStore_ring_t *pRing, int capacity) {
+    pRing->capacity = capacity > 0 ? capacity : 1;
+    pRing->pEntries = calloc(pRing->capacity, sizeof(pRing->pEntries[0]));
+    if (pRing->pEntries == NULL) {
+        printf("ERROR: Unable to allocate history store\n");
+        exit(-1);
+    }
+}
+
+static void append(HistoryStore_t *pStore, enum HistoryStore_tier tier, const HistoryStore_summary_t *pSummary) {
+    HistoryStore_ring_t *pRing = &pStore->tiers[tier];
+    pRing->pEntries[pRing->next] = *pSummary;
+    pRing->next = (pRing->next + 1) % pRing->capacity;
+    if (pRing->count < pRing->capacity) {
+        pRing->count++;
+    }
+
+    if (ROLL_UP_COUNT[tier] == 0) {
+        return;
+    }
+    HistoryStore_summary_t *pPending = &pStore->pending[tier];
+    if (pStore->pendingCount[tier] == 0) {
+        *pPending = *pSummary;
+        pPending->epoch = 0;
+        pPending->firstSampleIndex = 0;
+        pPending->numSamples = 0;
+    }
+    else {
+        WindowKernel_merge(&pPending->stats, &pSummary->stats);
+        pPending->endTimeMs = pSummary->endTimeMs;
+    }
+    pStore->pendingCount[tier]++;
+    if (pStore->pendingCount[tier] == ROLL_UP_COUNT[tier]) {
+        pStore->pendingCount[tier] = 0;
+        append(pStore, tier + 1, pPending);
+    }
+}
+
+// Logical index 0 is the oldest entry
+static const HistoryStore_summary_t *getEntry(const HistoryStore_ring_t *pRing, int index) {
+    int oldest = (pRing->next - pRing->count + pRing->capacity) % pRing->capacity;
+    return &pRing->pEntries[(oldest + index) % pRing->capacity];
+}
+
+static int findFirstStartingAtOrAfter(const HistoryStore_ring_t *pRing, long long timeMs) {
+    int low = 0;
+    int high = pRing->count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (getEntry(pRing, middle)->startTimeMs < timeMs) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static int findFirstEndingAfter(const HistoryStore_ring_t *pRing, long long timeMs) {
+    int low = 0;
+    int high = pRing->count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (getEntry(pRing, middle)->endTimeMs <= timeMs) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Merge this tier's run of entries lying wholly inside [fromMs, toMs), then
+// cover what is left on either side of the run from the next finer tier.
+static void queryTier(HistoryStore_t *pStore, int tier, long long fromMs, long long toMs, HistoryStore_range_t *pRange) {
+    if (tier < 0 || fromMs >= toMs) {
+        return;
+    }
+    const HistoryStore_ring_t *pRing = &pStore->tiers[tier];
+    int first = findFirstStartingAtOrAfter(pRing, fromMs);
+    int end = findFirstEndingAfter(pRing, toMs);
+    if (first >= end) {
+        queryTier(pStore, tier - 1, fromMs, toMs, pRange);
+        return;
+    }
+
+    long long runStartMs = getEntry(pRing, first)->startTimeMs;
+    long long runEndMs = getEntry(pRing, end - 1)->endTimeMs;
+    queryTier(pStore, tier - 1, fromMs, runStartMs, pRange);
+    for (int i = first; i < end; i++) {
+        const HistoryStore_summary_t *pEntry = getEntry(pRing, i);
+        WindowKernel_merge(&pRange->stats, &pEntry->stats);
+        pRange->coveredMs += pEntry->endTimeMs - pEntry->startTimeMs;
+        if (pRange->numSummaries == 0 || pEntry->startTimeMs < pRange->firstTimeMs) {
+            pRange->firstTimeMs = pEntry->startTimeMs;
+        }
+        if (pRange->numSummaries == 0 || pEntry->endTimeMs > pRange->lastTimeMs) {
+            pRange->lastTimeMs = pEntry->endTimeMs;
+        }
+        pRange->numSummaries++;
+    }
+    queryTier(pStore, tier - 1, runEndMs, toMs, pRange);
+}
+
+// A read races the producer's writes, but only ever sees indices within the
+// rings, and is retried if a summary was added (or was being added) meanwhile
+static unsigned int beginRead(const HistoryStore_t *pStore) {
+    return atomic_load_explicit(&pStore->sequence, memory_order_acquire);
+}
+
+static bool isReadConsistent(const HistoryStore_t *pStore, unsigned int sequence) {
+    atomic_thread_fence(memory_order_acquire);
+    return (sequence & 1) == 0 && sequence == atomic_load_explicit(&pStore->sequence, memory_order_relaxed);
+}
@@ -1,36 +1,53 @@
-#include "pthread.h"
 #include "stdbool.h"
 #include "stdlib.h"
 #include "stdio.h"
+#include "time.h"
 
-#include "hal/file.h"
+#include "hal/backend.h"
 #include "hal/led.h"
+#include "hal/periodTimer.h"
+#include "hal/reactor.h"
 
-static void runCommand(char* command);
-static void *pwmMonitorUpdateLoop(void *arg);
+static void updatePwm(void *pContext);
 static void sleepForMs(long long delayInMs);
 
-static _Atomic bool isRunning;
-static int currentPOTValue;
-static pthread_t flashingThread;
+static _Atomic int currentPOTValue;
+static SampleSource_t potSource;
+static int currentHz;
+static int pwmEnableOutput;
+static int pwmPeriodOutput;
+static int pwmDutyCycleOutput;
+static int potReadsPerSecond = LED_DEFAULT_POT_READS_PER_SECOND;
 
-#define POT_VOLTAGE_DIRECTORY "/sys/bus/iio/devices/iio:device0/in_voltage0_raw"
+#define POT_CHANNEL 0
 #define PWM_DUTY_CYCLE_DIRECTORY "/dev/bone/pwm/0/b/duty_cycle"
 #define PWM_PERIOD_DIRECTORY "/dev/bone/pwm/0/b/period"
 #define PWM_ENABLE_DIRECTORY "/dev/bone/pwm/0/b/enable"
 #define PWM_ENABLE_PIN_COMMAND "config-pin p9.21 pwm"
 
 void Led_init() {
-    isRunning = true;
-    runCommand(PWM_ENABLE_PIN_COMMAND);
-    sleepForMs(100); // Wait for pin to be enabled
-    pthread_create(&flashingThread, NULL, pwmMonitorUpdateLoop, NULL);
+    Backend_runCommand(PWM_ENABLE_PIN_COMMAND);
+    if(!Backend_isSimulated()) {
+        sleepForMs(100); // Wait for pin to be enabled
+    }
+    pwmEnableOutput = Backend_openOutput(PWM_ENABLE_DIRECTORY);
+    pwmPeriodOutput = Backend_openOutput(PWM_PERIOD_DIRECTORY);
+    pwmDutyCycleOutput = Backend_openOutput(PWM_DUTY_CYCLE_DIRECTORY);
+    Backend_openAdcSource(&potSource, BACKEND_ADC_POLLED, POT_CHANNEL, potReadsPerSecond);
+    currentHz = 0;
+    Reactor_addTask(1000000000LL / potReadsPerSecond, updatePwm, NULL);
 }
 
 void Led_cleanup() {
-    isRunning = false;
-    File_writeToFile(PWM_ENABLE_DIRECTORY, "0");
-    pthread_join(flashingThread, NULL);
+    potSource.close(&potSource);
+    Backend_writeOutput(pwmEnableOutput, "0", 1);
+    Backend_closeOutput(pwmEnableOutput);
+    Backend_closeOutput(pwmPeriodOutput);
+    Backend_closeOutput(pwmDutyCycleOutput);
+}
+
+void Led_setPotReadsPerSecond(int readsPerSecond) {
+    potReadsPerSecond = readsPerSecond > 0 ? readsPerSecond : LED_DEFAULT_POT_READS_PER_SECOND;
 }
 
 int Led_getPOTValue(void) {
@@ -38,51 +55,32 @@ int Led_getPOTValue(void) {
 }
 
 #define SECOND_MULTIPLIER 1000000000
-static void *pwmMonitorUpdateLoop(void *arg) {
-    (void)arg;
-    int currentHz = 0;
-    while(isRunning) {
-        char readFileBuffer[64];
-        File_readFromFile(POT_VOLTAGE_DIRECTORY, readFileBuffer);
-        currentPOTValue = atoi(readFileBuffer);
-        int targetHz = currentPOTValue / 40;
-        char targetPeriod[16];
-        char targetDutyCycle[16];
-        if(targetHz != currentHz) {
-            if(targetHz == 0) {
-                File_writeToFile(PWM_ENABLE_DIRECTORY, "0");
-            }
-            else {
-                double flTargetPeriod = (float)SECOND_MULTIPLIER / (float)targetHz;
-                double flTargetDutyCycle = 0.25 * flTargetPeriod;
-                snprintf(targetPeriod, 16, "%d", (int)(flTargetPeriod));
-                snprintf(targetDutyCycle, 16, "%d", (int)(flTargetDutyCycle));
-
-                File_writeToFile(PWM_ENABLE_DIRECTORY, "1");
-                File_writeToFile(PWM_PERIOD_DIRECTORY, targetPeriod);
-                File_writeToFile(PWM_DUTY_CYCLE_DIRECTORY, targetDutyCycle);
-            }
-            currentHz = targetHz;
-        }
-
-        sleepForMs(100);
-    }
-    return NULL;
-}
-
-static void runCommand(char* command) {
-    FILE *pipe = popen(command, "r");
-    char buffer[1024];
-
-    while (!feof(pipe) && !ferror(pipe)) {
-        if (fgets(buffer, sizeof(buffer), pipe) == NULL)
-        break;
+// Reactor task: read the POT and retune the PWM if its frequency changed
+static void updatePwm(void *pContext) {
+    (void)pContext;
+    Period_markEvent(PERIOD_EVENT_LED_UPDATE);
+    uint16_t potCode;
+    if(potSource.read(&potSource, &potCode, 1) == 1) {
+        currentPOTValue = potCode;
     }
+    int targetHz = currentPOTValue / 40;
+    char targetPeriod[16];
+    char targetDutyCycle[16];
+    if(targetHz != currentHz) {
+        if(targetHz == 0) {
+            Backend_writeOutput(pwmEnableOutput, "0", 1);
+        }
+        else {
+            double flTargetPeriod = (float)SECOND_MULTIPLIER / (float)targetHz;
+            double flTargetDutyCycle = 0.25 * flTargetPeriod;
+            int periodLength = snprintf(targetPeriod, 16, "%d", (int)(flTargetPeriod));
+            int dutyCycleLength = snprintf(targetDutyCycle, 16, "%d", (int)(flTargetDutyCycle));
 
-    int exitCode = WEXITSTATUS(pclose(pipe));
-    if (exitCode != 0) {
-        printf("Unable to execute command: %s, exit code: %d\n", command, exitCode);
-        exit(1);
+            Backend_writeOutput(pwmEnableOutput, "1", 1);
+            Backend_writeOutput(pwmPeriodOutput, targetPeriod, periodLength);
+            Backend_writeOutput(pwmDutyCycleOutput, targetDutyCycle, dutyCycleLength);
+        }
+        currentHz = targetHz;
     }
 }
 
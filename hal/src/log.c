@@ -0,0 +1,272 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "hal/log.h"
+
+// A power of two; a burst of more messages than this before the writer
+// catches up is dropped
+#define RING_SLOTS 256
+#define RECORD_HEADER_BYTES 12
+
+typedef struct {
+    // Equal to the position it may next be filled for; one more once filled
+    _Atomic unsigned long long sequence;
+    long long timeNs;
+    int level;
+    int length;
+    char text[LOG_MAX_MESSAGE_LEN];
+} slot_t;
+
+static void *writeLoop(void *arg);
+static bool writeAvailable(void);
+static bool isRingEmpty(void);
+static void wakeWriter(void);
+static void writeRecord(int level, long long timeNs, const char *pText, int length);
+static int formatMessage(char *pText, const char *format, va_list args);
+static long long getTimeInNs(void);
+
+static const char *levelNames[NUM_LOG_LEVELS] = {
+    [LOG_LEVEL_ERROR] = "error",
+    [LOG_LEVEL_WARNING] = "warning",
+    [LOG_LEVEL_INFO] = "info",
+    [LOG_LEVEL_DEBUG] = "debug",
+};
+
+static _Atomic int maxLevel = LOG_LEVEL_INFO;
+static char *binaryPath = NULL;
+static int binaryFd = -1;
+
+static pthread_t writerThread;
+static _Atomic bool isRunning;
+static int wakeEventDescriptor = -1;
+static _Atomic bool isWriterWaiting;
+
+// Many producers claim positions at the tail; the writer alone reads at
+// the head
+static slot_t slots[RING_SLOTS];
+static _Atomic unsigned long long ringTail;
+static unsigned long long ringHead;
+
+static _Atomic long long numDropped;
+static long long numDroppedReported;
+
+void Log_setLevel(enum Log_level level) {
+    maxLevel = level;
+}
+
+bool Log_parseLevel(const char *name, enum Log_level *pLevel) {
+    for (int i = 0; i < NUM_LOG_LEVELS; i++) {
+        if (strcmp(name, levelNames[i]) == 0) {
+            *pLevel = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Log_setBinaryOutput(char *path) {
+    binaryPath = path;
+}
+
+void Log_init(void) {
+    for (int i = 0; i < RING_SLOTS; i++) {
+        atomic_init(&slots[i].sequence, i);
+    }
+    ringTail = 0;
+    ringHead = 0;
+    if (binaryPath != NULL) {
+        binaryFd = open(binaryPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (binaryFd < 0) {
+            printf("ERROR: Unable to open log (%s) for write (%s)\n", binaryPath, strerror(errno));
+            exit(-1);
+        }
+    }
+    wakeEventDescriptor = eventfd(0, EFD_CLOEXEC);
+    if (wakeEventDescriptor == -1) {
+        printf("ERROR: Unable to create log wake event (%s)\n", strerror(errno));
+        exit(-1);
+    }
+    isRunning = true;
+    pthread_create(&writerThread, NULL, writeLoop, NULL);
+}
+
+void Log_cleanup(void) {
+    isRunning = false;
+    uint64_t one = 1;
+    if (write(wakeEventDescriptor, &one, sizeof(one)) != sizeof(one)) {
+        printf("WARNING: Unable to wake log writer (%s)\n", strerror(errno));
+    }
+    pthread_join(writerThread, NULL);
+    // Anything queued while the writer was finishing
+    while (writeAvailable()) {
+    }
+    fflush(stdout);
+    close(wakeEventDescriptor);
+    wakeEventDescriptor = -1;
+    if (binaryFd >= 0) {
+        close(binaryFd);
+        binaryFd = -1;
+    }
+}
+
+void Log_write(enum Log_level level, const char *format, ...) {
+    if ((int)level > maxLevel) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    if (!isRunning) {
+        char text[LOG_MAX_MESSAGE_LEN];
+        int length = formatMessage(text, format, args);
+        va_end(args);
+        writeRecord(level, getTimeInNs(), text, length);
+        fflush(level == LOG_LEVEL_ERROR ? stderr : stdout);
+        return;
+    }
+
+    // Claim the slot at the tail, unless the writer has yet to empty it
+    unsigned long long position = atomic_load_explicit(&ringTail, memory_order_relaxed);
+    slot_t *pSlot;
+    while (true) {
+        pSlot = &slots[position % RING_SLOTS];
+        unsigned long long sequence = atomic_load_explicit(&pSlot->sequence, memory_order_acquire);
+        long long difference = (long long)(sequence - position);
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ringTail, &position, position + 1,
+                memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0) {
+            va_end(args);
+            numDropped++;
+            return;
+        }
+        else {
+            position = atomic_load_explicit(&ringTail, memory_order_relaxed);
+        }
+    }
+
+    pSlot->timeNs = getTimeInNs();
+    pSlot->level = level;
+    pSlot->length = formatMessage(pSlot->text, format, args);
+    va_end(args);
+    atomic_store_explicit(&pSlot->sequence, position + 1, memory_order_release);
+    wakeWriter();
+}
+
+long long Log_getNumDropped(void) {
+    return numDropped;
+}
+
+static void *writeLoop(void *arg) {
+    (void)arg;
+    while (isRunning) {
+        bool hasWritten = false;
+        while (writeAvailable()) {
+            hasWritten = true;
+        }
+        long long dropped = numDropped;
+        if (dropped != numDroppedReported) {
+            char text[LOG_MAX_MESSAGE_LEN];
+            int length = snprintf(text, sizeof(text), "WARNING: Log dropped %lld messages (writer behind)\n",
+                dropped - numDroppedReported);
+            writeRecord(LOG_LEVEL_WARNING, getTimeInNs(), text, length);
+            numDroppedReported = dropped;
+            hasWritten = true;
+        }
+        if (hasWritten) {
+            fflush(stdout);
+            continue;
+        }
+
+        // Sleep until a producer finds the flag set; the exchange orders
+        // it against their publishing, so no message is left waiting
+        atomic_exchange(&isWriterWaiting, true);
+        if (isRingEmpty() && isRunning) {
+            uint64_t numWakes;
+            if (read(wakeEventDescriptor, &numWakes, sizeof(numWakes)) != sizeof(numWakes) && errno != EINTR) {
+                fprintf(stderr, "WARNING: Unable to wait for log messages (%s)\n", strerror(errno));
+            }
+        }
+        atomic_store(&isWriterWaiting, false);
+    }
+    while (writeAvailable()) {
+    }
+    return NULL;
+}
+
+// Write out the message at the head of the ring. Returns false if there
+// was none (or it is still being formatted).
+static bool writeAvailable(void) {
+    slot_t *pSlot = &slots[ringHead % RING_SLOTS];
+    if (atomic_load_explicit(&pSlot->sequence, memory_order_acquire) != ringHead + 1) {
+        return false;
+    }
+    writeRecord(pSlot->level, pSlot->timeNs, pSlot->text, pSlot->length);
+    atomic_store_explicit(&pSlot->sequence, ringHead + RING_SLOTS, memory_order_release);
+    ringHead++;
+    return true;
+}
+
+static bool isRingEmpty(void) {
+    slot_t *pSlot = &slots[ringHead % RING_SLOTS];
+    return atomic_load_explicit(&pSlot->sequence, memory_order_acquire) != ringHead + 1;
+}
+
+static void wakeWriter(void) {
+    if (atomic_exchange(&isWriterWaiting, false)) {
+        // An eventfd write only fails on overflow, when the writer is
+        // certainly awake already
+        uint64_t one = 1;
+        ssize_t result = write(wakeEventDescriptor, &one, sizeof(one));
+        (void)result;
+    }
+}
+
+static void writeRecord(int level, long long timeNs, const char *pText, int length) {
+    if (binaryFd < 0) {
+        fwrite(pText, 1, length, level == LOG_LEVEL_ERROR ? stderr : stdout);
+        return;
+    }
+    unsigned char record[RECORD_HEADER_BYTES + LOG_MAX_MESSAGE_LEN];
+    uint64_t time = timeNs;
+    uint16_t textLength = length;
+    memcpy(record, &time, sizeof(time));
+    record[8] = level;
+    record[9] = 0;
+    memcpy(record + 10, &textLength, sizeof(textLength));
+    memcpy(record + RECORD_HEADER_BYTES, pText, length);
+    if (write(binaryFd, record, RECORD_HEADER_BYTES + length) != RECORD_HEADER_BYTES + length) {
+        fprintf(stderr, "WARNING: Unable to write log (%s); logging to the console\n", strerror(errno));
+        close(binaryFd);
+        binaryFd = -1;
+    }
+}
+
+// Returns the length kept, which is less than the full message's if it
+// did not fit
+static int formatMessage(char *pText, const char *format, va_list args) {
+    int length = vsnprintf(pText, LOG_MAX_MESSAGE_LEN, format, args);
+    if (length < 0) {
+        return 0;
+    }
+    return length < LOG_MAX_MESSAGE_LEN ? length : LOG_MAX_MESSAGE_LEN - 1;
+}
+
+static long long getTimeInNs(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec * 1000000000LL + spec.tv_nsec;
+}
@@ -1,41 +1,95 @@
 #include <assert.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 
 #include "hal/periodTimer.h"
 
 // Written by Brian Fraser
 
+#define MS_PER_NS (1000*1000.0)
 
 
-// Data collected
+// Periods between one thread's marks, since the last statistics
 typedef struct {
-    // Store the timestamp samples each time we mark an event.
-    long timestampCount;
-    long long timestampsInNs[MAX_EVENT_TIMESTAMPS];
+    long long count;
+    long long sumNs;
+    long long minNs;
+    long long maxNs;
+    int missedDeadlineCount;
+    Period_histogram_t histogram;
+} accumulator_t;
+
+// Written only by the thread which registered it
+typedef struct {
+    // Odd while the owner is updating a bank
+    _Atomic unsigned int updateSequence;
 
     // Used for recording the event between analysis periods.
     long long prevTimestampInNs;
-} timestamps_t;
-static timestamps_t s_eventData[NUM_PERIOD_EVENTS];
 
-static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+    accumulator_t banks[2];
+} threadData_t;
+
+typedef struct {
+    // Bank the marking threads currently update
+    _Atomic int activeBank;
+    _Atomic int numThreads;
+    threadData_t threads[PERIOD_MAX_THREADS_PER_EVENT];
+} eventData_t;
+static eventData_t s_eventData[NUM_PERIOD_EVENTS];
+
+// Each thread's slot in every event (index + 1; 0 until it first marks),
+// valid for one Period_init()
+typedef struct {
+    int generation;
+    int slots[NUM_PERIOD_EVENTS];
+} threadSlots_t;
+static _Thread_local threadSlots_t s_threadSlots;
+static _Atomic int s_generation = 0;
+
+// Serializes readers only; marking never takes it
+static pthread_mutex_t s_readLock = PTHREAD_MUTEX_INITIALIZER;
 static bool s_initialized = false;
 
+static const char *s_eventNames[NUM_PERIOD_EVENTS] = {
+    [PERIOD_EVENT_SAMPLE_LIGHT] = "sampling",
+    [PERIOD_EVENT_ADC_READ] = "A2D read",
+    [PERIOD_EVENT_NETWORK_LOOP] = "network loop",
+    [PERIOD_EVENT_NETWORK_REQUEST] = "network request",
+    [PERIOD_EVENT_DISPLAY_FRAME] = "display frame",
+    [PERIOD_EVENT_LED_UPDATE] = "LED update",
+};
+
 
 // Prototypes
-static void updateStats(
-    timestamps_t *pData, 
-    Period_statistics_t *pStats
-);
+static threadData_t *getThreadData(enum Period_whichEvent whichEvent);
+static void accumulate(enum Period_whichEvent whichEvent, threadData_t *pThread, long long valueNs);
+static int getBucket(long long valueNs);
+static long long getBucketUpperBound(int bucket);
+static void beginUpdate(threadData_t *pThread);
+static void endUpdate(threadData_t *pThread);
+static void waitForUpdate(threadData_t *pThread);
+static void resetAccumulator(accumulator_t *pAccumulator);
 static long long getTimeInNanoS(void);
 
 
 void Period_init(void)
 {
     memset(s_eventData, 0, sizeof(s_eventData[0]) * NUM_PERIOD_EVENTS);
+    for (int i = 0; i < NUM_PERIOD_EVENTS; i++) {
+        for (int j = 0; j < PERIOD_MAX_THREADS_PER_EVENT; j++) {
+            resetAccumulator(&s_eventData[i].threads[j].banks[0]);
+            resetAccumulator(&s_eventData[i].threads[j].banks[1]);
+        }
+    }
+    // Forget every thread's registration from a previous init
+    atomic_fetch_add(&s_generation, 1);
     s_initialized = true;
 }
 void Period_cleanup(void)
@@ -44,104 +98,290 @@ void Period_cleanup(void)
     s_initialized = false;
 }
 
+const char *Period_getEventName(enum Period_whichEvent whichEvent)
+{
+    assert (whichEvent >= 0 && whichEvent < NUM_PERIOD_EVENTS);
+    return s_eventNames[whichEvent];
+}
+
 void Period_markEvent(enum Period_whichEvent whichEvent)
 {
     assert (whichEvent >= 0 && whichEvent < NUM_PERIOD_EVENTS);
     assert (s_initialized);
 
-    timestamps_t *pData = &s_eventData[whichEvent];
-    pthread_mutex_lock(&s_lock);
-    {
-        if (pData->timestampCount < MAX_EVENT_TIMESTAMPS) {
-            pData->timestampsInNs[pData->timestampCount] = getTimeInNanoS();
-            pData->timestampCount++;
-        } else {
-            printf("WARNING: No sample space for event collection on %d\n", whichEvent);
-        }
+    threadData_t *pThread = getThreadData(whichEvent);
+    if (pThread == NULL) {
+        return;
     }
-    pthread_mutex_unlock(&s_lock);
+    long long nowInNs = getTimeInNanoS();
+
+    beginUpdate(pThread);
+    if (pThread->prevTimestampInNs != 0) {
+        accumulate(whichEvent, pThread, nowInNs - pThread->prevTimestampInNs);
+    }
+    pThread->prevTimestampInNs = nowInNs;
+    endUpdate(pThread);
+}
+
+void Period_markDuration(enum Period_whichEvent whichEvent, long long startInNs)
+{
+    assert (whichEvent >= 0 && whichEvent < NUM_PERIOD_EVENTS);
+    assert (s_initialized);
+
+    threadData_t *pThread = getThreadData(whichEvent);
+    if (pThread == NULL) {
+        return;
+    }
+    long long durationInNs = getTimeInNanoS() - startInNs;
+
+    beginUpdate(pThread);
+    accumulate(whichEvent, pThread, durationInNs);
+    endUpdate(pThread);
+}
+
+long long Period_getTimeInNs(void)
+{
+    return getTimeInNanoS();
+}
+
+void Period_markMissedDeadlines(enum Period_whichEvent whichEvent, int count)
+{
+    assert (whichEvent >= 0 && whichEvent < NUM_PERIOD_EVENTS);
+    assert (s_initialized);
+
+    threadData_t *pThread = getThreadData(whichEvent);
+    if (pThread == NULL) {
+        return;
+    }
+    beginUpdate(pThread);
+    int bank = atomic_load(&s_eventData[whichEvent].activeBank);
+    pThread->banks[bank].missedDeadlineCount += count;
+    endUpdate(pThread);
 }
 
 void Period_getStatisticsAndClear(
     enum Period_whichEvent whichEvent,
     Period_statistics_t *pStats
 )
+{
+    Period_histogram_t histogram;
+    Period_getHistogramAndClear(whichEvent, pStats, &histogram);
+}
+
+void Period_getHistogramAndClear(
+    enum Period_whichEvent whichEvent,
+    Period_statistics_t *pStats,
+    Period_histogram_t *pHistogram
+)
 {
     assert (whichEvent >= 0 && whichEvent < NUM_PERIOD_EVENTS);
     assert (s_initialized);
-    timestamps_t *pData = &s_eventData[whichEvent];
-    pthread_mutex_lock(&s_lock);
+    eventData_t *pData = &s_eventData[whichEvent];
+
+    accumulator_t total;
+    resetAccumulator(&total);
+    Period_resetHistogram(pHistogram);
+    pthread_mutex_lock(&s_readLock);
     {
-        // Compute stats
-        updateStats(pData, pStats);
+        // Send new marks to the other bank, then let any mark which may
+        // still be updating the old one finish before reading it
+        int oldBank = atomic_load(&pData->activeBank);
+        atomic_store(&pData->activeBank, 1 - oldBank);
 
-        // Update the "previous" sample (if we have any)
-        if (pData->timestampCount > 0) {
-            pData->prevTimestampInNs = pData->timestampsInNs[pData->timestampCount - 1];
+        // (briefly over the limit while a thread too many is turned away)
+        int numThreads = atomic_load(&pData->numThreads);
+        numThreads = numThreads < PERIOD_MAX_THREADS_PER_EVENT ? numThreads : PERIOD_MAX_THREADS_PER_EVENT;
+        for (int i = 0; i < numThreads; i++) {
+            threadData_t *pThread = &pData->threads[i];
+            waitForUpdate(pThread);
+            accumulator_t *pAccumulator = &pThread->banks[oldBank];
+            total.count += pAccumulator->count;
+            total.sumNs += pAccumulator->sumNs;
+            total.missedDeadlineCount += pAccumulator->missedDeadlineCount;
+            if (pAccumulator->minNs < total.minNs) {
+                total.minNs = pAccumulator->minNs;
+            }
+            if (pAccumulator->maxNs > total.maxNs) {
+                total.maxNs = pAccumulator->maxNs;
+            }
+            Period_mergeHistogram(pHistogram, &pAccumulator->histogram);
+            resetAccumulator(pAccumulator);
         }
-
-        // Clear
-        pData->timestampCount = 0;
     }
-    pthread_mutex_unlock(&s_lock);
+    pthread_mutex_unlock(&s_readLock);
+
+    // Save stats
+    bool hasPeriods = total.count > 0;
+    pStats->minPeriodInMs = hasPeriods ? total.minNs / MS_PER_NS : 0;
+    pStats->maxPeriodInMs = hasPeriods ? total.maxNs / MS_PER_NS : 0;
+    pStats->avgPeriodInMs = hasPeriods ? total.sumNs / total.count / MS_PER_NS : 0;
+    pStats->numSamples = (int)total.count;
+    pStats->numMissedDeadlines = total.missedDeadlineCount;
+    pStats->p50PeriodInMs = Period_getPercentileInMs(pHistogram, 50);
+    pStats->p90PeriodInMs = Period_getPercentileInMs(pHistogram, 90);
+    pStats->p99PeriodInMs = Period_getPercentileInMs(pHistogram, 99);
+    pStats->p999PeriodInMs = Period_getPercentileInMs(pHistogram, 99.9);
 }
 
-static void updateStats(
-    timestamps_t *pData, 
-    Period_statistics_t *pStats
-)
+void Period_resetHistogram(Period_histogram_t *pHistogram)
+{
+    memset(pHistogram, 0, sizeof(*pHistogram));
+}
+
+void Period_recordInHistogram(Period_histogram_t *pHistogram, long long valueNs)
 {
-    long long prevInNs = pData->prevTimestampInNs;
+    pHistogram->counts[getBucket(valueNs)]++;
+    pHistogram->totalCount++;
+    if (valueNs > pHistogram->maxNs) {
+        pHistogram->maxNs = valueNs;
+    }
+}
 
-    // Handle startup (no previous sample)
-    if (prevInNs == 0) {
-        prevInNs = pData->timestampsInNs[0];
+void Period_mergeHistogram(Period_histogram_t *pInto, const Period_histogram_t *pFrom)
+{
+    if (pFrom->totalCount == 0) {
+        return;
     }
-    
-    // Find min/max/sum time delta between consecutive samples
-    long long sumDeltasNs = 0;
-    long long minNs = 0;
-    long long maxNs = 0;
-    for (int i = 0; i < pData->timestampCount; i++) {
-        long long thisTime = pData->timestampsInNs[i];
-        long long deltaNs = thisTime - prevInNs;
-        sumDeltasNs += deltaNs;
+    for (int i = 0; i < PERIOD_HISTOGRAM_BUCKETS; i++) {
+        pInto->counts[i] += pFrom->counts[i];
+    }
+    pInto->totalCount += pFrom->totalCount;
+    if (pFrom->maxNs > pInto->maxNs) {
+        pInto->maxNs = pFrom->maxNs;
+    }
+}
 
-        if (i == 0 || deltaNs < minNs) {
-            minNs = deltaNs;
+double Period_getPercentileInMs(const Period_histogram_t *pHistogram, double percentile)
+{
+    if (pHistogram->totalCount == 0) {
+        return 0;
+    }
+    // The smallest value with at least `percentile` of the values at or below it
+    long long rank = (long long)(percentile / 100 * pHistogram->totalCount + 0.5);
+    rank = rank < 1 ? 1 : rank > pHistogram->totalCount ? pHistogram->totalCount : rank;
+    long long seen = 0;
+    for (int i = 0; i < PERIOD_HISTOGRAM_BUCKETS; i++) {
+        seen += pHistogram->counts[i];
+        if (seen >= rank) {
+            long long valueNs = getBucketUpperBound(i);
+            return (valueNs < pHistogram->maxNs ? valueNs : pHistogram->maxNs) / MS_PER_NS;
         }
-        if (i == 0 || deltaNs > maxNs) {
-            maxNs = deltaNs;
+    }
+    return pHistogram->maxNs / MS_PER_NS;
+}
+
+// The calling thread's slot for the event, claimed on its first mark.
+// NULL if the event already has PERIOD_MAX_THREADS_PER_EVENT threads.
+static threadData_t *getThreadData(enum Period_whichEvent whichEvent)
+{
+    int generation = atomic_load_explicit(&s_generation, memory_order_relaxed);
+    if (s_threadSlots.generation != generation) {
+        memset(&s_threadSlots, 0, sizeof(s_threadSlots));
+        s_threadSlots.generation = generation;
+    }
+
+    eventData_t *pData = &s_eventData[whichEvent];
+    int slot = s_threadSlots.slots[whichEvent];
+    if (slot == 0) {
+        int index = atomic_fetch_add(&pData->numThreads, 1);
+        if (index >= PERIOD_MAX_THREADS_PER_EVENT) {
+            atomic_fetch_sub(&pData->numThreads, 1);
+            return NULL;
         }
+        slot = index + 1;
+        s_threadSlots.slots[whichEvent] = slot;
+    }
+    return &pData->threads[slot - 1];
+}
 
-        prevInNs = thisTime;
+// Add one period (or duration) to the thread's active bank. Only between
+// beginUpdate() and endUpdate().
+static void accumulate(enum Period_whichEvent whichEvent, threadData_t *pThread, long long valueNs)
+{
+    int bank = atomic_load(&s_eventData[whichEvent].activeBank);
+    accumulator_t *pAccumulator = &pThread->banks[bank];
+    pAccumulator->count++;
+    pAccumulator->sumNs += valueNs;
+    if (valueNs < pAccumulator->minNs) {
+        pAccumulator->minNs = valueNs;
     }
+    if (valueNs > pAccumulator->maxNs) {
+        pAccumulator->maxNs = valueNs;
+    }
+    Period_recordInHistogram(&pAccumulator->histogram, valueNs);
+}
 
-    long long avgNs = 0;
-    if (pData->timestampCount > 0) {
-        avgNs = sumDeltasNs / pData->timestampCount;
-    } 
+// Values below 2^S are their own bucket. Above, a value whose top bit is
+// bit m is shifted right by e = m - S + 1, leaving S significant bits
+// (the top one set), so each power of two gets 2^(S-1) buckets.
+static int getBucket(long long valueNs)
+{
+    const long long maxValue = (1LL << PERIOD_HISTOGRAM_MAX_BITS) - 1;
+    unsigned long long value = valueNs < 0 ? 0 : valueNs > maxValue ? maxValue : valueNs;
+    int topBit = 63 - __builtin_clzll(value | 1);
+    int shift = topBit - PERIOD_HISTOGRAM_SUB_BUCKET_BITS + 1;
+    shift = shift < 0 ? 0 : shift;
+    return (shift << (PERIOD_HISTOGRAM_SUB_BUCKET_BITS - 1)) + (int)(value >> shift);
+}
 
-    // Save stats
-    #define MS_PER_NS (1000*1000.0)
-    pStats->minPeriodInMs = minNs / MS_PER_NS;
-    pStats->maxPeriodInMs = maxNs / MS_PER_NS;
-    pStats->avgPeriodInMs = avgNs / MS_PER_NS;
-    pStats->numSamples = pData->timestampCount;
+static long long getBucketUpperBound(int bucket)
+{
+    const int halfBuckets = 1 << (PERIOD_HISTOGRAM_SUB_BUCKET_BITS - 1);
+    if (bucket < 2 * halfBuckets) {
+        return bucket;
+    }
+    int shift = bucket / halfBuckets - 1;
+    long long subBucket = bucket - (long long)shift * halfBuckets;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+// Marks the update in progress before the bank is chosen. Paired with the
+// reader swapping banks before checking, one of the two always sees the
+// other: either the mark picks the new bank or the reader waits for it.
+// Only the owner writes the sequence, so plain stores will do.
+static void beginUpdate(threadData_t *pThread)
+{
+    unsigned int sequence = atomic_load_explicit(&pThread->updateSequence, memory_order_relaxed);
+    atomic_store_explicit(&pThread->updateSequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+static void endUpdate(threadData_t *pThread)
+{
+    unsigned int sequence = atomic_load_explicit(&pThread->updateSequence, memory_order_relaxed);
+    atomic_store_explicit(&pThread->updateSequence, sequence + 1, memory_order_release);
+}
+
+// Wait out the thread's update in progress, if any (a few instructions)
+static void waitForUpdate(threadData_t *pThread)
+{
+    unsigned int sequence = atomic_load(&pThread->updateSequence);
+    if ((sequence & 1) == 0) {
+        return;
+    }
+    while (atomic_load_explicit(&pThread->updateSequence, memory_order_acquire) == sequence) {
+        sched_yield();
+    }
+}
+
+static void resetAccumulator(accumulator_t *pAccumulator)
+{
+    pAccumulator->count = 0;
+    pAccumulator->sumNs = 0;
+    pAccumulator->minNs = LLONG_MAX;
+    pAccumulator->maxNs = 0;
+    pAccumulator->missedDeadlineCount = 0;
+    Period_resetHistogram(&pAccumulator->histogram);
 }
 
 // Timing function
-static long long getTimeInNanoS(void) 
+static long long getTimeInNanoS(void)
 {
     struct timespec spec;
     clock_gettime(CLOCK_BOOTTIME, &spec);
     long long seconds = spec.tv_sec;
     long long nanoSeconds = spec.tv_nsec + seconds * 1000*1000*1000;
 	assert(nanoSeconds > 0);
-    
-    static long long lastTimeHack = 0;
-    assert(nanoSeconds > lastTimeHack);
-    lastTimeHack = nanoSeconds;
 
     return nanoSeconds;
-}
\ No newline at end of file
+}
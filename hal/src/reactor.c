@@ -0,0 +1,238 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "hal/reactor.h"
+#include "hal/log.h"
+
+#define NS_PER_SECOND 1000000000LL
+
+// A task may run up to this fraction of its period early, so tasks of
+// different periods share the wakeups of the most frequent one
+#define SLACK_DIVISOR 8
+
+typedef struct {
+    Reactor_task_t task;
+    void *pContext;
+    long long periodNs;
+    long long nextRunNs;
+} task_t;
+
+typedef struct {
+    int fd;
+    Reactor_handler_t handler;
+    void *pContext;
+} handler_t;
+
+static void *reactorLoop(void *arg);
+static void runDueTasks(void);
+static void armTimer(void);
+static handler_t *findHandler(int fd);
+static void addToEpoll(int fd);
+static long long getTimeInNs(void);
+
+static pthread_t reactorThread;
+static bool isStarted;
+static int epollDescriptor = -1;
+static int timerDescriptor = -1;
+static int stopEventDescriptor = -1;
+
+// Only touched by the reactor thread once it is started
+static task_t tasks[REACTOR_MAX_TASKS];
+static int numTasks;
+static handler_t handlers[REACTOR_MAX_HANDLERS];
+static int numHandlers;
+static long long armedNs;
+
+void Reactor_init(void) {
+    numTasks = 0;
+    numHandlers = 0;
+    armedNs = 0;
+    epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    timerDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    stopEventDescriptor = eventfd(0, EFD_CLOEXEC);
+    if (epollDescriptor == -1 || timerDescriptor == -1 || stopEventDescriptor == -1) {
+        printf("ERROR: Unable to create reactor (%s)\n", strerror(errno));
+        exit(-1);
+    }
+    addToEpoll(timerDescriptor);
+    addToEpoll(stopEventDescriptor);
+}
+
+void Reactor_cleanup(void) {
+    Reactor_stop();
+    close(stopEventDescriptor);
+    close(timerDescriptor);
+    close(epollDescriptor);
+    stopEventDescriptor = timerDescriptor = epollDescriptor = -1;
+}
+
+void Reactor_start(void) {
+    isStarted = true;
+    pthread_create(&reactorThread, NULL, reactorLoop, NULL);
+}
+
+void Reactor_stop(void) {
+    if (!isStarted) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(stopEventDescriptor, &one, sizeof(one)) != sizeof(one)) {
+        printf("ERROR: Unable to stop reactor (%s)\n", strerror(errno));
+        exit(-1);
+    }
+    pthread_join(reactorThread, NULL);
+    isStarted = false;
+}
+
+int Reactor_addTask(long long periodNs, Reactor_task_t task, void *pContext) {
+    if (numTasks == REACTOR_MAX_TASKS) {
+        printf("ERROR: Too many reactor tasks\n");
+        exit(-1);
+    }
+    tasks[numTasks] = (task_t){
+        .task = task,
+        .pContext = pContext,
+        .periodNs = periodNs,
+        .nextRunNs = getTimeInNs() + periodNs,
+    };
+    numTasks++;
+    armTimer();
+    return numTasks - 1;
+}
+
+void Reactor_setTaskPeriod(int task, long long periodNs) {
+    tasks[task].periodNs = periodNs;
+}
+
+void Reactor_addHandler(int fd, Reactor_handler_t handler, void *pContext) {
+    if (numHandlers == REACTOR_MAX_HANDLERS) {
+        printf("ERROR: Too many reactor handlers\n");
+        exit(-1);
+    }
+    handlers[numHandlers] = (handler_t){.fd = fd, .handler = handler, .pContext = pContext};
+    numHandlers++;
+    addToEpoll(fd);
+}
+
+void Reactor_removeHandler(int fd) {
+    handler_t *pHandler = findHandler(fd);
+    if (pHandler == NULL) {
+        return;
+    }
+    epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, fd, NULL);
+    *pHandler = handlers[numHandlers - 1];
+    numHandlers--;
+}
+
+static void *reactorLoop(void *arg) {
+    (void)arg;
+    bool isStopping = false;
+    while (!isStopping) {
+        struct epoll_event events[REACTOR_MAX_HANDLERS + 2];
+        int numEvents = epoll_wait(epollDescriptor, events, REACTOR_MAX_HANDLERS + 2, -1);
+        if (numEvents == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("ERROR: Unable to wait for reactor events (%s)\n", strerror(errno));
+            exit(-1);
+        }
+
+        for (int i = 0; i < numEvents; i++) {
+            int fd = events[i].data.fd;
+            if (fd == stopEventDescriptor) {
+                isStopping = true;
+            }
+            else if (fd == timerDescriptor) {
+                uint64_t numExpirations;
+                if (read(timerDescriptor, &numExpirations, sizeof(numExpirations)) == sizeof(numExpirations)) {
+                    runDueTasks();
+                }
+            }
+            else {
+                // May have been removed by an earlier handler of this batch
+                handler_t *pHandler = findHandler(fd);
+                if (pHandler != NULL) {
+                    pHandler->handler(fd, pHandler->pContext);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+static void runDueTasks(void) {
+    long long nowNs = getTimeInNs();
+    for (int i = 0; i < numTasks; i++) {
+        task_t *pTask = &tasks[i];
+        if (pTask->nextRunNs - pTask->periodNs / SLACK_DIVISOR > nowNs) {
+            continue;
+        }
+        pTask->task(pTask->pContext);
+        // After a stall, run next a period from now rather than catching up
+        pTask->nextRunNs += pTask->periodNs;
+        if (pTask->nextRunNs <= nowNs) {
+            pTask->nextRunNs = nowNs + pTask->periodNs;
+        }
+    }
+    armedNs = 0;
+    armTimer();
+}
+
+// A handful of tasks: scan for the earliest deadline and arm the timer
+// for it, unless it already is
+static void armTimer(void) {
+    long long earliestNs = 0;
+    for (int i = 0; i < numTasks; i++) {
+        if (earliestNs == 0 || tasks[i].nextRunNs < earliestNs) {
+            earliestNs = tasks[i].nextRunNs;
+        }
+    }
+    if (earliestNs == 0 || earliestNs == armedNs) {
+        return;
+    }
+    struct itimerspec timer = {
+        .it_interval = {0, 0},
+        .it_value = {earliestNs / NS_PER_SECOND, earliestNs % NS_PER_SECOND},
+    };
+    if (timerfd_settime(timerDescriptor, TFD_TIMER_ABSTIME, &timer, NULL) != 0) {
+        Log_write(LOG_LEVEL_ERROR, "ERROR: Unable to arm reactor timer (%s)\n", strerror(errno));
+        return;
+    }
+    armedNs = earliestNs;
+}
+
+static handler_t *findHandler(int fd) {
+    for (int i = 0; i < numHandlers; i++) {
+        if (handlers[i].fd == fd) {
+            return &handlers[i];
+        }
+    }
+    return NULL;
+}
+
+static void addToEpoll(int fd) {
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, fd, &event) != 0) {
+        printf("ERROR: Unable to watch descriptor %d in the reactor (%s)\n", fd, strerror(errno));
+        exit(-1);
+    }
+}
+
+static long long getTimeInNs(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec * NS_PER_SECOND + spec.tv_nsec;
+}
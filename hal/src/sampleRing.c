@@ -0,0 +1,120 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal/sampleRing.h"
+
+static unsigned long long roundUpToPowerOfTwo(unsigned long long value);
+
+void SampleRing_init(SampleRing_t *pRing, int maxWindowSize, int retainedWindows) {
+    memset(pRing, 0, sizeof(*pRing));
+    retainedWindows = retainedWindows < 1 ? 1 : retainedWindows;
+    unsigned long long capacity = roundUpToPowerOfTwo((retainedWindows + 1ULL) * maxWindowSize);
+    pRing->pSamples = calloc(capacity, sizeof(pRing->pSamples[0]));
+    if (pRing->pSamples == NULL) {
+        printf("ERROR: Unable to allocate sample ring of %llu samples\n", capacity);
+        exit(-1);
+    }
+    pRing->mask = capacity - 1;
+    pRing->maxWindowSize = maxWindowSize;
+}
+
+void SampleRing_cleanup(SampleRing_t *pRing) {
+    free(pRing->pSamples);
+    pRing->pSamples = NULL;
+}
+
+void SampleRing_push(SampleRing_t *pRing, uint16_t sample) {
+    unsigned long long index = atomic_load_explicit(&pRing->writeIndex, memory_order_relaxed);
+
+    // Announce the slot before overwriting it so readers can tell the old
+    // contents may be torn
+    atomic_store_explicit(&pRing->claimIndex, index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&pRing->pSamples[index & pRing->mask], sample, memory_order_relaxed);
+    atomic_store_explicit(&pRing->writeIndex, index + 1, memory_order_release);
+}
+
+SampleRing_window_t SampleRing_completeWindow(SampleRing_t *pRing) {
+    SampleRing_window_t window;
+    unsigned long long endIndex = atomic_load_explicit(&pRing->writeIndex, memory_order_relaxed);
+    unsigned long long startIndex = pRing->windowStartIndex;
+    window.droppedSamples = 0;
+    if (endIndex - startIndex > (unsigned long long)pRing->maxWindowSize) {
+        window.droppedSamples = (int)(endIndex - startIndex - pRing->maxWindowSize);
+        startIndex = endIndex - pRing->maxWindowSize;
+    }
+    pRing->windowEpoch++;
+    window.epoch = pRing->windowEpoch;
+    window.startIndex = startIndex;
+    window.size = (int)(endIndex - startIndex);
+
+    pRing->windowStartIndex = endIndex;
+    return window;
+}
+
+uint16_t SampleRing_get(const SampleRing_t *pRing, unsigned long long index) {
+    return atomic_load_explicit(&pRing->pSamples[index & pRing->mask], memory_order_relaxed);
+}
+
+int SampleRing_getSpans(const SampleRing_t *pRing, SampleRing_window_t window,
+    const uint16_t *pSpans[2], int spanSizes[2])
+{
+    // Only the producer writes the ring, so it may view it as plain memory
+    const uint16_t *pSamples = (const uint16_t *)pRing->pSamples;
+    const unsigned long long capacity = pRing->mask + 1;
+    unsigned long long first = window.startIndex & pRing->mask;
+    unsigned long long untilWrap = capacity - first;
+
+    pSpans[0] = pSamples + first;
+    if ((unsigned long long)window.size <= untilWrap) {
+        spanSizes[0] = window.size;
+        return 1;
+    }
+    spanSizes[0] = (int)untilWrap;
+    pSpans[1] = pSamples;
+    spanSizes[1] = window.size - (int)untilWrap;
+    return 2;
+}
+
+bool SampleRing_copyWindow(const SampleRing_t *pRing, SampleRing_window_t window, uint16_t *pDest,
+    int maxSamples, SampleRing_window_t *pCopied)
+{
+    *pCopied = window;
+    if (window.size > maxSamples) {
+        return false;
+    }
+
+    for (int i = 0; i < window.size; i++) {
+        pDest[i] = SampleRing_get(pRing, window.startIndex + i);
+    }
+
+    // Anything at or above claimIndex - capacity was not overwritten
+    // while we copied it
+    atomic_thread_fence(memory_order_acquire);
+    const unsigned long long capacity = pRing->mask + 1;
+    unsigned long long claimed = atomic_load_explicit(&pRing->claimIndex, memory_order_relaxed);
+    unsigned long long lowestIntact = claimed > capacity ? claimed - capacity : 0;
+    if (window.startIndex >= lowestIntact) {
+        return true;
+    }
+
+    unsigned long long lost = lowestIntact - window.startIndex;
+    if (lost >= (unsigned long long)window.size) {
+        lost = window.size;
+    }
+    memmove(pDest, pDest + lost, sizeof(pDest[0]) * (window.size - lost));
+    pCopied->startIndex += lost;
+    pCopied->size -= (int)lost;
+    pCopied->droppedSamples += (int)lost;
+    return true;
+}
+
+static unsigned long long roundUpToPowerOfTwo(unsigned long long value) {
+    unsigned long long result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
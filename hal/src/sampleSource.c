@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hal/sampleSource.h"
+#include "hal/file.h"
+#include "hal/log.h"
+
+#define READ_TIMEOUT_MS 100
+#define NS_PER_SECOND 1000000000LL
+#define PACKED_BUFFER_SIZE 4096
+#define MAX_REAL_BITS 12
+#define MAX_PATH_LENGTH 256
+#define SYSFS_MAX_SAMPLES_PER_SECOND 1000
+
+typedef struct {
+    File_reader_t reader;
+} sysfsState_t;
+
+typedef struct {
+    int fd;
+    SampleSource_layout_t layout;
+    unsigned char bytes[PACKED_BUFFER_SIZE];
+    int leftoverBytes;
+
+    // Set for the IIO backend so the buffer can be disabled on close
+    char bufferEnableFile[MAX_PATH_LENGTH];
+} packedState_t;
+
+static int readSysfs(SampleSource_t *pSource, uint16_t *pCodes, int maxCodes);
+static void closeSysfs(SampleSource_t *pSource);
+static int readPacked(SampleSource_t *pSource, uint16_t *pCodes, int maxCodes);
+static void closePacked(SampleSource_t *pSource);
+static packedState_t *openPackedState(char *path, const SampleSource_layout_t *pLayout);
+static uint16_t decodeScan(const unsigned char *pScan, const SampleSource_layout_t *pLayout);
+static bool writeSysfs(char *filename, char *content);
+static void writeSysfsOrExit(char *filename, char *content);
+static void disableOtherScanElements(const char *iioDirectory, int channel);
+
+void SampleSource_openSysfs(SampleSource_t *pSource, char *voltageFile) {
+    sysfsState_t *pState = malloc(sizeof(*pState));
+    File_openReader(&pState->reader, voltageFile);
+
+    pSource->read = readSysfs;
+    pSource->close = closeSysfs;
+    pSource->isPaced = false;
+    pSource->getTimeNs = NULL;
+    pSource->stopEventDescriptor = -1;
+    pSource->maxSamplesPerSecond = SYSFS_MAX_SAMPLES_PER_SECOND;
+    pSource->pState = pState;
+}
+
+void SampleSource_openIioBuffer(SampleSource_t *pSource, const SampleSource_iioConfig_t *pConfig) {
+    char path[MAX_PATH_LENGTH];
+    char value[32];
+
+    // The buffer must be disabled while the scan setup is changed
+    snprintf(path, sizeof(path), "%s/buffer/enable", pConfig->iioDirectory);
+    writeSysfsOrExit(path, "0");
+
+    // The scan must hold only this channel for the layout below to apply
+    disableOtherScanElements(pConfig->iioDirectory, pConfig->channel);
+    snprintf(path, sizeof(path), "%s/scan_elements/in_voltage%d_en", pConfig->iioDirectory, pConfig->channel);
+    writeSysfsOrExit(path, "1");
+
+    snprintf(path, sizeof(path), "%s/scan_elements/in_voltage%d_type", pConfig->iioDirectory, pConfig->channel);
+    char typeString[64] = {0};
+    File_readFromFile(path, typeString);
+    SampleSource_layout_t layout;
+    if (!SampleSource_parseLayout(typeString, &layout)) {
+        printf("ERROR: Unknown IIO scan type (%s)\n", typeString);
+        exit(-1);
+    }
+
+    if (pConfig->triggerName != NULL) {
+        snprintf(path, sizeof(path), "%s/trigger/current_trigger", pConfig->iioDirectory);
+        writeSysfsOrExit(path, pConfig->triggerName);
+    }
+
+    snprintf(value, sizeof(value), "%d", pConfig->bufferLength);
+    snprintf(path, sizeof(path), "%s/buffer/length", pConfig->iioDirectory);
+    writeSysfsOrExit(path, value);
+
+    // Wake the reader once half the buffer has filled (older kernels lack this)
+    snprintf(value, sizeof(value), "%d", pConfig->bufferLength / 2 > 0 ? pConfig->bufferLength / 2 : 1);
+    snprintf(path, sizeof(path), "%s/buffer/watermark", pConfig->iioDirectory);
+    writeSysfs(path, value);
+
+    snprintf(path, sizeof(path), "%s/buffer/enable", pConfig->iioDirectory);
+    writeSysfsOrExit(path, "1");
+
+    packedState_t *pState = openPackedState(pConfig->devicePath, &layout);
+    snprintf(pState->bufferEnableFile, sizeof(pState->bufferEnableFile), "%s", path);
+
+    pSource->read = readPacked;
+    pSource->close = closePacked;
+    pSource->isPaced = true;
+    pSource->getTimeNs = NULL;
+    pSource->stopEventDescriptor = -1;
+    pSource->maxSamplesPerSecond = pConfig->maxSamplesPerSecond;
+    pSource->pState = pState;
+}
+
+void SampleSource_openPacked(SampleSource_t *pSource, char *path, const SampleSource_layout_t *pLayout,
+    int maxSamplesPerSecond)
+{
+    pSource->read = readPacked;
+    pSource->close = closePacked;
+    pSource->isPaced = true;
+    pSource->getTimeNs = NULL;
+    pSource->stopEventDescriptor = -1;
+    pSource->maxSamplesPerSecond = maxSamplesPerSecond;
+    pSource->pState = openPackedState(path, pLayout);
+}
+
+bool SampleSource_parseLayout(const char *typeString, SampleSource_layout_t *pLayout) {
+    char endian[3] = {0};
+    char sign = 0;
+    int realBits = 0;
+    int storageBits = 0;
+    int shift = 0;
+    int matched = sscanf(typeString, "%2[bl]e:%c%d/%d>>%d", endian, &sign, &realBits, &storageBits, &shift);
+    // Codes are unsigned and 12-bit; a signed channel would decode negative
+    // values as huge ones, and a wider one past what the kernels and the
+    // text formatting are sized for
+    if (matched != 5 || sign != 'u' || storageBits <= 0 || storageBits > 32 || storageBits % 8 != 0
+        || realBits <= 0 || realBits > MAX_REAL_BITS || realBits + shift > storageBits) {
+        return false;
+    }
+
+    pLayout->bytesPerScan = storageBits / 8;
+    pLayout->byteOffset = 0;
+    pLayout->storageBits = storageBits;
+    pLayout->realBits = realBits;
+    pLayout->shift = shift;
+    pLayout->isBigEndian = endian[0] == 'b';
+    return true;
+}
+
+bool SampleSource_waitNs(const SampleSource_t *pSource, long long waitNs) {
+    struct timespec timeout = {waitNs / NS_PER_SECOND, waitNs % NS_PER_SECOND};
+    if (pSource->stopEventDescriptor < 0) {
+        nanosleep(&timeout, NULL);
+        return true;
+    }
+    struct pollfd pollDesc = {.fd = pSource->stopEventDescriptor, .events = POLLIN};
+    return ppoll(&pollDesc, 1, &timeout, NULL) <= 0;
+}
+
+static int readSysfs(SampleSource_t *pSource, uint16_t *pCodes, int maxCodes) {
+    sysfsState_t *pState = pSource->pState;
+    if (maxCodes <= 0) {
+        return 0;
+    }
+    pCodes[0] = File_readInt(&pState->reader);
+    return 1;
+}
+
+static void closeSysfs(SampleSource_t *pSource) {
+    sysfsState_t *pState = pSource->pState;
+    File_closeReader(&pState->reader);
+    free(pState);
+    pSource->pState = NULL;
+}
+
+static int readPacked(SampleSource_t *pSource, uint16_t *pCodes, int maxCodes) {
+    packedState_t *pState = pSource->pState;
+    const int bytesPerScan = pState->layout.bytesPerScan;
+
+    // With no stop event, poll() ignores the negative descriptor
+    struct pollfd pollDescs[2] = {
+        {.fd = pState->fd, .events = POLLIN},
+        {.fd = pSource->stopEventDescriptor, .events = POLLIN},
+    };
+    // A signal must not send us on to a read() which could then block
+    int ready;
+    do {
+        ready = poll(pollDescs, 2, READ_TIMEOUT_MS);
+    } while (ready < 0 && errno == EINTR);
+    if (ready < 0) {
+        Log_write(LOG_LEVEL_ERROR, "ERROR: Unable to wait for samples: %s\n", strerror(errno));
+        return -1;
+    }
+    if (ready == 0 || pollDescs[1].revents != 0) {
+        return 0;
+    }
+
+    int wantedBytes = maxCodes * bytesPerScan - pState->leftoverBytes;
+    int freeBytes = PACKED_BUFFER_SIZE - pState->leftoverBytes;
+    wantedBytes = wantedBytes < freeBytes ? wantedBytes : freeBytes;
+    ssize_t bytesRead = read(pState->fd, pState->bytes + pState->leftoverBytes, wantedBytes);
+    if (bytesRead < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return 0;
+    }
+    if (bytesRead < 0) {
+        Log_write(LOG_LEVEL_ERROR, "ERROR: Unable to read samples: %s\n", strerror(errno));
+        return -1;
+    }
+    if (bytesRead == 0) {
+        return -1;
+    }
+
+    int totalBytes = pState->leftoverBytes + bytesRead;
+    int numCodes = totalBytes / bytesPerScan;
+    for (int i = 0; i < numCodes; i++) {
+        pCodes[i] = decodeScan(pState->bytes + i * bytesPerScan, &pState->layout);
+    }
+
+    // Keep any partial scan for the next read
+    pState->leftoverBytes = totalBytes - numCodes * bytesPerScan;
+    memmove(pState->bytes, pState->bytes + numCodes * bytesPerScan, pState->leftoverBytes);
+    return numCodes;
+}
+
+static void closePacked(SampleSource_t *pSource) {
+    packedState_t *pState = pSource->pState;
+    close(pState->fd);
+    if (pState->bufferEnableFile[0] != 0) {
+        writeSysfs(pState->bufferEnableFile, "0");
+    }
+    free(pState);
+    pSource->pState = NULL;
+}
+
+static packedState_t *openPackedState(char *path, const SampleSource_layout_t *pLayout) {
+    packedState_t *pState = calloc(1, sizeof(*pState));
+    pState->fd = open(path, O_RDONLY);
+    if (pState->fd < 0) {
+        printf("ERROR: Unable to open file (%s) for read\n", path);
+        exit(-1);
+    }
+    pState->layout = *pLayout;
+    return pState;
+}
+
+static uint16_t decodeScan(const unsigned char *pScan, const SampleSource_layout_t *pLayout) {
+    const unsigned char *pElement = pScan + pLayout->byteOffset;
+    int numBytes = pLayout->storageBits / 8;
+    uint32_t raw = 0;
+    for (int i = 0; i < numBytes; i++) {
+        int byteIndex = pLayout->isBigEndian ? i : numBytes - 1 - i;
+        raw = (raw << 8) | pElement[byteIndex];
+    }
+    return (uint16_t)((raw >> pLayout->shift) & ((1u << pLayout->realBits) - 1));
+}
+
+static bool writeSysfs(char *filename, char *content) {
+    int fd = open(filename, O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t written = write(fd, content, strlen(content));
+    close(fd);
+    return written > 0;
+}
+
+static void writeSysfsOrExit(char *filename, char *content) {
+    if (!writeSysfs(filename, content)) {
+        printf("ERROR: Unable to write %s to %s\n", content, filename);
+        exit(-1);
+    }
+}
+
+// Turn off every scan element but the channel's, such as a timestamp or
+// another channel left enabled by an earlier run or another tool
+static void disableOtherScanElements(const char *iioDirectory, int channel) {
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/scan_elements", iioDirectory);
+    DIR *pDirectory = opendir(path);
+    if (pDirectory == NULL) {
+        printf("ERROR: Unable to list IIO scan elements (%s)\n", path);
+        exit(-1);
+    }
+
+    char channelEnable[32];
+    snprintf(channelEnable, sizeof(channelEnable), "in_voltage%d_en", channel);
+    struct dirent *pEntry;
+    while ((pEntry = readdir(pDirectory)) != NULL) {
+        size_t length = strlen(pEntry->d_name);
+        if (length < 3 || strcmp(pEntry->d_name + length - 3, "_en") != 0
+            || strcmp(pEntry->d_name, channelEnable) == 0) {
+            continue;
+        }
+        char elementPath[2 * MAX_PATH_LENGTH];
+        snprintf(elementPath, sizeof(elementPath), "%s/scan_elements/%s", iioDirectory, pEntry->d_name);
+        writeSysfsOrExit(elementPath, "0");
+    }
+    closedir(pDirectory);
+}
@@ -1,76 +1,325 @@
+#define _GNU_SOURCE
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <stdio.h>
 #include <stdbool.h>
-#include <string.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "hal/sampler.h"
-#include "hal/file.h"
 #include "hal/periodTimer.h"
 #include "hal/segDisplay.h"
+#include "hal/sampleSource.h"
+#include "hal/sampleRing.h"
+#include "hal/historySnapshot.h"
+#include "hal/windowKernel.h"
+#include "hal/windowAnalyzer.h"
+#include "hal/historyStore.h"
+#include "hal/deadlineTimer.h"
+#include "hal/backend.h"
+#include "hal/trace.h"
+#include "hal/historyLog.h"
+#include "hal/log.h"
 
 static void *collectionLoop(void *arg);
-static void calculateDips(void);
-static void moveCurrentDataToHistory(void);
-static void sleepForMs(long long delayInMs);
-static long long getTimeInMs(void);
+static WindowKernel_thresholds_t getDipThresholds(int32_t average);
+static void analyzeWindow(SampleRing_window_t window, WindowKernel_stats_t *pStats);
+static void publishHistory(SampleRing_window_t window, long long endTimeMs, const WindowKernel_stats_t *pStats);
+static void signalWindowEvent(void);
+static void publishHistoryStats(const Period_statistics_t *pStats);
+static void recoverHistory(void);
+static void collectRawWindow(const HistoryLog_entry_t *pEntry, const uint16_t *pRaw, void *pContext);
+static void restoreWindow(const HistoryLog_entry_t *pEntry, const uint16_t *pRaw, void *pContext);
+static bool isRestorable(const HistoryLog_entry_t *pEntry, const HistoryLog_entry_t *pLastEntry);
+static void applyThreadScheduling(void);
+static int getMaxWindowSize(const SampleSource_t *pSource);
+static long long getSampleTimeInMs(void);
+static long long getMonotonicTimeInMs(void);
 
 static pthread_t sampleThread;
 static _Atomic bool isRunning;
+static SampleSource_t sampleSource;
+
+// Written once at cleanup, so the sampling thread's waits (the source's
+// reads and the pacing timer) end at once rather than at their timeouts
+static int stopEventDescriptor = -1;
+
+// Raw input is recorded here when set (see hal/trace.h)
+static char *recordingPath = NULL;
+
+// Time of the last read by the source's clock, for sources with their own
+static _Atomic long long sampleTimeMs;
+
+// Signalled each time a completed window is published
+static int windowEventDescriptor = -1;
+
+// Pacing of polled sources, and real-time scheduling of the sampling thread
+#define WINDOW_LENGTH_MS 1000
+static int samplesPerSecond = SAMPLER_DEFAULT_SAMPLES_PER_SECOND;
+static int realtimePriority = 0;
+static int samplingCpu = -1;
+
+#define SAMPLE_BATCH_SIZE 256
+#define IIO_MAX_SAMPLES_PER_SECOND 50000
+
+#define HISTORY_SNAPSHOT_POOL_SIZE 8
+static int rawHistorySeconds = SAMPLER_DEFAULT_RAW_HISTORY_SECONDS;
+static int numSecondSummaries = SAMPLER_DEFAULT_SECOND_SUMMARIES;
+static int numMinuteSummaries = SAMPLER_DEFAULT_MINUTE_SUMMARIES;
+static int numHourSummaries = SAMPLER_DEFAULT_HOUR_SUMMARIES;
+
+// Samples of the current and previous second
+static SampleRing_t sampleRing;
+// Read-only copies of the previous second handed out to readers
+static HistorySnapshot_pool_t historyPool;
+
+// Sliding windows, updated as samples arrive
+static WindowAnalyzer_config_t analysisWindowConfigs[WINDOW_ANALYZER_MAX_WINDOWS] = {
+    {.lengthMs = 100, .hopMs = 100},
+    {.lengthMs = 1000, .hopMs = 100},
+    {.lengthMs = 10000, .hopMs = 1000},
+};
+static int numAnalysisWindows = 3;
+static WindowAnalyzer_t windowAnalyzer;
+
+// Per second summaries rolled up into minutes and hours
+static HistoryStore_t historyStore;
+
+// Optional on-disk copy of every window, restored on start: the summaries
+// in one log and, if kept, the raw samples in another (<path>.raw), each
+// with its own depth
+static char *persistencePath = NULL;
+static int numPersistedWindows;
+static int numPersistedRawWindows;
+static HistoryLog_t historyLog;
+static HistoryLog_t rawLog;
+
+// Windows farther apart than this in the two logs are different windows
+// (each log converts its times with its own reading of the clocks)
+#define RESTORE_MATCH_TOLERANCE_MS (WINDOW_LENGTH_MS / 2)
+
+// A raw window read back from the raw log, and where it went in the ring
+typedef struct {
+    HistoryLog_entry_t entry;
+    const uint16_t *pRaw;
+    SampleRing_window_t window;
+} restoredRaw_t;
 
-static pthread_mutex_t historyBufferLock;
-static pthread_mutex_t historyStatsLock;
+// The newest raw windows, as many as the ring retains (a circular buffer
+// while they are read back)
+typedef struct {
+    HistoryLog_entry_t lastEntry;
+    restoredRaw_t *pWindows;
+    int capacity;
+    int count;
+    int next;
+} restoredRawWindows_t;
 
-static double currentSamples[1000] = {0};
-static int currentSize = 0;
+typedef struct {
+    HistoryLog_entry_t lastEntry;
+    restoredRawWindows_t *pRawWindows;
+    int rawIndex;
+} restoredHistory_t;
 
-static _Atomic double average = 0;
-static _Atomic int totalSize = 0;
+static restoredRaw_t *getRestoredRaw(restoredRawWindows_t *pWindows, int index);
+
+// The A2D is 12 bits over a 1.8V reference
+#define MAX_CODE 4095
+#define REFERENCE_VOLTAGE 1.8
+
+// The exponential average and dip thresholds are kept in A2D code units in
+// Q16 fixed point, so the per-sample work is integer only.
+#define Q16_SHIFT 16
+#define VOLTS_TO_Q16(volts) ((int32_t)((volts) * MAX_CODE / REFERENCE_VOLTAGE * (1 << Q16_SHIFT) + 0.5))
+#define AVERAGE_WEIGHT_Q16 66                       // ~0.001 of each new sample
+static int32_t dipEnterThresholdQ16 = VOLTS_TO_Q16(SAMPLER_DEFAULT_DIP_ENTER_VOLTS);
+static int32_t dipExitThresholdQ16 = VOLTS_TO_Q16(SAMPLER_DEFAULT_DIP_EXIT_VOLTS);
+
+static _Atomic int32_t averageQ16 = 0;
+static _Atomic long long totalSize = 0;
 
-static double historySamples[1000];
 static _Atomic int historySize;
 static _Atomic int historyDips;
-Period_statistics_t historyStats;
 
-#define VOLTAGE_DIRECTORY "/sys/bus/iio/devices/iio:device0/in_voltage1_raw"
+// Written by the sampling thread once a window; readers retry while the
+// sequence is odd or changes under them, so they never hold it up
+static _Atomic unsigned int historyStatsSequence;
+static Period_statistics_t historyStats;
+
+#define LIGHT_SENSOR_CHANNEL 1
+
+void Sampler_init(enum Sampler_captureMode mode) {
+    SampleSource_t source;
+    if (mode == SAMPLER_CAPTURE_IIO_BUFFER) {
+        Backend_openAdcSource(&source, BACKEND_ADC_BUFFERED, LIGHT_SENSOR_CHANNEL, IIO_MAX_SAMPLES_PER_SECOND);
+    }
+    else {
+        Backend_openAdcSource(&source, BACKEND_ADC_POLLED, LIGHT_SENSOR_CHANNEL, samplesPerSecond);
+    }
+    Sampler_initWithSource(source);
+}
 
-void Sampler_init(void) {
-    Period_init();
+void Sampler_initWithSource(SampleSource_t source) {
+    sampleSource = source;
+    SampleRing_init(&sampleRing, getMaxWindowSize(&source), rawHistorySeconds);
+    HistoryStore_init(&historyStore, numSecondSummaries, numMinuteSummaries, numHourSummaries);
+    HistorySnapshot_initPool(&historyPool, HISTORY_SNAPSHOT_POOL_SIZE, getMaxWindowSize(&source));
+    WindowAnalyzer_init(&windowAnalyzer, analysisWindowConfigs, numAnalysisWindows);
+    if (persistencePath != NULL) {
+        HistoryLog_open(&historyLog, persistencePath, numPersistedWindows, 0);
+        if (numPersistedRawWindows > 0) {
+            char rawPath[PATH_MAX];
+            snprintf(rawPath, sizeof(rawPath), "%s.raw", persistencePath);
+            HistoryLog_open(&rawLog, rawPath, numPersistedRawWindows, getMaxWindowSize(&source));
+        }
+        recoverHistory();
+    }
+    windowEventDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stopEventDescriptor = eventfd(0, EFD_CLOEXEC);
+    if (windowEventDescriptor == -1 || stopEventDescriptor == -1) {
+        printf("ERROR: Unable to create sampler events (%s)\n", strerror(errno));
+        exit(-1);
+    }
+    sampleSource.stopEventDescriptor = stopEventDescriptor;
+    if (recordingPath != NULL) {
+        Trace_startRecording(recordingPath, source.maxSamplesPerSecond);
+    }
     isRunning = true;
-    pthread_mutex_init(&historyBufferLock, NULL);
-    pthread_mutex_init(&historyStatsLock, NULL);
     pthread_create(&sampleThread, NULL, collectionLoop, NULL);
 }
 
 void Sampler_cleanup(void) {
     isRunning = false;
-    pthread_mutex_destroy(&historyStatsLock);
-    pthread_mutex_destroy(&historyBufferLock);
+    uint64_t one = 1;
+    if (write(stopEventDescriptor, &one, sizeof(one)) != sizeof(one)) {
+        Log_write(LOG_LEVEL_WARNING, "WARNING: Unable to wake sampler (%s)\n", strerror(errno));
+    }
     pthread_join(sampleThread, NULL);
-    Period_cleanup();
+    Trace_stopRecording();
+    sampleSource.close(&sampleSource);
+    if (persistencePath != NULL) {
+        HistoryLog_close(&historyLog);
+        if (numPersistedRawWindows > 0) {
+            HistoryLog_close(&rawLog);
+        }
+    }
+    WindowAnalyzer_cleanup(&windowAnalyzer);
+    HistoryStore_cleanup(&historyStore);
+    HistorySnapshot_cleanupPool(&historyPool);
+    SampleRing_cleanup(&sampleRing);
+    close(windowEventDescriptor);
+    close(stopEventDescriptor);
+    windowEventDescriptor = stopEventDescriptor = -1;
 }
 
 static void *collectionLoop(void *arg) {
     (void)arg;
-    char buffer[16];
+    applyThreadScheduling();
+    uint16_t codes[SAMPLE_BATCH_SIZE];
+    DeadlineTimer_t sampleTimer;
+    DeadlineTimer_start(&sampleTimer, 1000000000LL / samplesPerSecond);
+
+    // Windows are back to back on the monotonic clock (or a replayed
+    // source's recorded clock), so neither read time nor wall clock
+    // adjustments shift their boundaries
+    long long windowStartMs = getSampleTimeInMs();
+    sampleTimeMs = windowStartMs;
+    long long loopStartMs = getMonotonicTimeInMs();
+    long long numSamplesRead = 0;
     while(isRunning) {
-        long long startTime = getTimeInMs();
-        long long currentTime = getTimeInMs();
-        while(currentTime - startTime < 1000) {
-            File_readFromFile(VOLTAGE_DIRECTORY, buffer);
-            double readValue = strtod(buffer, NULL) / 4095 * 1.8;
-            average = average == 0 ? readValue : average*0.999 + readValue*0.001;
-            currentSamples[currentSize] = readValue;
-            currentSize++;
-            sleepForMs(1);
-            currentTime = getTimeInMs();
-            Period_markEvent(PERIOD_EVENT_SAMPLE_LIGHT);
+        long long windowEndMs = windowStartMs + WINDOW_LENGTH_MS;
+        long long currentTime = getSampleTimeInMs();
+        while(isRunning && currentTime < windowEndMs) {
+            long long readStartNs = Period_getTimeInNs();
+            int numCodes = sampleSource.read(&sampleSource, codes, SAMPLE_BATCH_SIZE);
+            if (numCodes < 0) {
+                // Source exhausted (e.g. end of a packed sample file or a
+                // replayed trace, where this doubles as a benchmark)
+                long long elapsedMs = getMonotonicTimeInMs() - loopStartMs;
+                Log_write(LOG_LEVEL_INFO, "Sample source finished: %lld samples in %.3fs (%.0f samples/s)\n",
+                    numSamplesRead, elapsedMs / 1000.0,
+                    elapsedMs > 0 ? numSamplesRead * 1000.0 / elapsedMs : 0.0);
+                isRunning = false;
+                break;
+            }
+            if (numCodes > 0) {
+                Period_markDuration(PERIOD_EVENT_ADC_READ, readStartNs);
+            }
+            if (recordingPath != NULL && numCodes > 0) {
+                long long readTimeNs = sampleSource.getTimeNs != NULL
+                    ? sampleSource.getTimeNs(&sampleSource)
+                    : DeadlineTimer_getTimeInNs();
+                Trace_record(codes, numCodes, readTimeNs);
+            }
+            numSamplesRead += numCodes;
+            int32_t average = averageQ16;
+            for (int i = 0; i < numCodes; i++) {
+                int32_t sample = (int32_t)codes[i] << Q16_SHIFT;
+                average = average == 0
+                    ? sample
+                    : average + (int32_t)(((int64_t)(sample - average) * AVERAGE_WEIGHT_Q16) >> Q16_SHIFT);
+                SampleRing_push(&sampleRing, codes[i]);
+            }
+            averageQ16 = average;
+            WindowKernel_thresholds_t thresholds = getDipThresholds(average);
+            WindowAnalyzer_addSamples(&windowAnalyzer, codes, numCodes, currentTime, &thresholds);
+            if (!sampleSource.isPaced) {
+                int missed = DeadlineTimer_waitUnless(&sampleTimer, stopEventDescriptor);
+                if (missed > 0) {
+                    Period_markMissedDeadlines(PERIOD_EVENT_SAMPLE_LIGHT, missed);
+                }
+            }
+            currentTime = getSampleTimeInMs();
+            sampleTimeMs = currentTime;
+            // Marks each read: one sample when polled, one batch when buffered
+            if (numCodes > 0) {
+                Period_markEvent(PERIOD_EVENT_SAMPLE_LIGHT);
+            }
         }
 
-        calculateDips();
-        pthread_mutex_lock(&historyStatsLock);
-        Period_getStatisticsAndClear(PERIOD_EVENT_SAMPLE_LIGHT, &historyStats);
-        pthread_mutex_unlock(&historyStatsLock);
-        moveCurrentDataToHistory();
+        SampleRing_window_t window = SampleRing_completeWindow(&sampleRing);
+        WindowKernel_stats_t windowStats;
+        analyzeWindow(window, &windowStats);
+        historyDips = windowStats.dips;
+        Period_statistics_t periodStats;
+        Period_getStatisticsAndClear(PERIOD_EVENT_SAMPLE_LIGHT, &periodStats);
+        publishHistoryStats(&periodStats);
+        publishHistory(window, windowEndMs, &windowStats);
+        signalWindowEvent();
+
+        HistoryStore_summary_t summary = {
+            .startTimeMs = windowStartMs,
+            .endTimeMs = windowEndMs,
+            .epoch = window.epoch,
+            .firstSampleIndex = window.startIndex,
+            .numSamples = window.size,
+            .stats = windowStats,
+        };
+        HistoryStore_addSecond(&historyStore, &summary);
+        if (persistencePath != NULL) {
+            HistoryLog_entry_t entry = {
+                .startTimeMs = windowStartMs,
+                .endTimeMs = windowEndMs,
+                .stats = windowStats,
+                .periodStats = periodStats,
+            };
+            HistoryLog_append(&historyLog, &entry, NULL, NULL, 0);
+            if (numPersistedRawWindows > 0) {
+                const uint16_t *pSpans[2];
+                int spanSizes[2];
+                int numSpans = SampleRing_getSpans(&sampleRing, window, pSpans, spanSizes);
+                HistoryLog_append(&rawLog, &entry, pSpans, spanSizes, numSpans);
+            }
+        }
+        // After a stall, start the next window now rather than catching up
+        windowStartMs = currentTime < windowEndMs + WINDOW_LENGTH_MS ? windowEndMs : currentTime;
+        historySize = window.size;
+        totalSize += window.size + window.droppedSamples;
         Seg_updateDigitValues(historyDips);
     }
     return NULL;
@@ -78,29 +327,49 @@ static void *collectionLoop(void *arg) {
 
 Period_statistics_t Sampler_getHistoryStats(void) {
     Period_statistics_t historyStatsCopy;
-    pthread_mutex_lock(&historyStatsLock);
-    historyStatsCopy =  historyStats;
-    pthread_mutex_unlock(&historyStatsLock);
+    unsigned int sequence;
+    do {
+        sequence = atomic_load_explicit(&historyStatsSequence, memory_order_acquire);
+        historyStatsCopy = historyStats;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((sequence & 1) != 0
+        || sequence != atomic_load_explicit(&historyStatsSequence, memory_order_relaxed));
     return historyStatsCopy;
 }
 
+int Sampler_getWindowEventDescriptor(void) {
+    return windowEventDescriptor;
+}
+
 int Sampler_getHistorySize(void) {
     return historySize;
 }
 
 double* Sampler_getHistory(int *size) {
-    pthread_mutex_lock(&historyBufferLock);
-    *size = historySize;
+    const HistorySnapshot_t *pHistory = Sampler_acquireHistory();
+    *size = pHistory->size;
+    double* history = (double*)malloc(sizeof(double) * (pHistory->size > 0 ? pHistory->size : 1));
+    for (int i = 0; i < pHistory->size; i++) {
+        history[i] = Sampler_codeToVolts(pHistory->pSamples[i]);
+    }
+    Sampler_releaseHistory(pHistory);
+    return history;
+}
 
-    double* history = (double*)malloc(sizeof(double) * *size);
-    memcpy(history, historySamples, sizeof(double) * *size);
-    pthread_mutex_unlock(&historyBufferLock);
+const HistorySnapshot_t *Sampler_acquireHistory(void) {
+    return HistorySnapshot_acquire(&historyPool);
+}
 
-    return history;
+void Sampler_releaseHistory(const HistorySnapshot_t *pHistory) {
+    HistorySnapshot_release(pHistory);
+}
+
+double Sampler_codeToVolts(double code) {
+    return code / MAX_CODE * REFERENCE_VOLTAGE;
 }
 
 double Sampler_getAverageReading(void) {
-    return average;
+    return (double)averageQ16 / (1 << Q16_SHIFT) / MAX_CODE * REFERENCE_VOLTAGE;
 }
 
 long long Sampler_getNumSamplesTaken(void) {
@@ -111,49 +380,290 @@ int Sampler_getDips(void) {
     return historyDips;
 }
 
-static void calculateDips(void) {
-    historyDips = 0;
-    bool dipped = false;
-    double* history = historySamples;
-    for(int i=0; i<historySize; i++) {
-        if(!dipped && (history[i] < average - 0.1) | (history[i] > average + 0.1)) {
-            dipped = true;
-            historyDips++;
+bool Sampler_queryHistoryRange(long long fromMsAgo, long long toMsAgo, HistoryStore_range_t *pRange) {
+    // A fast replay's clock runs ahead of the monotonic one
+    long long nowMs = sampleSource.getTimeNs != NULL ? sampleTimeMs : getMonotonicTimeInMs();
+    return HistoryStore_query(&historyStore, nowMs - fromMsAgo, nowMs - toMsAgo, pRange);
+}
+
+long long Sampler_getHistorySpanSeconds(void) {
+    return numHourSummaries * 3600LL;
+}
+
+int Sampler_getMaxHistorySize(void) {
+    return getMaxWindowSize(&sampleSource);
+}
+
+int Sampler_copyRecentHistory(int secondsAgo, uint16_t *pDest, int maxSamples, HistoryStore_summary_t *pSecond) {
+    HistoryStore_summary_t second;
+    if (secondsAgo >= rawHistorySeconds || !HistoryStore_getSecond(&historyStore, secondsAgo, &second)) {
+        return -1;
+    }
+    // Restored from the history log without its raw samples
+    if (second.epoch == 0) {
+        return -1;
+    }
+    SampleRing_window_t window = {
+        .epoch = 0,
+        .startIndex = second.firstSampleIndex,
+        .size = second.numSamples,
+        .droppedSamples = 0,
+    };
+    SampleRing_window_t copied;
+    if (!SampleRing_copyWindow(&sampleRing, window, pDest, maxSamples, &copied)) {
+        return -1;
+    }
+    if (pSecond != NULL) {
+        *pSecond = second;
+        pSecond->numSamples = copied.size;
+    }
+    return copied.size;
+}
+
+void Sampler_setSampleRate(int newSamplesPerSecond) {
+    samplesPerSecond = newSamplesPerSecond > 0 ? newSamplesPerSecond : SAMPLER_DEFAULT_SAMPLES_PER_SECOND;
+    samplesPerSecond = samplesPerSecond < SAMPLER_MAX_SAMPLES_PER_SECOND ? samplesPerSecond
+        : SAMPLER_MAX_SAMPLES_PER_SECOND;
+}
+
+void Sampler_setHistoryDepth(int rawSeconds, int secondSummaries, int minuteSummaries, int hourSummaries) {
+    rawHistorySeconds = rawSeconds > 0 ? rawSeconds : 1;
+    numSecondSummaries = secondSummaries > 0 ? secondSummaries : 1;
+    numMinuteSummaries = minuteSummaries > 0 ? minuteSummaries : 1;
+    numHourSummaries = hourSummaries > 0 ? hourSummaries : 1;
+}
+
+void Sampler_setDipThresholds(double enterVolts, double exitVolts) {
+    dipEnterThresholdQ16 = VOLTS_TO_Q16(enterVolts);
+    dipExitThresholdQ16 = VOLTS_TO_Q16(exitVolts);
+}
+
+void Sampler_setRecording(char *path) {
+    recordingPath = path;
+}
+
+void Sampler_setPersistence(char *path, int numWindows, int numRawWindows) {
+    persistencePath = path;
+    numPersistedWindows = numWindows > 0 ? numWindows : 1;
+    numPersistedRawWindows = numRawWindows > 0 ? numRawWindows : 0;
+}
+
+void Sampler_setThreadScheduling(int priority, int cpu) {
+    realtimePriority = priority;
+    samplingCpu = cpu;
+}
+
+void Sampler_setAnalysisWindows(const WindowAnalyzer_config_t *pConfigs, int numWindows) {
+    if (numWindows > WINDOW_ANALYZER_MAX_WINDOWS) {
+        numWindows = WINDOW_ANALYZER_MAX_WINDOWS;
+    }
+    memcpy(analysisWindowConfigs, pConfigs, sizeof(pConfigs[0]) * numWindows);
+    numAnalysisWindows = numWindows;
+}
+
+int Sampler_getNumAnalysisWindows(void) {
+    return numAnalysisWindows;
+}
+
+bool Sampler_getAnalysisWindow(int index, WindowAnalyzer_result_t *pResult) {
+    return WindowAnalyzer_getResult(&windowAnalyzer, index, pResult);
+}
+
+// Codes strictly beyond average +/- the enter threshold (0.1V by default)
+// start a dip and codes strictly within average +/- the exit threshold
+// (0.07V) end it. Convert the Q16 bounds to the equivalent
+// inclusive integer code bounds for the kernel.
+static WindowKernel_thresholds_t getDipThresholds(int32_t average) {
+    WindowKernel_thresholds_t thresholds = {
+        .enterLow = -((dipEnterThresholdQ16 - average) >> Q16_SHIFT),
+        .enterHigh = (average + dipEnterThresholdQ16) >> Q16_SHIFT,
+        .exitLow = ((average - dipExitThresholdQ16) >> Q16_SHIFT) + 1,
+        .exitHigh = -((-(average + dipExitThresholdQ16)) >> Q16_SHIFT) - 1,
+    };
+    return thresholds;
+}
+
+static void analyzeWindow(SampleRing_window_t window, WindowKernel_stats_t *pStats) {
+    WindowKernel_thresholds_t thresholds = getDipThresholds(averageQ16);
+
+    const uint16_t *pSpans[2];
+    int spanSizes[2];
+    int numSpans = SampleRing_getSpans(&sampleRing, window, pSpans, spanSizes);
+    WindowKernel_reset(pStats);
+    for (int i = 0; i < numSpans; i++) {
+        WindowKernel_accumulate(pStats, pSpans[i], spanSizes[i], &thresholds);
+    }
+}
+
+static void publishHistory(SampleRing_window_t window, long long endTimeMs, const WindowKernel_stats_t *pStats) {
+    HistorySnapshot_t *pSnapshot = HistorySnapshot_claim(&historyPool);
+    if (pSnapshot == NULL) {
+        // Every buffer is held by a reader; keep serving the older second
+        return;
+    }
+    int size = window.size < pSnapshot->capacity ? window.size : pSnapshot->capacity;
+    for (int i = 0; i < size; i++) {
+        pSnapshot->pSamples[i] = SampleRing_get(&sampleRing, window.startIndex + i);
+    }
+    pSnapshot->epoch = window.epoch;
+    pSnapshot->endTimeMs = endTimeMs;
+    pSnapshot->size = size;
+    pSnapshot->droppedSamples = window.droppedSamples + (window.size - size);
+    pSnapshot->stats = *pStats;
+    HistorySnapshot_publish(&historyPool, pSnapshot);
+}
+
+// Replay the persisted windows into the history store. The newest raw
+// windows go back into the ring first, so the seconds they belong to can be
+// served raw again, and the last of them is the history until a new second
+// completes.
+static void recoverHistory(void) {
+    restoredRawWindows_t raw = {0};
+    if (numPersistedRawWindows > 0) {
+        raw.capacity = rawHistorySeconds;
+        raw.pWindows = calloc(raw.capacity, sizeof(raw.pWindows[0]));
+        if (raw.pWindows == NULL) {
+            printf("ERROR: Unable to allocate history recovery\n");
+            exit(-1);
+        }
+        HistoryLog_recover(&rawLog, collectRawWindow, &raw);
+    }
+    for (int i = 0; i < raw.count; i++) {
+        restoredRaw_t *pRestored = getRestoredRaw(&raw, i);
+        for (int j = 0; j < pRestored->entry.numRawSamples; j++) {
+            SampleRing_push(&sampleRing, pRestored->pRaw[j]);
         }
-        if(dipped && (history[i] > average - 0.07) && (history[i] < average + 0.07)) {
-            dipped = false;
+        pRestored->window = SampleRing_completeWindow(&sampleRing);
+    }
+
+    restoredHistory_t restored = {.pRawWindows = &raw};
+    int numRecovered = HistoryLog_recover(&historyLog, restoreWindow, &restored);
+    if (numRecovered > 0) {
+        Log_write(LOG_LEVEL_INFO, "Restored %d windows of history\n", numRecovered);
+    }
+    if (raw.count > 0) {
+        Log_write(LOG_LEVEL_INFO, "Restored the raw samples of the last %d windows\n", raw.count);
+        const restoredRaw_t *pLast = getRestoredRaw(&raw, raw.count - 1);
+        publishHistory(pLast->window, pLast->entry.endTimeMs, &pLast->entry.stats);
+    }
+    free(raw.pWindows);
+}
+
+// Keep the newest windows of the raw log, as many as the ring retains
+static void collectRawWindow(const HistoryLog_entry_t *pEntry, const uint16_t *pRaw, void *pContext) {
+    restoredRawWindows_t *pWindows = pContext;
+    if (pRaw == NULL || !isRestorable(pEntry, &pWindows->lastEntry)) {
+        return;
+    }
+    pWindows->lastEntry = *pEntry;
+    // Codes are read from the log's mapping once all are collected, before
+    // anything is appended to it
+    restoredRaw_t *pRestored = &pWindows->pWindows[pWindows->next];
+    pRestored->entry = *pEntry;
+    pRestored->pRaw = pRaw;
+    pWindows->next = (pWindows->next + 1) % pWindows->capacity;
+    pWindows->count = pWindows->count < pWindows->capacity ? pWindows->count + 1 : pWindows->capacity;
+}
+
+static void restoreWindow(const HistoryLog_entry_t *pEntry, const uint16_t *pRaw, void *pContext) {
+    (void)pRaw;
+    restoredHistory_t *pRestored = pContext;
+    if (!isRestorable(pEntry, &pRestored->lastEntry)) {
+        return;
+    }
+    HistoryStore_summary_t summary = {
+        .startTimeMs = pEntry->startTimeMs,
+        .endTimeMs = pEntry->endTimeMs,
+        .epoch = 0,
+        .firstSampleIndex = 0,
+        .numSamples = 0,
+        .stats = pEntry->stats,
+    };
+
+    // Both logs are in time order: point the summary at its raw window, if
+    // that went back into the ring
+    restoredRawWindows_t *pRawWindows = pRestored->pRawWindows;
+    while (pRestored->rawIndex < pRawWindows->count
+        && getRestoredRaw(pRawWindows, pRestored->rawIndex)->entry.startTimeMs
+            < pEntry->startTimeMs - RESTORE_MATCH_TOLERANCE_MS)
+    {
+        pRestored->rawIndex++;
+    }
+    if (pRestored->rawIndex < pRawWindows->count) {
+        const restoredRaw_t *pRawWindow = getRestoredRaw(pRawWindows, pRestored->rawIndex);
+        if (llabs(pRawWindow->entry.startTimeMs - pEntry->startTimeMs) <= RESTORE_MATCH_TOLERANCE_MS) {
+            summary.epoch = pRawWindow->window.epoch;
+            summary.firstSampleIndex = pRawWindow->window.startIndex;
+            summary.numSamples = pRawWindow->window.size;
+            pRestored->rawIndex++;
         }
     }
+    HistoryStore_addSecond(&historyStore, &summary);
+    pRestored->lastEntry = *pEntry;
+}
+
+// Skip windows the clocks put in the future (e.g. the wall clock was set
+// back), or before the last one restored, so the store stays in time order
+static bool isRestorable(const HistoryLog_entry_t *pEntry, const HistoryLog_entry_t *pLastEntry) {
+    return pEntry->endTimeMs <= getMonotonicTimeInMs()
+        && (pLastEntry->endTimeMs == 0 || pEntry->startTimeMs >= pLastEntry->endTimeMs);
+}
+
+// Restored raw window `index`, oldest first
+static restoredRaw_t *getRestoredRaw(restoredRawWindows_t *pWindows, int index) {
+    return &pWindows->pWindows[(pWindows->next - pWindows->count + index + pWindows->capacity) % pWindows->capacity];
+}
+
+static void publishHistoryStats(const Period_statistics_t *pStats) {
+    unsigned int sequence = atomic_load_explicit(&historyStatsSequence, memory_order_relaxed);
+    atomic_store_explicit(&historyStatsSequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    historyStats = *pStats;
+    atomic_store_explicit(&historyStatsSequence, sequence + 2, memory_order_release);
+}
+
+static void signalWindowEvent(void) {
+    uint64_t one = 1;
+    if (write(windowEventDescriptor, &one, sizeof(one)) != sizeof(one)) {
+        Log_write(LOG_LEVEL_WARNING, "WARNING: Unable to signal window event (%s)\n", strerror(errno));
+    }
 }
 
-static void moveCurrentDataToHistory(void) {
-    pthread_mutex_lock(&historyBufferLock);
-    memset(historySamples, 0, sizeof(double)*historySize);
-    memcpy(historySamples, currentSamples, sizeof(double)*currentSize);
-    historySize = currentSize;
-    pthread_mutex_unlock(&historyBufferLock);
+// Leave headroom over the nominal rate for jitter and a late final batch
+static int getMaxWindowSize(const SampleSource_t *pSource) {
+    int nominal = (int)((long long)pSource->maxSamplesPerSecond * WINDOW_LENGTH_MS / 1000);
+    return nominal + nominal / 8 + SAMPLE_BATCH_SIZE;
+}
 
-    totalSize += currentSize;
-    currentSize = 0;
-    memset(currentSamples, 0, sizeof(double)*currentSize);
+static void applyThreadScheduling(void) {
+    if (realtimePriority > 0) {
+        struct sched_param param = {.sched_priority = realtimePriority};
+        int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (result != 0) {
+            Log_write(LOG_LEVEL_WARNING, "WARNING: Unable to run sampler at SCHED_FIFO priority %d (%s)\n",
+                realtimePriority, strerror(result));
+        }
+    }
+    if (samplingCpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(samplingCpu, &cpus);
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (result != 0) {
+            Log_write(LOG_LEVEL_WARNING, "WARNING: Unable to pin sampler to CPU %d (%s)\n", samplingCpu, strerror(result));
+        }
+    }
 }
 
-static void sleepForMs(long long delayInMs) {
-    const long long NS_PER_MS = 1000 * 1000;
-    const long long NS_PER_SECOND = 1000000000;
-    long long delayNs = delayInMs * NS_PER_MS;
-    int seconds = delayNs / NS_PER_SECOND;
-    int nanoseconds = delayNs % NS_PER_SECOND;
-    struct timespec reqDelay = {seconds, nanoseconds};
-    nanosleep(&reqDelay, (struct timespec *) NULL);
+static long long getSampleTimeInMs(void) {
+    if (sampleSource.getTimeNs != NULL) {
+        return sampleSource.getTimeNs(&sampleSource) / 1000000;
+    }
+    return getMonotonicTimeInMs();
 }
 
-static long long getTimeInMs(void) {
+static long long getMonotonicTimeInMs(void) {
     struct timespec spec;
-    clock_gettime(CLOCK_REALTIME, &spec);
-    long long seconds = spec.tv_sec;
-    long long nanoSeconds = spec.tv_nsec;
-    long long milliSeconds = seconds * 1000
-    + nanoSeconds / 1000000;
-    return milliSeconds;
-}
\ No newline at end of file
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec * 1000LL + spec.tv_nsec / 1000000;
+}
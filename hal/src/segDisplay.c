@@ -1,15 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <fcntl.h>
-#include <unistd.h>
+#include <string.h>
+#include <errno.h>
 #include <stdbool.h>
-#include <pthread.h>
-#include <sys/ioctl.h>
-#include <linux/i2c.h>
-#include <linux/i2c-dev.h>
 
 #include "hal/segDisplay.h"
-#include "hal/file.h"
+#include "hal/backend.h"
+#include "hal/periodTimer.h"
+#include "hal/log.h"
+#include "hal/reactor.h"
 
 /**
  *   -----1b------
@@ -32,47 +31,44 @@
 #define REG_OUTA 0x00
 #define REG_OUTB 0x01
 
-struct DigitValues {
-    unsigned int first;
-    unsigned int second;
-};
-
 struct SegValues {
     unsigned int regAVal;
     unsigned int regBVal;
 };
 
+enum Digit {
+    FIRST_DIGIT,
+    SECOND_DIGIT,
+    NUM_DIGITS
+};
+
 static int initI2cBus(char* bus, int address);
-static void writeI2cReg(int i2cFileDesc, unsigned char regAddr, unsigned char value);
-static void *segDisplayLoop(void *arg);
+static void writeSegValues(int i2c, struct SegValues values);
+static void setDigitOn(enum Digit digit, bool isOn);
+static void updateDisplay(void *pContext);
 static struct SegValues getSegValues(unsigned int digitValue);
-static void sleepForMs(long long delayInMs);
-static void runCommand(char* command);
 
-static _Atomic bool isRunning;
-static pthread_t segThread;
-static struct DigitValues digitValues;
+// Each digit is lit in turn for a digit period; a static frame (both
+// digits the same) is only checked for a new value every two
+static long long digitPeriodNs = SEG_DEFAULT_DIGIT_PERIOD_MS * 1000 * 1000LL;
 
-void Seg_init(void) {
-    isRunning = true;
-    pthread_create(&segThread, NULL, segDisplayLoop, NULL);
-}
+// Value to show (0-99); written by any thread, read once per frame
+static _Atomic unsigned int displayValue;
 
-void Seg_cleanup(void) {
-    isRunning = false;
-    pthread_join(segThread, NULL);
-}
+// Reactor thread state
+static int i2c;
+static int displayTask;
+static unsigned int currentValue;
+static struct SegValues values[NUM_DIGITS];
+static bool isShowingStaticFrame;
+static enum Digit nextDigit;
 
-void Seg_updateDigitValues(unsigned int newValue) {
-    if(newValue >= 99) {
-        digitValues.first = 9;
-        digitValues.second = 9;
-    }
-    else {
-        digitValues.first = newValue / 10;
-        digitValues.second = newValue % 10;
-    }
-}
+// Digit enable GPIOs, kept open, and what was last written to them so
+// unchanged values are never rewritten
+static int digitOutputs[NUM_DIGITS];
+static bool isDigitOn[NUM_DIGITS];
+// Set once a write has failed, so a flaky bus is reported only once
+static bool hasReportedError;
 
 #define CONFIG_PINS_OUT_COMMAND "echo out > /sys/class/gpio/gpio61/direction; echo out > /sys/class/gpio/gpio44/direction"
 #define CONFIG_PINS_I2C_COMMAND "config-pin P9_17 i2c; config-pin P9_18 i2c"
@@ -80,86 +76,120 @@ void Seg_updateDigitValues(unsigned int newValue) {
 
 #define FIRST_DIGIT_FILE "/sys/class/gpio/gpio61/value"
 #define SECOND_DIGIT_FILE "/sys/class/gpio/gpio44/value"
-static void *segDisplayLoop(void *arg) {
-    (void)arg;
-    int i2cFileDesc = initI2cBus(I2CDRV_LINUX_BUS1, I2C_DEVICE_ADDRESS);
-    unsigned int currentFirstDigitValue = 0;
-    unsigned int currentSecondDigitValue = 0;
-    struct SegValues firstValues = {0, 0};
-    struct SegValues secondValues = {0, 0};
+void Seg_init(void) {
+    i2c = initI2cBus(I2CDRV_LINUX_BUS1, I2C_DEVICE_ADDRESS);
     // Configure pins for I2C
-    runCommand(CONFIG_PINS_OUT_COMMAND);
-    runCommand(CONFIG_PINS_I2C_COMMAND);
-    runCommand(ZEN_RED_I2C_OUTPUT_COMMAND);
-    while(isRunning) {
-        // Update seg value structs if we have an update to our digit values
-        if((digitValues.first != currentFirstDigitValue)) {
-            currentFirstDigitValue = digitValues.first;
-            firstValues = getSegValues(currentFirstDigitValue);
+    Backend_runCommand(CONFIG_PINS_OUT_COMMAND);
+    Backend_runCommand(CONFIG_PINS_I2C_COMMAND);
+    Backend_runCommand(ZEN_RED_I2C_OUTPUT_COMMAND);
+    digitOutputs[FIRST_DIGIT] = Backend_openOutput(FIRST_DIGIT_FILE);
+    digitOutputs[SECOND_DIGIT] = Backend_openOutput(SECOND_DIGIT_FILE);
+    // Start from a known state: both digits off
+    isDigitOn[FIRST_DIGIT] = isDigitOn[SECOND_DIGIT] = true;
+    setDigitOn(FIRST_DIGIT, false);
+    setDigitOn(SECOND_DIGIT, false);
+
+    currentValue = 0;
+    values[FIRST_DIGIT] = values[SECOND_DIGIT] = getSegValues(0);
+    isShowingStaticFrame = false;
+    nextDigit = FIRST_DIGIT;
+    displayTask = Reactor_addTask(digitPeriodNs, updateDisplay, NULL);
+}
+
+void Seg_cleanup(void) {
+    setDigitOn(FIRST_DIGIT, false);
+    setDigitOn(SECOND_DIGIT, false);
+    Backend_closeOutput(digitOutputs[FIRST_DIGIT]);
+    Backend_closeOutput(digitOutputs[SECOND_DIGIT]);
+    Backend_closeI2c(i2c);
+}
+
+void Seg_setDigitPeriod(int periodMs) {
+    digitPeriodNs = (periodMs > 0 ? periodMs : SEG_DEFAULT_DIGIT_PERIOD_MS) * 1000 * 1000LL;
+}
+
+void Seg_updateDigitValues(unsigned int newValue) {
+    displayValue = newValue >= 99 ? 99 : newValue;
+}
+
+// Reactor task, once per digit
+static void updateDisplay(void *pContext) {
+    (void)pContext;
+    if(nextDigit == FIRST_DIGIT) {
+        Period_markEvent(PERIOD_EVENT_DISPLAY_FRAME);
+
+        // Update seg values if we have an update to our digit values
+        unsigned int newValue = displayValue;
+        if(newValue != currentValue) {
+            currentValue = newValue;
+            values[FIRST_DIGIT] = getSegValues(currentValue / 10);
+            values[SECOND_DIGIT] = getSegValues(currentValue % 10);
+            isShowingStaticFrame = false;
         }
-        if((digitValues.second != currentSecondDigitValue)) {
-            currentSecondDigitValue = digitValues.second;
-            secondValues = getSegValues(currentSecondDigitValue);
+
+        // Two identical digits need no multiplexing: show both at once and
+        // do no I/O at all until the value changes
+        if(values[FIRST_DIGIT].regAVal == values[SECOND_DIGIT].regAVal
+            && values[FIRST_DIGIT].regBVal == values[SECOND_DIGIT].regBVal) {
+            if(!isShowingStaticFrame) {
+                setDigitOn(FIRST_DIGIT, false);
+                setDigitOn(SECOND_DIGIT, false);
+                writeSegValues(i2c, values[FIRST_DIGIT]);
+                setDigitOn(FIRST_DIGIT, true);
+                setDigitOn(SECOND_DIGIT, true);
+                isShowingStaticFrame = true;
+            }
+            Reactor_setTaskPeriod(displayTask, 2 * digitPeriodNs);
+            return;
         }
-        // Turn both digits off
-        File_writeToFile(FIRST_DIGIT_FILE, "0");
-        File_writeToFile(SECOND_DIGIT_FILE, "0");
-
-        // Write first digit and turn digit on, then sleep 5ms
-        writeI2cReg(i2cFileDesc, REG_OUTA, firstValues.regAVal);
-        writeI2cReg(i2cFileDesc, REG_OUTB, firstValues.regBVal);
-        File_writeToFile(FIRST_DIGIT_FILE, "1");
-        sleepForMs(5);
-
-        // Turn both digits off
-        File_writeToFile(FIRST_DIGIT_FILE, "0");
-        File_writeToFile(SECOND_DIGIT_FILE, "0");
-
-        // Write second digit and turn digit on, then sleep 5ms
-        writeI2cReg(i2cFileDesc, REG_OUTA, secondValues.regAVal);
-        writeI2cReg(i2cFileDesc, REG_OUTB, secondValues.regBVal);
-        File_writeToFile(SECOND_DIGIT_FILE, "1");
-        sleepForMs(5);
+        Reactor_setTaskPeriod(displayTask, digitPeriodNs);
     }
-    File_writeToFile(FIRST_DIGIT_FILE, "0");
-    File_writeToFile(SECOND_DIGIT_FILE, "0");
-    close(i2cFileDesc);
-    return NULL;
+
+    // Otherwise show each digit in turn: turn the lit digit off, load both
+    // port registers in one transaction, turn on the next
+    setDigitOn(FIRST_DIGIT, false);
+    setDigitOn(SECOND_DIGIT, false);
+    writeSegValues(i2c, values[nextDigit]);
+    setDigitOn(nextDigit, true);
+    nextDigit = nextDigit == FIRST_DIGIT ? SECOND_DIGIT : FIRST_DIGIT;
 }
 
 #define CONFIG_P9_17 "config-pin P9_17 i2c"
 #define CONFIG_P9_18 "config-pin P9_18 i2c"
 static int initI2cBus(char* bus, int address)
-{   
+{
     // Configure pins for i2c
-    runCommand(CONFIG_P9_17);
-    runCommand(CONFIG_P9_18);
-
-    // Initialize i2c bus
-	int i2cFileDesc = open(bus, O_RDWR);
-	if (i2cFileDesc < 0) {
-		printf("I2C DRV: Unable to open bus for read/write (%s)\n", bus);
-		perror("Error is:");
-		exit(-1);
-	}
+    Backend_runCommand(CONFIG_P9_17);
+    Backend_runCommand(CONFIG_P9_18);
 
-	int result = ioctl(i2cFileDesc, I2C_SLAVE, address);
-	if (result < 0) {
-		perror("Unable to set I2C device to slave address.");
-		exit(-1);
-	}
-	return i2cFileDesc;
+    return Backend_openI2c(bus, address);
+}
+
+// Both output registers in a single transaction. A failure leaves the old
+// (stale) segments lit.
+static void writeSegValues(int i2c, struct SegValues values)
+{
+    const unsigned char registerValues[2][2] = {
+        {REG_OUTA, values.regAVal},
+        {REG_OUTB, values.regBVal},
+    };
+    if (!Backend_writeI2cRegisters(i2c, registerValues, 2) && !hasReportedError) {
+        Log_write(LOG_LEVEL_ERROR, "Unable to write i2c registers: %s\n", strerror(errno));
+        hasReportedError = true;
+    }
 }
 
-static void writeI2cReg(int i2cFileDesc, unsigned char regAddr, unsigned char value)
+static void setDigitOn(enum Digit digit, bool isOn)
 {
-	unsigned char buff[2];
-	buff[0] = regAddr;
-	buff[1] = value;
-	int res = write(i2cFileDesc, buff, 2);
-	if (res != 2) {
-		perror("Unable to write i2c register");
-		exit(-1);
+	if (isDigitOn[digit] == isOn) {
+		return;
+	}
+	if (Backend_writeOutput(digitOutputs[digit], isOn ? "1" : "0", 1)) {
+		isDigitOn[digit] = isOn;
+	}
+	else if (!hasReportedError) {
+		Log_write(LOG_LEVEL_ERROR, "Unable to write digit GPIO: %s\n", strerror(errno));
+		hasReportedError = true;
 	}
 }
 
@@ -209,29 +239,3 @@ static struct SegValues getSegValues(unsigned int digitValue) {
     }
     return segValues;
 }
-
-static void sleepForMs(long long delayInMs) {
-    const long long NS_PER_MS = 1000 * 1000;
-    const long long NS_PER_SECOND = 1000000000;
-    long long delayNs = delayInMs * NS_PER_MS;
-    int seconds = delayNs / NS_PER_SECOND;
-    int nanoseconds = delayNs % NS_PER_SECOND;
-    struct timespec reqDelay = {seconds, nanoseconds};
-    nanosleep(&reqDelay, (struct timespec *) NULL);
-}
-
-static void runCommand(char* command) {
-    FILE *pipe = popen(command, "r");
-    char buffer[1024];
-
-    while (!feof(pipe) && !ferror(pipe)) {
-        if (fgets(buffer, sizeof(buffer), pipe) == NULL)
-        break;
-    }
-
-    int exitCode = WEXITSTATUS(pclose(pipe));
-    if (exitCode != 0) {
-        printf("Unable to execute command: %s, exit code: %d\n", command, exitCode);
-        exit(1);
-    }
-}
\ No newline at end of file
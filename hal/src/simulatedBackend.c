@@ -0,0 +1,311 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hal/simulatedBackend.h"
+
+#define LIGHT_SENSOR_CHANNEL 1
+#define MAX_CODE 4095
+#define REFERENCE_VOLTAGE 1.8
+
+// Buffered reads give up after this long without a sample due, so the
+// caller can check for shutdown (as the IIO source does)
+#define READ_TIMEOUT_NS (100 * 1000 * 1000LL)
+#define NS_PER_SECOND 1000000000LL
+#define WATERMARK_MS 1
+
+#define MAX_OUTPUTS 16
+#define MAX_OUTPUT_PATH 128
+#define MAX_OUTPUT_VALUE 32
+#define MAX_I2C_DEVICES 4
+#define NUM_I2C_REGISTERS 256
+
+typedef struct {
+    int channel;
+    bool isBuffered;
+    int samplesPerSecond;
+
+    // Codes produced so far, and when the first was due
+    long long numProduced;
+    long long startNs;
+
+    unsigned int noiseState;
+    SampleSource_t trace;
+    bool hasTrace;
+} simulatedAdc_t;
+
+typedef struct {
+    char path[MAX_OUTPUT_PATH];
+    char value[MAX_OUTPUT_VALUE];
+} simulatedOutput_t;
+
+static int readAdc(SampleSource_t *pSource, uint16_t *pCodes, int maxCodes);
+static void closeAdc(SampleSource_t *pSource);
+static uint16_t getWaveformCode(simulatedAdc_t *pAdc, long long sampleIndex);
+static long long getNumDue(const simulatedAdc_t *pAdc);
+static long long getSampleTimeNs(const simulatedAdc_t *pAdc, long long sampleIndex);
+static long long getTimeInNs(void);
+
+static SimulatedBackend_config_t config;
+static bool hasConfig = false;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static simulatedOutput_t outputs[MAX_OUTPUTS];
+static int numOutputs;
+static unsigned char i2cRegisters[MAX_I2C_DEVICES][NUM_I2C_REGISTERS];
+static int numI2cDevices;
+static long long numOutputWrites;
+static long long numI2cWrites;
+
+void SimulatedBackend_getDefaultConfig(SimulatedBackend_config_t *pConfig) {
+    memset(pConfig, 0, sizeof(*pConfig));
+    pConfig->waveform = SIMULATED_WAVE_DIPS;
+    pConfig->baseVolts = 0.9;
+    pConfig->amplitudeVolts = 0.2;
+    pConfig->frequencyHz = 2;
+    pConfig->tracePath = NULL;
+    pConfig->samplesPerSecond = 1000;
+    pConfig->otherChannelCode = MAX_CODE / 2;
+}
+
+void SimulatedBackend_setConfig(const SimulatedBackend_config_t *pConfig) {
+    config = *pConfig;
+    hasConfig = true;
+}
+
+void SimulatedBackend_openAdcSource(SampleSource_t *pSource, bool isBuffered, int channel,
+    int maxSamplesPerSecond)
+{
+    if (!hasConfig) {
+        SimulatedBackend_getDefaultConfig(&config);
+        hasConfig = true;
+    }
+
+    simulatedAdc_t *pAdc = calloc(1, sizeof(*pAdc));
+    if (pAdc == NULL) {
+        printf("ERROR: Unable to allocate simulated A2D\n");
+        exit(-1);
+    }
+    pAdc->channel = channel;
+    pAdc->isBuffered = isBuffered;
+    pAdc->samplesPerSecond = isBuffered ? config.samplesPerSecond : maxSamplesPerSecond;
+    pAdc->startNs = getTimeInNs();
+    pAdc->noiseState = 2463534242u + channel;
+    if (channel == LIGHT_SENSOR_CHANNEL && config.tracePath != NULL) {
+        SampleSource_openPacked(&pAdc->trace, config.tracePath, &config.traceLayout, pAdc->samplesPerSecond);
+        pAdc->hasTrace = true;
+    }
+
+    pSource->read = readAdc;
+    pSource->close = closeAdc;
+    pSource->isPaced = isBuffered;
+    pSource->getTimeNs = NULL;
+    pSource->stopEventDescriptor = -1;
+    pSource->maxSamplesPerSecond = pAdc->samplesPerSecond;
+    pSource->pState = pAdc;
+}
+
+int SimulatedBackend_openOutput(char *path) {
+    pthread_mutex_lock(&lock);
+    int output = -1;
+    for (int i = 0; i < numOutputs; i++) {
+        if (strcmp(outputs[i].path, path) == 0) {
+            output = i;
+        }
+    }
+    if (output == -1 && numOutputs < MAX_OUTPUTS) {
+        output = numOutputs++;
+        snprintf(outputs[output].path, MAX_OUTPUT_PATH, "%s", path);
+        outputs[output].value[0] = 0;
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (output == -1) {
+        printf("ERROR: Too many simulated outputs (%s)\n", path);
+        exit(-1);
+    }
+    return output;
+}
+
+bool SimulatedBackend_writeOutput(int output, const char *content, int length) {
+    if (length >= MAX_OUTPUT_VALUE) {
+        return false;
+    }
+    pthread_mutex_lock(&lock);
+    memcpy(outputs[output].value, content, length);
+    outputs[output].value[length] = 0;
+    numOutputWrites++;
+    pthread_mutex_unlock(&lock);
+    return true;
+}
+
+int SimulatedBackend_openI2c(char *bus, int address) {
+    pthread_mutex_lock(&lock);
+    int i2c = numI2cDevices < MAX_I2C_DEVICES ? numI2cDevices++ : -1;
+    pthread_mutex_unlock(&lock);
+
+    if (i2c == -1) {
+        printf("ERROR: Too many simulated I2C devices (%s, 0x%02x)\n", bus, address);
+        exit(-1);
+    }
+    return i2c;
+}
+
+bool SimulatedBackend_writeI2cRegisters(int i2c, const unsigned char (*pRegisterValues)[2], int count) {
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < count; i++) {
+        i2cRegisters[i2c][pRegisterValues[i][0]] = pRegisterValues[i][1];
+    }
+    numI2cWrites++;
+    pthread_mutex_unlock(&lock);
+    return true;
+}
+
+bool SimulatedBackend_getOutput(const char *path, char *pValue, int maxLength) {
+    bool found = false;
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < numOutputs; i++) {
+        if (strcmp(outputs[i].path, path) == 0) {
+            snprintf(pValue, maxLength, "%s", outputs[i].value);
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return found;
+}
+
+int SimulatedBackend_getI2cRegister(int i2c, int reg) {
+    pthread_mutex_lock(&lock);
+    int value = i2cRegisters[i2c][reg & (NUM_I2C_REGISTERS - 1)];
+    pthread_mutex_unlock(&lock);
+    return value;
+}
+
+long long SimulatedBackend_getNumOutputWrites(void) {
+    pthread_mutex_lock(&lock);
+    long long count = numOutputWrites;
+    pthread_mutex_unlock(&lock);
+    return count;
+}
+
+long long SimulatedBackend_getNumI2cWrites(void) {
+    pthread_mutex_lock(&lock);
+    long long count = numI2cWrites;
+    pthread_mutex_unlock(&lock);
+    return count;
+}
+
+// Polled reads convert one sample immediately. Buffered reads deliver every
+// sample due since the last read, first waiting (up to the timeout) for at
+// least a watermark's worth.
+static int readAdc(SampleSource_t *pSource, uint16_t *pCodes, int maxCodes) {
+    simulatedAdc_t *pAdc = pSource->pState;
+    if (maxCodes <= 0) {
+        return 0;
+    }
+
+    int numCodes = 1;
+    if (pAdc->isBuffered) {
+        // Like the kernel buffer, wake the reader once per WATERMARK_MS of
+        // samples (or a full read) rather than per sample, so high rates
+        // are not dominated by tiny reads
+        long long watermark = (long long)pAdc->samplesPerSecond * WATERMARK_MS / 1000;
+        watermark = watermark < 1 ? 1 : watermark > maxCodes ? maxCodes : watermark;
+        long long numDue = getNumDue(pAdc);
+        if (numDue < watermark) {
+            long long readyNs = getSampleTimeNs(pAdc, pAdc->numProduced + watermark - 1);
+            long long waitNs = readyNs - (getTimeInNs() - pAdc->startNs);
+            waitNs = waitNs < READ_TIMEOUT_NS ? waitNs : READ_TIMEOUT_NS;
+            if (waitNs > 0 && !SampleSource_waitNs(pSource, waitNs)) {
+                return 0;
+            }
+            numDue = getNumDue(pAdc);
+            if (numDue <= 0) {
+                return 0;
+            }
+        }
+        numCodes = numDue < maxCodes ? numDue : maxCodes;
+    }
+
+    if (pAdc->hasTrace) {
+        numCodes = pAdc->trace.read(&pAdc->trace, pCodes, numCodes);
+    }
+    else if (pAdc->channel != LIGHT_SENSOR_CHANNEL) {
+        for (int i = 0; i < numCodes; i++) {
+            pCodes[i] = config.otherChannelCode;
+        }
+    }
+    else {
+        for (int i = 0; i < numCodes; i++) {
+            pCodes[i] = getWaveformCode(pAdc, pAdc->numProduced + i);
+        }
+    }
+    if (numCodes > 0) {
+        pAdc->numProduced += numCodes;
+    }
+    return numCodes;
+}
+
+static void closeAdc(SampleSource_t *pSource) {
+    simulatedAdc_t *pAdc = pSource->pState;
+    if (pAdc->hasTrace) {
+        pAdc->trace.close(&pAdc->trace);
+    }
+    free(pAdc);
+    pSource->pState = NULL;
+}
+
+static uint16_t getWaveformCode(simulatedAdc_t *pAdc, long long sampleIndex) {
+    double timeInS = (double)sampleIndex / pAdc->samplesPerSecond;
+    double phase = timeInS * config.frequencyHz;
+    phase -= (long long)phase;
+
+    double volts = config.baseVolts;
+    switch (config.waveform) {
+        case SIMULATED_WAVE_SINE:
+            volts += config.amplitudeVolts * sin(2 * M_PI * phase);
+            break;
+        case SIMULATED_WAVE_DIPS:
+            volts -= phase < 0.1 ? config.amplitudeVolts : 0;
+            break;
+        case SIMULATED_WAVE_NOISE:
+            // xorshift32, mapped to [-1, 1]
+            pAdc->noiseState ^= pAdc->noiseState << 13;
+            pAdc->noiseState ^= pAdc->noiseState >> 17;
+            pAdc->noiseState ^= pAdc->noiseState << 5;
+            volts += config.amplitudeVolts * ((double)pAdc->noiseState / UINT32_MAX * 2 - 1);
+            break;
+        case SIMULATED_WAVE_CONSTANT:
+        default:
+            break;
+    }
+
+    long long code = (long long)(volts / REFERENCE_VOLTAGE * MAX_CODE + 0.5);
+    return code < 0 ? 0 : code > MAX_CODE ? MAX_CODE : code;
+}
+
+// Samples whose conversion time has passed but have not been read. Whole
+// seconds and the remainder are scaled apart, so the products stay well
+// inside 64 bits however long the run and however high the rate.
+static long long getNumDue(const simulatedAdc_t *pAdc) {
+    long long elapsedNs = getTimeInNs() - pAdc->startNs;
+    long long numConverted = elapsedNs / NS_PER_SECOND * pAdc->samplesPerSecond
+        + elapsedNs % NS_PER_SECOND * pAdc->samplesPerSecond / NS_PER_SECOND;
+    return numConverted + 1 - pAdc->numProduced;
+}
+
+// When sample `sampleIndex` is converted, relative to the start
+static long long getSampleTimeNs(const simulatedAdc_t *pAdc, long long sampleIndex) {
+    return sampleIndex / pAdc->samplesPerSecond * NS_PER_SECOND
+        + sampleIndex % pAdc->samplesPerSecond * NS_PER_SECOND / pAdc->samplesPerSecond;
+}
+
+static long long getTimeInNs(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec * NS_PER_SECOND + spec.tv_nsec;
+}
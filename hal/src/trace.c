@@ -0,0 +1,340 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hal/trace.h"
+#include "hal/deadlineTimer.h"
+#include "hal/log.h"
+
+#define TRACE_MAGIC "LSTR"
+#define TRACE_VERSION 1
+#define HEADER_BYTES 24
+#define RECORD_HEADER_BYTES 6
+#define MAX_RECORD_CODES 0xFFFF
+#define MAX_CODE 4095
+
+// About 10s of codes at 200k samples/s; the writer drains it every
+// WRITE_INTERVAL_MS, so it only fills if the disk stalls
+#define RECORD_BUFFER_BYTES (4 * 1024 * 1024)
+#define WRITE_INTERVAL_MS 10
+
+#define REPLAY_BUFFER_BYTES (64 * 1024)
+#define REPLAY_WAIT_LIMIT_NS (100 * 1000 * 1000LL)
+
+typedef struct {
+    int fd;
+    bool isRealTime;
+    unsigned char bytes[REPLAY_BUFFER_BYTES];
+    int position;
+    int length;
+
+    // Recorded times are shifted onto the replay's own clock
+    long long offsetUs;
+    long long recordTimeUs;
+    int codesLeftInRecord;
+} replayState_t;
+
+static void *writeLoop(void *arg);
+static bool writeAvailable(void);
+static void putBytes(unsigned long long position, const unsigned char *pBytes, int count);
+static int readReplay(SampleSource_t *pSource, uint16_t *pCodes, int maxCodes);
+static void closeReplay(SampleSource_t *pSource);
+static long long getReplayTimeNs(SampleSource_t *pSource);
+static bool fillReplayBuffer(replayState_t *pState, int neededBytes);
+static void putLittleEndian(unsigned char *pBytes, unsigned long long value, int numBytes);
+static unsigned long long getLittleEndian(const unsigned char *pBytes, int numBytes);
+
+static int recordFd = -1;
+static pthread_t writerThread;
+static _Atomic bool isWriterRunning;
+
+// Single producer (the sampling thread), single consumer (the writer)
+static unsigned char *pRecordBuffer;
+static _Atomic unsigned long long recordHead;
+static _Atomic unsigned long long recordTail;
+static long long lastRecordTimeUs;
+static long long numRecordedSamples;
+static long long numDroppedSamples;
+static bool hasWriteFailed;
+
+void Trace_startRecording(char *path, int samplesPerSecond) {
+    recordFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (recordFd < 0) {
+        printf("ERROR: Unable to open trace (%s) for write (%s)\n", path, strerror(errno));
+        exit(-1);
+    }
+
+    // Touch every page now so the sampling thread never faults them in
+    pRecordBuffer = malloc(RECORD_BUFFER_BYTES);
+    if (pRecordBuffer == NULL) {
+        printf("ERROR: Unable to allocate trace buffer\n");
+        exit(-1);
+    }
+    memset(pRecordBuffer, 0, RECORD_BUFFER_BYTES);
+    recordHead = 0;
+    recordTail = 0;
+    numRecordedSamples = 0;
+    numDroppedSamples = 0;
+    hasWriteFailed = false;
+
+    lastRecordTimeUs = DeadlineTimer_getTimeInNs() / 1000;
+    unsigned char header[HEADER_BYTES] = {0};
+    memcpy(header, TRACE_MAGIC, 4);
+    putLittleEndian(header + 4, TRACE_VERSION, 2);
+    putLittleEndian(header + 8, samplesPerSecond, 4);
+    putLittleEndian(header + 16, lastRecordTimeUs, 8);
+    if (write(recordFd, header, HEADER_BYTES) != HEADER_BYTES) {
+        printf("ERROR: Unable to write trace header (%s)\n", strerror(errno));
+        exit(-1);
+    }
+
+    isWriterRunning = true;
+    pthread_create(&writerThread, NULL, writeLoop, NULL);
+}
+
+void Trace_record(const uint16_t *pCodes, int numCodes, long long timeNs) {
+    if (recordFd < 0) {
+        return;
+    }
+    while (numCodes > 0) {
+        int count = numCodes < MAX_RECORD_CODES ? numCodes : MAX_RECORD_CODES;
+        unsigned long long head = atomic_load_explicit(&recordHead, memory_order_relaxed);
+        unsigned long long tail = atomic_load_explicit(&recordTail, memory_order_acquire);
+        int recordBytes = RECORD_HEADER_BYTES + count * 2;
+        if (RECORD_BUFFER_BYTES - (head - tail) < (unsigned long long)recordBytes) {
+            numDroppedSamples += numCodes;
+            return;
+        }
+
+        // Deltas are taken between the rounded times, so they add up exactly
+        long long timeUs = timeNs / 1000;
+        long long deltaUs = timeUs - lastRecordTimeUs;
+        deltaUs = deltaUs < 0 ? 0 : deltaUs > UINT32_MAX ? UINT32_MAX : deltaUs;
+        lastRecordTimeUs += deltaUs;
+
+        unsigned char recordHeader[RECORD_HEADER_BYTES];
+        putLittleEndian(recordHeader, deltaUs, 4);
+        putLittleEndian(recordHeader + 4, count, 2);
+        putBytes(head, recordHeader, RECORD_HEADER_BYTES);
+        head += RECORD_HEADER_BYTES;
+        // Records are whole u16s, so a code never straddles the wrap
+        for (int i = 0; i < count; i++) {
+            unsigned char *pCode = pRecordBuffer + head % RECORD_BUFFER_BYTES;
+            pCode[0] = pCodes[i] & 0xFF;
+            pCode[1] = pCodes[i] >> 8;
+            head += 2;
+        }
+        atomic_store_explicit(&recordHead, head, memory_order_release);
+
+        numRecordedSamples += count;
+        pCodes += count;
+        numCodes -= count;
+    }
+}
+
+void Trace_stopRecording(void) {
+    if (recordFd < 0) {
+        return;
+    }
+    isWriterRunning = false;
+    pthread_join(writerThread, NULL);
+    close(recordFd);
+    recordFd = -1;
+    free(pRecordBuffer);
+    pRecordBuffer = NULL;
+
+    if (numDroppedSamples > 0) {
+        Log_write(LOG_LEVEL_WARNING, "Trace: recorded %lld samples, dropped %lld (writer behind)\n",
+            numRecordedSamples, numDroppedSamples);
+    }
+    else {
+        Log_write(LOG_LEVEL_INFO, "Trace: recorded %lld samples\n", numRecordedSamples);
+    }
+}
+
+bool Trace_isRecording(void) {
+    return recordFd >= 0;
+}
+
+void Trace_openReplay(SampleSource_t *pSource, char *path, bool isRealTime) {
+    replayState_t *pState = calloc(1, sizeof(*pState));
+    if (pState == NULL) {
+        printf("ERROR: Unable to allocate trace replay\n");
+        exit(-1);
+    }
+    pState->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (pState->fd < 0) {
+        printf("ERROR: Unable to open trace (%s) for read\n", path);
+        exit(-1);
+    }
+    pState->isRealTime = isRealTime;
+
+    if (!fillReplayBuffer(pState, HEADER_BYTES)
+        || memcmp(pState->bytes, TRACE_MAGIC, 4) != 0
+        || getLittleEndian(pState->bytes + 4, 2) != TRACE_VERSION)
+    {
+        printf("ERROR: %s is not a version %d trace\n", path, TRACE_VERSION);
+        exit(-1);
+    }
+    int samplesPerSecond = (int)getLittleEndian(pState->bytes + 8, 4);
+    pState->recordTimeUs = (long long)getLittleEndian(pState->bytes + 16, 8);
+    pState->offsetUs = DeadlineTimer_getTimeInNs() / 1000 - pState->recordTimeUs;
+    pState->position = HEADER_BYTES;
+
+    pSource->read = readReplay;
+    pSource->close = closeReplay;
+    pSource->isPaced = true;
+    pSource->maxSamplesPerSecond = samplesPerSecond;
+    pSource->getTimeNs = getReplayTimeNs;
+    pSource->stopEventDescriptor = -1;
+    pSource->pState = pState;
+}
+
+static void *writeLoop(void *arg) {
+    (void)arg;
+    struct timespec interval = {0, WRITE_INTERVAL_MS * 1000000L};
+    while (isWriterRunning) {
+        if (!writeAvailable()) {
+            nanosleep(&interval, NULL);
+        }
+    }
+    // The sampling thread has stopped; write out whatever it left
+    while (writeAvailable()) {
+    }
+    return NULL;
+}
+
+// Write the contiguous run at the tail of the ring. Returns false if there
+// was nothing to write.
+static bool writeAvailable(void) {
+    unsigned long long tail = atomic_load_explicit(&recordTail, memory_order_relaxed);
+    unsigned long long head = atomic_load_explicit(&recordHead, memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+    unsigned long long offset = tail % RECORD_BUFFER_BYTES;
+    unsigned long long count = head - tail;
+    count = count < RECORD_BUFFER_BYTES - offset ? count : RECORD_BUFFER_BYTES - offset;
+
+    if (!hasWriteFailed) {
+        ssize_t written = write(recordFd, pRecordBuffer + offset, count);
+        if (written < 0 && errno == EINTR) {
+            return true;
+        }
+        if (written <= 0) {
+            Log_write(LOG_LEVEL_WARNING, "WARNING: Unable to write trace (%s); no longer recording\n", strerror(errno));
+            hasWriteFailed = true;
+        }
+        else {
+            count = written;
+        }
+    }
+    atomic_store_explicit(&recordTail, tail + count, memory_order_release);
+    return true;
+}
+
+static void putBytes(unsigned long long position, const unsigned char *pBytes, int count) {
+    for (int i = 0; i < count; i++) {
+        pRecordBuffer[(position + i) % RECORD_BUFFER_BYTES] = pBytes[i];
+    }
+}
+
+static int readReplay(SampleSource_t *pSource, uint16_t *pCodes, int maxCodes) {
+    replayState_t *pState = pSource->pState;
+    if (pState->codesLeftInRecord == 0) {
+        if (!fillReplayBuffer(pState, RECORD_HEADER_BYTES)) {
+            return -1;
+        }
+        const unsigned char *pRecord = pState->bytes + pState->position;
+        pState->recordTimeUs += getLittleEndian(pRecord, 4);
+        pState->codesLeftInRecord = (int)getLittleEndian(pRecord + 4, 2);
+        pState->position += RECORD_HEADER_BYTES;
+    }
+
+    if (pState->isRealTime) {
+        long long waitNs = getReplayTimeNs(pSource) - DeadlineTimer_getTimeInNs();
+        if (waitNs > 0) {
+            // Return now and then so the caller can check for shutdown
+            long long sleepNs = waitNs < REPLAY_WAIT_LIMIT_NS ? waitNs : REPLAY_WAIT_LIMIT_NS;
+            if (!SampleSource_waitNs(pSource, sleepNs) || waitNs > REPLAY_WAIT_LIMIT_NS) {
+                return 0;
+            }
+        }
+    }
+
+    int numCodes = maxCodes < pState->codesLeftInRecord ? maxCodes : pState->codesLeftInRecord;
+    int numRead = 0;
+    while (numRead < numCodes) {
+        if (!fillReplayBuffer(pState, 2)) {
+            // Truncated final record (e.g. the recorder was killed)
+            pState->codesLeftInRecord = 0;
+            return numRead > 0 ? numRead : -1;
+        }
+        const unsigned char *pBytes = pState->bytes + pState->position;
+        int count = (pState->length - pState->position) / 2;
+        count = count < numCodes - numRead ? count : numCodes - numRead;
+        // A corrupt or foreign trace must not hand the sampler codes past 12 bits
+        for (int i = 0; i < count; i++) {
+            uint16_t code = (uint16_t)(pBytes[2 * i] | (pBytes[2 * i + 1] << 8));
+            pCodes[numRead + i] = code < MAX_CODE ? code : MAX_CODE;
+        }
+        pState->position += 2 * count;
+        numRead += count;
+    }
+    pState->codesLeftInRecord -= numCodes;
+    return numCodes;
+}
+
+static void closeReplay(SampleSource_t *pSource) {
+    replayState_t *pState = pSource->pState;
+    close(pState->fd);
+    free(pState);
+    pSource->pState = NULL;
+}
+
+static long long getReplayTimeNs(SampleSource_t *pSource) {
+    replayState_t *pState = pSource->pState;
+    return (pState->recordTimeUs + pState->offsetUs) * 1000;
+}
+
+// Make sure `neededBytes` unread bytes are buffered. Returns false at the
+// end of the file.
+static bool fillReplayBuffer(replayState_t *pState, int neededBytes) {
+    if (pState->length - pState->position >= neededBytes) {
+        return true;
+    }
+    pState->length -= pState->position;
+    memmove(pState->bytes, pState->bytes + pState->position, pState->length);
+    pState->position = 0;
+    while (pState->length < neededBytes) {
+        ssize_t bytesRead = read(pState->fd, pState->bytes + pState->length, REPLAY_BUFFER_BYTES - pState->length);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            return false;
+        }
+        pState->length += bytesRead;
+    }
+    return true;
+}
+
+static void putLittleEndian(unsigned char *pBytes, unsigned long long value, int numBytes) {
+    for (int i = 0; i < numBytes; i++) {
+        pBytes[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static unsigned long long getLittleEndian(const unsigned char *pBytes, int numBytes) {
+    unsigned long long value = 0;
+    for (int i = numBytes - 1; i >= 0; i--) {
+        value = (value << 8) | pBytes[i];
+    }
+    return value;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal/windowAnalyzer.h"
+
+static int greatestCommonDivisor(int a, int b);
+static void completeBlock(WindowAnalyzer_t *pAnalyzer);
+static void updateResult(WindowAnalyzer_t *pAnalyzer, int index, long long endTimeMs);
+
+void WindowAnalyzer_init(WindowAnalyzer_t *pAnalyzer, const WindowAnalyzer_config_t *pConfigs, int numWindows) {
+    memset(pAnalyzer, 0, sizeof(*pAnalyzer));
+    if (numWindows < 1 || numWindows > WINDOW_ANALYZER_MAX_WINDOWS) {
+        printf("ERROR: Unsupported number of analysis windows (%d)\n", numWindows);
+        exit(-1);
+    }
+
+    int tickMs = 0;
+    int longestMs = 0;
+    for (int i = 0; i < numWindows; i++) {
+        const WindowAnalyzer_config_t *pConfig = &pConfigs[i];
+        if (pConfig->lengthMs <= 0 || pConfig->hopMs <= 0 || pConfig->lengthMs % pConfig->hopMs != 0) {
+            printf("ERROR: Invalid analysis window (%dms every %dms)\n", pConfig->lengthMs, pConfig->hopMs);
+            exit(-1);
+        }
+        tickMs = greatestCommonDivisor(tickMs, pConfig->lengthMs);
+        tickMs = greatestCommonDivisor(tickMs, pConfig->hopMs);
+        longestMs = pConfig->lengthMs > longestMs ? pConfig->lengthMs : longestMs;
+
+        pAnalyzer->configs[i] = *pConfig;
+        pAnalyzer->results[i].config = *pConfig;
+        WindowKernel_reset(&pAnalyzer->results[i].stats);
+    }
+
+    pAnalyzer->numWindows = numWindows;
+    pAnalyzer->tickMs = tickMs;
+    pAnalyzer->numBlocks = longestMs / tickMs;
+    pAnalyzer->pBlocks = calloc(pAnalyzer->numBlocks, sizeof(pAnalyzer->pBlocks[0]));
+    if (pAnalyzer->pBlocks == NULL) {
+        printf("ERROR: Unable to allocate analysis windows\n");
+        exit(-1);
+    }
+    WindowKernel_reset(&pAnalyzer->current);
+    pAnalyzer->currentStartMs = -1;
+}
+
+void WindowAnalyzer_cleanup(WindowAnalyzer_t *pAnalyzer) {
+    free(pAnalyzer->pBlocks);
+    pAnalyzer->pBlocks = NULL;
+}
+
+void WindowAnalyzer_addSamples(WindowAnalyzer_t *pAnalyzer, const uint16_t *pSamples, int count,
+    long long timeMs, const WindowKernel_thresholds_t *pThresholds)
+{
+    if (pAnalyzer->currentStartMs < 0) {
+        pAnalyzer->currentStartMs = timeMs - timeMs % pAnalyzer->tickMs;
+    }
+
+    // Close every tick which ended before this batch (empty ones after a stall)
+    while (timeMs >= pAnalyzer->currentStartMs + pAnalyzer->tickMs) {
+        completeBlock(pAnalyzer);
+    }
+    WindowKernel_accumulate(&pAnalyzer->current, pSamples, count, pThresholds);
+}
+
+bool WindowAnalyzer_getResult(WindowAnalyzer_t *pAnalyzer, int index, WindowAnalyzer_result_t *pResult) {
+    if (index < 0 || index >= pAnalyzer->numWindows) {
+        return false;
+    }
+    unsigned int sequence;
+    do {
+        sequence = atomic_load_explicit(&pAnalyzer->resultSequence, memory_order_acquire);
+        *pResult = pAnalyzer->results[index];
+        atomic_thread_fence(memory_order_acquire);
+    } while ((sequence & 1) != 0
+        || sequence != atomic_load_explicit(&pAnalyzer->resultSequence, memory_order_relaxed));
+    return true;
+}
+
+static void completeBlock(WindowAnalyzer_t *pAnalyzer) {
+    pAnalyzer->pBlocks[pAnalyzer->completedBlocks % pAnalyzer->numBlocks] = pAnalyzer->current;
+    pAnalyzer->completedBlocks++;
+    pAnalyzer->currentStartMs += pAnalyzer->tickMs;
+
+    // Keep the hysteresis state running into the next block
+    bool isDipped = pAnalyzer->current.isDipped;
+    WindowKernel_reset(&pAnalyzer->current);
+    pAnalyzer->current.isDipped = isDipped;
+
+    for (int i = 0; i < pAnalyzer->numWindows; i++) {
+        unsigned long long blocksPerHop = pAnalyzer->configs[i].hopMs / pAnalyzer->tickMs;
+        if (pAnalyzer->completedBlocks % blocksPerHop == 0) {
+            updateResult(pAnalyzer, i, pAnalyzer->currentStartMs);
+        }
+    }
+}
+
+static void updateResult(WindowAnalyzer_t *pAnalyzer, int index, long long endTimeMs) {
+    unsigned long long blocksPerWindow = pAnalyzer->configs[index].lengthMs / pAnalyzer->tickMs;
+    if (blocksPerWindow > pAnalyzer->completedBlocks) {
+        blocksPerWindow = pAnalyzer->completedBlocks;
+    }
+
+    WindowKernel_stats_t stats;
+    WindowKernel_reset(&stats);
+    for (unsigned long long i = pAnalyzer->completedBlocks - blocksPerWindow; i < pAnalyzer->completedBlocks; i++) {
+        WindowKernel_merge(&stats, &pAnalyzer->pBlocks[i % pAnalyzer->numBlocks]);
+    }
+
+    unsigned int sequence = atomic_load_explicit(&pAnalyzer->resultSequence, memory_order_relaxed);
+    atomic_store_explicit(&pAnalyzer->resultSequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    WindowAnalyzer_result_t *pResult = &pAnalyzer->results[index];
+    pResult->sequence++;
+    pResult->endTimeMs = endTimeMs;
+    pResult->stats = stats;
+    atomic_store_explicit(&pAnalyzer->resultSequence, sequence + 2, memory_order_release);
+}
+
+static int greatestCommonDivisor(int a, int b) {
+    while (b != 0) {
+        int remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
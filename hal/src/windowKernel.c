@@ -0,0 +1,333 @@
+#include "hal/windowKernel.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define KERNEL_NEON
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define KERNEL_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define KERNEL_SSE2
+#endif
+
+#if defined(KERNEL_NEON) || defined(KERNEL_AVX2) || defined(KERNEL_SSE2)
+#define KERNEL_VECTOR
+
+// Samples per block: one bit per sample in each 64-bit crossing mask
+#define BLOCK_SIZE 64
+
+typedef struct {
+    int minCode;
+    int maxCode;
+    unsigned long long sum;
+    unsigned long long sumOfSquares;
+    uint64_t enterMask;
+    uint64_t exitMask;
+} block_t;
+
+static void analyzeBlock(const uint16_t *pSamples, const WindowKernel_thresholds_t *pThresholds, block_t *pBlock);
+static void mergeBlock(WindowKernel_stats_t *pStats, const block_t *pBlock);
+static int clampThreshold(int value, int low, int high);
+#endif
+
+void WindowKernel_reset(WindowKernel_stats_t *pStats) {
+    pStats->count = 0;
+    pStats->minCode = 0;
+    pStats->maxCode = 0;
+    pStats->sum = 0;
+    pStats->sumOfSquares = 0;
+    pStats->dips = 0;
+    pStats->isDipped = false;
+}
+
+void WindowKernel_accumulate(WindowKernel_stats_t *pStats, const uint16_t *pSamples, int count,
+    const WindowKernel_thresholds_t *pThresholds)
+{
+#ifdef KERNEL_VECTOR
+    int i = 0;
+    for (; i + BLOCK_SIZE <= count; i += BLOCK_SIZE) {
+        block_t block;
+        analyzeBlock(pSamples + i, pThresholds, &block);
+        mergeBlock(pStats, &block);
+    }
+    WindowKernel_accumulateScalar(pStats, pSamples + i, count - i, pThresholds);
+#else
+    WindowKernel_accumulateScalar(pStats, pSamples, count, pThresholds);
+#endif
+}
+
+void WindowKernel_accumulateScalar(WindowKernel_stats_t *pStats, const uint16_t *pSamples, int count,
+    const WindowKernel_thresholds_t *pThresholds)
+{
+    if (count <= 0) {
+        return;
+    }
+    int minCode = pStats->count == 0 ? pSamples[0] : pStats->minCode;
+    int maxCode = pStats->count == 0 ? pSamples[0] : pStats->maxCode;
+    bool dipped = pStats->isDipped;
+    for (int i = 0; i < count; i++) {
+        int sample = pSamples[i];
+        minCode = sample < minCode ? sample : minCode;
+        maxCode = sample > maxCode ? sample : maxCode;
+        pStats->sum += sample;
+        pStats->sumOfSquares += (unsigned long long)(sample * sample);
+
+        if (!dipped && (sample < pThresholds->enterLow || sample > pThresholds->enterHigh)) {
+            dipped = true;
+            pStats->dips++;
+        }
+        if (dipped && sample >= pThresholds->exitLow && sample <= pThresholds->exitHigh) {
+            dipped = false;
+        }
+    }
+    pStats->minCode = minCode;
+    pStats->maxCode = maxCode;
+    pStats->isDipped = dipped;
+    pStats->count += count;
+}
+
+void WindowKernel_merge(WindowKernel_stats_t *pInto, const WindowKernel_stats_t *pFrom) {
+    if (pFrom->count > 0) {
+        if (pInto->count == 0 || pFrom->minCode < pInto->minCode) {
+            pInto->minCode = pFrom->minCode;
+        }
+        if (pInto->count == 0 || pFrom->maxCode > pInto->maxCode) {
+            pInto->maxCode = pFrom->maxCode;
+        }
+    }
+    pInto->count += pFrom->count;
+    pInto->sum += pFrom->sum;
+    pInto->sumOfSquares += pFrom->sumOfSquares;
+    pInto->dips += pFrom->dips;
+    pInto->isDipped = pFrom->isDipped;
+}
+
+double WindowKernel_getMean(const WindowKernel_stats_t *pStats) {
+    if (pStats->count == 0) {
+        return 0;
+    }
+    return (double)pStats->sum / pStats->count;
+}
+
+double WindowKernel_getVariance(const WindowKernel_stats_t *pStats) {
+    if (pStats->count == 0) {
+        return 0;
+    }
+    double mean = WindowKernel_getMean(pStats);
+    double variance = (double)pStats->sumOfSquares / pStats->count - mean * mean;
+    return variance > 0 ? variance : 0;
+}
+
+const char *WindowKernel_getImplementation(void) {
+#if defined(KERNEL_NEON)
+    return "neon";
+#elif defined(KERNEL_AVX2)
+    return "avx2";
+#elif defined(KERNEL_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+#ifdef KERNEL_VECTOR
+
+// Walk the hysteresis state machine only at crossings: while not dipped
+// jump to the next enter bit, while dipped jump to the next exit bit.
+static void mergeBlock(WindowKernel_stats_t *pStats, const block_t *pBlock) {
+    if (pStats->count == 0 || pBlock->minCode < pStats->minCode) {
+        pStats->minCode = pBlock->minCode;
+    }
+    if (pStats->count == 0 || pBlock->maxCode > pStats->maxCode) {
+        pStats->maxCode = pBlock->maxCode;
+    }
+    pStats->sum += pBlock->sum;
+    pStats->sumOfSquares += pBlock->sumOfSquares;
+    pStats->count += BLOCK_SIZE;
+
+    uint64_t enterMask = pBlock->enterMask;
+    uint64_t exitMask = pBlock->exitMask;
+    while (true) {
+        uint64_t *pNextMask = pStats->isDipped ? &exitMask : &enterMask;
+        if (*pNextMask == 0) {
+            break;
+        }
+        int position = __builtin_ctzll(*pNextMask);
+        // Crossings at or before this sample are now history
+        uint64_t consumed = position == 63 ? ~0ULL : (2ULL << position) - 1;
+        enterMask &= ~consumed;
+        exitMask &= ~consumed;
+        if (pStats->isDipped) {
+            pStats->isDipped = false;
+        } else {
+            // A sample in both bands ends the dip it starts, as in the
+            // scalar loop
+            pStats->dips++;
+            pStats->isDipped = (pBlock->exitMask & (1ULL << position)) == 0;
+        }
+    }
+}
+
+static int clampThreshold(int value, int low, int high) {
+    return value < low ? low : (value > high ? high : value);
+}
+
+#endif
+
+#if defined(KERNEL_NEON)
+
+static uint64_t laneMaskToBits(uint16x8_t laneMask) {
+    static const uint16_t BIT_WEIGHTS[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+    uint16x8_t bits = vandq_u16(laneMask, vld1q_u16(BIT_WEIGHTS));
+    uint16x4_t sum = vpadd_u16(vget_low_u16(bits), vget_high_u16(bits));
+    sum = vpadd_u16(sum, sum);
+    sum = vpadd_u16(sum, sum);
+    return vget_lane_u16(sum, 0);
+}
+
+static void analyzeBlock(const uint16_t *pSamples, const WindowKernel_thresholds_t *pThresholds, block_t *pBlock) {
+    // Unsigned compares: clamping keeps each comparison's meaning
+    const uint16x8_t enterLow = vdupq_n_u16(clampThreshold(pThresholds->enterLow, 0, 0xFFFF));
+    const bool enterAlways = pThresholds->enterHigh < 0;
+    const uint16x8_t enterHigh = vdupq_n_u16(clampThreshold(pThresholds->enterHigh, 0, 0xFFFF));
+    const uint16x8_t exitLow = vdupq_n_u16(clampThreshold(pThresholds->exitLow, 0, 0xFFFF));
+    const bool exitPossible = pThresholds->exitHigh >= 0;
+    const uint16x8_t exitHigh = vdupq_n_u16(clampThreshold(pThresholds->exitHigh, 0, 0xFFFF));
+
+    uint16x8_t minV = vdupq_n_u16(0xFFFF);
+    uint16x8_t maxV = vdupq_n_u16(0);
+    uint32x4_t sumV = vdupq_n_u32(0);
+    uint64x2_t sumOfSquaresV = vdupq_n_u64(0);
+    uint64_t enterMask = 0;
+    uint64_t exitMask = 0;
+    for (int i = 0; i < BLOCK_SIZE; i += 8) {
+        uint16x8_t v = vld1q_u16(pSamples + i);
+        minV = vminq_u16(minV, v);
+        maxV = vmaxq_u16(maxV, v);
+        sumV = vpadalq_u16(sumV, v);
+        uint32x4_t squares = vmull_u16(vget_low_u16(v), vget_low_u16(v));
+        squares = vmlal_u16(squares, vget_high_u16(v), vget_high_u16(v));
+        sumOfSquaresV = vpadalq_u32(sumOfSquaresV, squares);
+
+        uint16x8_t enter = vorrq_u16(vcltq_u16(v, enterLow), vcgtq_u16(v, enterHigh));
+        uint16x8_t exit = vandq_u16(vcgeq_u16(v, exitLow), vcleq_u16(v, exitHigh));
+        enterMask |= laneMaskToBits(enter) << i;
+        exitMask |= laneMaskToBits(exit) << i;
+    }
+
+    uint16x4_t min4 = vpmin_u16(vget_low_u16(minV), vget_high_u16(minV));
+    min4 = vpmin_u16(min4, min4);
+    min4 = vpmin_u16(min4, min4);
+    uint16x4_t max4 = vpmax_u16(vget_low_u16(maxV), vget_high_u16(maxV));
+    max4 = vpmax_u16(max4, max4);
+    max4 = vpmax_u16(max4, max4);
+    uint64x2_t sum2 = vpaddlq_u32(sumV);
+
+    pBlock->minCode = vget_lane_u16(min4, 0);
+    pBlock->maxCode = vget_lane_u16(max4, 0);
+    pBlock->sum = vgetq_lane_u64(sum2, 0) + vgetq_lane_u64(sum2, 1);
+    pBlock->sumOfSquares = vgetq_lane_u64(sumOfSquaresV, 0) + vgetq_lane_u64(sumOfSquaresV, 1);
+    pBlock->enterMask = enterAlways ? ~0ULL : enterMask;
+    pBlock->exitMask = exitPossible ? exitMask : 0;
+}
+
+#elif defined(KERNEL_AVX2) || defined(KERNEL_SSE2)
+
+static int horizontalMin16(__m128i v) {
+    v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_min_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (int16_t)_mm_cvtsi128_si32(v);
+}
+
+static int horizontalMax16(__m128i v) {
+    v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (int16_t)_mm_cvtsi128_si32(v);
+}
+
+static unsigned long long horizontalSum32(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (unsigned int)_mm_cvtsi128_si32(v);
+}
+
+static void analyzeBlock(const uint16_t *pSamples, const WindowKernel_thresholds_t *pThresholds, block_t *pBlock) {
+    // Signed 16-bit compares; 12-bit codes never reach the sign bit
+    const int16_t enterLow = clampThreshold(pThresholds->enterLow, -1, 0x7FFF);
+    const int16_t enterHigh = clampThreshold(pThresholds->enterHigh, -1, 0x7FFF);
+    const int16_t exitLow = clampThreshold(pThresholds->exitLow, -1, 0x7FFF);
+    const int16_t exitHigh = clampThreshold(pThresholds->exitHigh, -1, 0x7FFF);
+
+    // Per-lane sums stay within 32 bits for a 64-sample block of 12-bit codes
+#if defined(KERNEL_AVX2)
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i enterLowV = _mm256_set1_epi16(enterLow);
+    const __m256i enterHighV = _mm256_set1_epi16(enterHigh);
+    const __m256i exitLowV = _mm256_set1_epi16(exitLow);
+    const __m256i exitHighV = _mm256_set1_epi16(exitHigh);
+    __m256i minV = _mm256_set1_epi16(0x7FFF);
+    __m256i maxV = _mm256_set1_epi16(-1);
+    __m256i sumV = _mm256_setzero_si256();
+    __m256i sumOfSquaresV = _mm256_setzero_si256();
+    uint64_t enterMask = 0;
+    uint64_t exitMask = 0;
+    for (int i = 0; i < BLOCK_SIZE; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(pSamples + i));
+        minV = _mm256_min_epi16(minV, v);
+        maxV = _mm256_max_epi16(maxV, v);
+        sumV = _mm256_add_epi32(sumV, _mm256_madd_epi16(v, ones));
+        sumOfSquaresV = _mm256_add_epi32(sumOfSquaresV, _mm256_madd_epi16(v, v));
+
+        __m256i enter = _mm256_or_si256(_mm256_cmpgt_epi16(enterLowV, v), _mm256_cmpgt_epi16(v, enterHighV));
+        __m256i outsideExit = _mm256_or_si256(_mm256_cmpgt_epi16(exitLowV, v), _mm256_cmpgt_epi16(v, exitHighV));
+        // Pack the two 128-bit halves so the byte mask keeps sample order
+        __m128i enterPacked = _mm_packs_epi16(_mm256_castsi256_si128(enter), _mm256_extracti128_si256(enter, 1));
+        __m128i outsidePacked = _mm_packs_epi16(_mm256_castsi256_si128(outsideExit),
+            _mm256_extracti128_si256(outsideExit, 1));
+        enterMask |= (uint64_t)(uint16_t)_mm_movemask_epi8(enterPacked) << i;
+        exitMask |= (uint64_t)(uint16_t)~_mm_movemask_epi8(outsidePacked) << i;
+    }
+    __m128i min8 = _mm_min_epi16(_mm256_castsi256_si128(minV), _mm256_extracti128_si256(minV, 1));
+    __m128i max8 = _mm_max_epi16(_mm256_castsi256_si128(maxV), _mm256_extracti128_si256(maxV, 1));
+    __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(sumV), _mm256_extracti128_si256(sumV, 1));
+    __m128i sumOfSquares4 = _mm_add_epi32(_mm256_castsi256_si128(sumOfSquaresV),
+        _mm256_extracti128_si256(sumOfSquaresV, 1));
+#else
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i enterLowV = _mm_set1_epi16(enterLow);
+    const __m128i enterHighV = _mm_set1_epi16(enterHigh);
+    const __m128i exitLowV = _mm_set1_epi16(exitLow);
+    const __m128i exitHighV = _mm_set1_epi16(exitHigh);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i min8 = _mm_set1_epi16(0x7FFF);
+    __m128i max8 = _mm_set1_epi16(-1);
+    __m128i sum4 = _mm_setzero_si128();
+    __m128i sumOfSquares4 = _mm_setzero_si128();
+    uint64_t enterMask = 0;
+    uint64_t exitMask = 0;
+    for (int i = 0; i < BLOCK_SIZE; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(pSamples + i));
+        min8 = _mm_min_epi16(min8, v);
+        max8 = _mm_max_epi16(max8, v);
+        sum4 = _mm_add_epi32(sum4, _mm_madd_epi16(v, ones));
+        sumOfSquares4 = _mm_add_epi32(sumOfSquares4, _mm_madd_epi16(v, v));
+
+        __m128i enter = _mm_or_si128(_mm_cmplt_epi16(v, enterLowV), _mm_cmpgt_epi16(v, enterHighV));
+        __m128i outsideExit = _mm_or_si128(_mm_cmplt_epi16(v, exitLowV), _mm_cmpgt_epi16(v, exitHighV));
+        enterMask |= (uint64_t)(uint8_t)_mm_movemask_epi8(_mm_packs_epi16(enter, zero)) << i;
+        exitMask |= (uint64_t)(uint8_t)~_mm_movemask_epi8(_mm_packs_epi16(outsideExit, zero)) << i;
+    }
+#endif
+
+    pBlock->minCode = horizontalMin16(min8);
+    pBlock->maxCode = horizontalMax16(max8);
+    pBlock->sum = horizontalSum32(sum4);
+    pBlock->sumOfSquares = horizontalSum32(sumOfSquares4);
+    pBlock->enterMask = enterMask;
+    pBlock->exitMask = exitMask;
+}
+
+#endif
@@ -0,0 +1,37 @@
+// Bench helpers
+// Wall and CPU clocks shared by the benchmark programs. Each bench runs a
+// few seconds of work per case and prints one line per case; "--quick"
+// shrinks that to a smoke run, which is how ctest runs them (label "bench").
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+static inline long long Bench_getNs(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static inline long long Bench_getWallNs(void) {
+    return Bench_getNs(CLOCK_MONOTONIC);
+}
+
+// CPU time of the whole process, all threads
+static inline long long Bench_getCpuNs(void) {
+    return Bench_getNs(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+static inline bool Bench_isQuick(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,25 @@
+// Test helpers
+// Minimal checks shared by the test programs. A failed check reports where
+// it failed and marks the test failed; main() returns TEST_EXIT_CODE() so
+// ctest sees the result.
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+// Checks may fail on any thread
+static _Atomic int numTestFailures = 0;
+
+#define TEST_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            numTestFailures++; \
+        } \
+    } while (0)
+
+#define TEST_EXIT_CODE() (numTestFailures == 0 ? 0 : 1)
+
+#endif
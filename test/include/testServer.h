@@ -0,0 +1,142 @@
+// Test server helpers
+// Run light_sampler (simulated hardware) as a child process and talk to it
+// over UDP on loopback, for the tests and benches of the network server.
+
+#ifndef _TEST_SERVER_H_
+#define _TEST_SERVER_H_
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEST_SERVER_MAX_ARGS 16
+#define TEST_SERVER_START_TIMEOUT_MS 5000
+
+// A port per process, so tests run in parallel don't collide
+static inline int TestServer_pickPort(void) {
+    return 20000 + getpid() % 20000;
+}
+
+static inline long long TestServer_getTimeNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static inline struct sockaddr_in TestServer_getAddress(int port) {
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    return address;
+}
+
+// A UDP socket connected to the server, so only its replies arrive
+static inline int TestServer_openClient(int port) {
+    int socketDescriptor = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in address = TestServer_getAddress(port);
+    if (socketDescriptor < 0 || connect(socketDescriptor, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("ERROR: Unable to open a client socket");
+        exit(-1);
+    }
+    return socketDescriptor;
+}
+
+// Send `request` and wait up to `timeoutMs` for the first reply datagram.
+// Returns its length, or -1 on timeout.
+static inline int TestServer_ask(int socketDescriptor, const char *request, char *pReply, int maxLength,
+    int timeoutMs)
+{
+    if (send(socketDescriptor, request, strlen(request), 0) < 0) {
+        return -1;
+    }
+    struct pollfd pollDesc = {.fd = socketDescriptor, .events = POLLIN};
+    if (poll(&pollDesc, 1, timeoutMs) != 1) {
+        return -1;
+    }
+    int length = recv(socketDescriptor, pReply, maxLength - 1, 0);
+    if (length >= 0) {
+        pReply[length] = 0;
+    }
+    return length;
+}
+
+// Start `program` --simulate --port=<port> --metrics=0 plus `extraArgs`
+// (NULL terminated), its output discarded, and wait until it answers.
+static inline pid_t TestServer_start(const char *program, int port, const char *const *extraArgs) {
+    char portArg[32];
+    snprintf(portArg, sizeof(portArg), "--port=%d", port);
+    char *args[TEST_SERVER_MAX_ARGS] = {(char *)program, "--simulate", portArg, "--metrics=0"};
+    int numArgs = 4;
+    for (int i = 0; extraArgs != NULL && extraArgs[i] != NULL && numArgs < TEST_SERVER_MAX_ARGS - 1; i++) {
+        args[numArgs++] = (char *)extraArgs[i];
+    }
+    args[numArgs] = NULL;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        int nullDescriptor = open("/dev/null", O_WRONLY);
+        dup2(nullDescriptor, STDOUT_FILENO);
+        execv(program, args);
+        perror("ERROR: Unable to run the server");
+        _exit(127);
+    }
+
+    int client = TestServer_openClient(port);
+    char reply[256];
+    long long deadline = TestServer_getTimeNs() + TEST_SERVER_START_TIMEOUT_MS * 1000000LL;
+    while (TestServer_ask(client, "count\n", reply, sizeof(reply), 50) < 0) {
+        if (TestServer_getTimeNs() > deadline || waitpid(pid, NULL, WNOHANG) == pid) {
+            printf("ERROR: %s did not start answering on port %d\n", program, port);
+            kill(pid, SIGKILL);
+            exit(-1);
+        }
+    }
+    close(client);
+    return pid;
+}
+
+// Wait up to `timeoutMs` for the server to exit; returns false (leaving it
+// running) on timeout. `pStatus` (may be NULL) gets its waitpid() status.
+static inline bool TestServer_waitForExit(pid_t pid, int timeoutMs, int *pStatus) {
+    long long deadline = TestServer_getTimeNs() + timeoutMs * 1000000LL;
+    int status;
+    while (waitpid(pid, &status, WNOHANG) != pid) {
+        if (TestServer_getTimeNs() > deadline) {
+            return false;
+        }
+        struct timespec pause = {0, 100000};
+        nanosleep(&pause, NULL);
+    }
+    if (pStatus != NULL) {
+        *pStatus = status;
+    }
+    return true;
+}
+
+// Ask the server to stop, killing it if it does not within `timeoutMs`.
+// Returns whether it exited cleanly by itself.
+static inline bool TestServer_stop(pid_t pid, int port, int timeoutMs) {
+    int client = TestServer_openClient(port);
+    send(client, "stop\n", 5, 0);
+    close(client);
+    int status;
+    if (!TestServer_waitForExit(pid, timeoutMs, &status)) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+#endif
@@ -0,0 +1,131 @@
+// NEON stand-in for tests
+// Plain C versions of the NEON intrinsics hal/src/windowKernel.c uses, so
+// its NEON path can be compiled and checked on a host without an ARM
+// compiler. Only the semantics matter here, not speed. Never on the include
+// path of a real ARM build.
+
+#ifndef _TEST_ARM_NEON_H_
+#define _TEST_ARM_NEON_H_
+
+#include <stdint.h>
+
+typedef struct { uint16_t lanes[4]; } uint16x4_t;
+typedef struct { uint16_t lanes[8]; } uint16x8_t;
+typedef struct { uint32_t lanes[4]; } uint32x4_t;
+typedef struct { uint64_t lanes[2]; } uint64x2_t;
+
+static inline uint16x8_t vld1q_u16(const uint16_t *pValues) {
+    uint16x8_t result;
+    for (int i = 0; i < 8; i++) {
+        result.lanes[i] = pValues[i];
+    }
+    return result;
+}
+
+static inline uint16x8_t vdupq_n_u16(uint16_t value) {
+    uint16x8_t result;
+    for (int i = 0; i < 8; i++) {
+        result.lanes[i] = value;
+    }
+    return result;
+}
+
+static inline uint32x4_t vdupq_n_u32(uint32_t value) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++) {
+        result.lanes[i] = value;
+    }
+    return result;
+}
+
+static inline uint64x2_t vdupq_n_u64(uint64_t value) {
+    uint64x2_t result = {{value, value}};
+    return result;
+}
+
+static inline uint16x4_t vget_low_u16(uint16x8_t v) {
+    uint16x4_t result = {{v.lanes[0], v.lanes[1], v.lanes[2], v.lanes[3]}};
+    return result;
+}
+
+static inline uint16x4_t vget_high_u16(uint16x8_t v) {
+    uint16x4_t result = {{v.lanes[4], v.lanes[5], v.lanes[6], v.lanes[7]}};
+    return result;
+}
+
+#define vget_lane_u16(v, lane) ((v).lanes[(lane)])
+#define vgetq_lane_u64(v, lane) ((v).lanes[(lane)])
+
+// Lane-wise operations on eight 16-bit lanes; compares give all ones or 0
+#define TEST_NEON_LANEWISE_U16(name, expression) \
+    static inline uint16x8_t name(uint16x8_t a, uint16x8_t b) { \
+        uint16x8_t result; \
+        for (int i = 0; i < 8; i++) { \
+            uint16_t x = a.lanes[i]; \
+            uint16_t y = b.lanes[i]; \
+            result.lanes[i] = (uint16_t)(expression); \
+        } \
+        return result; \
+    }
+
+TEST_NEON_LANEWISE_U16(vandq_u16, x & y)
+TEST_NEON_LANEWISE_U16(vorrq_u16, x | y)
+TEST_NEON_LANEWISE_U16(vminq_u16, x < y ? x : y)
+TEST_NEON_LANEWISE_U16(vmaxq_u16, x > y ? x : y)
+TEST_NEON_LANEWISE_U16(vcltq_u16, x < y ? 0xFFFF : 0)
+TEST_NEON_LANEWISE_U16(vcgtq_u16, x > y ? 0xFFFF : 0)
+TEST_NEON_LANEWISE_U16(vcgeq_u16, x >= y ? 0xFFFF : 0)
+TEST_NEON_LANEWISE_U16(vcleq_u16, x <= y ? 0xFFFF : 0)
+
+// Pairwise operations: adjacent lanes of a, then of b
+#define TEST_NEON_PAIRWISE_U16(name, expression) \
+    static inline uint16x4_t name(uint16x4_t a, uint16x4_t b) { \
+        uint16x4_t result; \
+        for (int i = 0; i < 4; i++) { \
+            const uint16x4_t *pFrom = i < 2 ? &a : &b; \
+            uint16_t x = pFrom->lanes[(i % 2) * 2]; \
+            uint16_t y = pFrom->lanes[(i % 2) * 2 + 1]; \
+            result.lanes[i] = (uint16_t)(expression); \
+        } \
+        return result; \
+    }
+
+TEST_NEON_PAIRWISE_U16(vpadd_u16, x + y)
+TEST_NEON_PAIRWISE_U16(vpmin_u16, x < y ? x : y)
+TEST_NEON_PAIRWISE_U16(vpmax_u16, x > y ? x : y)
+
+static inline uint32x4_t vpadalq_u16(uint32x4_t a, uint16x8_t b) {
+    for (int i = 0; i < 4; i++) {
+        a.lanes[i] += (uint32_t)b.lanes[2 * i] + b.lanes[2 * i + 1];
+    }
+    return a;
+}
+
+static inline uint64x2_t vpadalq_u32(uint64x2_t a, uint32x4_t b) {
+    for (int i = 0; i < 2; i++) {
+        a.lanes[i] += (uint64_t)b.lanes[2 * i] + b.lanes[2 * i + 1];
+    }
+    return a;
+}
+
+static inline uint64x2_t vpaddlq_u32(uint32x4_t a) {
+    uint64x2_t result = {{(uint64_t)a.lanes[0] + a.lanes[1], (uint64_t)a.lanes[2] + a.lanes[3]}};
+    return result;
+}
+
+static inline uint32x4_t vmull_u16(uint16x4_t a, uint16x4_t b) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++) {
+        result.lanes[i] = (uint32_t)a.lanes[i] * b.lanes[i];
+    }
+    return result;
+}
+
+static inline uint32x4_t vmlal_u16(uint32x4_t a, uint16x4_t b, uint16x4_t c) {
+    for (int i = 0; i < 4; i++) {
+        a.lanes[i] += (uint32_t)b.lanes[i] * c.lanes[i];
+    }
+    return a;
+}
+
+#endif
@@ -0,0 +1,87 @@
+// File reader bench
+// Samples/s and CPU cost of reading an A2D value the old way (fopen, fgets,
+// fclose and strtod per sample) against a persistent File_reader_t (one
+// pread and a hand-rolled parse). A regular file stands in for the sysfs
+// node; sysfs adds its own per-read cost on the board, the same to both.
+//
+// Usage: fileReaderBench [--quick] [file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "hal/file.h"
+
+#define SAMPLES_PER_SECOND_ON_BOARD 1000
+
+typedef struct {
+    long long numReads;
+    long long wallNs;
+    long long cpuNs;
+    double checksum;
+} Result_t;
+
+static Result_t runOldPath(char *path, long long numReads) {
+    Result_t result = {.numReads = numReads};
+    char buffer[1024];
+    long long startWall = Bench_getWallNs();
+    long long startCpu = Bench_getCpuNs();
+    for (long long i = 0; i < numReads; i++) {
+        File_readFromFile(path, buffer);
+        result.checksum += strtod(buffer, NULL);
+    }
+    result.cpuNs = Bench_getCpuNs() - startCpu;
+    result.wallNs = Bench_getWallNs() - startWall;
+    return result;
+}
+
+static Result_t runReader(char *path, long long numReads) {
+    Result_t result = {.numReads = numReads};
+    File_reader_t reader;
+    File_openReader(&reader, path);
+    long long startWall = Bench_getWallNs();
+    long long startCpu = Bench_getCpuNs();
+    for (long long i = 0; i < numReads; i++) {
+        result.checksum += File_readInt(&reader);
+    }
+    result.cpuNs = Bench_getCpuNs() - startCpu;
+    result.wallNs = Bench_getWallNs() - startWall;
+    File_closeReader(&reader);
+    return result;
+}
+
+static void printResult(const char *name, Result_t result) {
+    double nsPerRead = (double)result.cpuNs / result.numReads;
+    printf("%-22s %10.0f samples/s  %7.2f us CPU/sample  %6.2f%% CPU at %d samples/s\n",
+        name, result.numReads * 1e9 / result.wallNs, nsPerRead / 1000,
+        nsPerRead * SAMPLES_PER_SECOND_ON_BOARD / 1e7, SAMPLES_PER_SECOND_ON_BOARD);
+}
+
+int main(int argc, char *argv[]) {
+    long long numReads = Bench_isQuick(argc, argv) ? 2000 : 200000;
+    char path[] = "/tmp/fileReaderBench.XXXXXX";
+    char *pPath = path;
+    if (argc > 1 && argv[argc - 1][0] != '-') {
+        pPath = argv[argc - 1];
+    } else {
+        int fd = mkstemp(path);
+        if (fd < 0 || write(fd, "2048\n", 5) != 5) {
+            perror("ERROR: Unable to create the stand-in file");
+            exit(-1);
+        }
+        close(fd);
+    }
+
+    Result_t old = runOldPath(pPath, numReads);
+    Result_t reader = runReader(pPath, numReads);
+    printResult("fopen/fgets/fclose", old);
+    printResult("File_reader_t (pread)", reader);
+    printf("speedup %.1fx\n", (double)old.cpuNs / reader.cpuNs);
+
+    if (pPath == path) {
+        unlink(path);
+    }
+    // Both paths must have read the same values
+    return old.checksum == reader.checksum ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+// History format bench
+// Samples/s formatting a window as the text history reply: the table
+// driven HistoryText path against the original per-sample snprintf path
+// (three snprintf calls, then strlen and memset per datagram), for 1k, 10k
+// and 100k-sample windows. Both must produce the same bytes.
+//
+// Usage: historyFormatBench [--quick]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "historyText.h"
+#include "hal/sampler.h"
+
+#define MAX_LEN 1500
+#define MAX_SAMPLE_SIZE 8
+#define MAX_CODE 4095
+
+// Every datagram of a window, back to back
+typedef struct {
+    char *pText;
+    long long length;
+    int numDatagrams;
+} Output_t;
+
+static void emit(Output_t *pOutput, const char *pDatagram, int length) {
+    memcpy(pOutput->pText + pOutput->length, pDatagram, length);
+    pOutput->length += length;
+    pOutput->numDatagrams++;
+}
+
+static void formatWithSnprintf(const uint16_t *pCodes, int length, Output_t *pOutput) {
+    char messageTx[MAX_LEN];
+    memset(messageTx, 0, MAX_LEN);
+    int offset = 0;
+    for (int i = 0; i < length; i++) {
+        int written = snprintf(messageTx + offset, MAX_LEN - offset, "%.3f", Sampler_codeToVolts(pCodes[i]));
+        offset += written;
+        if (i != length - 1) {
+            written = snprintf(messageTx + offset, MAX_LEN - offset, ", ");
+            offset += written;
+        }
+        if ((i + 1) % 10 == 0 || i == length - 1) {
+            written = snprintf(messageTx + offset, MAX_LEN - offset, "\n");
+            offset += written;
+        }
+        if (MAX_LEN - offset < MAX_SAMPLE_SIZE || i == length - 1) {
+            emit(pOutput, messageTx, strlen(messageTx));
+            memset(messageTx, 0, MAX_LEN);
+            offset = 0;
+        }
+    }
+}
+
+static void formatWithTable(const uint16_t *pCodes, int length, Output_t *pOutput) {
+    char messageTx[MAX_LEN];
+    int offset = 0;
+    for (int i = 0; i < length; i++) {
+        offset = HistoryText_appendSample(messageTx, offset, pCodes, i, length);
+        if (MAX_LEN - offset < HISTORY_TEXT_MAX_SAMPLE_SIZE || i == length - 1) {
+            emit(pOutput, messageTx, offset);
+            offset = 0;
+        }
+    }
+}
+
+static double measure(void (*format)(const uint16_t *, int, Output_t *), const uint16_t *pCodes, int length,
+    int numWindows, Output_t *pOutput)
+{
+    long long start = Bench_getCpuNs();
+    for (int i = 0; i < numWindows; i++) {
+        pOutput->length = 0;
+        pOutput->numDatagrams = 0;
+        format(pCodes, length, pOutput);
+    }
+    long long elapsedNs = Bench_getCpuNs() - start;
+    return (double)length * numWindows * 1e9 / (elapsedNs > 0 ? elapsedNs : 1);
+}
+
+int main(int argc, char *argv[]) {
+    static const int WINDOW_SIZES[] = {1000, 10000, 100000};
+    long long samplesPerCase = Bench_isQuick(argc, argv) ? 100000 : 20000000;
+    const int maxWindowSize = 100000;
+    HistoryText_init();
+
+    // Every code, so each table entry (and length) is exercised
+    uint16_t *pCodes = malloc(sizeof(uint16_t) * maxWindowSize);
+    unsigned int seed = 1;
+    for (int i = 0; i < maxWindowSize; i++) {
+        pCodes[i] = i <= MAX_CODE ? i : rand_r(&seed) % (MAX_CODE + 1);
+    }
+    Output_t before = {.pText = malloc(maxWindowSize * MAX_SAMPLE_SIZE)};
+    Output_t after = {.pText = malloc(maxWindowSize * MAX_SAMPLE_SIZE)};
+
+    printf("%-8s %18s %18s %8s %10s\n", "window", "snprintf samples/s", "table samples/s", "speedup", "datagrams");
+    int result = 0;
+    for (size_t i = 0; i < sizeof(WINDOW_SIZES) / sizeof(WINDOW_SIZES[0]); i++) {
+        int length = WINDOW_SIZES[i];
+        int numWindows = samplesPerCase / length > 0 ? samplesPerCase / length : 1;
+        double snprintfRate = measure(formatWithSnprintf, pCodes, length, numWindows, &before);
+        double tableRate = measure(formatWithTable, pCodes, length, numWindows, &after);
+        bool isSame = before.length == after.length && before.numDatagrams == after.numDatagrams
+            && memcmp(before.pText, after.pText, before.length) == 0;
+        printf("%-8d %18.3e %18.3e %7.1fx %10d%s\n", length, snprintfRate, tableRate, tableRate / snprintfRate,
+            after.numDatagrams, isSame ? "" : "  OUTPUT DIFFERS");
+        result |= !isSame;
+    }
+
+    free(pCodes);
+    free(before.pText);
+    free(after.pText);
+    return result;
+}
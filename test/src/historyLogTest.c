@@ -0,0 +1,188 @@
+// History log test
+// Recovery after reopening the file: once appends have wrapped around the
+// slots, records come back oldest first whatever slot they are in; a slot
+// torn or corrupted on disk fails its CRC and is skipped while the others
+// survive; and times stored on the wall clock come back on the monotonic
+// clock they were appended with. A file of another geometry is started
+// afresh.
+//
+// Usage: historyLogTest
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "test.h"
+#include "hal/historyLog.h"
+
+#define NUM_SLOTS 4
+#define MAX_RAW_SAMPLES 8
+#define NUM_APPENDS 6
+
+// As laid out by historyLog.c: a 64 byte header, then the slots, each
+// starting with its sequence number and CRC-32 (4 bytes), the number of raw
+// codes (4) and the wall clock start time (8)
+#define HEADER_BYTES 64
+#define WALL_START_OFFSET 16
+
+// The clocks are read a moment apart on append and on recovery
+#define MAX_CLOCK_SKEW_MS 2
+
+#define MAX_RECOVERED 16
+
+typedef struct {
+    HistoryLog_entry_t entries[MAX_RECOVERED];
+    uint16_t raw[MAX_RECOVERED][MAX_RAW_SAMPLES];
+    int count;
+} Recovered_t;
+
+static long long getTimeInMs(clockid_t clock) {
+    struct timespec spec;
+    clock_gettime(clock, &spec);
+    return spec.tv_sec * 1000LL + spec.tv_nsec / 1000000;
+}
+
+static void onEntry(const HistoryLog_entry_t *pEntry, const uint16_t *pRaw, void *pContext) {
+    Recovered_t *pRecovered = pContext;
+    if (pRecovered->count == MAX_RECOVERED) {
+        return;
+    }
+    pRecovered->entries[pRecovered->count] = *pEntry;
+    if (pRaw != NULL) {
+        memcpy(pRecovered->raw[pRecovered->count], pRaw, sizeof(pRaw[0]) * pEntry->numRawSamples);
+    }
+    pRecovered->count++;
+}
+
+static int recover(const char *path, int numSlots, Recovered_t *pRecovered) {
+    HistoryLog_t log;
+    memset(pRecovered, 0, sizeof(*pRecovered));
+    HistoryLog_open(&log, (char *)path, numSlots, MAX_RAW_SAMPLES);
+    int numRecovered = HistoryLog_recover(&log, onEntry, pRecovered);
+    HistoryLog_close(&log);
+    return numRecovered;
+}
+
+// Window `n` (1 based) has `n` samples, all coded `n`, and ends `n` seconds
+// after `startMs`
+static void appendWindow(HistoryLog_t *pLog, long long startMs, int n) {
+    uint16_t codes[MAX_RAW_SAMPLES];
+    for (int i = 0; i < MAX_RAW_SAMPLES; i++) {
+        codes[i] = (uint16_t)n;
+    }
+    HistoryLog_entry_t entry = {
+        .startTimeMs = startMs + (n - 1) * 1000LL,
+        .endTimeMs = startMs + n * 1000LL,
+        .stats = {.count = n, .minCode = n, .maxCode = n, .sum = (unsigned long long)n * n},
+    };
+    // Two spans, as the sample ring hands them out when it wraps
+    const uint16_t *pSpans[2] = {codes, codes + 3};
+    int spanSizes[2] = {3, MAX_RAW_SAMPLES - 3};
+    HistoryLog_append(pLog, &entry, pSpans, spanSizes, 2);
+}
+
+// The windows recovered must be `first`..`last` in order, less `skipped`
+// (0 for none)
+static void checkWindows(const Recovered_t *pRecovered, long long startMs, int first, int last, int skipped) {
+    int i = 0;
+    for (int n = first; n <= last; n++) {
+        if (n == skipped) {
+            continue;
+        }
+        if (i >= pRecovered->count) {
+            TEST_CHECK(i < pRecovered->count);
+            return;
+        }
+        const HistoryLog_entry_t *pEntry = &pRecovered->entries[i];
+        TEST_CHECK(pEntry->stats.count == n);
+        TEST_CHECK(pEntry->stats.sum == (unsigned long long)n * n);
+        TEST_CHECK(pEntry->numRawSamples == MAX_RAW_SAMPLES);
+        TEST_CHECK(pRecovered->raw[i][0] == n && pRecovered->raw[i][MAX_RAW_SAMPLES - 1] == n);
+        long long expectedStartMs = startMs + (n - 1) * 1000LL;
+        TEST_CHECK(llabs(pEntry->startTimeMs - expectedStartMs) <= MAX_CLOCK_SKEW_MS);
+        TEST_CHECK(pEntry->endTimeMs - pEntry->startTimeMs == 1000);
+        i++;
+    }
+    TEST_CHECK(i == pRecovered->count);
+}
+
+static int getSlotBytes(const char *path) {
+    struct stat status;
+    stat(path, &status);
+    return (int)((status.st_size - HEADER_BYTES) / NUM_SLOTS);
+}
+
+// Flip one byte of window `n`'s slot, e.g. a code or the sequence number
+static void corrupt(const char *path, int n, int offsetInSlot) {
+    int slot = (n - 1) % NUM_SLOTS;
+    long long offset = HEADER_BYTES + (long long)slot * getSlotBytes(path) + offsetInSlot;
+    int fd = open(path, O_RDWR);
+    unsigned char byte = 0;
+    TEST_CHECK(pread(fd, &byte, 1, offset) == 1);
+    byte ^= 0x5A;
+    TEST_CHECK(pwrite(fd, &byte, 1, offset) == 1);
+    close(fd);
+}
+
+int main(void) {
+    char directory[] = "/tmp/historyLogTest.XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("ERROR: Unable to create a directory for the log");
+        exit(-1);
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/history", directory);
+
+    // Windows 1..6 into 4 slots: 5 and 6 overwrite 1 and 2, so slot order
+    // (5, 6, 3, 4) is no longer time order
+    long long startMs = getTimeInMs(CLOCK_MONOTONIC) - NUM_APPENDS * 1000LL;
+    HistoryLog_t log;
+    HistoryLog_open(&log, path, NUM_SLOTS, MAX_RAW_SAMPLES);
+    for (int n = 1; n <= NUM_APPENDS; n++) {
+        appendWindow(&log, startMs, n);
+    }
+    HistoryLog_close(&log);
+
+    Recovered_t recovered;
+    TEST_CHECK(recover(path, NUM_SLOTS, &recovered) == NUM_SLOTS);
+    checkWindows(&recovered, startMs, 3, NUM_APPENDS, 0);
+    printf("recovered windows %d..%d oldest first after wrapping\n", 3, NUM_APPENDS);
+
+    // On disk the times are on the wall clock
+    int fd = open(path, O_RDONLY);
+    int64_t wallStartMs = 0;
+    TEST_CHECK(pread(fd, &wallStartMs, sizeof(wallStartMs), HEADER_BYTES + WALL_START_OFFSET) == sizeof(wallStartMs));
+    close(fd);
+    long long wallClockOffsetMs = getTimeInMs(CLOCK_REALTIME) - getTimeInMs(CLOCK_MONOTONIC);
+    long long expectedWallStartMs = startMs + (NUM_APPENDS - 2) * 1000LL + wallClockOffsetMs;
+    TEST_CHECK(llabs(wallStartMs - expectedWallStartMs) <= MAX_CLOCK_SKEW_MS);
+
+    // Recovery picks up the sequence: the next append replaces the oldest
+    HistoryLog_open(&log, path, NUM_SLOTS, MAX_RAW_SAMPLES);
+    HistoryLog_recover(&log, onEntry, &recovered);
+    appendWindow(&log, startMs, NUM_APPENDS + 1);
+    HistoryLog_close(&log);
+    TEST_CHECK(recover(path, NUM_SLOTS, &recovered) == NUM_SLOTS);
+    checkWindows(&recovered, startMs, 4, NUM_APPENDS + 1, 0);
+
+    // A bad code in window 5, then a torn sequence number in window 7
+    corrupt(path, 5, getSlotBytes(path) - 1);
+    TEST_CHECK(recover(path, NUM_SLOTS, &recovered) == NUM_SLOTS - 1);
+    checkWindows(&recovered, startMs, 4, NUM_APPENDS + 1, 5);
+    corrupt(path, 7, 0);
+    TEST_CHECK(recover(path, NUM_SLOTS, &recovered) == NUM_SLOTS - 2);
+    checkWindows(&recovered, startMs, 4, NUM_APPENDS, 5);
+    printf("skipped corrupted windows 5 and 7\n");
+
+    // Another number of slots doesn't match the file
+    TEST_CHECK(recover(path, NUM_SLOTS + 1, &recovered) == 0);
+
+    unlink(path);
+    rmdir(directory);
+    return TEST_EXIT_CODE();
+}
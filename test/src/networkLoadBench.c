@@ -0,0 +1,175 @@
+// Network load generator
+// Many UDP clients on loopback, each sending requests to the server at a
+// steady rate (just under the per-client limit) with one request in
+// flight, reporting the requests/s answered and the reply latency
+// percentiles. Starts light_sampler (simulated hardware) itself, or loads a
+// server already running.
+//
+// Usage: networkLoadBench <light_sampler> [--quick] [--clients=N] [--seconds=S]
+//        networkLoadBench --host=<ip> --port=<port> [--clients=N] [--seconds=S]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+#include "bench.h"
+#include "testServer.h"
+
+// Below the server's REQUESTS_PER_SECOND, so no client is rate limited
+#define REQUESTS_PER_CLIENT_PER_SECOND 80
+#define REPLY_TIMEOUT_NS 1000000000LL
+#define MAX_EVENTS 64
+
+typedef struct {
+    int socketDescriptor;
+    long long nextSendNs;
+    long long sentNs;
+    bool isWaiting;
+    int nextRequest;
+} Client_t;
+
+static const char *const REQUESTS[] = {"count\n", "length\n", "dips\n", "windows\n", "timing\n"};
+#define NUM_REQUESTS ((int)(sizeof(REQUESTS) / sizeof(REQUESTS[0])))
+
+static long long *latencies;
+static int numLatencies;
+static int maxLatencies;
+
+static void recordLatency(long long latencyNs) {
+    if (numLatencies == maxLatencies) {
+        maxLatencies = maxLatencies == 0 ? 65536 : maxLatencies * 2;
+        latencies = realloc(latencies, sizeof(latencies[0]) * maxLatencies);
+    }
+    latencies[numLatencies++] = latencyNs;
+}
+
+static int compareLatencies(const void *pA, const void *pB) {
+    long long a = *(const long long *)pA;
+    long long b = *(const long long *)pB;
+    return (a > b) - (a < b);
+}
+
+static double getPercentileUs(double percentile) {
+    if (numLatencies == 0) {
+        return 0;
+    }
+    int index = (int)(percentile / 100 * (numLatencies - 1) + 0.5);
+    return latencies[index] / 1000.0;
+}
+
+static const char *getOption(int argc, char *argv[], const char *name) {
+    size_t length = strlen(name);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], name, length) == 0 && argv[i][length] == '=') {
+            return argv[i] + length + 1;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    bool isQuick = Bench_isQuick(argc, argv);
+    const char *program = argc > 1 && argv[1][0] != '-' ? argv[1] : NULL;
+    const char *host = getOption(argc, argv, "--host");
+    const char *portOption = getOption(argc, argv, "--port");
+    const char *clientsOption = getOption(argc, argv, "--clients");
+    const char *secondsOption = getOption(argc, argv, "--seconds");
+    int numClients = clientsOption != NULL ? atoi(clientsOption) : (isQuick ? 16 : 256);
+    double seconds = secondsOption != NULL ? atof(secondsOption) : (isQuick ? 1 : 5);
+    if ((program == NULL) == (portOption == NULL) || numClients <= 0) {
+        printf("Usage: %s <light_sampler> [--quick] [--clients=N] [--seconds=S]\n"
+            "       %s --host=<ip> --port=<port> [--clients=N] [--seconds=S]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    int port = portOption != NULL ? atoi(portOption) : TestServer_pickPort();
+    pid_t serverPid = program != NULL ? TestServer_start(program, port, NULL) : 0;
+
+    struct sockaddr_in address = TestServer_getAddress(port);
+    if (host != NULL) {
+        inet_pton(AF_INET, host, &address.sin_addr);
+    }
+    int epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    Client_t *clients = calloc(numClients, sizeof(Client_t));
+    long long startNs = TestServer_getTimeNs();
+    long long periodNs = 1000000000LL / REQUESTS_PER_CLIENT_PER_SECOND;
+    for (int i = 0; i < numClients; i++) {
+        clients[i].socketDescriptor = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (clients[i].socketDescriptor < 0
+            || connect(clients[i].socketDescriptor, (struct sockaddr *)&address, sizeof(address)) < 0)
+        {
+            perror("ERROR: Unable to open a client socket");
+            return 1;
+        }
+        // Spread the clients' sends over the period
+        clients[i].nextSendNs = startNs + periodNs * i / numClients;
+        clients[i].nextRequest = i % NUM_REQUESTS;
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = &clients[i]};
+        epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, clients[i].socketDescriptor, &event);
+    }
+
+    long long numSent = 0;
+    long long numLost = 0;
+    long long startCpuNs = Bench_getCpuNs();
+    long long endNs = startNs + (long long)(seconds * 1e9);
+    long long nowNs = startNs;
+    while (nowNs < endNs) {
+        for (int i = 0; i < numClients; i++) {
+            Client_t *pClient = &clients[i];
+            if (pClient->isWaiting && nowNs - pClient->sentNs > REPLY_TIMEOUT_NS) {
+                pClient->isWaiting = false;
+                numLost++;
+            }
+            if (!pClient->isWaiting && nowNs >= pClient->nextSendNs) {
+                const char *request = REQUESTS[pClient->nextRequest];
+                pClient->nextRequest = (pClient->nextRequest + 1) % NUM_REQUESTS;
+                if (send(pClient->socketDescriptor, request, strlen(request), 0) > 0) {
+                    pClient->sentNs = nowNs;
+                    pClient->isWaiting = true;
+                    numSent++;
+                }
+                pClient->nextSendNs += periodNs;
+                if (pClient->nextSendNs < nowNs) {
+                    // Fell behind (a slow reply); don't burst to catch up
+                    pClient->nextSendNs = nowNs + periodNs;
+                }
+            }
+        }
+
+        struct epoll_event events[MAX_EVENTS];
+        int numEvents = epoll_wait(epollDescriptor, events, MAX_EVENTS, 1);
+        nowNs = TestServer_getTimeNs();
+        for (int i = 0; i < numEvents; i++) {
+            Client_t *pClient = events[i].data.ptr;
+            char reply[1500];
+            while (recv(pClient->socketDescriptor, reply, sizeof(reply), 0) > 0) {
+                if (pClient->isWaiting) {
+                    recordLatency(nowNs - pClient->sentNs);
+                    pClient->isWaiting = false;
+                }
+            }
+        }
+    }
+    long long elapsedNs = TestServer_getTimeNs() - startNs;
+    long long cpuNs = Bench_getCpuNs() - startCpuNs;
+
+    qsort(latencies, numLatencies, sizeof(latencies[0]), compareLatencies);
+    printf("%d clients, %.1fs: %lld sent, %d answered (%.0f requests/s), %lld lost\n", numClients,
+        elapsedNs / 1e9, numSent, numLatencies, numLatencies * 1e9 / elapsedNs, numLost);
+    printf("latency us: p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n", getPercentileUs(50),
+        getPercentileUs(90), getPercentileUs(99), getPercentileUs(99.9), getPercentileUs(100));
+    printf("load generator CPU: %.1f%%\n", cpuNs * 100.0 / elapsedNs);
+
+    bool isStopped = true;
+    if (serverPid != 0) {
+        isStopped = TestServer_stop(serverPid, port, 5000);
+    }
+    for (int i = 0; i < numClients; i++) {
+        close(clients[i].socketDescriptor);
+    }
+    close(epollDescriptor);
+    free(clients);
+    free(latencies);
+    return isStopped && numLatencies > 0 ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+// Period timer test
+// Several threads mark events flat out while a reader keeps taking the
+// statistics (and histograms) and clearing them, so marks land in both
+// banks across many swaps: every period, duration and missed deadline must
+// be counted exactly once, and each histogram must hold exactly the
+// periods its statistics counted. Percentiles of known distributions,
+// with values on either side of bucket boundaries, must come out as the
+// upper bound of the right bucket (capped at the maximum), within a
+// bucket's width of the exact value.
+//
+// Usage: periodTimerTest [marks per thread]
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hal/periodTimer.h"
+
+#define DEFAULT_MARKS 200000
+#define NUM_MARKERS 4
+#define MARKS_PER_MISSED_DEADLINE 10
+
+static int numMarks;
+static _Atomic int numMarkersRunning;
+
+static void *mark(void *arg) {
+    (void)arg;
+    for (int i = 0; i < numMarks; i++) {
+        long long startNs = Period_getTimeInNs();
+        Period_markEvent(PERIOD_EVENT_SAMPLE_LIGHT);
+        Period_markDuration(PERIOD_EVENT_ADC_READ, startNs);
+        if (i % MARKS_PER_MISSED_DEADLINE == 0) {
+            Period_markMissedDeadlines(PERIOD_EVENT_SAMPLE_LIGHT, 1);
+        }
+    }
+    numMarkersRunning--;
+    return NULL;
+}
+
+typedef struct {
+    long long numPeriods;
+    long long numDurations;
+    long long numMissedDeadlines;
+    long long numReads;
+} Totals_t;
+
+// Take and clear the statistics once, alternating the two calls
+static void collect(Totals_t *pTotals) {
+    Period_statistics_t stats;
+    if (pTotals->numReads % 2 == 0) {
+        Period_getStatisticsAndClear(PERIOD_EVENT_SAMPLE_LIGHT, &stats);
+    }
+    else {
+        Period_histogram_t histogram;
+        Period_getHistogramAndClear(PERIOD_EVENT_SAMPLE_LIGHT, &stats, &histogram);
+        TEST_CHECK(histogram.totalCount == stats.numSamples);
+    }
+    TEST_CHECK(stats.p50PeriodInMs <= stats.maxPeriodInMs);
+    TEST_CHECK(stats.p999PeriodInMs <= stats.maxPeriodInMs);
+    pTotals->numPeriods += stats.numSamples;
+    pTotals->numMissedDeadlines += stats.numMissedDeadlines;
+
+    Period_histogram_t histogram;
+    Period_getHistogramAndClear(PERIOD_EVENT_ADC_READ, &stats, &histogram);
+    TEST_CHECK(histogram.totalCount == stats.numSamples);
+    pTotals->numDurations += stats.numSamples;
+    pTotals->numReads++;
+}
+
+static void testConcurrentMarks(void) {
+    Period_init();
+    numMarkersRunning = NUM_MARKERS;
+    pthread_t markers[NUM_MARKERS];
+    for (int i = 0; i < NUM_MARKERS; i++) {
+        pthread_create(&markers[i], NULL, mark, NULL);
+    }
+
+    Totals_t totals = {0};
+    while (numMarkersRunning > 0) {
+        collect(&totals);
+    }
+    for (int i = 0; i < NUM_MARKERS; i++) {
+        pthread_join(markers[i], NULL);
+    }
+    // Whatever the last swap left in the banks
+    collect(&totals);
+    collect(&totals);
+    Period_cleanup();
+
+    printf("%lld periods, %lld durations, %lld missed deadlines over %lld reads\n",
+        totals.numPeriods, totals.numDurations, totals.numMissedDeadlines, totals.numReads);
+    // A thread's first mark starts its first period
+    TEST_CHECK(totals.numPeriods == (long long)NUM_MARKERS * (numMarks - 1));
+    TEST_CHECK(totals.numDurations == (long long)NUM_MARKERS * numMarks);
+    TEST_CHECK(totals.numMissedDeadlines
+        == (long long)NUM_MARKERS * ((numMarks + MARKS_PER_MISSED_DEADLINE - 1) / MARKS_PER_MISSED_DEADLINE));
+}
+
+// Percentiles in ms; `expectedNs` as an exact count of ns
+static bool isNs(double ms, long long expectedNs) {
+    double differenceNs = ms * 1e6 - expectedNs;
+    return differenceNs > -0.01 && differenceNs < 0.01;
+}
+
+static void recordMany(Period_histogram_t *pHistogram, long long valueNs, int count) {
+    for (int i = 0; i < count; i++) {
+        Period_recordInHistogram(pHistogram, valueNs);
+    }
+}
+
+static void testBucketBoundaries(void) {
+    Period_histogram_t histogram;
+    Period_resetHistogram(&histogram);
+    TEST_CHECK(Period_getPercentileInMs(&histogram, 50) == 0);
+
+    // 992..1023ns share a bucket; 2047 ends one and 2048 starts the next
+    // (2048..2175)
+    recordMany(&histogram, 1000, 900);
+    recordMany(&histogram, 2047, 90);
+    recordMany(&histogram, 2048, 9);
+    recordMany(&histogram, 1000000, 1);
+    TEST_CHECK(histogram.totalCount == 1000);
+    TEST_CHECK(isNs(Period_getPercentileInMs(&histogram, 50), 1023));
+    TEST_CHECK(isNs(Period_getPercentileInMs(&histogram, 90), 1023));
+    TEST_CHECK(isNs(Period_getPercentileInMs(&histogram, 99), 2047));
+    TEST_CHECK(isNs(Period_getPercentileInMs(&histogram, 99.9), 2175));
+    TEST_CHECK(isNs(Period_getPercentileInMs(&histogram, 100), 1000000));
+
+    // Split in two and merged, the same histogram
+    Period_histogram_t first;
+    Period_histogram_t second;
+    Period_resetHistogram(&first);
+    Period_resetHistogram(&second);
+    recordMany(&first, 1000, 900);
+    recordMany(&first, 2048, 9);
+    recordMany(&second, 2047, 90);
+    recordMany(&second, 1000000, 1);
+    Period_mergeHistogram(&first, &second);
+    TEST_CHECK(memcmp(&first, &histogram, sizeof(histogram)) == 0);
+
+    // Exact below 32ns; 32 and 33 share a bucket, capped at the maximum
+    Period_resetHistogram(&histogram);
+    recordMany(&histogram, 31, 99);
+    recordMany(&histogram, 32, 1);
+    TEST_CHECK(isNs(Period_getPercentileInMs(&histogram, 50), 31));
+    TEST_CHECK(isNs(Period_getPercentileInMs(&histogram, 99), 31));
+    TEST_CHECK(isNs(Period_getPercentileInMs(&histogram, 99.9), 32));
+    Period_recordInHistogram(&histogram, 33);
+    TEST_CHECK(isNs(Period_getPercentileInMs(&histogram, 100), 33));
+}
+
+// 1..n ns once each: the exact percentile is its rank
+static void testUniformPercentiles(void) {
+    const int n = 100000;
+    Period_histogram_t histogram;
+    Period_resetHistogram(&histogram);
+    for (int i = 1; i <= n; i++) {
+        Period_recordInHistogram(&histogram, i);
+    }
+    const double percentiles[] = {50, 90, 99, 99.9};
+    for (int i = 0; i < 4; i++) {
+        long long exactNs = (long long)(percentiles[i] / 100 * n + 0.5);
+        double reportedNs = Period_getPercentileInMs(&histogram, percentiles[i]) * 1e6;
+        printf("p%g of 1..%d ns: %.0f ns (exact %lld)\n", percentiles[i], n, reportedNs, exactNs);
+        TEST_CHECK(reportedNs > exactNs - 0.01);
+        TEST_CHECK(reportedNs < exactNs + exactNs / 16.0);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    numMarks = argc > 1 ? atoi(argv[1]) : DEFAULT_MARKS;
+    testConcurrentMarks();
+    testBucketBoundaries();
+    testUniformPercentiles();
+    return TEST_EXIT_CODE();
+}
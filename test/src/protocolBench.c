@@ -0,0 +1,175 @@
+// Protocol bench
+// Bytes on the wire and CPU per "history" request, text against binary, at
+// a few sample rates. The client side includes turning the reply back into
+// volts (strtod for text, a scale for binary); the server side is the
+// CPU light_sampler (simulated hardware) spent above its idle rate while
+// answering.
+//
+// Usage: protocolBench <light_sampler> [--quick]
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "binaryClient.h"
+#include "testServer.h"
+
+#define MAX_SAMPLES 100000
+#define MAX_DATAGRAM 1500
+// Under the server's per-client request burst
+#define REQUESTS_PER_CLIENT 40
+#define WARM_UP_MS 1500
+
+typedef struct {
+    long long numRequests;
+    long long numSamples;
+    long long numDatagrams;
+    long long numBytes;
+    long long clientCpuNs;
+    long long serverCpuNs;
+} Totals_t;
+
+static float volts[MAX_SAMPLES];
+
+// CPU time of every thread of the process, from /proc/<pid>/task/*/schedstat
+static long long getProcessCpuNs(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+    DIR *pDirectory = opendir(path);
+    long long totalNs = 0;
+    struct dirent *pEntry;
+    while (pDirectory != NULL && (pEntry = readdir(pDirectory)) != NULL) {
+        char statPath[128];
+        snprintf(statPath, sizeof(statPath), "%.40s/%.32s/schedstat", path, pEntry->d_name);
+        FILE *pFile = fopen(statPath, "r");
+        long long ns;
+        if (pFile != NULL && fscanf(pFile, "%lld", &ns) == 1) {
+            totalNs += ns;
+        }
+        if (pFile != NULL) {
+            fclose(pFile);
+        }
+    }
+    if (pDirectory != NULL) {
+        closedir(pDirectory);
+    }
+    return totalNs;
+}
+
+static void sleepForMs(int ms) {
+    struct timespec duration = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&duration, NULL);
+}
+
+// The last datagram of a text history ends in a sample and a newline, with
+// no separator
+static int getTextHistory(int socketDescriptor, Totals_t *pTotals) {
+    char reply[MAX_DATAGRAM + 1];
+    int length = TestServer_ask(socketDescriptor, "history\n", reply, sizeof(reply), BINARY_CLIENT_TIMEOUT_MS);
+    int numSamples = 0;
+    while (length >= 0) {
+        pTotals->numDatagrams++;
+        pTotals->numBytes += length;
+        char *pText = reply;
+        char *pEnd;
+        while (numSamples < MAX_SAMPLES) {
+            double value = strtod(pText, &pEnd);
+            if (pEnd == pText) {
+                break;
+            }
+            volts[numSamples++] = value;
+            pText = pEnd + strspn(pEnd, ", \n");
+        }
+        if (length < 2 || (reply[length - 1] == '\n' && reply[length - 2] >= '0' && reply[length - 2] <= '9')) {
+            break;
+        }
+        struct pollfd pollDesc = {.fd = socketDescriptor, .events = POLLIN};
+        if (poll(&pollDesc, 1, BINARY_CLIENT_TIMEOUT_MS) != 1) {
+            break;
+        }
+        length = recv(socketDescriptor, reply, MAX_DATAGRAM, 0);
+        reply[length > 0 ? length : 0] = 0;
+    }
+    return numSamples;
+}
+
+static int getBinaryHistory(int socketDescriptor, Totals_t *pTotals) {
+    static uint16_t codes[MAX_SAMPLES];
+    BinaryClient_reply_t reply;
+    if (!BinaryClient_getHistory(socketDescriptor, 0, codes, MAX_SAMPLES, &reply)) {
+        return 0;
+    }
+    for (int i = 0; i < reply.numSamples; i++) {
+        volts[i] = codes[i] * reply.header.voltsPerCode;
+    }
+    pTotals->numDatagrams += reply.numDatagrams;
+    pTotals->numBytes += reply.numBytes;
+    return reply.numSamples;
+}
+
+// Requests back to back, from several clients so none is rate limited
+static void run(pid_t serverPid, int port, bool isBinary, int numClients, double idleCpuNsPerMs, Totals_t *pTotals) {
+    long long startServerNs = getProcessCpuNs(serverPid);
+    long long startNs = TestServer_getTimeNs();
+    for (int i = 0; i < numClients; i++) {
+        int socketDescriptor = isBinary ? BinaryClient_open("127.0.0.1", port) : TestServer_openClient(port);
+        for (int j = 0; j < REQUESTS_PER_CLIENT; j++) {
+            long long startCpuNs = Bench_getCpuNs();
+            int numSamples = isBinary ? getBinaryHistory(socketDescriptor, pTotals)
+                : getTextHistory(socketDescriptor, pTotals);
+            pTotals->clientCpuNs += Bench_getCpuNs() - startCpuNs;
+            pTotals->numSamples += numSamples;
+            pTotals->numRequests++;
+        }
+        close(socketDescriptor);
+    }
+    double elapsedMs = (TestServer_getTimeNs() - startNs) / 1e6;
+    pTotals->serverCpuNs += getProcessCpuNs(serverPid) - startServerNs - (long long)(idleCpuNsPerMs * elapsedMs);
+}
+
+static void printTotals(const char *name, const Totals_t *pTotals) {
+    double requests = pTotals->numRequests;
+    printf("  %-6s %8.0f samples %6.1f datagrams %9.0f bytes (%5.2f/sample)  client %7.1f us  server %7.1f us\n",
+        name, pTotals->numSamples / requests, pTotals->numDatagrams / requests, pTotals->numBytes / requests,
+        (double)pTotals->numBytes / (pTotals->numSamples > 0 ? pTotals->numSamples : 1),
+        pTotals->clientCpuNs / requests / 1000, pTotals->serverCpuNs / requests / 1000);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        printf("Usage: %s <light_sampler> [--quick]\n", argv[0]);
+        return 1;
+    }
+    bool isQuick = Bench_isQuick(argc, argv);
+    static const int RATES[] = {1000, 10000, 50000};
+    int numRates = isQuick ? 1 : 3;
+    int numClients = isQuick ? 1 : 25;
+
+    int result = 0;
+    for (int i = 0; i < numRates; i++) {
+        char rateArg[32];
+        snprintf(rateArg, sizeof(rateArg), "--rate=%d", RATES[i]);
+        const char *extraArgs[] = {rateArg, NULL};
+        int port = TestServer_pickPort();
+        pid_t serverPid = TestServer_start(argv[1], port, extraArgs);
+        sleepForMs(WARM_UP_MS);
+
+        long long idleStartNs = TestServer_getTimeNs();
+        long long idleStartCpuNs = getProcessCpuNs(serverPid);
+        sleepForMs(1000);
+        double idleCpuNsPerMs = (getProcessCpuNs(serverPid) - idleStartCpuNs) / ((TestServer_getTimeNs() - idleStartNs) / 1e6);
+
+        Totals_t text = {0};
+        Totals_t binary = {0};
+        run(serverPid, port, false, numClients, idleCpuNsPerMs, &text);
+        run(serverPid, port, true, numClients, idleCpuNsPerMs, &binary);
+        printf("%d samples/s, per history request:\n", RATES[i]);
+        printTotals("text", &text);
+        printTotals("binary", &binary);
+
+        result |= !TestServer_stop(serverPid, port, 5000) || binary.numSamples == 0 || text.numSamples == 0;
+    }
+    return result;
+}
@@ -0,0 +1,221 @@
+// Reactor bench
+// Wakeups/s of the periodic module work, and the jitter it causes a 1 kHz
+// sampling thread, with that work done two ways:
+//  - thread per module, each polling with nanosleep, as the modules did
+//    before the reactor: display every 5 ms, LED/POT every 100 ms and
+//    statistics every second, plus a network thread blocked in recv;
+//  - the same tasks and the socket registered on the reactor.
+// Each task does the same trivial work either way, so what differs is only
+// how the work is scheduled. Wakeups are the module threads' voluntary
+// context switches; jitter is how late the sampling thread wakes past each
+// absolute deadline.
+//
+// Usage: reactorBench [--quick]
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "bench.h"
+#include "test.h"
+#include "hal/reactor.h"
+
+#define SAMPLE_PERIOD_NS 1000000LL
+#define MAX_SAMPLES 100000
+#define NUM_TASKS 3
+
+typedef struct {
+    const char *name;
+    long long periodNs;
+    _Atomic long long numRuns;
+} Task_t;
+
+static Task_t tasks[NUM_TASKS] = {
+    {"display", 5000000LL, 0},
+    {"LED/POT", 100000000LL, 0},
+    {"statistics", 1000000000LL, 0},
+};
+
+static _Atomic bool isRunning;
+static int socketDescriptor;
+
+// Sampling thread: how late each wakeup was, and its own context switches
+static long long latenessNs[MAX_SAMPLES];
+static int numSamples;
+static long long samplerSwitches;
+
+typedef struct {
+    double wakeupsPerSecond;
+    double p50Us;
+    double p99Us;
+    double maxUs;
+} Result_t;
+
+static long long getSwitches(int who) {
+    struct rusage usage;
+    getrusage(who, &usage);
+    return usage.ru_nvcsw;
+}
+
+static void runTask(void *pContext) {
+    Task_t *pTask = pContext;
+    pTask->numRuns++;
+}
+
+static void *sample(void *arg) {
+    int maxSamples = *(int *)arg;
+    long long startSwitches = getSwitches(RUSAGE_THREAD);
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    for (numSamples = 0; numSamples < maxSamples; numSamples++) {
+        deadline.tv_nsec += SAMPLE_PERIOD_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        latenessNs[numSamples] = Bench_getWallNs() - (deadline.tv_sec * 1000000000LL + deadline.tv_nsec);
+    }
+    samplerSwitches = getSwitches(RUSAGE_THREAD) - startSwitches;
+    return NULL;
+}
+
+static void *pollTask(void *arg) {
+    Task_t *pTask = arg;
+    struct timespec delay = {pTask->periodNs / 1000000000LL, pTask->periodNs % 1000000000LL};
+    while (isRunning) {
+        nanosleep(&delay, NULL);
+        runTask(pTask);
+    }
+    return NULL;
+}
+
+static void *receive(void *arg) {
+    (void)arg;
+    char buffer[64];
+    // Unblocked at the end by a datagram to ourselves
+    while (isRunning) {
+        recv(socketDescriptor, buffer, sizeof(buffer), 0);
+    }
+    return NULL;
+}
+
+static void handleDatagram(int fd, void *pContext) {
+    (void)pContext;
+    char buffer[64];
+    recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+}
+
+static int compareLateness(const void *pA, const void *pB) {
+    long long a = *(const long long *)pA;
+    long long b = *(const long long *)pB;
+    return a < b ? -1 : a > b;
+}
+
+// Run the sampling thread for `maxSamples` periods, with the module work
+// already scheduled one way or the other; the switches of the main and
+// sampling threads are left out of the wakeups
+static Result_t measure(int maxSamples) {
+    long long startSwitches = getSwitches(RUSAGE_SELF);
+    long long mainSwitches = getSwitches(RUSAGE_THREAD);
+    long long startNs = Bench_getWallNs();
+    pthread_t sampler;
+    pthread_create(&sampler, NULL, sample, &maxSamples);
+    pthread_join(sampler, NULL);
+    long long wallNs = Bench_getWallNs() - startNs;
+    mainSwitches = getSwitches(RUSAGE_THREAD) - mainSwitches;
+    long long moduleSwitches = getSwitches(RUSAGE_SELF) - startSwitches - samplerSwitches - mainSwitches;
+
+    qsort(latenessNs, numSamples, sizeof(latenessNs[0]), compareLateness);
+    Result_t result = {
+        .wakeupsPerSecond = moduleSwitches * 1e9 / wallNs,
+        .p50Us = latenessNs[numSamples / 2] / 1000.0,
+        .p99Us = latenessNs[numSamples * 99 / 100] / 1000.0,
+        .maxUs = latenessNs[numSamples - 1] / 1000.0,
+    };
+    return result;
+}
+
+static void openSocket(void) {
+    socketDescriptor = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if (socketDescriptor < 0 || bind(socketDescriptor, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror("ERROR: Unable to open the stand-in socket");
+        exit(-1);
+    }
+}
+
+static void wakeSocket(void) {
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    getsockname(socketDescriptor, (struct sockaddr *)&address, &length);
+    sendto(socketDescriptor, "", 1, 0, (struct sockaddr *)&address, length);
+}
+
+static Result_t runThreadPerModule(int maxSamples) {
+    openSocket();
+    isRunning = true;
+    pthread_t threads[NUM_TASKS + 1];
+    for (int i = 0; i < NUM_TASKS; i++) {
+        pthread_create(&threads[i], NULL, pollTask, &tasks[i]);
+    }
+    pthread_create(&threads[NUM_TASKS], NULL, receive, NULL);
+
+    Result_t result = measure(maxSamples);
+
+    isRunning = false;
+    wakeSocket();
+    for (int i = 0; i < NUM_TASKS + 1; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    close(socketDescriptor);
+    return result;
+}
+
+static Result_t runReactor(int maxSamples) {
+    openSocket();
+    Reactor_init();
+    for (int i = 0; i < NUM_TASKS; i++) {
+        Reactor_addTask(tasks[i].periodNs, runTask, &tasks[i]);
+    }
+    Reactor_addHandler(socketDescriptor, handleDatagram, NULL);
+    Reactor_start();
+
+    Result_t result = measure(maxSamples);
+
+    Reactor_stop();
+    Reactor_cleanup();
+    close(socketDescriptor);
+    return result;
+}
+
+static void printResult(const char *name, Result_t result) {
+    printf("%-18s %7.1f wakeups/s  sampler late by p50 %6.1f us  p99 %7.1f us  max %8.1f us\n",
+        name, result.wakeupsPerSecond, result.p50Us, result.p99Us, result.maxUs);
+}
+
+int main(int argc, char *argv[]) {
+    int maxSamples = Bench_isQuick(argc, argv) ? 1000 : 20000;
+    Result_t threads = runThreadPerModule(maxSamples);
+    long long threadRuns = tasks[0].numRuns;
+    tasks[0].numRuns = 0;
+    Result_t reactor = runReactor(maxSamples);
+    printResult("thread per module", threads);
+    printResult("reactor", reactor);
+
+    // Both ran the display about once per 5 ms; the reactor never needs
+    // more wakeups than the threads did, since tasks due together share one
+    long long expectedRuns = maxSamples * SAMPLE_PERIOD_NS / tasks[0].periodNs;
+    TEST_CHECK(threadRuns > expectedRuns * 0.8 && threadRuns < expectedRuns * 1.2);
+    TEST_CHECK(tasks[0].numRuns > expectedRuns * 0.8 && tasks[0].numRuns < expectedRuns * 1.2);
+    TEST_CHECK(reactor.wakeupsPerSecond <= threads.wakeupsPerSecond * 1.1);
+    return TEST_EXIT_CODE();
+}
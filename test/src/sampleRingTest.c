@@ -0,0 +1,195 @@
+// Sample ring stress test
+// One producer fills the ring at full speed and publishes each window the
+// way the sampler does: as a snapshot (hal/historySnapshot.h) and as a
+// summary in the history store, whose metadata readers copy out of the ring.
+// Several readers of each kind run at once and check that no window they
+// get is torn: every sample must be the one pushed at its absolute index.
+//
+// Usage: sampleRingTest [seconds]
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "test.h"
+#include "hal/sampleRing.h"
+#include "hal/historySnapshot.h"
+#include "hal/historyStore.h"
+#include "hal/windowKernel.h"
+
+#define MAX_WINDOW_SIZE 1024
+#define RETAINED_WINDOWS 2
+#define SNAPSHOT_POOL_SIZE 4
+#define NUM_SNAPSHOT_READERS 3
+#define NUM_RING_READERS 3
+#define DEFAULT_SECONDS 1.0
+
+static SampleRing_t ring;
+static HistorySnapshot_pool_t pool;
+static HistoryStore_t store;
+static _Atomic bool isRunning;
+
+static _Atomic long long numWindows;
+static _Atomic long long numSnapshotsChecked;
+static _Atomic long long numCopiesChecked;
+static _Atomic long long numPartialCopies;
+
+// Differs from whatever an earlier lap left in the same slot, so a stale
+// (torn) sample never passes for the right one
+static uint16_t getPattern(unsigned long long index) {
+    unsigned long long capacity = ring.mask + 1;
+    return (uint16_t)((index + index / capacity) & 0xFFF);
+}
+
+static const WindowKernel_thresholds_t noDips = {
+    .enterLow = -1,
+    .enterHigh = 4096,
+    .exitLow = -1,
+    .exitHigh = 4096,
+};
+
+static void *produce(void *arg) {
+    (void)arg;
+    unsigned int seed = 1;
+    unsigned long long index = 0;
+    long long timeMs = 0;
+    while (isRunning) {
+        // Mostly full windows, some short ones and some which overflow
+        int size = rand_r(&seed) % (MAX_WINDOW_SIZE + MAX_WINDOW_SIZE / 4) + 1;
+        for (int i = 0; i < size; i++) {
+            SampleRing_push(&ring, getPattern(index));
+            index++;
+        }
+        SampleRing_window_t window = SampleRing_completeWindow(&ring);
+
+        WindowKernel_stats_t stats;
+        WindowKernel_reset(&stats);
+        const uint16_t *pSpans[2];
+        int spanSizes[2];
+        int numSpans = SampleRing_getSpans(&ring, window, pSpans, spanSizes);
+        for (int i = 0; i < numSpans; i++) {
+            WindowKernel_accumulate(&stats, pSpans[i], spanSizes[i], &noDips);
+        }
+
+        HistorySnapshot_t *pSnapshot = HistorySnapshot_claim(&pool);
+        if (pSnapshot != NULL) {
+            for (int i = 0; i < window.size; i++) {
+                pSnapshot->pSamples[i] = SampleRing_get(&ring, window.startIndex + i);
+            }
+            pSnapshot->epoch = window.epoch;
+            pSnapshot->endTimeMs = timeMs + 1000;
+            pSnapshot->size = window.size;
+            pSnapshot->droppedSamples = window.droppedSamples;
+            pSnapshot->stats = stats;
+            HistorySnapshot_publish(&pool, pSnapshot);
+        }
+
+        HistoryStore_summary_t summary = {
+            .startTimeMs = timeMs,
+            .endTimeMs = timeMs + 1000,
+            .epoch = window.epoch,
+            .firstSampleIndex = window.startIndex,
+            .numSamples = window.size,
+            .stats = stats,
+        };
+        HistoryStore_addSecond(&store, &summary);
+        timeMs += 1000;
+        numWindows++;
+    }
+    return NULL;
+}
+
+// A snapshot must hold exactly the samples its statistics were taken over
+static void *readSnapshots(void *arg) {
+    (void)arg;
+    unsigned long long lastEpoch = 0;
+    while (isRunning) {
+        const HistorySnapshot_t *pSnapshot = HistorySnapshot_acquire(&pool);
+        if (pSnapshot->epoch != 0) {
+            TEST_CHECK(pSnapshot->epoch >= lastEpoch);
+            lastEpoch = pSnapshot->epoch;
+            unsigned long long sum = 0;
+            for (int i = 0; i < pSnapshot->size; i++) {
+                sum += pSnapshot->pSamples[i];
+            }
+            TEST_CHECK(pSnapshot->size == pSnapshot->stats.count);
+            TEST_CHECK(sum == pSnapshot->stats.sum);
+            numSnapshotsChecked++;
+        }
+        HistorySnapshot_release(pSnapshot);
+    }
+    return NULL;
+}
+
+// A copy may lose the head of a window the producer has run over, but what
+// it returns must be intact
+static void *readRing(void *arg) {
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    uint16_t samples[MAX_WINDOW_SIZE];
+    while (isRunning) {
+        HistoryStore_summary_t second;
+        // Reach back past the retained windows too, into overwritten ones
+        if (!HistoryStore_getSecond(&store, rand_r(&seed) % (RETAINED_WINDOWS + 2), &second)) {
+            continue;
+        }
+        SampleRing_window_t window = {
+            .epoch = second.epoch,
+            .startIndex = second.firstSampleIndex,
+            .size = second.numSamples,
+            .droppedSamples = 0,
+        };
+        SampleRing_window_t copied;
+        TEST_CHECK(SampleRing_copyWindow(&ring, window, samples, MAX_WINDOW_SIZE, &copied));
+        TEST_CHECK(copied.startIndex >= window.startIndex);
+        TEST_CHECK(copied.startIndex - window.startIndex + copied.size == (unsigned long long)window.size);
+        int numTorn = 0;
+        for (int i = 0; i < copied.size; i++) {
+            numTorn += samples[i] != getPattern(copied.startIndex + i);
+        }
+        TEST_CHECK(numTorn == 0);
+        numCopiesChecked++;
+        numPartialCopies += copied.size != window.size;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : DEFAULT_SECONDS;
+    SampleRing_init(&ring, MAX_WINDOW_SIZE, RETAINED_WINDOWS);
+    HistorySnapshot_initPool(&pool, SNAPSHOT_POOL_SIZE, MAX_WINDOW_SIZE);
+    HistoryStore_init(&store, RETAINED_WINDOWS + 2, 1, 1);
+
+    isRunning = true;
+    pthread_t producer;
+    pthread_t readers[NUM_SNAPSHOT_READERS + NUM_RING_READERS];
+    pthread_create(&producer, NULL, produce, NULL);
+    for (int i = 0; i < NUM_SNAPSHOT_READERS; i++) {
+        pthread_create(&readers[i], NULL, readSnapshots, NULL);
+    }
+    for (int i = NUM_SNAPSHOT_READERS; i < NUM_SNAPSHOT_READERS + NUM_RING_READERS; i++) {
+        pthread_create(&readers[i], NULL, readRing, (void *)(uintptr_t)(i + 1));
+    }
+
+    struct timespec duration = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&duration, NULL);
+    isRunning = false;
+    pthread_join(producer, NULL);
+    for (int i = 0; i < NUM_SNAPSHOT_READERS + NUM_RING_READERS; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    printf("%lld windows; %lld snapshots and %lld ring copies (%lld partial) checked\n",
+        (long long)numWindows, (long long)numSnapshotsChecked, (long long)numCopiesChecked,
+        (long long)numPartialCopies);
+    TEST_CHECK(numWindows > 0);
+    TEST_CHECK(numSnapshotsChecked > 0);
+    TEST_CHECK(numCopiesChecked > 0);
+
+    HistoryStore_cleanup(&store);
+    HistorySnapshot_cleanupPool(&pool);
+    SampleRing_cleanup(&ring);
+    return TEST_EXIT_CODE();
+}
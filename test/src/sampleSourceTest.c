@@ -0,0 +1,218 @@
+// Sample source test
+// Layout strings: unsigned 12-bit ones parse, signed, wider and malformed
+// ones are rejected. IIO setup, on a stand-in sysfs directory: every scan
+// element but the channel's ends up disabled. Packed reads: codes decode
+// from a FIFO, and a signal landing while a read waits for data must not
+// leave it blocked past its stop event (a watchdog alarm fails the test if
+// it does).
+//
+// Usage: sampleSourceTest
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "hal/sampleSource.h"
+
+#define WATCHDOG_SECONDS 5
+
+static void testParseLayout(void) {
+    SampleSource_layout_t layout;
+    TEST_CHECK(SampleSource_parseLayout("le:u12/16>>0", &layout));
+    TEST_CHECK(layout.bytesPerScan == 2 && layout.realBits == 12 && layout.shift == 0);
+    TEST_CHECK(!layout.isBigEndian);
+    TEST_CHECK(SampleSource_parseLayout("be:u12/32>>4", &layout));
+    TEST_CHECK(layout.bytesPerScan == 4 && layout.shift == 4 && layout.isBigEndian);
+
+    TEST_CHECK(!SampleSource_parseLayout("le:s12/16>>0", &layout));
+    TEST_CHECK(!SampleSource_parseLayout("be:s16/16>>0", &layout));
+    TEST_CHECK(!SampleSource_parseLayout("le:x12/16>>0", &layout));
+    TEST_CHECK(!SampleSource_parseLayout("le:u12/12>>0", &layout));
+    TEST_CHECK(!SampleSource_parseLayout("le:u12/16>>8", &layout));
+    TEST_CHECK(!SampleSource_parseLayout("le:u12/16", &layout));
+    // Wider than the 12 bits the kernels and the text formatting assume
+    TEST_CHECK(!SampleSource_parseLayout("le:u13/16>>0", &layout));
+    TEST_CHECK(!SampleSource_parseLayout("be:u16/16>>0", &layout));
+}
+
+static void writeStandIn(const char *directory, const char *name, const char *content) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    FILE *pFile = fopen(path, "w");
+    if (pFile == NULL) {
+        perror("ERROR: Unable to create a stand-in sysfs file");
+        exit(-1);
+    }
+    fputs(content, pFile);
+    fclose(pFile);
+}
+
+static bool hasContent(const char *directory, const char *name, const char *content) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    char buffer[32] = {0};
+    FILE *pFile = fopen(path, "r");
+    if (pFile == NULL) {
+        return false;
+    }
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, pFile);
+    fclose(pFile);
+    return length >= strlen(content) && strncmp(buffer, content, strlen(content)) == 0;
+}
+
+// A timestamp and another channel left enabled would widen each scan past
+// the channel's own layout
+static void testIioSetup(void) {
+    char directory[] = "/tmp/sampleSourceTest.XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("ERROR: Unable to create the stand-in sysfs directory");
+        exit(-1);
+    }
+    static const char *const subdirectories[] = {"buffer", "scan_elements"};
+    for (int i = 0; i < 2; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "%s/%s", directory, subdirectories[i]);
+        mkdir(path, 0700);
+    }
+    static const char *const files[][2] = {
+        {"buffer/enable", "0"},
+        {"buffer/length", "0000"},
+        {"buffer/watermark", "0000"},
+        {"scan_elements/in_voltage0_en", "1"},
+        {"scan_elements/in_voltage1_en", "0"},
+        {"scan_elements/in_voltage1_type", "le:u12/16>>0"},
+        {"scan_elements/in_timestamp_en", "1"},
+        {"device", ""},
+    };
+    const int numFiles = sizeof(files) / sizeof(files[0]);
+    for (int i = 0; i < numFiles; i++) {
+        writeStandIn(directory, files[i][0], files[i][1]);
+    }
+
+    char devicePath[64];
+    snprintf(devicePath, sizeof(devicePath), "%s/device", directory);
+    SampleSource_iioConfig_t config = {
+        .iioDirectory = directory,
+        .devicePath = devicePath,
+        .channel = 1,
+        .bufferLength = 1024,
+        .maxSamplesPerSecond = 1000,
+    };
+    SampleSource_t source;
+    SampleSource_openIioBuffer(&source, &config);
+    TEST_CHECK(hasContent(directory, "scan_elements/in_voltage0_en", "0"));
+    TEST_CHECK(hasContent(directory, "scan_elements/in_timestamp_en", "0"));
+    TEST_CHECK(hasContent(directory, "scan_elements/in_voltage1_en", "1"));
+    TEST_CHECK(hasContent(directory, "buffer/enable", "1"));
+    source.close(&source);
+    TEST_CHECK(hasContent(directory, "buffer/enable", "0"));
+
+    char path[64];
+    for (int i = numFiles - 1; i >= 0; i--) {
+        snprintf(path, sizeof(path), "%s/%s", directory, files[i][0]);
+        unlink(path);
+    }
+    for (int i = 0; i < 2; i++) {
+        snprintf(path, sizeof(path), "%s/%s", directory, subdirectories[i]);
+        rmdir(path);
+    }
+    rmdir(directory);
+}
+
+static void sleepForMs(long long delayInMs) {
+    struct timespec delay = {delayInMs / 1000, delayInMs % 1000 * 1000000};
+    nanosleep(&delay, NULL);
+}
+
+static void onSignal(int signal) {
+    (void)signal;
+}
+
+typedef struct {
+    pthread_t reader;
+    int stopEvent;
+} Interrupter_t;
+
+// Interrupt the reader while it waits, then ask it to stop
+static void *interrupt(void *arg) {
+    Interrupter_t *pInterrupter = arg;
+    sleepForMs(30);
+    pthread_kill(pInterrupter->reader, SIGUSR1);
+    sleepForMs(30);
+    uint64_t one = 1;
+    if (write(pInterrupter->stopEvent, &one, sizeof(one)) != sizeof(one)) {
+        perror("ERROR: Unable to signal the stop event");
+    }
+    return NULL;
+}
+
+static void testPackedRead(void) {
+    char directory[] = "/tmp/sampleSourceTest.XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("ERROR: Unable to create a directory for the FIFO");
+        exit(-1);
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/fifo", directory);
+    if (mkfifo(path, 0600) != 0) {
+        perror("ERROR: Unable to create the FIFO");
+        exit(-1);
+    }
+    // Held open for writing throughout, so opening the source doesn't block
+    // and it never sees the end of the stream
+    int writer = open(path, O_RDWR);
+
+    SampleSource_layout_t layout;
+    SampleSource_parseLayout("le:u12/16>>0", &layout);
+    SampleSource_t source;
+    SampleSource_openPacked(&source, path, &layout, 1000);
+    source.stopEventDescriptor = eventfd(0, 0);
+
+    // Codes, and a partial scan kept for the next read
+    const unsigned char bytes[] = {0x01, 0x08, 0xFF, 0x0F, 0x34};
+    TEST_CHECK(write(writer, bytes, sizeof(bytes)) == sizeof(bytes));
+    uint16_t codes[8];
+    TEST_CHECK(source.read(&source, codes, 8) == 2);
+    TEST_CHECK(codes[0] == 0x801 && codes[1] == 0xFFF);
+    const unsigned char rest[] = {0x02};
+    TEST_CHECK(write(writer, rest, sizeof(rest)) == sizeof(rest));
+    TEST_CHECK(source.read(&source, codes, 8) == 1);
+    TEST_CHECK(codes[0] == 0x234);
+
+    // No SA_RESTART, so the signal interrupts the wait
+    struct sigaction action = {.sa_handler = onSignal};
+    sigaction(SIGUSR1, &action, NULL);
+    alarm(WATCHDOG_SECONDS);
+    Interrupter_t interrupter = {.reader = pthread_self(), .stopEvent = source.stopEventDescriptor};
+    pthread_t thread;
+    pthread_create(&thread, NULL, interrupt, &interrupter);
+    int numStoppedReads = 0;
+    for (int i = 0; i < 5; i++) {
+        numStoppedReads += source.read(&source, codes, 8) == 0;
+    }
+    alarm(0);
+    pthread_join(thread, NULL);
+    TEST_CHECK(numStoppedReads == 5);
+    printf("interrupted read returned instead of blocking\n");
+
+    close(source.stopEventDescriptor);
+    source.close(&source);
+    close(writer);
+    unlink(path);
+    rmdir(directory);
+}
+
+int main(void) {
+    testParseLayout();
+    testIioSetup();
+    testPackedRead();
+    return TEST_EXIT_CODE();
+}
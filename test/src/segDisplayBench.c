@@ -0,0 +1,203 @@
+// Seg display bench
+// Refresh rate and CPU cost of driving the 14-segment display.
+//
+// First the real driver runs on the reactor against the simulated backend,
+// whose in-memory GPIO outputs and I2C registers stand in for the board:
+// once showing two different digits (multiplexed) and once two identical
+// ones (a static frame, which should do no I/O at all).
+//
+// Then the per-frame I/O of the old driver (fopen/fprintf/fclose for each
+// of 8 GPIO writes, and 4 single-register I2C writes) is replayed against
+// the new one's (4 pwrite()s on kept-open GPIO files, one I2C transaction
+// per digit) with regular files standing in for the GPIO value files and
+// the I2C bus, one syscall per write or transaction either way. Sysfs and
+// the bus add their own cost on the board, the same to both.
+//
+// Usage: segDisplayBench [--quick]
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "test.h"
+#include "hal/backend.h"
+#include "hal/file.h"
+#include "hal/periodTimer.h"
+#include "hal/reactor.h"
+#include "hal/segDisplay.h"
+
+#define REG_OUTA 0x00
+
+// The driver's frame: two digits each lit for a digit period
+#define FRAMES_PER_SECOND (1000 / (2 * SEG_DEFAULT_DIGIT_PERIOD_MS))
+
+typedef struct {
+    double seconds;
+    double framesPerSecond;
+    double outputWritesPerSecond;
+    double i2cWritesPerSecond;
+    double cpuPercent;
+} DriverResult_t;
+
+static void sleepForMs(long long delayInMs) {
+    struct timespec delay = {delayInMs / 1000, delayInMs % 1000 * 1000000};
+    nanosleep(&delay, NULL);
+}
+
+static DriverResult_t runDriver(unsigned int value, double seconds) {
+    // Let the new value reach the display before counting
+    Seg_updateDigitValues(value);
+    sleepForMs(4 * SEG_DEFAULT_DIGIT_PERIOD_MS);
+
+    long long outputWrites = SimulatedBackend_getNumOutputWrites();
+    long long i2cWrites = SimulatedBackend_getNumI2cWrites();
+    long long startWall = Bench_getWallNs();
+    long long startCpu = Bench_getCpuNs();
+    sleepForMs((long long)(seconds * 1000));
+    long long cpuNs = Bench_getCpuNs() - startCpu;
+    long long wallNs = Bench_getWallNs() - startWall;
+
+    DriverResult_t result = {.seconds = wallNs / 1e9};
+    result.outputWritesPerSecond = (SimulatedBackend_getNumOutputWrites() - outputWrites) / result.seconds;
+    result.i2cWritesPerSecond = (SimulatedBackend_getNumI2cWrites() - i2cWrites) / result.seconds;
+    // One transaction per digit shown
+    result.framesPerSecond = result.i2cWritesPerSecond / 2;
+    result.cpuPercent = 100.0 * cpuNs / wallNs;
+    return result;
+}
+
+static void printDriverResult(const char *name, DriverResult_t result) {
+    printf("%-24s %7.1f frames/s  %7.1f GPIO writes/s  %7.1f I2C writes/s  %5.2f%% CPU\n",
+        name, result.framesPerSecond, result.outputWritesPerSecond, result.i2cWritesPerSecond,
+        result.cpuPercent);
+}
+
+static void benchDriver(double seconds) {
+    SimulatedBackend_config_t simulation;
+    SimulatedBackend_getDefaultConfig(&simulation);
+    Backend_useSimulation(&simulation);
+    Period_init();
+    Reactor_init();
+    Seg_init();
+    Reactor_start();
+
+    DriverResult_t multiplexed = runDriver(42, seconds);
+    printDriverResult("driver, multiplexed (42)", multiplexed);
+    DriverResult_t staticFrame = runDriver(77, seconds);
+    printDriverResult("driver, static (77)", staticFrame);
+
+    Reactor_stop();
+    Seg_cleanup();
+    Reactor_cleanup();
+    Period_cleanup();
+
+    // The reactor may run a digit a little late but never skips a frame
+    // while it is idle, and a static frame needs nothing written
+    TEST_CHECK(multiplexed.framesPerSecond > FRAMES_PER_SECOND * 0.8);
+    TEST_CHECK(multiplexed.framesPerSecond < FRAMES_PER_SECOND * 1.2);
+    TEST_CHECK(staticFrame.outputWritesPerSecond == 0);
+    TEST_CHECK(staticFrame.i2cWritesPerSecond == 0);
+    TEST_CHECK(SimulatedBackend_getI2cRegister(0, REG_OUTA) >= 0);
+}
+
+typedef struct {
+    char first[32];
+    char second[32];
+    char i2c[32];
+} MockFiles_t;
+
+static void createMockFile(char *path, const char *name) {
+    snprintf(path, 32, "/tmp/segDisplay%s.XXXXXX", name);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("ERROR: Unable to create the stand-in file");
+        exit(-1);
+    }
+    close(fd);
+}
+
+static void writeI2cStandIn(int fd, const unsigned char *pBytes, int length) {
+    if (pwrite(fd, pBytes, length, 0) != length) {
+        perror("ERROR: Unable to write the I2C stand-in");
+        exit(-1);
+    }
+}
+
+// The old driver's frame: both digits off, two register writes and one
+// digit on, for each digit; every GPIO write opens and closes the file
+static long long runOldFrames(MockFiles_t *pFiles, long long numFrames) {
+    int i2c = open(pFiles->i2c, O_RDWR);
+    long long startCpu = Bench_getCpuNs();
+    for (long long i = 0; i < numFrames; i++) {
+        for (int digit = 0; digit < 2; digit++) {
+            File_writeToFile(pFiles->first, "0");
+            File_writeToFile(pFiles->second, "0");
+            unsigned char regA[2] = {0x00, (unsigned char)i};
+            unsigned char regB[2] = {0x01, (unsigned char)digit};
+            writeI2cStandIn(i2c, regA, 2);
+            writeI2cStandIn(i2c, regB, 2);
+            File_writeToFile(digit == 0 ? pFiles->first : pFiles->second, "1");
+        }
+    }
+    long long cpuNs = Bench_getCpuNs() - startCpu;
+    close(i2c);
+    return cpuNs;
+}
+
+// The new driver's multiplexed frame: for each digit the lit one goes off,
+// both registers go in one transaction and the next digit comes on
+static long long runNewFrames(MockFiles_t *pFiles, long long numFrames) {
+    File_writer_t digits[2];
+    File_openWriter(&digits[0], pFiles->first);
+    File_openWriter(&digits[1], pFiles->second);
+    int i2c = open(pFiles->i2c, O_RDWR);
+    long long startCpu = Bench_getCpuNs();
+    for (long long i = 0; i < numFrames; i++) {
+        for (int digit = 0; digit < 2; digit++) {
+            File_write(&digits[1 - digit], "0", 1);
+            unsigned char registers[4] = {0x00, (unsigned char)i, 0x01, (unsigned char)digit};
+            writeI2cStandIn(i2c, registers, 4);
+            File_write(&digits[digit], "1", 1);
+        }
+    }
+    long long cpuNs = Bench_getCpuNs() - startCpu;
+    close(i2c);
+    File_closeWriter(&digits[0]);
+    File_closeWriter(&digits[1]);
+    return cpuNs;
+}
+
+static void printFrameResult(const char *name, long long cpuNs, long long numFrames) {
+    double nsPerFrame = (double)cpuNs / numFrames;
+    printf("%-24s %7.2f us CPU/frame  %10.0f frames/s max  %5.2f%% CPU at %d frames/s\n",
+        name, nsPerFrame / 1000, 1e9 / nsPerFrame, nsPerFrame * FRAMES_PER_SECOND / 1e7,
+        FRAMES_PER_SECOND);
+}
+
+static void benchFrameIo(long long numFrames) {
+    MockFiles_t files;
+    createMockFile(files.first, "First");
+    createMockFile(files.second, "Second");
+    createMockFile(files.i2c, "I2c");
+
+    long long oldCpuNs = runOldFrames(&files, numFrames);
+    long long newCpuNs = runNewFrames(&files, numFrames);
+    printFrameResult("frame I/O, fopen/fclose", oldCpuNs, numFrames);
+    printFrameResult("frame I/O, kept open", newCpuNs, numFrames);
+    printf("speedup %.1fx\n", (double)oldCpuNs / newCpuNs);
+
+    unlink(files.first);
+    unlink(files.second);
+    unlink(files.i2c);
+    TEST_CHECK(newCpuNs < oldCpuNs);
+}
+
+int main(int argc, char *argv[]) {
+    bool isQuick = Bench_isQuick(argc, argv);
+    benchDriver(isQuick ? 0.5 : 5.0);
+    benchFrameIo(isQuick ? 2000 : 100000);
+    return TEST_EXIT_CODE();
+}
@@ -0,0 +1,72 @@
+// Session table bench
+// Per-packet cost of the server's session bookkeeping (a lookup and a
+// request token) on a full table the size the server uses: for clients
+// already known, and for a flood of new ones, each evicting the least
+// recently seen.
+//
+// Usage: sessionTableBench [--quick]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include "bench.h"
+#include "sessionTable.h"
+
+// As in network.c
+#define MAX_SESSIONS 4096
+#define SESSION_IDLE_TIMEOUT_MS (5 * 60 * 1000)
+#define REQUESTS_PER_SECOND 100
+#define REQUEST_BURST 50
+
+static struct sockaddr_in makeAddress(unsigned int client) {
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(0x0A000000 + client / 50000);
+    address.sin_port = htons(1024 + client % 50000);
+    return address;
+}
+
+// Nanoseconds per packet from `numClients` distinct clients in random order
+static double measure(SessionTable_t *pTable, const unsigned int *pClients, int numPackets, int *pNumNew) {
+    long long start = Bench_getCpuNs();
+    for (int i = 0; i < numPackets; i++) {
+        struct sockaddr_in address = makeAddress(pClients[i]);
+        bool isNew;
+        Session_t *pSession = SessionTable_lookup(pTable, &address, i / 1000, &isNew);
+        SessionTable_takeRequestToken(pSession, i / 1000, REQUESTS_PER_SECOND, REQUEST_BURST);
+        *pNumNew += isNew;
+    }
+    return (double)(Bench_getCpuNs() - start) / numPackets;
+}
+
+int main(int argc, char *argv[]) {
+    int numPackets = Bench_isQuick(argc, argv) ? 100000 : 20000000;
+    unsigned int *pClients = malloc(sizeof(pClients[0]) * numPackets);
+    unsigned int seed = 1;
+
+    SessionTable_t table;
+    SessionTable_init(&table, MAX_SESSIONS, SESSION_IDLE_TIMEOUT_MS);
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        struct sockaddr_in address = makeAddress(i);
+        SessionTable_lookup(&table, &address, 0, NULL);
+    }
+
+    for (int i = 0; i < numPackets; i++) {
+        pClients[i] = rand_r(&seed) % MAX_SESSIONS;
+    }
+    int numNew = 0;
+    double knownNs = measure(&table, pClients, numPackets, &numNew);
+    printf("known clients:  %6.1f ns/packet (%d new)\n", knownNs, numNew);
+
+    for (int i = 0; i < numPackets; i++) {
+        pClients[i] = MAX_SESSIONS + i;
+    }
+    numNew = 0;
+    double newNs = measure(&table, pClients, numPackets, &numNew);
+    printf("new clients:    %6.1f ns/packet (%d new, evicting)\n", newNs, numNew);
+
+    SessionTable_cleanup(&table);
+    free(pClients);
+    return 0;
+}
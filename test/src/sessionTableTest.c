@@ -0,0 +1,198 @@
+// Session table test
+// LRU eviction, idle expiry and the request token bucket, then a long run
+// of random lookups and expiries on a small, crowded table checked against
+// a plain list model. With the hash table kept half full, that churn makes
+// long probe runs, so backward-shift deletion is exercised every few
+// operations; a session lost by it shows up as a lookup wrongly reported new.
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "test.h"
+#include "sessionTable.h"
+
+#define NUM_RANDOM_OPERATIONS 200000
+
+static struct sockaddr_in makeAddress(int client) {
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(0x7F000001 + client / 1000);
+    address.sin_port = htons(10000 + client % 1000);
+    return address;
+}
+
+static int getClient(const Session_t *pSession) {
+    return (ntohl(pSession->address.sin_addr.s_addr) - 0x7F000001) * 1000 + ntohs(pSession->address.sin_port) - 10000;
+}
+
+static bool lookupIsNew(SessionTable_t *pTable, int client, long long nowMs) {
+    struct sockaddr_in address = makeAddress(client);
+    bool isNew;
+    Session_t *pSession = SessionTable_lookup(pTable, &address, nowMs, &isNew);
+    TEST_CHECK(getClient(pSession) == client);
+    return isNew;
+}
+
+static void testEviction(void) {
+    SessionTable_t table;
+    SessionTable_init(&table, 8, 1000000);
+    for (int i = 0; i < 8; i++) {
+        TEST_CHECK(lookupIsNew(&table, i, i));
+    }
+    // Client 0 is seen again, so 1 is now the least recently seen
+    TEST_CHECK(!lookupIsNew(&table, 0, 10));
+    TEST_CHECK(lookupIsNew(&table, 100, 11));
+    TEST_CHECK(SessionTable_getNumSessions(&table) == 8);
+    TEST_CHECK(!lookupIsNew(&table, 0, 12));
+    TEST_CHECK(!lookupIsNew(&table, 2, 13));
+    TEST_CHECK(lookupIsNew(&table, 1, 14));
+
+    // Most recently seen first
+    static const int EXPECTED[] = {1, 2, 0, 100, 7, 6, 5, 4};
+    int i = 0;
+    for (Session_t *pSession = SessionTable_getFirst(&table); pSession != NULL;
+        pSession = SessionTable_getNext(&table, pSession))
+    {
+        TEST_CHECK(i < 8 && getClient(pSession) == EXPECTED[i]);
+        i++;
+    }
+    TEST_CHECK(i == 8);
+    SessionTable_cleanup(&table);
+}
+
+static void testExpiry(void) {
+    SessionTable_t table;
+    SessionTable_init(&table, 8, 1000);
+    lookupIsNew(&table, 1, 0);
+    lookupIsNew(&table, 2, 500);
+    lookupIsNew(&table, 3, 900);
+    SessionTable_expireIdle(&table, 1000);
+    TEST_CHECK(SessionTable_getNumSessions(&table) == 3);
+    SessionTable_expireIdle(&table, 1501);
+    TEST_CHECK(SessionTable_getNumSessions(&table) == 1);
+    TEST_CHECK(lookupIsNew(&table, 1, 1501));
+    TEST_CHECK(!lookupIsNew(&table, 3, 1501));
+
+    // A session past the timeout but not yet expired starts over
+    struct sockaddr_in address = makeAddress(1);
+    Session_t *pSession = SessionTable_lookup(&table, &address, 1600, NULL);
+    pSession->subscriptions = 1;
+    bool isNew;
+    pSession = SessionTable_lookup(&table, &address, 2601, &isNew);
+    TEST_CHECK(isNew);
+    TEST_CHECK(pSession->subscriptions == 0);
+    TEST_CHECK(pSession->firstSeenMs == 2601);
+    SessionTable_cleanup(&table);
+}
+
+static void testRequestTokens(void) {
+    SessionTable_t table;
+    SessionTable_init(&table, 1, 1000000);
+    struct sockaddr_in address = makeAddress(1);
+    Session_t *pSession = SessionTable_lookup(&table, &address, 0, NULL);
+
+    // A full burst, then nothing until a token is refilled
+    for (int i = 0; i < 5; i++) {
+        TEST_CHECK(SessionTable_takeRequestToken(pSession, 0, 10, 5));
+    }
+    TEST_CHECK(!SessionTable_takeRequestToken(pSession, 0, 10, 5));
+    TEST_CHECK(!SessionTable_takeRequestToken(pSession, 99, 10, 5));
+    TEST_CHECK(SessionTable_takeRequestToken(pSession, 100, 10, 5));
+    TEST_CHECK(pSession->numDroppedRequests == 2);
+
+    // Partial refills carry over: 150ms then 50ms more make two tokens
+    TEST_CHECK(SessionTable_takeRequestToken(pSession, 250, 10, 5));
+    TEST_CHECK(!SessionTable_takeRequestToken(pSession, 250, 10, 5));
+    TEST_CHECK(SessionTable_takeRequestToken(pSession, 300, 10, 5));
+
+    // Asking every millisecond for ten seconds gets the rate plus a burst
+    pSession->requestTokens = -1;
+    int numTaken = 0;
+    for (int nowMs = 1000; nowMs < 11000; nowMs++) {
+        numTaken += SessionTable_takeRequestToken(pSession, nowMs, 10, 5);
+    }
+    TEST_CHECK(numTaken >= 5 + 99 && numTaken <= 5 + 100);
+    SessionTable_cleanup(&table);
+}
+
+// Reference: clients, most recently seen first, and when each was seen
+typedef struct {
+    int clients[64];
+    long long lastSeenMs[64];
+    int count;
+} Model_t;
+
+static void removeFromModel(Model_t *pModel, int position) {
+    memmove(&pModel->clients[position], &pModel->clients[position + 1],
+        sizeof(pModel->clients[0]) * (pModel->count - position - 1));
+    memmove(&pModel->lastSeenMs[position], &pModel->lastSeenMs[position + 1],
+        sizeof(pModel->lastSeenMs[0]) * (pModel->count - position - 1));
+    pModel->count--;
+}
+
+static bool lookupInModel(Model_t *pModel, int maxSessions, long long idleTimeoutMs, int client, long long nowMs) {
+    bool isNew = true;
+    for (int i = 0; i < pModel->count; i++) {
+        if (pModel->clients[i] == client) {
+            isNew = nowMs - pModel->lastSeenMs[i] > idleTimeoutMs;
+            removeFromModel(pModel, i);
+            break;
+        }
+    }
+    if (pModel->count == maxSessions) {
+        removeFromModel(pModel, pModel->count - 1);
+    }
+    memmove(&pModel->clients[1], &pModel->clients[0], sizeof(pModel->clients[0]) * pModel->count);
+    memmove(&pModel->lastSeenMs[1], &pModel->lastSeenMs[0], sizeof(pModel->lastSeenMs[0]) * pModel->count);
+    pModel->clients[0] = client;
+    pModel->lastSeenMs[0] = nowMs;
+    pModel->count++;
+    return isNew;
+}
+
+static void testAgainstModel(void) {
+    const int maxSessions = 64;
+    const long long idleTimeoutMs = 300;
+    SessionTable_t table;
+    SessionTable_init(&table, maxSessions, idleTimeoutMs);
+    Model_t model = {.count = 0};
+    unsigned int seed = 1;
+    long long nowMs = 0;
+    int numMismatches = 0;
+    for (int i = 0; i < NUM_RANDOM_OPERATIONS && numMismatches == 0; i++) {
+        nowMs += rand_r(&seed) % 3;
+        if (rand_r(&seed) % 50 == 0) {
+            SessionTable_expireIdle(&table, nowMs);
+            while (model.count > 0 && nowMs - model.lastSeenMs[model.count - 1] > idleTimeoutMs) {
+                removeFromModel(&model, model.count - 1);
+            }
+        }
+        else {
+            // Sometimes a client from a large pool (forcing evictions),
+            // mostly one of a few regulars
+            int client = rand_r(&seed) % 4 == 0 ? rand_r(&seed) % 5000 : rand_r(&seed) % 80;
+            bool isNew = lookupIsNew(&table, client, nowMs);
+            numMismatches += isNew != lookupInModel(&model, maxSessions, idleTimeoutMs, client, nowMs);
+        }
+
+        int position = 0;
+        for (Session_t *pSession = SessionTable_getFirst(&table); pSession != NULL;
+            pSession = SessionTable_getNext(&table, pSession))
+        {
+            numMismatches += position >= model.count || getClient(pSession) != model.clients[position];
+            position++;
+        }
+        numMismatches += position != model.count || SessionTable_getNumSessions(&table) != model.count;
+    }
+    TEST_CHECK(numMismatches == 0);
+    SessionTable_cleanup(&table);
+}
+
+int main(void) {
+    testEviction();
+    testExpiry();
+    testRequestTokens();
+    testAgainstModel();
+    return TEST_EXIT_CODE();
+}
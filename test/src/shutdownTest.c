@@ -0,0 +1,104 @@
+// Shutdown test
+// Time from a "stop" request to the server's exit, while it samples at a
+// high rate and clients keep sending it requests. Every run must exit
+// cleanly (status 0) within MAX_STOP_MS.
+//
+// Usage: shutdownTest <light_sampler> [runs]
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+#include "testServer.h"
+
+#define DEFAULT_RUNS 3
+#define NUM_CLIENTS 4
+#define LOAD_MS 500
+#define MAX_STOP_MS 500
+#define EXIT_TIMEOUT_MS 5000
+
+static const char *const requests[] = {"count\n", "length\n", "history\n", "dips\n", "stats\n"};
+#define NUM_REQUESTS ((int)(sizeof(requests) / sizeof(requests[0])))
+
+static _Atomic bool isLoading;
+static _Atomic long long numReplies;
+static int serverPort;
+
+// Send requests as fast as replies come back, until told to stop
+static void *load(void *arg) {
+    int client = TestServer_openClient(serverPort);
+    char reply[2048];
+    for (int i = (int)(intptr_t)arg; isLoading; i++) {
+        numReplies += TestServer_ask(client, requests[i % NUM_REQUESTS], reply, sizeof(reply), 5) > 0;
+    }
+    close(client);
+    return NULL;
+}
+
+static void sleepForMs(long long delayInMs) {
+    struct timespec delay = {delayInMs / 1000, delayInMs % 1000 * 1000000};
+    nanosleep(&delay, NULL);
+}
+
+// Returns the stop-to-exit time in ms, or -1 if it did not exit cleanly
+static double runOnce(const char *program) {
+    static const char *const args[] = {"--rate=200000", NULL};
+    pid_t pid = TestServer_start(program, serverPort, args);
+
+    isLoading = true;
+    pthread_t clients[NUM_CLIENTS];
+    for (int i = 0; i < NUM_CLIENTS; i++) {
+        pthread_create(&clients[i], NULL, load, (void *)(intptr_t)i);
+    }
+    sleepForMs(LOAD_MS);
+
+    int stopClient = TestServer_openClient(serverPort);
+    long long stopNs = TestServer_getTimeNs();
+    send(stopClient, "stop\n", 5, 0);
+    int status;
+    bool hasExited = TestServer_waitForExit(pid, EXIT_TIMEOUT_MS, &status);
+    double stopMs = (TestServer_getTimeNs() - stopNs) / 1e6;
+    close(stopClient);
+
+    isLoading = false;
+    for (int i = 0; i < NUM_CLIENTS; i++) {
+        pthread_join(clients[i], NULL);
+    }
+    if (!hasExited) {
+        printf("ERROR: Server still running %d ms after stop\n", EXIT_TIMEOUT_MS);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("ERROR: Server exited with status 0x%x\n", status);
+        return -1;
+    }
+    return stopMs;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <light_sampler> [runs]\n", argv[0]);
+        return 2;
+    }
+    int numRuns = argc > 2 ? atoi(argv[2]) : DEFAULT_RUNS;
+    serverPort = TestServer_pickPort();
+
+    double maxStopMs = 0;
+    double totalStopMs = 0;
+    for (int i = 0; i < numRuns; i++) {
+        double stopMs = runOnce(argv[1]);
+        TEST_CHECK(stopMs >= 0);
+        TEST_CHECK(stopMs < MAX_STOP_MS);
+        maxStopMs = stopMs > maxStopMs ? stopMs : maxStopMs;
+        totalStopMs += stopMs;
+    }
+    printf("stop to exit under load: average %.1f ms, max %.1f ms over %d runs\n",
+        totalStopMs / numRuns, maxStopMs, numRuns);
+    printf("%.0f replies/s while loading\n", (double)numReplies / numRuns * 1000 / LOAD_MS);
+    TEST_CHECK(numReplies > 0);
+    return TEST_EXIT_CODE();
+}
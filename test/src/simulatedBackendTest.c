@@ -0,0 +1,111 @@
+// Simulated backend test
+// Output and I2C writes must land in the in-memory stand-ins, readable
+// back and counted one per write or transaction. Buffered A2D capture must
+// deliver the configured rate, including rates far above the board's, and
+// the CPU it costs to do so is printed for each.
+//
+// Usage: simulatedBackendTest [seconds per rate]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "test.h"
+#include "hal/backend.h"
+
+#define DEFAULT_SECONDS 0.3
+#define LIGHT_SENSOR_CHANNEL 1
+#define MAX_CODES 65536
+
+static void testOutputs(void) {
+    long long numWrites = SimulatedBackend_getNumOutputWrites();
+    int first = Backend_openOutput("/sys/class/gpio/gpio61/value");
+    int second = Backend_openOutput("/sys/class/gpio/gpio44/value");
+    TEST_CHECK(first != second);
+    TEST_CHECK(Backend_openOutput("/sys/class/gpio/gpio61/value") == first);
+
+    TEST_CHECK(Backend_writeOutput(first, "1", 1));
+    TEST_CHECK(Backend_writeOutput(second, "0", 1));
+    TEST_CHECK(Backend_writeOutput(first, "500000", 6));
+    char value[32];
+    TEST_CHECK(SimulatedBackend_getOutput("/sys/class/gpio/gpio61/value", value, sizeof(value)));
+    TEST_CHECK(strcmp(value, "500000") == 0);
+    TEST_CHECK(SimulatedBackend_getOutput("/sys/class/gpio/gpio44/value", value, sizeof(value)));
+    TEST_CHECK(strcmp(value, "0") == 0);
+    TEST_CHECK(!SimulatedBackend_getOutput("/sys/class/gpio/gpio1/value", value, sizeof(value)));
+    TEST_CHECK(SimulatedBackend_getNumOutputWrites() - numWrites == 3);
+    Backend_closeOutput(first);
+    Backend_closeOutput(second);
+}
+
+static void testI2c(void) {
+    long long numWrites = SimulatedBackend_getNumI2cWrites();
+    int i2c = Backend_openI2c("/dev/i2c-1", 0x20);
+    const unsigned char registerValues[2][2] = {{0x00, 0xD0}, {0x01, 0xA1}};
+    TEST_CHECK(Backend_writeI2cRegisters(i2c, registerValues, 2));
+    TEST_CHECK(SimulatedBackend_getI2cRegister(i2c, 0x00) == 0xD0);
+    TEST_CHECK(SimulatedBackend_getI2cRegister(i2c, 0x01) == 0xA1);
+    TEST_CHECK(SimulatedBackend_getI2cRegister(i2c, 0x02) == 0);
+
+    const unsigned char update[1][2] = {{0x01, 0x04}};
+    TEST_CHECK(Backend_writeI2cRegisters(i2c, update, 1));
+    TEST_CHECK(SimulatedBackend_getI2cRegister(i2c, 0x00) == 0xD0);
+    TEST_CHECK(SimulatedBackend_getI2cRegister(i2c, 0x01) == 0x04);
+    // One transaction per call, however many registers it sets
+    TEST_CHECK(SimulatedBackend_getNumI2cWrites() - numWrites == 2);
+    Backend_closeI2c(i2c);
+}
+
+// Read buffered capture flat out for `seconds`; the count must match the
+// rate and the dips must show up in the codes
+static void testBufferedRate(int samplesPerSecond, double seconds) {
+    SimulatedBackend_config_t config;
+    SimulatedBackend_getDefaultConfig(&config);
+    config.samplesPerSecond = samplesPerSecond;
+    Backend_useSimulation(&config);
+
+    static uint16_t codes[MAX_CODES];
+    SampleSource_t source;
+    Backend_openAdcSource(&source, BACKEND_ADC_BUFFERED, LIGHT_SENSOR_CHANNEL, samplesPerSecond);
+    long long numSamples = 0;
+    int minCode = 4096;
+    int maxCode = -1;
+    long long startWall = Bench_getWallNs();
+    long long startCpu = Bench_getCpuNs();
+    long long endWall = startWall + (long long)(seconds * 1e9);
+    while (Bench_getWallNs() < endWall) {
+        int numRead = source.read(&source, codes, MAX_CODES);
+        for (int i = 0; i < numRead; i++) {
+            minCode = codes[i] < minCode ? codes[i] : minCode;
+            maxCode = codes[i] > maxCode ? codes[i] : maxCode;
+        }
+        numSamples += numRead > 0 ? numRead : 0;
+    }
+    long long cpuNs = Bench_getCpuNs() - startCpu;
+    long long wallNs = Bench_getWallNs() - startWall;
+    source.close(&source);
+
+    double rate = numSamples * 1e9 / wallNs;
+    printf("%9d samples/s configured: %11.0f delivered  %6.1f ns CPU/sample  %5.1f%% CPU\n",
+        samplesPerSecond, rate, (double)cpuNs / numSamples, 100.0 * cpuNs / wallNs);
+    // Up to a watermark (a millisecond) short at the end
+    TEST_CHECK(rate > samplesPerSecond * 0.95);
+    TEST_CHECK(rate < samplesPerSecond * 1.05);
+    TEST_CHECK(minCode < maxCode);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : DEFAULT_SECONDS;
+    SimulatedBackend_config_t config;
+    SimulatedBackend_getDefaultConfig(&config);
+    Backend_useSimulation(&config);
+    testOutputs();
+    testI2c();
+
+    testBufferedRate(1000, seconds * 2);
+    testBufferedRate(100000, seconds);
+    testBufferedRate(2000000, seconds);
+    testBufferedRate(10000000, seconds);
+    return TEST_EXIT_CODE();
+}
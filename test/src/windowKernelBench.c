@@ -0,0 +1,70 @@
+// Window kernel bench
+// Samples/s for the scalar reference against the vector kernel over
+// light-sensor-like windows of a few sizes, with the sampler's default
+// thresholds. Build with -DCMAKE_BUILD_TYPE=Release for numbers worth
+// comparing.
+//
+// Usage: windowKernelBench [--quick]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "hal/windowKernel.h"
+
+#define MAX_CODE 4095
+
+typedef void (*accumulate_t)(WindowKernel_stats_t *pStats, const uint16_t *pSamples, int count,
+    const WindowKernel_thresholds_t *pThresholds);
+
+static const WindowKernel_thresholds_t THRESHOLDS = {
+    .enterLow = 1850,
+    .enterHigh = 2150,
+    .exitLow = 1961,
+    .exitHigh = 2039,
+};
+
+static double measure(accumulate_t accumulate, const uint16_t *pCodes, int windowSize, long long numSamples,
+    int *pDips)
+{
+    int numWindows = (int)(numSamples / windowSize);
+    long long start = Bench_getCpuNs();
+    for (int i = 0; i < numWindows; i++) {
+        WindowKernel_stats_t stats;
+        WindowKernel_reset(&stats);
+        accumulate(&stats, pCodes, windowSize, &THRESHOLDS);
+        *pDips += stats.dips;
+    }
+    long long elapsedNs = Bench_getCpuNs() - start;
+    return (double)numWindows * windowSize * 1e9 / (elapsedNs > 0 ? elapsedNs : 1);
+}
+
+int main(int argc, char *argv[]) {
+    static const int WINDOW_SIZES[] = {64, 1000, 10000, 50000};
+    const int maxWindowSize = 50000;
+    long long numSamples = Bench_isQuick(argc, argv) ? 200000 : 200000000;
+
+    // A noisy level with the odd shadow
+    uint16_t *pCodes = malloc(sizeof(uint16_t) * maxWindowSize);
+    unsigned int seed = 1;
+    for (int i = 0; i < maxWindowSize; i++) {
+        int code = 2000 + rand_r(&seed) % 41 - 20 - (i % 997 < 20 ? 800 : 0);
+        pCodes[i] = code < 0 ? 0 : (code > MAX_CODE ? MAX_CODE : code);
+    }
+
+    printf("%-8s %16s %16s %8s\n", "window", "scalar samples/s", "vector samples/s", "speedup");
+    int result = 0;
+    for (size_t i = 0; i < sizeof(WINDOW_SIZES) / sizeof(WINDOW_SIZES[0]); i++) {
+        int scalarDips = 0;
+        int vectorDips = 0;
+        double scalar = measure(WindowKernel_accumulateScalar, pCodes, WINDOW_SIZES[i], numSamples, &scalarDips);
+        double vector = measure(WindowKernel_accumulate, pCodes, WINDOW_SIZES[i], numSamples, &vectorDips);
+        printf("%-8d %16.3e %16.3e %7.1fx  (%s)\n", WINDOW_SIZES[i], scalar, vector, vector / scalar,
+            WindowKernel_getImplementation());
+        // Same work both ways
+        result |= scalarDips != vectorDips;
+    }
+    free(pCodes);
+    return result;
+}
@@ -0,0 +1,201 @@
+// Window kernel equivalence test
+// The vector kernel (WindowKernel_accumulate) must give exactly what the
+// scalar reference gives: min, max, sums, dip count and hysteresis state,
+// however a window is split across calls. Checked over random codes and
+// light-sensor-like traces (a drifting level with noise, shadows and
+// chatter around the thresholds), or over recorded trace files, for
+// thresholds like the sampler's and for edge cases, including an exit band
+// wider than the enter band.
+//
+// Built twice: against hal (the host's vector path) and, on hosts without
+// NEON, from hal/src/windowKernel.c with test/neon/arm_neon.h standing in
+// for the NEON intrinsics.
+//
+// Usage: windowKernelTest [trace file...]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hal/windowKernel.h"
+
+#define TRACE_SIZE 8000
+#define MAX_CODE 4095
+#define NUM_RANDOM_THRESHOLDS 40
+#define NUM_SPLITS 8
+#define TRACE_HEADER_BYTES 24
+#define TRACE_RECORD_HEADER_BYTES 6
+
+typedef struct {
+    const char *name;
+    WindowKernel_thresholds_t thresholds;
+} Case_t;
+
+// Thresholds around a level, as the sampler sets them (exit band inside)
+// and otherwise
+static const Case_t CASES[] = {
+    {"sampler-like", {.enterLow = 1850, .enterHigh = 2150, .exitLow = 1961, .exitHigh = 2039}},
+    {"equal bands", {.enterLow = 1900, .enterHigh = 2100, .exitLow = 1900, .exitHigh = 2100}},
+    {"exit wider", {.enterLow = 1950, .enterHigh = 2050, .exitLow = 1800, .exitHigh = 2200}},
+    {"exit disjoint", {.enterLow = 1000, .enterHigh = 3000, .exitLow = 3500, .exitHigh = 4095}},
+    {"never enter", {.enterLow = -1, .enterHigh = 4096, .exitLow = 0, .exitHigh = 4095}},
+    {"always enter", {.enterLow = 4096, .enterHigh = -1, .exitLow = 2000, .exitHigh = 2100}},
+    {"never exit", {.enterLow = 1900, .enterHigh = 2100, .exitLow = 0, .exitHigh = -1}},
+    {"always exit", {.enterLow = 1900, .enterHigh = 2100, .exitLow = -5, .exitHigh = 5000}},
+};
+
+static void makeRandomTrace(uint16_t *pCodes, int count, unsigned int *pSeed) {
+    for (int i = 0; i < count; i++) {
+        pCodes[i] = rand_r(pSeed) % (MAX_CODE + 1);
+    }
+}
+
+// A light level which drifts, with sensor noise, shadows passing over, and
+// stretches of chatter right at the thresholds
+static void makeRecordedStyleTrace(uint16_t *pCodes, int count, unsigned int *pSeed) {
+    int level = 2000;
+    int shadowLeft = 0;
+    int shadowDepth = 0;
+    int chatterLeft = 0;
+    for (int i = 0; i < count; i++) {
+        level += rand_r(pSeed) % 3 - 1;
+        level = level < 1500 ? 1500 : (level > 2500 ? 2500 : level);
+        if (shadowLeft == 0 && rand_r(pSeed) % 500 == 0) {
+            shadowLeft = rand_r(pSeed) % 200 + 1;
+            shadowDepth = rand_r(pSeed) % 1500;
+        }
+        if (chatterLeft == 0 && rand_r(pSeed) % 300 == 0) {
+            chatterLeft = rand_r(pSeed) % 100 + 1;
+        }
+
+        int code = level + rand_r(pSeed) % 21 - 10;
+        if (shadowLeft > 0) {
+            code -= shadowDepth;
+            shadowLeft--;
+        } else if (chatterLeft > 0) {
+            // Land on or either side of one of the thresholds below
+            static const int OFFSETS[] = {-150, -149, -151, -50, -39, -40, -38, 38, 39, 40, 50, 149, 150, 151};
+            code = level + OFFSETS[rand_r(pSeed) % (sizeof(OFFSETS) / sizeof(OFFSETS[0]))];
+            chatterLeft--;
+        }
+        pCodes[i] = code < 0 ? 0 : (code > MAX_CODE ? MAX_CODE : code);
+    }
+}
+
+// Samples of a recorded trace file (see hal/trace.h); returns the count
+static int readTraceFile(const char *path, uint16_t **ppCodes) {
+    FILE *pFile = fopen(path, "rb");
+    if (pFile == NULL) {
+        printf("ERROR: Unable to open trace %s\n", path);
+        exit(-1);
+    }
+    unsigned char header[TRACE_HEADER_BYTES];
+    if (fread(header, 1, sizeof(header), pFile) != sizeof(header) || memcmp(header, "LSTR", 4) != 0) {
+        printf("ERROR: %s is not a trace\n", path);
+        exit(-1);
+    }
+    int count = 0;
+    int capacity = 0;
+    *ppCodes = NULL;
+    unsigned char record[TRACE_RECORD_HEADER_BYTES];
+    while (fread(record, 1, sizeof(record), pFile) == sizeof(record)) {
+        int recordCount = record[4] | record[5] << 8;
+        if (count + recordCount > capacity) {
+            capacity = (count + recordCount) * 2;
+            *ppCodes = realloc(*ppCodes, sizeof(uint16_t) * capacity);
+        }
+        for (int i = 0; i < recordCount; i++) {
+            unsigned char code[2];
+            if (fread(code, 1, 2, pFile) != 2) {
+                break;
+            }
+            (*ppCodes)[count++] = code[0] | code[1] << 8;
+        }
+    }
+    fclose(pFile);
+    return count;
+}
+
+static bool isSameStats(const WindowKernel_stats_t *pA, const WindowKernel_stats_t *pB) {
+    return pA->count == pB->count && pA->minCode == pB->minCode && pA->maxCode == pB->maxCode
+        && pA->sum == pB->sum && pA->sumOfSquares == pB->sumOfSquares && pA->dips == pB->dips
+        && pA->isDipped == pB->isDipped;
+}
+
+static void printStats(const char *name, const WindowKernel_stats_t *pStats) {
+    fprintf(stderr, "  %-7s count %d min %d max %d sum %llu squares %llu dips %d dipped %d\n", name,
+        pStats->count, pStats->minCode, pStats->maxCode, pStats->sum, pStats->sumOfSquares,
+        pStats->dips, pStats->isDipped);
+}
+
+// Whole trace and NUM_SPLITS random splits of it against the reference
+static void checkTrace(const char *traceName, const uint16_t *pCodes, int count, const Case_t *pCase,
+    unsigned int *pSeed)
+{
+    WindowKernel_stats_t reference;
+    WindowKernel_reset(&reference);
+    WindowKernel_accumulateScalar(&reference, pCodes, count, &pCase->thresholds);
+
+    for (int split = 0; split <= NUM_SPLITS; split++) {
+        WindowKernel_stats_t stats;
+        WindowKernel_reset(&stats);
+        int maxChunk = split == 0 ? count : rand_r(pSeed) % 500 + 1;
+        for (int i = 0; i < count;) {
+            int chunk = split == 0 ? count : rand_r(pSeed) % maxChunk + 1;
+            chunk = chunk > count - i ? count - i : chunk;
+            WindowKernel_accumulate(&stats, pCodes + i, chunk, &pCase->thresholds);
+            i += chunk;
+        }
+        if (!isSameStats(&stats, &reference)) {
+            fprintf(stderr, "%s, %s thresholds {%d, %d, %d, %d}, split %d:\n", traceName, pCase->name,
+                pCase->thresholds.enterLow, pCase->thresholds.enterHigh, pCase->thresholds.exitLow,
+                pCase->thresholds.exitHigh, split);
+            printStats("scalar", &reference);
+            printStats(WindowKernel_getImplementation(), &stats);
+            TEST_CHECK(isSameStats(&stats, &reference));
+            return;
+        }
+    }
+}
+
+static void checkAllThresholds(const char *traceName, const uint16_t *pCodes, int count, unsigned int *pSeed) {
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++) {
+        checkTrace(traceName, pCodes, count, &CASES[i], pSeed);
+    }
+    for (int i = 0; i < NUM_RANDOM_THRESHOLDS; i++) {
+        Case_t randomCase = {"random", {
+            .enterLow = rand_r(pSeed) % 4200 - 50,
+            .enterHigh = rand_r(pSeed) % 4200 - 50,
+            .exitLow = rand_r(pSeed) % 4200 - 50,
+            .exitHigh = rand_r(pSeed) % 4200 - 50,
+        }};
+        checkTrace(traceName, pCodes, count, &randomCase, pSeed);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    printf("Checking the %s kernel against scalar\n", WindowKernel_getImplementation());
+#ifdef TEST_EXPECTED_IMPLEMENTATION
+    TEST_CHECK(strcmp(WindowKernel_getImplementation(), TEST_EXPECTED_IMPLEMENTATION) == 0);
+#endif
+
+    unsigned int seed = 1;
+    static uint16_t codes[TRACE_SIZE];
+    for (int i = 0; i < 3; i++) {
+        makeRandomTrace(codes, TRACE_SIZE, &seed);
+        checkAllThresholds("random", codes, TRACE_SIZE, &seed);
+        makeRecordedStyleTrace(codes, TRACE_SIZE, &seed);
+        checkAllThresholds("recorded-style", codes, TRACE_SIZE, &seed);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        uint16_t *pCodes;
+        int count = readTraceFile(argv[i], &pCodes);
+        printf("%s: %d samples\n", argv[i], count);
+        checkAllThresholds(argv[i], pCodes, count, &seed);
+        free(pCodes);
+    }
+    return TEST_EXIT_CODE();
+}